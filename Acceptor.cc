@@ -5,12 +5,14 @@
 
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/stat.h>
 #include <unistd.h>
+#include <fcntl.h>
 #include <errno.h>
 
-static int createNonblocking()
+static int createNonblocking(int family)
 {
-    int sockfd = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    int sockfd = ::socket(family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
     if(sockfd < 0)
         LOG_FATAL("%s:%S:%d listen socket create err: %d \n", __FILE__, __FUNCTION__, __LINE__, errno);
     return sockfd;
@@ -18,21 +20,63 @@ static int createNonblocking()
 
 Acceptor::Acceptor(EventLoop *loop, const InetAddress &listenAddr, bool reuseport)
     : loop_(loop)
-    , acceptSocket_(createNonblocking())
+    , acceptSocket_(createNonblocking(listenAddr.family()))
     , acceptChannel_(loop, acceptSocket_.fd())
     , listenning_(false)
 {
-    acceptSocket_.setReuseAddr(true);
-    acceptSocket_.setReusePort(true);
+    if(listenAddr.isUnix())
+    {
+        // 路径形式的Unix域socket在文件系统中留有socket文件，上次运行遗留的文件会导致bind失败
+        std::string path = listenAddr.toIp();
+        if(!path.empty() && path[0] != '@')
+        {
+            // 只删除socket文件，路径写错时不能误删普通文件，此时让bind报错
+            struct stat st;
+            if(::lstat(path.c_str(), &st) == 0 && !S_ISSOCK(st.st_mode))
+                LOG_ERROR("Acceptor: %s exists and is not a socket, not removing it\n", path.c_str());
+            else
+            {
+                ::unlink(path.c_str());
+                unixPath_ = path;
+            }
+        }
+    }
+    else
+    {
+        acceptSocket_.setReuseAddr(true);
+        acceptSocket_.setReusePort(true);
+    }
     acceptSocket_.bindAddress(listenAddr);  //bind
     // TcpServer::start() Acceptor.listen 新用户连接，执行回调 connfd=>channel=>subloop
     acceptChannel_.setReadCallback(std::bind(&Acceptor::handleRead, this));
 }
 
+Acceptor::Acceptor(EventLoop *loop, int listenFd)
+    : loop_(loop)
+    , acceptSocket_(listenFd)
+    , acceptChannel_(loop, listenFd)
+    , listenning_(false)
+{
+    // 通过SCM_RIGHTS收到的fd和原fd共享文件状态，非阻塞标志保持不变，这里再确认一次
+    int flags = ::fcntl(listenFd, F_GETFL, 0);
+    if(flags >= 0 && !(flags & O_NONBLOCK))
+        ::fcntl(listenFd, F_SETFL, flags | O_NONBLOCK);
+    InetAddress localAddr = InetAddress::getLocalAddr(listenFd);
+    if(localAddr.isUnix())
+    {
+        std::string path = localAddr.toIp();
+        if(!path.empty() && path[0] != '@')
+            unixPath_ = path;
+    }
+    acceptChannel_.setReadCallback(std::bind(&Acceptor::handleRead, this));
+}
+
 Acceptor::~Acceptor()
 {
     acceptChannel_.disableAll(); 
     acceptChannel_.remove();
+    if(!unixPath_.empty())
+        ::unlink(unixPath_.c_str());
 }
 
 void Acceptor::listen()
@@ -42,13 +86,35 @@ void Acceptor::listen()
     acceptChannel_.enableReading(); // acceptChannel_ => Poller
 }
 
+// 只是不再监听读事件，已经完成握手的连接留在backlog中，监听socket关闭时由内核重置
+void Acceptor::stopListening()
+{
+    if(listenning_)
+    {
+        listenning_ = false;
+        acceptChannel_.disableAll();
+    }
+}
+
+void Acceptor::resumeListening()
+{
+    if(!listenning_)
+    {
+        listenning_ = true;
+        acceptChannel_.enableReading();
+    }
+}
+
 // listenfd有事件发生，即有新用户连接
 void Acceptor::handleRead()
 {
     InetAddress peerAddr;
+    LoopTrace::Span span(loop_->trace(), LoopTrace::kAccept);
     int connfd = acceptSocket_.accept(&peerAddr);
+    span.setFd(connfd);
     if(connfd >= 0)
     {
+        loop_->metrics().accepts.add();
         if(newConnectionCallback_)
             newConnectionCallback_(connfd, peerAddr);  // 轮询找到subLoop，唤醒，分发新客户
         else
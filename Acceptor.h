@@ -5,6 +5,7 @@
 #include "Channel.h"
 
 #include <functional>
+#include <string>
 
 class InetAddress;
 class EventLoop;
@@ -14,14 +15,25 @@ class Acceptor : noncopyable
 public:
     using NewConnectionCallback = std::function<void(int sockfd, const InetAddress&)>;
     Acceptor(EventLoop *loop, const InetAddress &listenAddr, bool reuseport);
+    // 接管一个已经bind并listen的socket(比如热重启时从旧进程收到的fd)，不再创建和绑定
+    Acceptor(EventLoop *loop, int listenFd);
     ~Acceptor();
 
     void setNewConnectionCallback(const NewConnectionCallback &cb)
     {newConnectionCallback_ = cb;}
     bool listening() const
     {return listenning_;}
+    int fd() const
+    {return acceptSocket_.fd();}
+    // 监听socket已经交给别的进程，析构时不再删除Unix域socket文件
+    void releaseUnixPath()
+    {unixPath_.clear();}
     
     void listen();
+    // 停止接受新连接，监听socket保持打开，直到Acceptor析构
+    void stopListening();
+    // stopListening()之后恢复accept，期间到达的连接一直在backlog中
+    void resumeListening();
 private:
     void handleRead();
 
@@ -30,4 +42,5 @@ private:
     Channel acceptChannel_;
     NewConnectionCallback newConnectionCallback_;
     bool listenning_;
+    std::string unixPath_; // 需要在析构时删除的socket文件
 };
\ No newline at end of file
@@ -0,0 +1,198 @@
+#include "AdmissionControl.h"
+#include "InetAddress.h"
+
+#include <endian.h>
+#include <stdio.h>
+#include <string.h>
+#include <netinet/in.h>
+
+namespace
+{
+// splitmix64的末尾混合，地址的高位和低位都参与到下标里
+inline uint64_t mix(uint64_t x)
+{
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return x;
+}
+
+const size_t kInitialEntries = 64;
+}
+
+bool IpCounterTable::keyOf(const InetAddress &addr, Key *key)
+{
+    if(addr.family() == AF_INET)
+    {
+        const sockaddr_in *in = reinterpret_cast<const sockaddr_in*>(addr.getSockAddr());
+        key->hi = 0;
+        key->lo = (0xffffULL << 32) | ntohl(in->sin_addr.s_addr);
+        return true;
+    }
+    if(addr.family() == AF_INET6)
+    {
+        const sockaddr_in6 *in6 = reinterpret_cast<const sockaddr_in6*>(addr.getSockAddr());
+        // 按网络字节序取成整数，和上面IPv4的写法一致，::ffff:a.b.c.d与a.b.c.d得到同一个key
+        uint64_t hi, lo;
+        memcpy(&hi, in6->sin6_addr.s6_addr, 8);
+        memcpy(&lo, in6->sin6_addr.s6_addr + 8, 8);
+        key->hi = be64toh(hi);
+        key->lo = be64toh(lo);
+        return true;
+    }
+    return false;
+}
+
+IpCounterTable::IpCounterTable()
+    : entries_(kInitialEntries)
+    , size_(0)
+{
+}
+
+size_t IpCounterTable::indexOf(const Key &key) const
+{
+    return mix(key.hi * 31 + key.lo) & (entries_.size() - 1);
+}
+
+uint32_t IpCounterTable::count(const Key &key) const
+{
+    const size_t mask = entries_.size() - 1;
+    for(size_t i = indexOf(key); entries_[i].count != 0; i = (i + 1) & mask)
+    {
+        if(entries_[i].key == key)
+            return entries_[i].count;
+    }
+    return 0;
+}
+
+uint32_t IpCounterTable::increment(const Key &key)
+{
+    if((size_ + 1) * 2 > entries_.size())
+        grow();
+    const size_t mask = entries_.size() - 1;
+    size_t i = indexOf(key);
+    for(; entries_[i].count != 0; i = (i + 1) & mask)
+    {
+        if(entries_[i].key == key)
+            return ++entries_[i].count;
+    }
+    entries_[i].key = key;
+    entries_[i].count = 1;
+    ++size_;
+    return 1;
+}
+
+void IpCounterTable::decrement(const Key &key)
+{
+    const size_t mask = entries_.size() - 1;
+    size_t i = indexOf(key);
+    for(; entries_[i].count != 0; i = (i + 1) & mask)
+    {
+        if(entries_[i].key == key)
+            break;
+    }
+    if(entries_[i].count == 0 || --entries_[i].count != 0)
+        return;
+
+    // 删除：把探测链上后面的项挪到空位，直到遇到空位；某一项的理想位置落在(空位, 该项]之间时不能挪
+    --size_;
+    size_t hole = i;
+    for(size_t j = (i + 1) & mask; entries_[j].count != 0; j = (j + 1) & mask)
+    {
+        size_t home = indexOf(entries_[j].key);
+        bool movable = hole <= j ? (home <= hole || home > j) : (home <= hole && home > j);
+        if(movable)
+        {
+            entries_[hole] = entries_[j];
+            hole = j;
+        }
+    }
+    entries_[hole].count = 0;
+}
+
+void IpCounterTable::grow()
+{
+    std::vector<Entry> old(entries_.size() * 2);
+    old.swap(entries_);
+    size_ = 0;
+    const size_t mask = entries_.size() - 1;
+    for(const Entry &entry : old)
+    {
+        if(entry.count == 0)
+            continue;
+        size_t i = indexOf(entry.key);
+        while(entries_[i].count != 0)
+            i = (i + 1) & mask;
+        entries_[i] = entry;
+        ++size_;
+    }
+}
+
+std::string AdmissionControl::Stats::toString() const
+{
+    char buf[256];
+    snprintf(buf, sizeof buf,
+        "admitted=%lu rejected_server=%lu rejected_loop=%lu rejected_ip=%lu shed=%lu accept_pauses=%lu connections=%zu ips=%zu",
+        static_cast<unsigned long>(admitted), static_cast<unsigned long>(rejectedServerLimit),
+        static_cast<unsigned long>(rejectedLoopLimit), static_cast<unsigned long>(rejectedIpLimit),
+        static_cast<unsigned long>(shed), static_cast<unsigned long>(acceptPauses), connections, trackedIps);
+    return buf;
+}
+
+AdmissionControl::AdmissionControl(const Policy &policy)
+    : policy_(policy)
+    , connections_(0)
+    , admitted_(0)
+    , rejectedServerLimit_(0)
+    , rejectedLoopLimit_(0)
+    , rejectedIpLimit_(0)
+    , shed_(0)
+    , acceptPauses_(0)
+{
+}
+
+AdmissionControl::Verdict AdmissionControl::acquire(const InetAddress &peer)
+{
+    // 只有baseLoop会增加计数，这里读到的值只会偏大(关闭还没归还)，不会超过上限
+    if(policy_.maxConnections > 0 && connections_.load(std::memory_order_relaxed) >= policy_.maxConnections)
+        return kServerLimit;
+
+    IpCounterTable::Key key;
+    if(policy_.maxConnectionsPerIp > 0 && IpCounterTable::keyOf(peer, &key))
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if(ipTable_.count(key) >= policy_.maxConnectionsPerIp)
+            return kIpLimit;
+        ipTable_.increment(key);
+    }
+    connections_.fetch_add(1, std::memory_order_relaxed);
+    return kAdmitted;
+}
+
+void AdmissionControl::release(const InetAddress &peer)
+{
+    IpCounterTable::Key key;
+    if(policy_.maxConnectionsPerIp > 0 && IpCounterTable::keyOf(peer, &key))
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        ipTable_.decrement(key);
+    }
+    connections_.fetch_sub(1, std::memory_order_relaxed);
+}
+
+AdmissionControl::Stats AdmissionControl::stats() const
+{
+    Stats s;
+    s.admitted = admitted_.load(std::memory_order_relaxed);
+    s.rejectedServerLimit = rejectedServerLimit_.load(std::memory_order_relaxed);
+    s.rejectedLoopLimit = rejectedLoopLimit_.load(std::memory_order_relaxed);
+    s.rejectedIpLimit = rejectedIpLimit_.load(std::memory_order_relaxed);
+    s.shed = shed_.load(std::memory_order_relaxed);
+    s.acceptPauses = acceptPauses_.load(std::memory_order_relaxed);
+    s.connections = connections_.load(std::memory_order_relaxed);
+    std::lock_guard<std::mutex> lock(mutex_);
+    s.trackedIps = ipTable_.size();
+    return s;
+}
@@ -0,0 +1,134 @@
+#pragma once
+
+#include "noncopyable.h"
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+class InetAddress;
+
+/**
+ * 按来源IP计数的开放寻址哈希表，key是16字节地址(IPv4按::ffff:a.b.c.d映射)
+ * 线性探测，删除时把后面的项往前挪填补空位，不需要墓碑；装载因子超过1/2时翻倍
+ * 每项24字节，10万个来源IP占用约6MB，查找通常只访问一个cache line
+ */
+class IpCounterTable : noncopyable
+{
+public:
+    struct Key
+    {
+        uint64_t hi;
+        uint64_t lo;
+        bool operator==(const Key &rhs) const {return hi == rhs.hi && lo == rhs.lo;}
+    };
+    // Unix域地址没有来源IP，返回false
+    static bool keyOf(const InetAddress &addr, Key *key);
+
+    IpCounterTable();
+
+    uint32_t count(const Key &key) const;
+    // 返回加一以后的计数
+    uint32_t increment(const Key &key);
+    void decrement(const Key &key);
+    size_t size() const {return size_;}
+
+private:
+    struct Entry
+    {
+        Key key;
+        uint32_t count;     // 0表示空位
+    };
+
+    size_t indexOf(const Key &key) const;
+    void grow();
+
+    std::vector<Entry> entries_;
+    size_t size_;
+};
+
+/**
+ * TcpServer的准入控制，在baseLoop accept以后、分发连接之前判断：
+ * - 整个服务器的连接数上限、每个来源IP的连接数上限，超过时拒绝
+ * - 每个loop的连接数上限，以及loop过载(事件循环延迟或pendingFunctor队列过长)，分发时跳过这些loop，全部不可用时拒绝
+ * 拒绝的方式见RejectAction：正常关闭、RST关闭，或者关闭后暂停accept一段时间，让新连接留在内核的backlog里
+ *
+ * 计数在连接关闭时于所属subLoop中归还，所以计数器是原子的，IP表带锁(只有accept和close会碰到)
+ * TcpServer和各个连接分片共同持有，服务器析构后还没关闭的连接仍然可以安全归还
+ */
+class AdmissionControl : noncopyable
+{
+public:
+    enum RejectAction
+    {
+        kClose,         // accept后立即close，客户端读到EOF
+        kReset,         // SO_LINGER(0)后close，客户端收到RST，服务端不留TIME_WAIT
+        kPauseAccept,   // close，并停止accept pauseSeconds，期间新连接在backlog中排队(每IP上限超过时只close)
+    };
+
+    struct Policy
+    {
+        size_t maxConnections = 0;          // 0表示不限，下同
+        size_t maxConnectionsPerLoop = 0;
+        size_t maxConnectionsPerIp = 0;
+        double maxLoopLagSeconds = 0;       // 投递到loop的探测任务等待执行的时间超过它就算过载
+        size_t maxPendingFunctors = 0;      // loop最近一次doPendingFunctors取出的任务数超过它就算过载
+        double lagProbeSeconds = 0.01;      // 探测间隔
+        RejectAction action = kClose;
+        double pauseSeconds = 0.01;         // kPauseAccept时每次暂停的时间
+
+        bool detectsOverload() const {return maxLoopLagSeconds > 0 || maxPendingFunctors > 0;}
+    };
+
+    // 累计值
+    struct Stats
+    {
+        uint64_t admitted = 0;
+        uint64_t rejectedServerLimit = 0;
+        uint64_t rejectedLoopLimit = 0;
+        uint64_t rejectedIpLimit = 0;
+        uint64_t shed = 0;              // 因为所有loop都过载而拒绝
+        uint64_t acceptPauses = 0;
+        size_t connections = 0;         // 当前连接数(包括还在投递途中的)
+        size_t trackedIps = 0;          // IP表中的来源IP数
+        std::string toString() const;
+    };
+
+    enum Verdict {kAdmitted, kServerLimit, kIpLimit};
+
+    explicit AdmissionControl(const Policy &policy);
+
+    const Policy& policy() const {return policy_;}
+
+    // baseLoop中调用，检查服务器和来源IP的上限，通过时占用计数，之后必须release()
+    Verdict acquire(const InetAddress &peer);
+    // 任意线程调用
+    void release(const InetAddress &peer);
+
+    void countAdmitted() {bump(admitted_);}
+    void countRejected(Verdict verdict) {bump(verdict == kServerLimit ? rejectedServerLimit_ : rejectedIpLimit_);}
+    void countLoopLimit() {bump(rejectedLoopLimit_);}
+    void countShed() {bump(shed_);}
+    void countPause() {bump(acceptPauses_);}
+
+    Stats stats() const;
+
+private:
+    // 统计计数只在baseLoop中修改
+    static void bump(std::atomic<uint64_t> &counter)
+    {counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);}
+
+    const Policy policy_;
+    std::atomic<size_t> connections_;
+    mutable std::mutex mutex_;
+    IpCounterTable ipTable_;
+
+    std::atomic<uint64_t> admitted_;
+    std::atomic<uint64_t> rejectedServerLimit_;
+    std::atomic<uint64_t> rejectedLoopLimit_;
+    std::atomic<uint64_t> rejectedIpLimit_;
+    std::atomic<uint64_t> shed_;
+    std::atomic<uint64_t> acceptPauses_;
+};
@@ -0,0 +1,87 @@
+#include "BlockPool.h"
+#include "CurrentThread.h"
+#include "Logger.h"
+
+#include <algorithm>
+#include <stdlib.h>
+
+BlockPool::BlockPool()
+    : blockSize_(0)
+    , stride_(0)
+    , ownerTid_(0)
+    , localFree_(nullptr)
+    , remoteFree_(nullptr)
+    , allocated_(0)
+    , freedLocal_(0)
+    , freedRemote_(0)
+{
+}
+
+BlockPool::~BlockPool()
+{
+    for(void *chunk : chunks_)
+        ::free(chunk);
+}
+
+void* BlockPool::allocate(size_t bytes)
+{
+    if(blockSize_ == 0)
+    {
+        blockSize_ = bytes;
+        stride_ = (std::max(bytes, sizeof(FreeBlock)) + kAlignment - 1) / kAlignment * kAlignment;
+        ownerTid_ = CurrentThread::tid();
+    }
+    if(bytes != blockSize_)
+        return nullptr;
+    if(ownerTid_ != CurrentThread::tid())
+        LOG_FATAL("BlockPool::allocate called from thread %d, owner is %d\n", CurrentThread::tid(), ownerTid_);
+
+    if(localFree_ == nullptr)
+    {
+        // 本地链表空了，把其他线程归还的块整批取回；整条链一次exchange，不存在ABA问题
+        localFree_ = remoteFree_.exchange(nullptr, std::memory_order_acquire);
+        if(localFree_ == nullptr)
+            grow();
+    }
+    FreeBlock *block = localFree_;
+    localFree_ = block->next;
+    allocated_.store(allocated_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    return block;
+}
+
+void BlockPool::deallocate(void *p)
+{
+    FreeBlock *block = static_cast<FreeBlock*>(p);
+    if(CurrentThread::tid() == ownerTid_)
+    {
+        block->next = localFree_;
+        localFree_ = block;
+        freedLocal_.store(freedLocal_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+    else
+    {
+        FreeBlock *head = remoteFree_.load(std::memory_order_relaxed);
+        do
+        {
+            block->next = head;
+        } while(!remoteFree_.compare_exchange_weak(head, block, std::memory_order_release, std::memory_order_relaxed));
+        freedRemote_.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void BlockPool::grow()
+{
+    void *chunk = nullptr;
+    if(::posix_memalign(&chunk, kAlignment, stride_ * kBlocksPerChunk) != 0)
+        LOG_FATAL("BlockPool::grow out of memory\n");
+    chunks_.push_back(chunk);
+
+    // 按地址顺序串成链表，先分配的块地址连续
+    char *base = static_cast<char*>(chunk);
+    for(size_t i = kBlocksPerChunk; i > 0; --i)
+    {
+        FreeBlock *block = reinterpret_cast<FreeBlock*>(base + (i - 1) * stride_);
+        block->next = localFree_;
+        localFree_ = block;
+    }
+}
@@ -0,0 +1,100 @@
+#pragma once
+
+#include "noncopyable.h"
+
+#include <atomic>
+#include <memory>
+#include <new>
+#include <vector>
+#include <stddef.h>
+#include <sys/types.h>
+
+/**
+ * 定长内存块池，每个loop一个，用来回收连接对象：TcpServer用allocate_shared把shared_ptr的控制块和TcpConnection
+ * (连同直接内嵌的Socket和Channel)放进同一块内存，连接关闭后整块还给池子，短连接反复建立不再走全局分配器
+ *
+ * 块按64字节对齐，每次向系统申请kBlocksPerChunk块连续内存，池子析构时才归还
+ * allocate()只能在所有者线程(第一次allocate的线程，即所属loop)中调用
+ * deallocate()可以在任意线程调用：所有者线程直接放回本地空闲链表，其他线程压入无锁栈，所有者在本地链表用完时整批取回
+ */
+class BlockPool : noncopyable
+{
+public:
+    static const size_t kBlocksPerChunk = 64;
+    static const size_t kAlignment = 64;
+
+    BlockPool();
+    ~BlockPool();
+
+    // 第一次分配时确定块大小，之后只接受同样大小的请求，其他大小返回nullptr由调用方自己分配
+    void* allocate(size_t bytes);
+    void deallocate(void *p);
+    bool fits(size_t bytes) const {return blockSize_ == 0 || bytes == blockSize_;}
+
+    // 统计信息，近似值
+    size_t chunks() const {return chunks_.size();}
+    size_t blocksInUse() const
+    {
+        return allocated_.load(std::memory_order_relaxed) - freedLocal_.load(std::memory_order_relaxed)
+            - freedRemote_.load(std::memory_order_relaxed);
+    }
+
+private:
+    struct FreeBlock
+    {
+        FreeBlock *next;
+    };
+
+    void grow();
+
+    size_t blockSize_;      // 请求的大小
+    size_t stride_;         // 按kAlignment取整后块与块的间距
+    pid_t ownerTid_;
+    FreeBlock *localFree_;                  // 只有所有者线程访问
+    std::atomic<FreeBlock*> remoteFree_;    // 其他线程归还的块
+    // 所有者线程路径上只有单写者计数(普通load+store)，只有跨线程归还才用fetch_add
+    std::atomic<size_t> allocated_;
+    std::atomic<size_t> freedLocal_;
+    std::atomic<size_t> freedRemote_;
+    std::vector<void*> chunks_;
+};
+
+/**
+ * 把BlockPool包装成标准分配器，配合std::allocate_shared使用
+ * 分配器的拷贝保存在shared_ptr的控制块里，持有池子的引用，所以最后一个连接释放之前池子不会析构
+ * 大小与池子的块大小不符的请求(比如rebind成别的类型)退回operator new
+ */
+template <typename T>
+class PoolAllocator
+{
+public:
+    using value_type = T;
+
+    explicit PoolAllocator(const std::shared_ptr<BlockPool> &pool) : pool_(pool) {}
+    template <typename U>
+    PoolAllocator(const PoolAllocator<U> &rhs) : pool_(rhs.pool()) {}
+
+    T* allocate(size_t n)
+    {
+        size_t bytes = n * sizeof(T);
+        void *p = pool_->fits(bytes) ? pool_->allocate(bytes) : nullptr;
+        return static_cast<T*>(p ? p : ::operator new(bytes));
+    }
+    void deallocate(T *p, size_t n)
+    {
+        if(pool_->fits(n * sizeof(T)))
+            pool_->deallocate(p);
+        else
+            ::operator delete(p);
+    }
+
+    const std::shared_ptr<BlockPool>& pool() const {return pool_;}
+
+    template <typename U>
+    bool operator==(const PoolAllocator<U> &rhs) const {return pool_ == rhs.pool();}
+    template <typename U>
+    bool operator!=(const PoolAllocator<U> &rhs) const {return pool_ != rhs.pool();}
+
+private:
+    std::shared_ptr<BlockPool> pool_;
+};
@@ -1,9 +1,12 @@
 #include "Buffer.h"
 
+#include <algorithm>
 #include <sys/uio.h>
 #include <unistd.h>
 #include <errno.h>
 
+const char Buffer::kCRLF[] = "\r\n";
+
 // 从fd上读取数据
 ssize_t Buffer::readFd(int fd, int *saveErrno)
 {
@@ -20,10 +23,10 @@ ssize_t Buffer::readFd(int fd, int *saveErrno)
 
     // 保证writable的空间稳定大于64K
     const int iovcnt = (writable < sizeof extrabuf) ? 2 : 1;
-    const size_t n = ::readv(fd, vec, iovcnt);
+    const ssize_t n = ::readv(fd, vec, iovcnt);
     if(n < 0)
         *saveErrno = errno;
-    else if(n <= writable)
+    else if(static_cast<size_t>(n) <= writable)
         writerIndex_ += n;
     else
     {
@@ -34,9 +37,9 @@ ssize_t Buffer::readFd(int fd, int *saveErrno)
 }
 
 // 通过fd发送数据
-ssize_t Buffer::writeFd(int fd, int *saveErrno)
+ssize_t Buffer::writeFd(int fd, int *saveErrno, size_t maxBytes)
 {
-    ssize_t n = ::write(fd, peek(), readableBytes());
+    ssize_t n = ::write(fd, peek(), std::min(readableBytes(), maxBytes));
     if(n < 0)
         *saveErrno = errno;
     return n;
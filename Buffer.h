@@ -3,7 +3,19 @@
 #include <vector>
 #include <string>
 #include <algorithm>
-
+#include <stdint.h>
+#include <string.h>
+#include <endian.h>
+
+/**
+ * +-------------------+------------------+------------------+
+ * | prependable bytes |  readable bytes  |  writable bytes  |
+ * |                   |     (CONTENT)    |                  |
+ * +-------------------+------------------+------------------+
+ * 0      <=      readerIndex   <=   writerIndex    <=     size
+ * prependable区域至少保留kCheapPrepend字节，用来在消息前面填长度头而不用搬移数据
+ * 整数的读写都按网络字节序(大端)
+ */
 class Buffer
 {
 public:
@@ -29,6 +41,20 @@ public:
     const char* peek() const
     {return begin() + readerIndex_;}
 
+    // 可读数据的可写视图，供解析器原地整理数据(比如去掉chunked编码的分块头)
+    char* beginRead()
+    {return begin() + readerIndex_;}
+
+    // 在可读数据中查找\r\n，没有找到返回nullptr
+    const char* findCRLF() const
+    {return findCRLF(peek());}
+
+    const char* findCRLF(const char* start) const
+    {
+        const char* crlf = std::search(start, beginWrite(), kCRLF, kCRLF + 2);
+        return crlf == beginWrite() ? nullptr : crlf;
+    }
+
     void retrieve(size_t len)
     {
         if(len < readableBytes())
@@ -63,16 +89,113 @@ public:
         writerIndex_ += len;
     }
 
+    void append(const std::string &str)
+    {append(str.data(), str.size());}
+
+    void appendInt64(int64_t x)
+    {
+        int64_t be64 = htobe64(x);
+        append(reinterpret_cast<const char*>(&be64), sizeof be64);
+    }
+    void appendInt32(int32_t x)
+    {
+        int32_t be32 = htobe32(x);
+        append(reinterpret_cast<const char*>(&be32), sizeof be32);
+    }
+    void appendInt16(int16_t x)
+    {
+        int16_t be16 = htobe16(x);
+        append(reinterpret_cast<const char*>(&be16), sizeof be16);
+    }
+    void appendInt8(int8_t x)
+    {append(reinterpret_cast<const char*>(&x), sizeof x);}
+
+    // 调用者保证readableBytes()足够
+    int64_t peekInt64() const
+    {
+        int64_t be64 = 0;
+        ::memcpy(&be64, peek(), sizeof be64);
+        return be64toh(be64);
+    }
+    int32_t peekInt32() const
+    {
+        int32_t be32 = 0;
+        ::memcpy(&be32, peek(), sizeof be32);
+        return be32toh(be32);
+    }
+    int16_t peekInt16() const
+    {
+        int16_t be16 = 0;
+        ::memcpy(&be16, peek(), sizeof be16);
+        return be16toh(be16);
+    }
+    int8_t peekInt8() const
+    {return *peek();}
+
+    int64_t readInt64()
+    {
+        int64_t result = peekInt64();
+        retrieve(sizeof result);
+        return result;
+    }
+    int32_t readInt32()
+    {
+        int32_t result = peekInt32();
+        retrieve(sizeof result);
+        return result;
+    }
+    int16_t readInt16()
+    {
+        int16_t result = peekInt16();
+        retrieve(sizeof result);
+        return result;
+    }
+    int8_t readInt8()
+    {
+        int8_t result = peekInt8();
+        retrieve(sizeof result);
+        return result;
+    }
+
+    // 把数据放到可读数据前面，调用者保证len <= prependableBytes()
+    void prepend(const void* data, size_t len)
+    {
+        readerIndex_ -= len;
+        const char* d = static_cast<const char*>(data);
+        std::copy(d, d + len, begin() + readerIndex_);
+    }
+    void prependInt64(int64_t x)
+    {
+        int64_t be64 = htobe64(x);
+        prepend(&be64, sizeof be64);
+    }
+    void prependInt32(int32_t x)
+    {
+        int32_t be32 = htobe32(x);
+        prepend(&be32, sizeof be32);
+    }
+    void prependInt16(int16_t x)
+    {
+        int16_t be16 = htobe16(x);
+        prepend(&be16, sizeof be16);
+    }
+    void prependInt8(int8_t x)
+    {prepend(&x, sizeof x);}
+
     char* beginWrite()
     {return begin() + writerIndex_;}
 
+    // 直接写入beginWrite()以后，移动writerIndex_
+    void hasWritten(size_t len)
+    {writerIndex_ += len;}
+
     const char* beginWrite() const
     {return begin() + writerIndex_;}
 
     // 从fd上读取数据
     ssize_t readFd(int fd, int* saveErrno);
-    // 通过fd发送数据
-    ssize_t writeFd(int fd, int* saveErrno);
+    // 通过fd发送数据，一次最多发送maxBytes字节
+    ssize_t writeFd(int fd, int* saveErrno, size_t maxBytes = static_cast<size_t>(-1));
 
 private:
     char* begin()
@@ -101,4 +224,6 @@ private:
     size_t readerIndex_;
     size_t writerIndex_;
 
+    static const char kCRLF[];
+
 };
\ No newline at end of file
@@ -2,12 +2,15 @@
 
 #include <memory>
 #include <functional>
+#include <string>
 
 class TcpConnection;
 class Buffer;
 class Timestamp;
 
 using TcpConnectionPtr = std::shared_ptr<TcpConnection>;
+// 不可变的共享数据，同一份内容发给多个连接时各连接只持有引用
+using SharedPayload = std::shared_ptr<const std::string>;
 using ConnectionCallback = std::function<void(const TcpConnectionPtr&)>;
 using CloseCallback = std::function<void(const TcpConnectionPtr&)>;
 using WriteCompleteCallback = std::function<void(const TcpConnectionPtr&)>;
@@ -51,7 +51,8 @@ public:
 
     int fd() const { return fd_; }                 // 查看fd
     int events() const { return events_; }         // 查看fd感兴趣的事件
-    int set_revents(int revt) { revents_ = revt; } // poller监听到事件后写入channel
+    int revents() const { return revents_; }       // 查看poller返回的事件
+    void set_revents(int revt) { revents_ = revt; } // poller监听到事件后写入channel
 
     // 设置fd所感兴趣的事件 update()=epoll_ctl() 位使能操作
     void enableReading()
@@ -0,0 +1,260 @@
+#include "ComputePool.h"
+#include "EventLoop.h"
+#include "Logger.h"
+
+#include <new>
+#include <stdio.h>
+#include <stdlib.h>
+
+namespace
+{
+// 当前线程所属的ComputePool和worker下标，worker里再提交的任务放进自己的队列
+__thread const ComputePool *t_pool = nullptr;
+__thread size_t t_workerIndex = 0;
+}
+
+std::string ComputePool::Stats::toString() const
+{
+    char buf[256];
+    snprintf(buf, sizeof buf, "executed=%lu stolen=%lu rejected=%lu completions=%lu wakeups=%lu",
+        static_cast<unsigned long>(executed), static_cast<unsigned long>(stolen),
+        static_cast<unsigned long>(rejected), static_cast<unsigned long>(completions),
+        static_cast<unsigned long>(wakeups));
+    return buf;
+}
+
+ComputePool::ComputePool(const std::string &name)
+    : name_(name)
+    , maxQueueSize_(0)
+    , running_(false)
+    , pending_(0)
+    , nextWorker_(0)
+    , rejected_(0)
+    , completions_(0)
+    , wakeups_(0)
+    , idle_(0)
+    , completionsMap_(std::make_shared<CompletionsMap>())
+{
+}
+
+ComputePool::~ComputePool()
+{
+    if(running_)
+        stop();
+}
+
+void* ComputePool::Worker::operator new(size_t size)
+{
+    void *p = nullptr;
+    if(::posix_memalign(&p, alignof(Worker), size) != 0)
+        throw std::bad_alloc();
+    return p;
+}
+
+void ComputePool::Worker::operator delete(void *p) noexcept
+{
+    ::free(p);
+}
+
+void ComputePool::start(int numThreads)
+{
+    if(numThreads <= 0)
+        LOG_FATAL("ComputePool::start %s needs at least one thread\n", name_.c_str());
+    running_ = true;
+    workers_.reserve(numThreads);
+    for(int i = 0; i < numThreads; ++i)
+        workers_.emplace_back(new Worker);
+    // 所有队列建好以后再启动线程，worker偷任务时会访问其他worker
+    for(int i = 0; i < numThreads; ++i)
+    {
+        char id[32];
+        snprintf(id, sizeof id, "%d", i + 1);
+        workers_[i]->thread.reset(new Thread(std::bind(&ComputePool::runInThread, this, i), name_ + id));
+        workers_[i]->thread->start();
+    }
+}
+
+void ComputePool::stop()
+{
+    {
+        std::unique_lock<std::mutex> lock(sleepMutex_);
+        running_ = false;
+        wakeup_.notify_all();
+    }
+    for(std::unique_ptr<Worker> &worker : workers_)
+        worker->thread->join();
+}
+
+bool ComputePool::submit(Task task)
+{
+    return push(std::move(task));
+}
+
+bool ComputePool::submit(EventLoop *loop, Task work, Task done)
+{
+    CompletionsPtr completions = completionsOf(loop);
+    return push([this, loop, completions, work, done]()
+    {
+        work();
+        complete(loop, completions, done);
+    });
+}
+
+bool ComputePool::push(Task task, PushMode mode)
+{
+    if(!running_ || workers_.empty())
+        return false;
+    if(mode == kBounded && maxQueueSize_ > 0 && pending_.load(std::memory_order_relaxed) >= maxQueueSize_)
+    {
+        rejected_.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    size_t index = t_pool == this ? t_workerIndex
+        : nextWorker_.fetch_add(1, std::memory_order_relaxed) % workers_.size();
+    Worker &worker = *workers_[index];
+    // pending_必须在任务放进队列之前增加：否则worker可能先取走任务减一，size_t回绕成SIZE_MAX，
+    // 这期间有界提交被误拒绝，空闲的worker也不再睡眠
+    // 先增加pending_再检查idle_，worker先增加idle_再检查pending_，两边都是seq_cst，不会丢失唤醒
+    pending_.fetch_add(1);
+    {
+        std::lock_guard<std::mutex> lock(worker.mutex);
+        if(mode == kYield)
+            worker.tasks.push_front(std::move(task));
+        else
+            worker.tasks.push_back(std::move(task));
+    }
+    if(idle_.load() > 0)
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex_);
+        wakeup_.notify_one();
+    }
+    return true;
+}
+
+bool ComputePool::popLocal(size_t index, Task *task)
+{
+    Worker &worker = *workers_[index];
+    std::lock_guard<std::mutex> lock(worker.mutex);
+    if(worker.tasks.empty())
+        return false;
+    *task = std::move(worker.tasks.back());
+    worker.tasks.pop_back();
+    return true;
+}
+
+// 从下一个worker开始依次尝试，从队列头部(最早提交的任务)偷一个
+bool ComputePool::steal(size_t index, Task *task)
+{
+    const size_t n = workers_.size();
+    for(size_t i = 1; i < n; ++i)
+    {
+        Worker &victim = *workers_[(index + i) % n];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if(!victim.tasks.empty())
+        {
+            *task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
+
+// stop()以后把所有队列中剩下的任务执行完再退出
+void ComputePool::runInThread(size_t index)
+{
+    t_pool = this;
+    t_workerIndex = index;
+    Worker &self = *workers_[index];
+    for(;;)
+    {
+        Task task;
+        bool stolen = false;
+        if(popLocal(index, &task) || (stolen = steal(index, &task)))
+        {
+            pending_.fetch_sub(1, std::memory_order_relaxed);
+            task();
+            // 只有自己写，普通load+store
+            self.executed.store(self.executed.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            if(stolen)
+                self.stolen.store(self.stolen.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(sleepMutex_);
+        idle_.fetch_add(1);
+        while(pending_.load() == 0 && running_)
+            wakeup_.wait(lock);
+        idle_.fetch_sub(1);
+        if(pending_.load() == 0 && !running_)
+            break;
+    }
+    t_pool = nullptr;
+}
+
+ComputePool::CompletionsPtr ComputePool::completionsOf(EventLoop *loop)
+{
+    std::shared_ptr<const CompletionsMap> map = std::atomic_load(&completionsMap_);
+    CompletionsMap::const_iterator it = map->find(loop);
+    if(it != map->end())
+        return it->second;
+
+    std::lock_guard<std::mutex> lock(completionsMutex_);
+    map = std::atomic_load(&completionsMap_);
+    it = map->find(loop);
+    if(it != map->end())
+        return it->second;
+    std::shared_ptr<CompletionsMap> copy = std::make_shared<CompletionsMap>(*map);
+    CompletionsPtr completions = std::make_shared<Completions>();
+    (*copy)[loop] = completions;
+    std::atomic_store(&completionsMap_, std::shared_ptr<const CompletionsMap>(copy));
+    return completions;
+}
+
+// 完成队列从空变为非空时才投递一次，loop执行之前到达的结果都搭同一班车
+void ComputePool::complete(EventLoop *loop, const CompletionsPtr &completions, Task done)
+{
+    bool schedule = false;
+    {
+        std::lock_guard<std::mutex> lock(completions->mutex);
+        completions->tasks.push_back(std::move(done));
+        if(!completions->scheduled)
+        {
+            completions->scheduled = true;
+            schedule = true;
+        }
+    }
+    completions_.fetch_add(1, std::memory_order_relaxed);
+    if(schedule)
+    {
+        wakeups_.fetch_add(1, std::memory_order_relaxed);
+        loop->queueLoop(std::bind(&ComputePool::runCompletions, completions));
+    }
+}
+
+void ComputePool::runCompletions(const CompletionsPtr &completions)
+{
+    std::vector<Task> tasks;
+    {
+        std::lock_guard<std::mutex> lock(completions->mutex);
+        tasks.swap(completions->tasks);
+        completions->scheduled = false;
+    }
+    for(Task &task : tasks)
+        task();
+}
+
+ComputePool::Stats ComputePool::stats() const
+{
+    Stats stats;
+    for(const std::unique_ptr<Worker> &worker : workers_)
+    {
+        stats.executed += worker->executed.load(std::memory_order_relaxed);
+        stats.stolen += worker->stolen.load(std::memory_order_relaxed);
+    }
+    stats.rejected = rejected_.load(std::memory_order_relaxed);
+    stats.completions = completions_.load(std::memory_order_relaxed);
+    stats.wakeups = wakeups_.load(std::memory_order_relaxed);
+    return stats;
+}
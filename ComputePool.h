@@ -0,0 +1,137 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "Thread.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <type_traits>
+#include <vector>
+#include <stdint.h>
+
+class EventLoop;
+class Strand;
+
+/**
+ * 工作窃取的计算线程池，用来把压缩、JSON、加解密这类CPU密集的处理移出subLoop，不让一个连接的计算拖住同一loop上的其他连接
+ *
+ * 每个worker一个双端队列：loop提交的任务按轮转分给各个worker，worker在自己的线程里再提交的任务放进自己的队列；
+ * worker从自己队列的尾部取(刚提交的数据还在cache里)，自己的空了就从其他worker队列的头部偷，都没有时才睡眠
+ *
+ * 完成回调投递回提交任务的loop：每个loop一个完成队列，队列从空变为非空时才queueLoop一次，
+ * loop来得及处理之前完成的任务都在同一次唤醒里批量执行，不会每个结果唤醒一次
+ *
+ * 和ThreadPool不同，队列满时submit()不阻塞(不能阻塞loop)，直接返回false，由调用方决定拒绝请求还是暂停读
+ */
+class ComputePool : noncopyable
+{
+public:
+    using Task = std::function<void()>;
+
+    struct Stats
+    {
+        uint64_t executed = 0;      // 执行完的任务
+        uint64_t stolen = 0;        // 其中从其他worker偷来的
+        uint64_t rejected = 0;      // 队列满被拒绝的
+        uint64_t completions = 0;   // 投递回loop的完成回调
+        uint64_t wakeups = 0;       // 为此调用queueLoop的次数，completions / wakeups就是平均批量
+        std::string toString() const;
+    };
+
+    explicit ComputePool(const std::string &name = std::string("ComputePool"));
+    ~ComputePool();
+
+    // 所有worker排队的任务总数上限，0表示不限制，在start()之前设置
+    void setMaxQueueSize(size_t maxSize) {maxQueueSize_ = maxSize;}
+
+    void start(int numThreads);
+    // 执行完已经提交的任务后退出，之后的submit()返回false
+    void stop();
+
+    // 可以在任意线程调用，队列满或者已经stop()时返回false
+    bool submit(Task task);
+    // work在worker线程中执行，完成后done在loop线程中执行
+    bool submit(EventLoop *loop, Task work, Task done);
+    // work的返回值交给done，done在loop线程中执行；work必须有返回值，没有时用上面的submit()
+    template <typename Work, typename Done>
+    bool call(EventLoop *loop, Work work, Done done)
+    {
+        using Result = typename std::result_of<Work()>::type;
+        std::shared_ptr<Result> result = std::make_shared<Result>();
+        return submit(loop, [work, result]() mutable {*result = work();},
+            [done, result]() mutable {done(std::move(*result));});
+    }
+
+    const std::string& name() const {return name_;}
+    size_t numThreads() const {return workers_.size();}
+    // 排队中(还没开始执行)的任务数，近似值
+    size_t pending() const {return pending_.load(std::memory_order_relaxed);}
+    Stats stats() const;
+
+private:
+    friend class Strand;
+
+    enum PushMode
+    {
+        kBounded,       // 受maxQueueSize_限制
+        kUnbounded,     // 已经接受的任务的后续，比如Strand的调度，不能被拒绝
+        kYield,         // 不受限制，放在队列头部：让出worker，排在本worker已有的任务之后，也最先被偷走
+    };
+
+    // 每个worker的队列独占一个cache line，偷任务时只和被偷的worker竞争
+    // C++11的new不保证超过16字节的对齐，自己用posix_memalign分配
+    struct alignas(64) Worker
+    {
+        static void* operator new(size_t size);
+        static void operator delete(void *p) noexcept;
+
+        std::mutex mutex;
+        std::deque<Task> tasks;
+        std::unique_ptr<Thread> thread;
+        std::atomic<uint64_t> executed{0};
+        std::atomic<uint64_t> stolen{0};
+    };
+
+    // 一个loop的完成队列
+    struct Completions
+    {
+        std::mutex mutex;
+        std::vector<Task> tasks;
+        bool scheduled = false;     // 已经queueLoop、loop还没有取走
+    };
+    using CompletionsPtr = std::shared_ptr<Completions>;
+    using CompletionsMap = std::map<EventLoop*, CompletionsPtr>;
+
+    bool push(Task task, PushMode mode = kBounded);
+    bool popLocal(size_t index, Task *task);
+    bool steal(size_t index, Task *task);
+    void runInThread(size_t index);
+    CompletionsPtr completionsOf(EventLoop *loop);
+    void complete(EventLoop *loop, const CompletionsPtr &completions, Task done);
+    static void runCompletions(const CompletionsPtr &completions);
+
+    const std::string name_;
+    std::vector<std::unique_ptr<Worker>> workers_;
+    size_t maxQueueSize_;
+    std::atomic_bool running_;
+    std::atomic<size_t> pending_;
+    std::atomic<size_t> nextWorker_;
+    std::atomic<uint64_t> rejected_;
+    std::atomic<uint64_t> completions_;
+    std::atomic<uint64_t> wakeups_;
+
+    // 没有任务时worker睡在这里；idle_和pending_配合，提交方只在有worker睡眠时才加锁通知
+    std::mutex sleepMutex_;
+    std::condition_variable wakeup_;
+    std::atomic<int> idle_;
+
+    // 完成队列表，读多写少：查找时原子地取一份快照，第一次见到某个loop时加锁复制一份再替换
+    std::mutex completionsMutex_;
+    std::shared_ptr<const CompletionsMap> completionsMap_;
+};
@@ -0,0 +1,132 @@
+#include "ConnectionRegistry.h"
+#include "EventLoop.h"
+#include "TcpConnection.h"
+#include "Logger.h"
+
+ConnectionRegistry::ConnectionRegistry(EventLoop *loop, uint32_t shard)
+    : loop_(loop)
+    , shard_(shard)
+    , freeHead_(kNoSlot)
+    , size_(0)
+    , pool_(std::make_shared<BlockPool>())
+    , inFlight_(0)
+    , probeSentNanos_(0)
+    , lagNanos_(0)
+{
+}
+
+ConnectionRegistry::~ConnectionRegistry()
+{
+}
+
+uint64_t ConnectionRegistry::allocate()
+{
+    uint32_t slot;
+    if(freeHead_ != kNoSlot)
+    {
+        slot = freeHead_;
+        freeHead_ = slots_[slot].nextFree;
+    }
+    else
+    {
+        if(slots_.size() >= kNoSlot)
+            LOG_FATAL("ConnectionRegistry shard %u out of slots\n", shard_);
+        slot = static_cast<uint32_t>(slots_.size());
+        // generation从1开始，保证0不会是合法的连接id
+        slots_.push_back(Slot{TcpConnectionPtr(), 1, kNoSlot});
+    }
+    slots_[slot].nextFree = kNoSlot;
+    return makeId(slot, slots_[slot].generation);
+}
+
+void ConnectionRegistry::insert(uint64_t id, const TcpConnectionPtr &conn)
+{
+    if(slotOf(id) == nullptr)
+    {
+        LOG_ERROR("ConnectionRegistry::insert invalid id %lx\n", static_cast<unsigned long>(id));
+        return;
+    }
+    slots_[static_cast<uint32_t>(id)].conn = conn;
+    size_.store(size() + 1, std::memory_order_relaxed);
+}
+
+void ConnectionRegistry::release(uint64_t id)
+{
+    if(slotOf(id) == nullptr)
+        return;
+    uint32_t index = static_cast<uint32_t>(id);
+    Slot &slot = slots_[index];
+    if(slot.conn)
+    {
+        slot.conn.reset();
+        size_.store(size() - 1, std::memory_order_relaxed);
+    }
+    // generation加一后旧id全部失效，回绕时跳过0
+    slot.generation = (slot.generation + 1) & kGenerationMask;
+    if(slot.generation == 0)
+        slot.generation = 1;
+    slot.nextFree = freeHead_;
+    freeHead_ = index;
+}
+
+const ConnectionRegistry::Slot* ConnectionRegistry::slotOf(uint64_t id) const
+{
+    uint32_t index = static_cast<uint32_t>(id);
+    uint32_t generation = static_cast<uint32_t>(id >> kSlotBits) & kGenerationMask;
+    if(shardOf(id) != shard_ || index >= slots_.size() || slots_[index].generation != generation)
+        return nullptr;
+    return &slots_[index];
+}
+
+TcpConnectionPtr ConnectionRegistry::find(uint64_t id) const
+{
+    const Slot *slot = slotOf(id);
+    return slot ? slot->conn : TcpConnectionPtr();
+}
+
+void ConnectionRegistry::removeConnection(const TcpConnectionPtr &conn)
+{
+    LOG_DEBUG("ConnectionRegistry::removeConnection shard %u - connection %s\n", shard_, conn->name().c_str());
+    release(conn->id());
+    if(admission_)
+        admission_->release(conn->peerAddress());
+    // 还在conn的handleEvent调用栈中，channel要等这一轮事件处理完再移除
+    loop_->queueLoop(std::bind(&TcpConnection::connectDestroyed, conn));
+}
+
+void ConnectionRegistry::finishLagProbe(int64_t nowNanos)
+{
+    lagNanos_.store(nowNanos - probeSentNanos_.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    probeSentNanos_.store(0, std::memory_order_relaxed);
+}
+
+int64_t ConnectionRegistry::lagNanos(int64_t nowNanos) const
+{
+    int64_t sent = probeSentNanos_.load(std::memory_order_relaxed);
+    int64_t lag = lagNanos_.load(std::memory_order_relaxed);
+    return sent != 0 && nowNanos - sent > lag ? nowNanos - sent : lag;
+}
+
+void ConnectionRegistry::forEach(const ConnectionCallback &cb) const
+{
+    for(const Slot &slot : slots_)
+    {
+        if(slot.conn)
+            cb(slot.conn);
+    }
+}
+
+void ConnectionRegistry::destroyAll()
+{
+    std::vector<TcpConnectionPtr> conns;
+    for(uint32_t index = 0; index < slots_.size(); ++index)
+    {
+        if(slots_[index].conn)
+        {
+            conns.push_back(slots_[index].conn);
+            release(makeId(index, slots_[index].generation));
+        }
+    }
+    for(const TcpConnectionPtr &conn : conns)
+        conn->connectDestroyed();
+}
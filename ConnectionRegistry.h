@@ -0,0 +1,100 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "Callbacks.h"
+#include "BlockPool.h"
+#include "AdmissionControl.h"
+
+#include <atomic>
+#include <vector>
+#include <stdint.h>
+
+class EventLoop;
+
+/**
+ * TcpServer在每个loop上的一个连接表分片，slab + generation：
+ * 连接id = shard(8位) | generation(24位) | slot(32位)，shard就是所属loop在TcpServer中的下标
+ * 槽位释放后放回空闲链表，复用时generation加一，拿着旧id查不到新连接
+ *
+ * 除size()以外的接口都只能在所属loop线程中调用，连接的建立、查找和关闭都不需要跨线程，也没有锁
+ * 其他线程按id找连接时，先由shardOf(id)找到分片，再把任务投递到分片所属的loop
+ */
+class ConnectionRegistry : noncopyable
+{
+public:
+    static const int kSlotBits = 32;
+    static const int kGenerationBits = 24;
+    static const int kShardBits = 8;
+    static const uint32_t kMaxShards = 1u << kShardBits;
+
+    static uint32_t shardOf(uint64_t id) {return static_cast<uint32_t>(id >> (kSlotBits + kGenerationBits));}
+
+    ConnectionRegistry(EventLoop *loop, uint32_t shard);
+    ~ConnectionRegistry();
+
+    EventLoop* getLoop() const {return loop_;}
+    uint32_t shard() const {return shard_;}
+
+    // 预留一个槽位并返回它的id，之后必须用insert()或release()把槽位用掉
+    uint64_t allocate();
+    void insert(uint64_t id, const TcpConnectionPtr &conn);
+    void release(uint64_t id);
+
+    // id已经失效(连接关闭或槽位被复用)时返回空指针
+    TcpConnectionPtr find(uint64_t id) const;
+    // 作为TcpConnection的closeCallback，在连接所属loop中完成移除和销毁，不经过baseLoop
+    void removeConnection(const TcpConnectionPtr &conn);
+    // 取出所有连接并逐个connectDestroyed，TcpServer析构时投递到所属loop执行
+    void destroyAll();
+    // 遍历本分片的连接，cb中不能同步地移除连接(forceClose()会投递到下一轮执行，可以调用)
+    void forEach(const ConnectionCallback &cb) const;
+
+    // 当前连接数，任意线程都可以读
+    size_t size() const {return size_.load(std::memory_order_relaxed);}
+    // 本分片的连接对象内存池，只能在所属loop中分配
+    const std::shared_ptr<BlockPool>& pool() const {return pool_;}
+
+    // 准入控制：设置以后连接关闭时向它归还计数，在start()中设置
+    void setAdmission(const std::shared_ptr<AdmissionControl> &admission) {admission_ = admission;}
+    // 已经分发到本分片、还没有insert的连接数，baseLoop分发时加一，所属loop建立连接时减一
+    void addInFlight() {inFlight_.fetch_add(1, std::memory_order_relaxed);}
+    void removeInFlight() {inFlight_.fetch_sub(1, std::memory_order_relaxed);}
+    size_t load() const {return size() + inFlight_.load(std::memory_order_relaxed);}
+
+    // loop延迟探测：baseLoop记下发出时刻并投递任务，任务执行时记录等待时间；还没执行时按已经等待的时间计算
+    bool lagProbePending() const {return probeSentNanos_.load(std::memory_order_relaxed) != 0;}
+    void beginLagProbe(int64_t nowNanos) {probeSentNanos_.store(nowNanos, std::memory_order_relaxed);}
+    void finishLagProbe(int64_t nowNanos);
+    int64_t lagNanos(int64_t nowNanos) const;
+
+private:
+    struct Slot
+    {
+        TcpConnectionPtr conn;
+        uint32_t generation;
+        uint32_t nextFree;
+    };
+
+    static const uint32_t kNoSlot = UINT32_MAX;
+    static const uint32_t kGenerationMask = (1u << kGenerationBits) - 1;
+
+    uint64_t makeId(uint32_t slot, uint32_t generation) const
+    {
+        return (static_cast<uint64_t>(shard_) << (kSlotBits + kGenerationBits))
+            | (static_cast<uint64_t>(generation) << kSlotBits)
+            | slot;
+    }
+    // id不属于本分片或已经失效时返回nullptr
+    const Slot* slotOf(uint64_t id) const;
+
+    EventLoop *loop_;
+    const uint32_t shard_;
+    std::vector<Slot> slots_;
+    uint32_t freeHead_;
+    std::atomic<size_t> size_;      // 单写者
+    std::shared_ptr<BlockPool> pool_;
+    std::shared_ptr<AdmissionControl> admission_;
+    std::atomic<size_t> inFlight_;
+    std::atomic<int64_t> probeSentNanos_;
+    std::atomic<int64_t> lagNanos_;
+};
@@ -0,0 +1,185 @@
+#include "Connector.h"
+#include "Channel.h"
+#include "EventLoop.h"
+#include "Logger.h"
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+
+static int createNonblocking(int family)
+{
+    int sockfd = ::socket(family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if(sockfd < 0)
+        LOG_FATAL("%s:%s:%d connect socket create err: %d \n", __FILE__, __FUNCTION__, __LINE__, errno);
+    return sockfd;
+}
+
+static int getSocketError(int sockfd)
+{
+    int optval;
+    socklen_t optlen = sizeof optval;
+    if(::getsockopt(sockfd, SOL_SOCKET, SO_ERROR, &optval, &optlen) < 0)
+        return errno;
+    return optval;
+}
+
+// 自连接：本地端口恰好等于对端端口时，内核会让socket连上自己，Unix域socket不存在这种情况
+static bool isSelfConnect(int sockfd)
+{
+    InetAddress local = InetAddress::getLocalAddr(sockfd);
+    InetAddress peer = InetAddress::getPeerAddr(sockfd);
+    if(local.family() != peer.family() || local.isUnix())
+        return false;
+    if(local.family() == AF_INET)
+    {
+        const sockaddr_in *l = reinterpret_cast<const sockaddr_in*>(local.getSockAddr());
+        const sockaddr_in *p = reinterpret_cast<const sockaddr_in*>(peer.getSockAddr());
+        return l->sin_port == p->sin_port && l->sin_addr.s_addr == p->sin_addr.s_addr;
+    }
+    if(local.family() == AF_INET6)
+    {
+        const sockaddr_in6 *l = reinterpret_cast<const sockaddr_in6*>(local.getSockAddr());
+        const sockaddr_in6 *p = reinterpret_cast<const sockaddr_in6*>(peer.getSockAddr());
+        return l->sin6_port == p->sin6_port
+            && memcmp(&l->sin6_addr, &p->sin6_addr, sizeof l->sin6_addr) == 0;
+    }
+    return false;
+}
+
+Connector::Connector(EventLoop *loop, const InetAddress &serverAddr)
+    : loop_(loop)
+    , serverAddr_(serverAddr)
+    , connect_(false)
+    , state_(kDisconnected)
+{
+}
+
+Connector::~Connector()
+{
+    // channel_必须在stop()或连接结束时就已经释放
+    if(channel_)
+        LOG_ERROR("Connector::dtor[%p] channel not reset\n", this);
+}
+
+void Connector::start()
+{
+    connect_ = true;
+    loop_->runInLoop(std::bind(&Connector::startInLoop, shared_from_this()));
+}
+
+void Connector::startInLoop()
+{
+    if(connect_ && state_ == kDisconnected)
+        connect();
+}
+
+void Connector::stop()
+{
+    connect_ = false;
+    loop_->queueLoop(std::bind(&Connector::stopInLoop, shared_from_this()));
+}
+
+void Connector::stopInLoop()
+{
+    if(state_ == kConnecting)
+    {
+        setState(kDisconnected);
+        int sockfd = removeAndResetChannel();
+        ::close(sockfd);
+    }
+}
+
+void Connector::connect()
+{
+    int sockfd = createNonblocking(serverAddr_.family());
+    int ret = ::connect(sockfd, serverAddr_.getSockAddr(), serverAddr_.length());
+    int savedErrno = (ret == 0) ? 0 : errno;
+    switch(savedErrno)
+    {
+    case 0:
+    case EINPROGRESS:
+    case EINTR:
+    case EISCONN:
+        connecting(sockfd); // 连接正在建立，等待EPOLLOUT
+        break;
+    default:
+        // ECONNREFUSED ENETUNREACH EADDRNOTAVAIL...
+        LOG_ERROR("Connector::connect to %s error:%d\n", serverAddr_.toIpPort().c_str(), savedErrno);
+        fail(sockfd, savedErrno);
+        break;
+    }
+}
+
+void Connector::connecting(int sockfd)
+{
+    setState(kConnecting);
+    channel_.reset(new Channel(loop_, sockfd));
+    channel_->setWriteCallback(std::bind(&Connector::handleWrite, this));
+    channel_->setErrorCallback(std::bind(&Connector::handleError, this));
+    channel_->enableWriting();
+}
+
+// 此时正处于channel_的handleEvent中，不能直接释放channel_，放到doPendingFunctors中释放
+int Connector::removeAndResetChannel()
+{
+    channel_->disableAll();
+    channel_->remove();
+    int sockfd = channel_->fd();
+    loop_->queueLoop(std::bind(&Connector::resetChannel, shared_from_this()));
+    return sockfd;
+}
+
+void Connector::resetChannel()
+{
+    channel_.reset();
+}
+
+void Connector::handleWrite()
+{
+    if(state_ != kConnecting)
+        return;
+
+    int sockfd = removeAndResetChannel();
+    int err = getSocketError(sockfd);
+    if(err)
+    {
+        LOG_ERROR("Connector::handleWrite SO_ERROR:%d\n", err);
+        fail(sockfd, err);
+    }
+    else if(isSelfConnect(sockfd))
+    {
+        LOG_ERROR("Connector::handleWrite self connect\n");
+        fail(sockfd, ECONNREFUSED);
+    }
+    else
+    {
+        setState(kConnected);
+        if(connect_ && newConnectionCallback_)
+            newConnectionCallback_(sockfd); // sockfd的所有权交给TcpConnection
+        else
+            ::close(sockfd);
+    }
+}
+
+void Connector::handleError()
+{
+    if(state_ == kConnecting)
+    {
+        int sockfd = removeAndResetChannel();
+        int err = getSocketError(sockfd);
+        LOG_ERROR("Connector::handleError SO_ERROR:%d\n", err);
+        fail(sockfd, err);
+    }
+}
+
+// 当前没有定时器，失败后不自动重连，交给用户决定
+void Connector::fail(int sockfd, int err)
+{
+    ::close(sockfd);
+    setState(kDisconnected);
+    if(connect_ && connectFailedCallback_)
+        connectFailedCallback_(err);
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "InetAddress.h"
+
+#include <functional>
+#include <memory>
+#include <atomic>
+
+class Channel;
+class EventLoop;
+
+/**
+ * 主动发起连接，对应服务端的Acceptor
+ * 非阻塞connect => 返回EINPROGRESS => 监听sockfd的EPOLLOUT => getsockopt(SO_ERROR)判断是否连接成功
+ * 连接成功以后，把sockfd交给TcpClient创建TcpConnection
+ */
+class Connector : noncopyable, public std::enable_shared_from_this<Connector>
+{
+public:
+    using NewConnectionCallback = std::function<void(int sockfd)>;
+    using ConnectFailedCallback = std::function<void(int err)>;
+
+    Connector(EventLoop *loop, const InetAddress &serverAddr);
+    ~Connector();
+
+    void setNewConnectionCallback(const NewConnectionCallback &cb)
+    {newConnectionCallback_ = cb;}
+    void setConnectFailedCallback(const ConnectFailedCallback &cb)
+    {connectFailedCallback_ = cb;}
+
+    const InetAddress& serverAddress() const {return serverAddr_;}
+
+    void start(); // 可以在任意线程调用
+    void stop();  // 可以在任意线程调用
+
+private:
+    enum StateE{kDisconnected, kConnecting, kConnected};
+    void setState(StateE state) {state_ = state;}
+
+    void startInLoop();
+    void stopInLoop();
+    void connect();
+    void connecting(int sockfd);
+    void handleWrite();
+    void handleError();
+    void fail(int sockfd, int err);
+    int removeAndResetChannel();
+    void resetChannel();
+
+    EventLoop *loop_;
+    InetAddress serverAddr_;
+    std::atomic_bool connect_;  // 用户是否希望连接
+    std::atomic_int state_;
+    std::unique_ptr<Channel> channel_;  // 只在connecting期间存在
+    NewConnectionCallback newConnectionCallback_;
+    ConnectFailedCallback connectFailedCallback_;
+};
@@ -0,0 +1,440 @@
+#pragma once
+
+/**
+ * C++20协程接口，把多步的协议写成顺序代码，代替层层std::bind回调：
+ *
+ *   Task<> session(std::shared_ptr<CoConnection> c)
+ *   {
+ *       while(size_t n = co_await c->readUntil("\r\n"))
+ *       {
+ *           std::string line = c->input()->retrieveAsString(n);
+ *           if(!co_await c->write(line))
+ *               break;
+ *       }
+ *   }
+ *   server.setConnectionCallback([](const TcpConnectionPtr &conn)
+ *   {
+ *       if(conn->connected())
+ *           spawn(session(CoConnection::attach(conn)));
+ *   });
+ *
+ * - 协程总是在所属loop线程中、由触发它的事件回调(messageCallback、writeComplete、定时器、connect完成)直接恢复，不经过任何队列
+ * - 协程帧从当前线程loop的FramePool分配(EventLoop::framePool())，同一个协程函数反复调用不走全局分配器
+ * - Task是惰性的：co_await时才开始执行，子协程结束后直接切回调用者(对称转移)；spawn()启动一个分离的顶层协程
+ * - 协程帧必须在loop析构之前结束，不支持异常(协程中抛出的异常会终止进程)
+ *
+ * 只是头文件，库本身仍然按C++11编译；使用者需要-std=c++20，cmake -DMYMUDUO_WITH_COROUTINES=ON会把整个构建切到C++20
+ */
+#if __cplusplus < 202002L
+#error "Coroutine.h requires C++20 (-std=c++20, or cmake -DMYMUDUO_WITH_COROUTINES=ON)"
+#endif
+
+#include "noncopyable.h"
+#include "EventLoop.h"
+#include "TcpConnection.h"
+#include "Connector.h"
+#include "Buffer.h"
+#include "InetAddress.h"
+#include "FramePool.h"
+#include "Logger.h"
+
+#include <algorithm>
+#include <coroutine>
+#include <memory>
+#include <optional>
+#include <string>
+#include <utility>
+
+// 所有协程的promise共用：帧从当前线程loop的FramePool分配，结束时切回等待者
+class TaskPromiseBase
+{
+public:
+    static void* operator new(size_t size)
+    {
+        EventLoop *loop = EventLoop::loopOfCurrentThread();
+        return FramePool::allocate(loop ? &loop->framePool() : nullptr, size);
+    }
+    static void operator delete(void *p) {FramePool::deallocate(p);}
+
+    std::suspend_always initial_suspend() noexcept {return {};}
+
+    struct FinalAwaiter
+    {
+        bool await_ready() noexcept {return false;}
+        template <typename Promise>
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> handle) noexcept
+        {
+            TaskPromiseBase &promise = handle.promise();
+            if(promise.continuation_)
+                return promise.continuation_;
+            // 分离的协程没有人持有句柄，结束时自己释放
+            if(promise.detached_)
+                handle.destroy();
+            return std::noop_coroutine();
+        }
+        void await_resume() noexcept {}
+    };
+    FinalAwaiter final_suspend() noexcept {return {};}
+
+    void unhandled_exception() {LOG_FATAL("unhandled exception in coroutine\n");}
+
+    std::coroutine_handle<> continuation_;
+    bool detached_ = false;
+};
+
+template <typename T>
+class TaskPromise : public TaskPromiseBase
+{
+public:
+    template <typename U>
+    void return_value(U &&value) {value_.emplace(std::forward<U>(value));}
+    T result() {return std::move(*value_);}
+
+private:
+    std::optional<T> value_;
+};
+
+template <>
+class TaskPromise<void> : public TaskPromiseBase
+{
+public:
+    void return_void() {}
+    void result() {}
+};
+
+/**
+ * 协程的返回类型，可以被co_await(得到返回值)，也可以交给spawn()分离执行
+ * 只能移动，析构时还没有执行完(也没有分离)的协程会被销毁
+ */
+template <typename T = void>
+class Task : noncopyable
+{
+public:
+    struct promise_type : TaskPromise<T>
+    {
+        Task get_return_object() {return Task(std::coroutine_handle<promise_type>::from_promise(*this));}
+    };
+    using Handle = std::coroutine_handle<promise_type>;
+
+    Task(Task &&rhs) noexcept : handle_(std::exchange(rhs.handle_, nullptr)) {}
+    ~Task()
+    {
+        if(handle_)
+            handle_.destroy();
+    }
+
+    bool await_ready() const noexcept {return false;}
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> caller) noexcept
+    {
+        handle_.promise().continuation_ = caller;
+        return handle_;
+    }
+    T await_resume() {return handle_.promise().result();}
+
+    // 交出句柄，由调用者负责，spawn()使用
+    Handle release() {return std::exchange(handle_, nullptr);}
+
+private:
+    explicit Task(Handle handle) : handle_(handle) {}
+
+    Handle handle_;
+};
+
+// 在当前线程(必须是loop线程)立即开始执行task，直到它第一次挂起；之后task自己管理生命周期
+inline void spawn(Task<> task)
+{
+    Task<>::Handle handle = task.release();
+    handle.promise().detached_ = true;
+    handle.resume();
+}
+
+// 在loop线程中开始执行task，可以在任意线程调用
+inline void spawn(EventLoop *loop, Task<> task)
+{
+    Task<>::Handle handle = task.release();
+    handle.promise().detached_ = true;
+    loop->runInLoop([handle]() {handle.resume();});
+}
+
+// co_await sleepFor(loop, seconds)：由loop的定时器恢复
+class SleepAwaiter
+{
+public:
+    SleepAwaiter(EventLoop *loop, double seconds) : loop_(loop), seconds_(seconds) {}
+
+    bool await_ready() const noexcept {return seconds_ <= 0;}
+    void await_suspend(std::coroutine_handle<> handle) {loop_->runAfter(seconds_, [handle]() {handle.resume();});}
+    void await_resume() const noexcept {}
+
+private:
+    EventLoop *loop_;
+    double seconds_;
+};
+
+inline SleepAwaiter sleepFor(EventLoop *loop, double seconds) {return SleepAwaiter(loop, seconds);}
+
+/**
+ * TcpConnection的协程适配：attach()接管连接的messageCallback、writeCompleteCallback和connectionCallback，
+ * 收到的数据留在input()(连接的inputBuffer)里，由协程自己retrieve
+ * 同一时刻只能有一个协程在等待，所有调用都必须在连接所属的loop线程中进行
+ * CoConnection由协程持有，析构时连接还没关闭就shutdown；回调里只持有weak_ptr，不会让连接和协程互相持有
+ */
+class CoConnection : noncopyable
+{
+public:
+    static std::shared_ptr<CoConnection> attach(const TcpConnectionPtr &conn)
+    {
+        std::shared_ptr<CoConnection> co(new CoConnection(conn));
+        std::weak_ptr<CoConnection> weak(co);
+        conn->setMessageCallback([weak](const TcpConnectionPtr&, Buffer*, Timestamp)
+        {
+            std::shared_ptr<CoConnection> self = weak.lock();
+            if(self)
+                self->onMessage();
+        });
+        conn->setWriteCompleteCallback([weak](const TcpConnectionPtr&)
+        {
+            std::shared_ptr<CoConnection> self = weak.lock();
+            // 之前直接写完的send也会投递writeComplete，outputBuffer确实清空了才算写完
+            if(self && self->waitKind_ == kWrite && self->conn_->outputBuffer()->readableBytes() == 0)
+                self->wake(1);
+        });
+        conn->setConnectionCallback([weak](const TcpConnectionPtr &conn)
+        {
+            std::shared_ptr<CoConnection> self = weak.lock();
+            if(self)
+                self->onConnection(conn->connected());
+        });
+        return co;
+    }
+
+    ~CoConnection()
+    {
+        if(!closed_)
+            conn_->shutdown();
+    }
+
+    const TcpConnectionPtr& connection() const {return conn_;}
+    Buffer* input() const {return conn_->inputBuffer();}
+    bool closed() const {return closed_;}
+
+    class Awaiter
+    {
+    public:
+        bool await_ready() {return co_->ready();}
+        void await_suspend(std::coroutine_handle<> handle) {co_->waiter_ = handle;}
+        size_t await_resume() {return co_->result_;}
+
+    private:
+        friend class CoConnection;
+        Awaiter(CoConnection *co) : co_(co) {}
+        CoConnection *co_;
+    };
+
+    // 等到input()中至少有n字节，返回可读字节数；连接关闭时数据还不够则返回0，已经收到的数据仍在input()中
+    Awaiter read(size_t n)
+    {
+        prepare(kRead);
+        minBytes_ = n;
+        return Awaiter(this);
+    }
+    // 等到input()中出现delim，返回到delim末尾为止的长度；连接关闭时返回0
+    Awaiter readUntil(const std::string &delim)
+    {
+        prepare(kReadUntil);
+        delim_ = delim;
+        scanned_ = 0;
+        return Awaiter(this);
+    }
+    // 发送数据，等到全部写入socket(outputBuffer清空)；返回0表示连接已经关闭
+    Awaiter write(const void *data, size_t len)
+    {
+        prepare(kWrite);
+        data_ = data;
+        len_ = len;
+        return Awaiter(this);
+    }
+    Awaiter write(const std::string &data) {return write(data.data(), data.size());}
+
+private:
+    friend class ConnectAwaiter;
+    enum WaitKind {kNone, kRead, kReadUntil, kWrite, kConnect};
+
+    explicit CoConnection(const TcpConnectionPtr &conn)
+        : conn_(conn)
+        , closed_(conn->disconnected())
+        , waitKind_(kNone)
+        , minBytes_(0)
+        , scanned_(0)
+        , data_(nullptr)
+        , len_(0)
+        , result_(0)
+    {
+    }
+
+    void prepare(WaitKind kind)
+    {
+        if(waiter_)
+            LOG_FATAL("CoConnection [%s] already has a waiting coroutine\n", conn_->name().c_str());
+        waitKind_ = kind;
+        result_ = 0;
+    }
+
+    // 条件已经满足时不挂起，result_就是co_await的结果
+    bool ready()
+    {
+        if(waitKind_ == kWrite)
+        {
+            if(closed_)
+                return finish(0);
+            conn_->send(data_, len_);
+            return conn_->outputBuffer()->readableBytes() == 0 ? finish(1) : false;
+        }
+        return check() || (closed_ && finish(0));
+    }
+
+    // 检查读条件，满足时记下结果
+    bool check()
+    {
+        Buffer *buf = conn_->inputBuffer();
+        if(waitKind_ == kRead)
+            return buf->readableBytes() >= minBytes_ ? finish(buf->readableBytes()) : false;
+        if(waitKind_ == kReadUntil)
+        {
+            // 每次只从上次扫描结束的地方(往回退delim长度减一)继续找，大消息分多次到达时不重复扫描
+            const char *begin = buf->peek();
+            const char *end = begin + buf->readableBytes();
+            size_t from = scanned_ >= delim_.size() ? scanned_ - delim_.size() + 1 : 0;
+            const char *found = std::search(begin + from, end, delim_.begin(), delim_.end());
+            scanned_ = buf->readableBytes();
+            if(found != end)
+                return finish(found - begin + delim_.size());
+        }
+        return false;
+    }
+
+    bool finish(size_t result)
+    {
+        result_ = result;
+        waitKind_ = kNone;
+        return true;
+    }
+
+    // 恢复等待中的协程；协程可能在里面结束并释放本对象，调用者要持有shared_ptr
+    void wake(size_t result)
+    {
+        finish(result);
+        std::coroutine_handle<> handle = std::exchange(waiter_, nullptr);
+        if(handle)
+            handle.resume();
+    }
+
+    void onMessage()
+    {
+        if(waiter_ && (waitKind_ == kRead || waitKind_ == kReadUntil) && check())
+            wake(result_);
+    }
+
+    void onConnection(bool connected)
+    {
+        if(connected)
+        {
+            if(waitKind_ == kConnect)
+                wake(1);
+            return;
+        }
+        closed_ = true;
+        if(waiter_)
+            wake(0);
+    }
+
+    TcpConnectionPtr conn_;
+    bool closed_;
+    WaitKind waitKind_;
+    std::coroutine_handle<> waiter_;
+    size_t minBytes_;
+    std::string delim_;
+    size_t scanned_;
+    const void *data_;
+    size_t len_;
+    size_t result_;
+};
+
+using CoConnectionPtr = std::shared_ptr<CoConnection>;
+
+/**
+ * co_await asyncConnect(loop, addr)：连接成功(TLS连接是握手完成)后返回CoConnection，失败返回nullptr
+ * 连接对象由它自己持有(context指向自己)，关闭后释放，不需要TcpClient
+ */
+class ConnectAwaiter
+{
+public:
+    ConnectAwaiter(EventLoop *loop, const InetAddress &addr, const TlsContextPtr &tls)
+        : loop_(loop), addr_(addr), tls_(tls)
+    {
+    }
+
+    bool await_ready() const noexcept {return false;}
+    void await_suspend(std::coroutine_handle<> handle)
+    {
+        connector_ = std::make_shared<Connector>(loop_, addr_);
+        connector_->setNewConnectionCallback([this, handle](int sockfd) {onConnected(sockfd, handle);});
+        connector_->setConnectFailedCallback([this, handle](int err)
+        {
+            LOG_ERROR("asyncConnect to %s failed:%d\n", addr_.toIpPort().c_str(), err);
+            releaseConnector();
+            handle.resume();
+        });
+        connector_->start();
+    }
+    CoConnectionPtr await_resume()
+    {
+        return co_ && !co_->closed() ? co_ : CoConnectionPtr();
+    }
+
+private:
+    // Connector还在自己的回调里，推迟到下一轮再释放
+    void releaseConnector()
+    {
+        std::shared_ptr<Connector> connector = std::move(connector_);
+        loop_->queueLoop([connector]() {});
+    }
+
+    void onConnected(int sockfd, std::coroutine_handle<> handle)
+    {
+        releaseConnector();
+        InetAddress peerAddr = InetAddress::getPeerAddr(sockfd);
+        TcpConnectionPtr conn(new TcpConnection(loop_, "co-" + peerAddr.toIpPort(), sockfd,
+            InetAddress::getLocalAddr(sockfd), peerAddr));
+        conn->setContext(conn);
+        co_ = CoConnection::attach(conn);
+        std::weak_ptr<CoConnection> weak(co_);
+        EventLoop *loop = loop_;
+        conn->setCloseCallback([weak, loop](const TcpConnectionPtr &conn)
+        {
+            // 握手失败时不会有connectionCallback，在这里通知等待connect的协程
+            std::shared_ptr<CoConnection> self = weak.lock();
+            if(self && !self->closed())
+                self->onConnection(false);
+            conn->setContext(std::shared_ptr<void>());
+            loop->queueLoop(std::bind(&TcpConnection::connectDestroyed, conn));
+        });
+        if(tls_)
+            conn->startTls(tls_);
+        co_->waitKind_ = CoConnection::kConnect;
+        co_->waiter_ = handle;
+        // 明文连接在这里同步执行connectionCallback，直接恢复协程
+        conn->connectEstablished();
+    }
+
+    EventLoop *loop_;
+    InetAddress addr_;
+    TlsContextPtr tls_;
+    std::shared_ptr<Connector> connector_;
+    CoConnectionPtr co_;
+};
+
+inline ConnectAwaiter asyncConnect(EventLoop *loop, const InetAddress &addr, const TlsContextPtr &tls = TlsContextPtr())
+{
+    return ConnectAwaiter(loop, addr, tls);
+}
@@ -24,6 +24,7 @@ EPollPoller::EPollPoller(EventLoop *loop)
     : Poller(loop)
     , epollfd_(::epoll_create1(EPOLL_CLOEXEC))
     , events_(kInitEventListSize)
+    , sparsePolls_(0)
 {
     if(epollfd_ < 0)
         LOG_FATAL("epoll_create error: %d\n", errno);
@@ -38,7 +39,7 @@ EPollPoller::~EPollPoller()
 Timestamp EPollPoller::poll(int timeoutMs, ChannelList *activeChannels)
 {
     // 操作频繁，实际应用中使用LOG_DEBUG更为合适
-    LOG_INFO("func=%s => fd total count:%lu \n", __FUNCTION__, channels_.size());
+    LOG_DEBUG("func=%s => fd total count:%lu \n", __FUNCTION__, numChannels());
 
     // &*events_中的*表示operator*()获得vector中的数据成员，而后使用&取地址
     int numEvents = ::epoll_wait(epollfd_, &*events_.begin(), static_cast<int>(events_.size()), timeoutMs);
@@ -47,10 +48,8 @@ Timestamp EPollPoller::poll(int timeoutMs, ChannelList *activeChannels)
 
     if(numEvents > 0)
     {
-        LOG_INFO("%d events happened \n", numEvents);
+        LOG_DEBUG("%d events happened \n", numEvents);
         fillActiveChannels(numEvents, activeChannels);
-        if(numEvents == events_.size())
-            events_.resize(events_.size() * 2);
     }
     else if(numEvents == 0)
     {
@@ -64,6 +63,25 @@ Timestamp EPollPoller::poll(int timeoutMs, ChannelList *activeChannels)
             LOG_ERROR("EPollPoller::poll() error!");
         }
     }
+
+    // 填满说明可能还有事件没取到，下次多取一倍；长期稀疏则减半，用新vector替换才能真正释放内存
+    if(numEvents == static_cast<int>(events_.size()))
+    {
+        events_.resize(events_.size() * 2);
+        sparsePolls_ = 0;
+    }
+    else if(numEvents >= 0 && events_.size() > kInitEventListSize
+        && static_cast<size_t>(numEvents) < events_.size() / 4)
+    {
+        if(++sparsePolls_ >= kShrinkAfterPolls)
+        {
+            EventList(events_.size() / 2).swap(events_);
+            sparsePolls_ = 0;
+        }
+    }
+    else
+        sparsePolls_ = 0;
+
     return now;
 }
 
@@ -71,12 +89,12 @@ Timestamp EPollPoller::poll(int timeoutMs, ChannelList *activeChannels)
 void EPollPoller::updateChannel(Channel *channel)
 {
     const int index = channel->index();
-    LOG_INFO("func=%s=>fd=%d events=%d index=%d\n",__FUNCTION__,channel->fd(),channel->events(),index);
+    LOG_DEBUG("func=%s=>fd=%d events=%d index=%d\n",__FUNCTION__,channel->fd(),channel->events(),index);
 
     if(index == kNew || index == kDeleted)
     {
         if(index == kNew)
-            channels_[channel->fd()] = channel;
+            addToTable(channel);
         channel->set_index(kAdded);
         update(EPOLL_CTL_ADD, channel);
     }
@@ -98,8 +116,7 @@ void EPollPoller::updateChannel(Channel *channel)
 // 从poller中删除channel
 void EPollPoller::removeChannel(Channel *channel)
 {
-    int fd = channel->fd();
-    channels_.erase(fd);
+    removeFromTable(channel);
 
     if(channel->index() == kAdded)
         update(EPOLL_CTL_DEL, channel);
@@ -30,6 +30,8 @@ public:
 
 private:
     static const int kInitEventListSize = 16;
+    // 连续这么多次poll返回的事件数都不到events_容量的1/4，就把events_减半，突发过后归还内存
+    static const int kShrinkAfterPolls = 256;
     
     // 填写活跃的连接
     void fillActiveChannels(int numEvents, ChannelList *activeChannels) const;
@@ -43,4 +45,5 @@ private:
 
     int epollfd_;
     EventList events_;
+    int sparsePolls_;   // 连续的稀疏poll次数
 };
\ No newline at end of file
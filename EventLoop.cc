@@ -2,9 +2,19 @@
 #include "Poller.h"
 #include "Channel.h"
 #include "Logger.h"
+#include "TimerQueue.h"
 
 #include <sys/eventfd.h>
+#include <signal.h>
 
+// 对端关闭后继续write会产生SIGPIPE，默认行为是终止进程，网络库统一忽略，由write返回EPIPE
+class IgnoreSigPipe
+{
+public:
+    IgnoreSigPipe()
+    {::signal(SIGPIPE, SIG_IGN);}
+};
+static IgnoreSigPipe initObj;
 
 // 防止一个线程创建多个EventLoop  线程中的单例,不过如果不单例就退出进程
 __thread EventLoop *t_loopInThisThread = nullptr;
@@ -27,8 +37,10 @@ EventLoop::EventLoop()
     , callingPendingFunctors_(false)
     , threadId_(CurrentThread::tid())
     , poller_(Poller::newDefaultPoller(this))
+    , timerQueue_(new TimerQueue(this))
     , wakeupFd_(createEventfd())
     , wakeupChannel_(new Channel(this, wakeupFd_))
+    , trace_(threadId_)
 {
     LOG_DEBUG("EventLoop created %p in thread %d\n", this, threadId_);
     if(t_loopInThisThread)
@@ -44,6 +56,11 @@ EventLoop::EventLoop()
     wakeupChannel_->setReadCallback(std::bind(&EventLoop::handleRead, this));
 }
 
+EventLoop* EventLoop::loopOfCurrentThread()
+{
+    return t_loopInThisThread;
+}
+
 // 析构函数可以根据构造函数来考虑，这样可以减少遗漏
 EventLoop::~EventLoop()
 {
@@ -67,17 +84,40 @@ void EventLoop::loop()
         activeChannels_.clear();
         // 监听两类fd client的fd和wakeupfd
         // Poller将监听到的channel事件上报给EventLoop
+        int64_t pollStart = Timestamp::monotonicNanos();
         pollReturnTime_ = poller_->poll(kPollTimeMs, &activeChannels_);
+        int64_t pollEnd = Timestamp::monotonicNanos();
+
+        // 没有事件说明是超时返回，超出kPollTimeMs的部分就是多睡的时间
+        if(activeChannels_.empty())
+            histograms_.pollOversleep.record(pollEnd - pollStart - kPollTimeMs * 1000000LL);
+        trace_.record(LoopTrace::kPoll, pollStart, pollEnd, -1, activeChannels_.size());
 
+        // 相邻两次取时间之差就是单个channel的处理时间，每个channel只多一次clock_gettime
+        int64_t callbackEnd = pollEnd;
         for(Channel *channel : activeChannels_)
         {
+            // 回调中channel可能被移除，fd和revents要先取出来
+            int fd = channel->fd();
+            int revents = channel->revents();
             // 执行channel的回调操作
             channel->handleEvent(pollReturnTime_);
+            int64_t now = Timestamp::monotonicNanos();
+            histograms_.handleEvent.record(now - callbackEnd);
+            trace_.record(LoopTrace::kHandleEvent, callbackEnd, now, fd, revents);
+            callbackEnd = now;
         }
         // 执行EventLoop的loop循环
         // mainloop事先为subloop注册cb回调
         // 当subloop被唤醒以后，执行下面的回调方法
         doPendingFunctors();
+        int64_t functorEnd = Timestamp::monotonicNanos();
+
+        metrics_.iterations.add();
+        metrics_.events.add(activeChannels_.size());
+        metrics_.pollNanos.add(pollEnd - pollStart);
+        metrics_.callbackNanos.add(callbackEnd - pollEnd);
+        metrics_.functorNanos.add(functorEnd - callbackEnd);
     }
 
     LOG_INFO("EventLoop %p stop looping.\n",this);
@@ -109,7 +149,7 @@ void EventLoop::runInLoop(Functor cb)
     // 在其他线程中，把cb塞入目标线程，并唤醒目标线程
     else
     {
-        queueLoop(cb);
+        queueLoop(std::move(cb));
     }
 }
 
@@ -117,8 +157,9 @@ void EventLoop::runInLoop(Functor cb)
 void EventLoop::queueLoop(Functor cb)
 {
     {
+        PendingFunctor pending{std::move(cb), Timestamp::monotonicNanos()};
         std::unique_lock<std::mutex> lock(mutex_);
-        pendingFunctors_.emplace_back(cb);
+        pendingFunctors_.emplace_back(std::move(pending));
     }
 
     // 在其他线程中 或 又有新cb入队时 唤醒目标线程进行cb
@@ -135,6 +176,32 @@ void EventLoop::handleRead()
         LOG_ERROR("EventLoop::handleRead() reads %lu bytes instead of 8\n", n);    
 }
 
+TimerId EventLoop::runAt(Timestamp time, Functor cb)
+{
+    // 墙上时间换算成单调时钟，之后系统时间被调整也不影响已经加入的定时器
+    int64_t delayNanos = (time.microSecondsSinceEpoch() - Timestamp::now().microSecondsSinceEpoch()) * 1000;
+    return timerQueue_->addTimer(std::move(cb), Timestamp::monotonicNanos() + delayNanos, 0);
+}
+
+TimerId EventLoop::runAfter(double delaySeconds, Functor cb)
+{
+    int64_t delayNanos = static_cast<int64_t>(delaySeconds * 1e9);
+    return timerQueue_->addTimer(std::move(cb), Timestamp::monotonicNanos() + delayNanos, 0);
+}
+
+TimerId EventLoop::runEvery(double intervalSeconds, Functor cb)
+{
+    int64_t intervalNanos = static_cast<int64_t>(intervalSeconds * 1e9);
+    if(intervalNanos <= 0)
+        intervalNanos = 1;
+    return timerQueue_->addTimer(std::move(cb), Timestamp::monotonicNanos() + intervalNanos, intervalNanos);
+}
+
+void EventLoop::cancel(TimerId timerId)
+{
+    timerQueue_->cancel(timerId);
+}
+
 // 唤醒loop所在的线程
 void EventLoop::wakeup()
 {
@@ -161,7 +228,7 @@ bool EventLoop::hasChannel(Channel *channel)
 
 void EventLoop::doPendingFunctors() // 执行回调
 {
-    std::vector<Functor> functors;
+    std::vector<PendingFunctor> functors;
     callingPendingFunctors_ = true;
 
     // 这里的swap用得很巧妙
@@ -173,11 +240,19 @@ void EventLoop::doPendingFunctors() // 执行回调
         std::unique_lock<std::mutex> lock(mutex_);
         functors.swap(pendingFunctors_);
     } 
+    metrics_.functorsRun.add(functors.size());
+    metrics_.lastPendingDepth.set(functors.size());
+    metrics_.maxPendingDepth.setMax(functors.size());
 
     // 执行loop的回调函数
-    for(const Functor &functor: functors)
+    int64_t start = Timestamp::monotonicNanos();
+    for(PendingFunctor &pending : functors)
     {
-        functor();   
+        histograms_.queueDelay.record(start - pending.queuedNanos);
+        pending.functor();
+        int64_t end = Timestamp::monotonicNanos();
+        trace_.record(LoopTrace::kFunctor, start, end, -1, (start - pending.queuedNanos) / 1000);
+        start = end;
     }
 
     callingPendingFunctors_ = false;
@@ -9,10 +9,16 @@
 #include "noncopyable.h"
 #include "Timestamp.h"
 #include "CurrentThread.h"
+#include "LoopMetrics.h"
+#include "Histogram.h"
+#include "LoopTrace.h"
+#include "TimerId.h"
+#include "FramePool.h"
 
 // 头文件的class声明 == 源文件中包含class所需的头文件
 class Channel;
 class Poller;
+class TimerQueue;
 
 // 时间循环类 主要包含channel和poller(epoll的抽象)
 class EventLoop : noncopyable
@@ -38,6 +44,12 @@ public:
     // 唤醒loop所在的线程
     void wakeup();
 
+    // 定时任务，可以在任意线程调用，回调总是在loop线程中执行
+    TimerId runAt(Timestamp time, Functor cb);
+    TimerId runAfter(double delaySeconds, Functor cb);
+    TimerId runEvery(double intervalSeconds, Functor cb);
+    void cancel(TimerId timerId);
+
     // EventLoop的方法 => Poller的方法
     // 使得channel可以借助EventLoop调用Poller的方法
     void updateChannel(Channel *channel);
@@ -47,12 +59,33 @@ public:
     // 判断EventLoop对象是否在自己的线程里面
     bool isInLoopThread() const { return threadId_ == CurrentThread::tid(); }
 
+    // 本loop的运行统计，只能由loop线程修改，其他线程通过metrics().snapshot()读取
+    LoopMetrics& metrics() { return metrics_; }
+    const LoopMetrics& metrics() const { return metrics_; }
+    // 本loop的延迟直方图，只能由loop线程记录，其他线程拷贝一份作为快照
+    LoopHistograms& histograms() { return histograms_; }
+    const LoopHistograms& histograms() const { return histograms_; }
+    // 本loop的追踪缓冲区，LoopTrace::enable()以后才开始记录
+    LoopTrace& trace() { return trace_; }
+    // 本loop的协程帧内存池，只能在loop线程中分配
+    FramePool& framePool() { return framePool_; }
+
+    // 当前线程的EventLoop，没有时返回nullptr
+    static EventLoop* loopOfCurrentThread();
+
 private:
     void handleRead();        //wake up
     void doPendingFunctors(); // 执行回调
 
     using ChannelList = std::vector<Channel *>;
 
+    // 入队时刻用来统计queueDelay
+    struct PendingFunctor
+    {
+        Functor functor;
+        int64_t queuedNanos;
+    };
+
     std::atomic_bool looping_; // 是否在loop中
     std::atomic_bool quit_;    // 是否退出loop
 
@@ -60,6 +93,7 @@ private:
 
     Timestamp pollReturnTime_; // poller返回发生事件的时间点
     std::unique_ptr<Poller> poller_;
+    std::unique_ptr<TimerQueue> timerQueue_;
 
     int wakeupFd_; // 当mainLoop获取一个新channel时，通过轮询选择一个subloop，并唤醒它处理channel
     std::unique_ptr<Channel> wakeupChannel_;
@@ -67,6 +101,11 @@ private:
     ChannelList activeChannels_;
 
     std::atomic_bool callingPendingFunctors_; // 是否在doPendingFunctor中
-    std::vector<Functor> pendingFunctors_;    // 存储loop需要执行的回调操作
+    std::vector<PendingFunctor> pendingFunctors_; // 存储loop需要执行的回调操作
     std::mutex mutex_;                        // 互斥锁，保护上面vector线程安全
+
+    LoopMetrics metrics_;
+    LoopHistograms histograms_;
+    LoopTrace trace_;
+    FramePool framePool_;
 };
\ No newline at end of file
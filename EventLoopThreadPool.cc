@@ -19,8 +19,8 @@ void EventLoopThreadPool::start(const ThreadInitCallback &cb)
 
     for(int i = 0; i < numThreads_; ++i)
     {
-        char buf[name_.size() + 32] = {0};
-        snprintf(buf, 32, "%s%d", name_.c_str(), i);
+        char buf[name_.size() + 32];
+        snprintf(buf, sizeof buf, "%s%d", name_.c_str(), i);
         EventLoopThread *t = new EventLoopThread(cb, buf);
         threads_.push_back(std::unique_ptr<EventLoopThread>(t));
         loops_.push_back(t->startLoop());   // 底层创建线程并启动
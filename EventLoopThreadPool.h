@@ -3,6 +3,7 @@
 #include <functional>
 #include <vector>
 #include <memory>
+#include <string>
 
 class EventLoop;
 class EventLoopThread;
@@ -0,0 +1,55 @@
+#include "FramePool.h"
+
+#include <new>
+
+FramePool::FramePool()
+{
+}
+
+FramePool::~FramePool()
+{
+}
+
+void* FramePool::allocate(FramePool *pool, size_t bytes)
+{
+    const size_t total = bytes + kHeaderBytes;
+    BlockPool *blocks = nullptr;
+    void *p = nullptr;
+    if(pool != nullptr && total <= kMaxPooledBytes)
+    {
+        size_t index = (total - 1) / kGranularity;
+        std::shared_ptr<BlockPool> &slot = pool->classes_[index];
+        if(!slot)
+            slot = std::make_shared<BlockPool>();
+        blocks = slot.get();
+        p = blocks->allocate((index + 1) * kGranularity);
+    }
+    if(p == nullptr)
+    {
+        blocks = nullptr;
+        p = ::operator new(total);
+    }
+    *static_cast<BlockPool**>(p) = blocks;
+    return static_cast<char*>(p) + kHeaderBytes;
+}
+
+void FramePool::deallocate(void *p)
+{
+    void *block = static_cast<char*>(p) - kHeaderBytes;
+    BlockPool *blocks = *static_cast<BlockPool**>(block);
+    if(blocks != nullptr)
+        blocks->deallocate(block);
+    else
+        ::operator delete(block);
+}
+
+size_t FramePool::blocksInUse() const
+{
+    size_t n = 0;
+    for(const std::shared_ptr<BlockPool> &blocks : classes_)
+    {
+        if(blocks)
+            n += blocks->blocksInUse();
+    }
+    return n;
+}
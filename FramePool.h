@@ -0,0 +1,37 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "BlockPool.h"
+
+#include <memory>
+#include <stddef.h>
+
+/**
+ * 协程帧的内存池，每个EventLoop一个(EventLoop::framePool())，见Coroutine.h
+ * 协程帧的大小由编译器决定，同一个协程函数每次都一样：按64字节分档，每档一个BlockPool，超过kMaxPooledBytes的退回operator new
+ *
+ * 每块前面有kHeaderBytes字节记录来自哪个BlockPool，deallocate()不需要知道池子，可以在任意线程调用
+ * allocate()只能在所属loop线程中调用；池子随loop析构，所以协程帧必须在loop析构之前释放
+ */
+class FramePool : noncopyable
+{
+public:
+    static const size_t kGranularity = 64;
+    static const size_t kMaxPooledBytes = 4096;
+    static const size_t kHeaderBytes = 16;  // 保持帧按16字节对齐
+
+    FramePool();
+    ~FramePool();
+
+    // pool为nullptr(当前线程没有loop)时用operator new
+    static void* allocate(FramePool *pool, size_t bytes);
+    static void deallocate(void *p);
+
+    // 统计信息，近似值
+    size_t blocksInUse() const;
+
+private:
+    static const size_t kClasses = kMaxPooledBytes / kGranularity;
+
+    std::shared_ptr<BlockPool> classes_[kClasses];  // 第i档块大小为(i+1)*kGranularity，第一次用到时创建
+};
@@ -0,0 +1,112 @@
+#include "Histogram.h"
+
+#include <math.h>
+#include <stdio.h>
+
+Histogram::Histogram()
+{
+    reset();
+}
+
+Histogram::Histogram(const Histogram &rhs)
+{
+    *this = rhs;
+}
+
+Histogram& Histogram::operator=(const Histogram &rhs)
+{
+    if(this != &rhs)
+    {
+        for(int i = 0; i < kBucketCount; ++i)
+            counts_[i].store(rhs.counts_[i].load(std::memory_order_relaxed), std::memory_order_relaxed);
+        count_.store(rhs.count_.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        sum_.store(rhs.sum_.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        min_.store(rhs.min_.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        max_.store(rhs.max_.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    }
+    return *this;
+}
+
+Histogram& Histogram::operator+=(const Histogram &rhs)
+{
+    for(int i = 0; i < kBucketCount; ++i)
+        increment(counts_[i], rhs.counts_[i].load(std::memory_order_relaxed));
+    increment(count_, rhs.count_.load(std::memory_order_relaxed));
+    increment(sum_, rhs.sum_.load(std::memory_order_relaxed));
+    if(rhs.min_.load(std::memory_order_relaxed) < min_.load(std::memory_order_relaxed))
+        min_.store(rhs.min_.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    if(rhs.max_.load(std::memory_order_relaxed) > max_.load(std::memory_order_relaxed))
+        max_.store(rhs.max_.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    return *this;
+}
+
+void Histogram::reset()
+{
+    for(int i = 0; i < kBucketCount; ++i)
+        counts_[i].store(0, std::memory_order_relaxed);
+    count_.store(0, std::memory_order_relaxed);
+    sum_.store(0, std::memory_order_relaxed);
+    min_.store(UINT64_MAX, std::memory_order_relaxed);
+    max_.store(0, std::memory_order_relaxed);
+}
+
+uint64_t Histogram::bucketUpperBound(int index)
+{
+    if(index < kSubBucketCount)
+        return static_cast<uint64_t>(index);
+    int shift = index / kSubBucketHalf - 1;
+    uint64_t lower = static_cast<uint64_t>(index - shift * kSubBucketHalf) << shift;
+    return lower + ((static_cast<uint64_t>(1) << shift) - 1);
+}
+
+uint64_t Histogram::percentile(double p) const
+{
+    uint64_t total = count();
+    if(total == 0)
+        return 0;
+    uint64_t target = static_cast<uint64_t>(ceil(p / 100.0 * total));
+    if(target < 1)
+        target = 1;
+
+    uint64_t seen = 0;
+    for(int i = 0; i < kBucketCount; ++i)
+    {
+        seen += counts_[i].load(std::memory_order_relaxed);
+        if(seen >= target)
+        {
+            // 桶的上界可能超过实际出现过的最大值
+            uint64_t value = bucketUpperBound(i);
+            return value < max() ? value : max();
+        }
+    }
+    return max();
+}
+
+std::string Histogram::toString(const std::string &prefix) const
+{
+    const char *pre = prefix.c_str();
+    char buf[512] = {0};
+    snprintf(buf, sizeof buf,
+        "%scount=%lu %smean_us=%.1f %sp50_us=%.1f %sp90_us=%.1f %sp99_us=%.1f %sp999_us=%.1f %smax_us=%.1f",
+        pre, (unsigned long)count(), pre, mean() / 1e3,
+        pre, percentile(50) / 1e3, pre, percentile(90) / 1e3, pre, percentile(99) / 1e3,
+        pre, percentile(99.9) / 1e3, pre, max() / 1e3);
+    return buf;
+}
+
+LoopHistograms& LoopHistograms::operator+=(const LoopHistograms &rhs)
+{
+    handleEvent += rhs.handleEvent;
+    messageCallback += rhs.messageCallback;
+    queueDelay += rhs.queueDelay;
+    pollOversleep += rhs.pollOversleep;
+    return *this;
+}
+
+std::string LoopHistograms::toString() const
+{
+    return handleEvent.toString("handle_event_") + " "
+        + messageCallback.toString("message_callback_") + " "
+        + queueDelay.toString("queue_delay_") + " "
+        + pollOversleep.toString("poll_oversleep_");
+}
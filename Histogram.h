@@ -0,0 +1,85 @@
+#pragma once
+
+#include <atomic>
+#include <string>
+#include <stdint.h>
+
+/**
+ * HDR风格的对数-线性直方图
+ * 小于32的值各占一个桶，之后每个2的幂区间[2^e, 2^(e+1))平分成16个线性子桶，相对误差不超过1/16
+ * 覆盖整个uint64范围只需要976个桶，record()只有一次clz、一次移位和一次自增
+ *
+ * 单写者：只由所属loop线程record()，任意线程可以拷贝(拷贝即快照)，拷贝之间可以用+=合并
+ * 本库记录的值统一以纳秒为单位，toString()按微秒输出
+ */
+class Histogram
+{
+public:
+    static const int kSubBucketBits = 4;
+    static const int kSubBucketHalf = 1 << kSubBucketBits;    // 每个区间的子桶数
+    static const int kSubBucketCount = kSubBucketHalf * 2;    // 线性区间[0, 32)
+    static const int kBucketCount = (64 - kSubBucketBits) * kSubBucketHalf + kSubBucketHalf;
+
+    Histogram();
+    Histogram(const Histogram &rhs);
+    Histogram& operator=(const Histogram &rhs);
+
+    void record(int64_t value)
+    {
+        uint64_t v = value > 0 ? static_cast<uint64_t>(value) : 0;
+        increment(counts_[bucketIndex(v)], 1);
+        increment(count_, 1);
+        increment(sum_, v);
+        if(v < min_.load(std::memory_order_relaxed))
+            min_.store(v, std::memory_order_relaxed);
+        if(v > max_.load(std::memory_order_relaxed))
+            max_.store(v, std::memory_order_relaxed);
+    }
+
+    // 合并另一个直方图，用于汇总多个loop
+    Histogram& operator+=(const Histogram &rhs);
+    void reset();
+
+    uint64_t count() const {return count_.load(std::memory_order_relaxed);}
+    uint64_t min() const {return count() ? min_.load(std::memory_order_relaxed) : 0;}
+    uint64_t max() const {return max_.load(std::memory_order_relaxed);}
+    double mean() const {return count() ? static_cast<double>(sum_.load(std::memory_order_relaxed)) / count() : 0;}
+    // p取值[0, 100]，返回落在该分位的桶的上界
+    uint64_t percentile(double p) const;
+
+    // count=... mean_us=... p50_us=... p90_us=... p99_us=... p999_us=... max_us=...
+    // prefix加在每个key前面，例如"queue_delay_"
+    std::string toString(const std::string &prefix = std::string()) const;
+
+    static int bucketIndex(uint64_t v)
+    {
+        if(v < static_cast<uint64_t>(kSubBucketCount))
+            return static_cast<int>(v);
+        int shift = 63 - __builtin_clzll(v) - kSubBucketBits;
+        return shift * kSubBucketHalf + static_cast<int>(v >> shift);
+    }
+    static uint64_t bucketUpperBound(int index);
+
+private:
+    // 单写者，relaxed的load+store即可，不需要fetch_add
+    static void increment(std::atomic<uint64_t> &counter, uint64_t n)
+    {counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);}
+
+    std::atomic<uint64_t> counts_[kBucketCount];
+    std::atomic<uint64_t> count_;
+    std::atomic<uint64_t> sum_;
+    std::atomic<uint64_t> min_;
+    std::atomic<uint64_t> max_;
+};
+
+// 每个loop一组的延迟直方图，均以纳秒记录
+struct LoopHistograms
+{
+    Histogram handleEvent;       // 单次Channel::handleEvent耗时
+    Histogram messageCallback;   // 单次MessageCallback耗时
+    Histogram queueDelay;        // queueLoop入队到开始执行的时间
+    Histogram pollOversleep;     // epoll_wait超时返回时比预期多睡的时间
+
+    LoopHistograms& operator+=(const LoopHistograms &rhs);
+    std::string toString() const;
+};
@@ -0,0 +1,441 @@
+#include "HotRestart.h"
+#include "Channel.h"
+#include "EventLoop.h"
+#include "InetAddress.h"
+#include "Logger.h"
+#include "TcpServer.h"
+#include "UdpServer.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace
+{
+const char kHello[] = "HELLO\n";
+const char kReady[] = "READY\n";
+const char kEnd[] = "END\n";
+const size_t kMaxPayload = 8192;
+
+bool makeUnixAddr(const std::string &path, sockaddr_un *addr)
+{
+    memset(addr, 0, sizeof *addr);
+    addr->sun_family = AF_UNIX;
+    if(path.size() >= sizeof addr->sun_path)
+    {
+        LOG_ERROR("HotRestart control path too long: %s\n", path.c_str());
+        return false;
+    }
+    memcpy(addr->sun_path, path.data(), path.size());
+    return true;
+}
+
+bool writeAll(int fd, const char *data, size_t len)
+{
+    while(len > 0)
+    {
+        ssize_t n = ::write(fd, data, len);
+        if(n < 0 && errno == EINTR)
+            continue;
+        if(n <= 0)
+            return false;
+        data += n;
+        len -= n;
+    }
+    return true;
+}
+}
+
+HotRestart::HotRestart(EventLoop *loop, const std::string &controlPath)
+    : loop_(loop)
+    , controlPath_(controlPath)
+    , controlFd_(-1)
+    , inheritedAny_(false)
+    , listenFd_(-1)
+    , peerFd_(-1)
+{
+}
+
+HotRestart::~HotRestart()
+{
+    closePeer();
+    stopControl();
+    if(controlFd_ >= 0)
+        ::close(controlFd_);
+    for(auto &item : inheritedFds_)
+    {
+        for(int fd : item.second)
+            ::close(fd);
+    }
+}
+
+bool HotRestart::inherit(double timeoutSeconds)
+{
+    sockaddr_un addr;
+    if(!makeUnixAddr(controlPath_, &addr))
+        return false;
+    int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if(fd < 0)
+    {
+        LOG_ERROR("HotRestart::inherit socket error:%d\n", errno);
+        return false;
+    }
+    if(::connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof addr) < 0)
+    {
+        // 没有旧进程在运行，正常冷启动
+        if(errno != ENOENT && errno != ECONNREFUSED)
+            LOG_ERROR("HotRestart::inherit connect %s error:%d\n", controlPath_.c_str(), errno);
+        ::close(fd);
+        return false;
+    }
+    timeval tv;
+    tv.tv_sec = static_cast<time_t>(timeoutSeconds);
+    tv.tv_usec = static_cast<suseconds_t>((timeoutSeconds - tv.tv_sec) * 1000000);
+    ::setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof tv);
+    ::setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof tv);
+
+    if(!writeAll(fd, kHello, sizeof kHello - 1))
+    {
+        LOG_ERROR("HotRestart::inherit send HELLO error:%d\n", errno);
+        ::close(fd);
+        return false;
+    }
+
+    // fd只随第一段数据到达，一次recvmsg取出全部fd，剩下的文本(如果有)继续读到END为止
+    std::string payload;
+    std::vector<int> fds;
+    char buf[kMaxPayload];
+    union
+    {
+        cmsghdr align;
+        char control[CMSG_SPACE(sizeof(int) * kMaxFds)];
+    } control;
+    while(payload.size() < kMaxPayload)
+    {
+        iovec iov;
+        iov.iov_base = buf;
+        iov.iov_len = sizeof buf;
+        msghdr msg;
+        memset(&msg, 0, sizeof msg);
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control.control;
+        msg.msg_controllen = sizeof control.control;
+        ssize_t n = ::recvmsg(fd, &msg, MSG_CMSG_CLOEXEC);
+        if(n < 0 && errno == EINTR)
+            continue;
+        if(n <= 0)
+            break;
+        for(cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg != nullptr; cmsg = CMSG_NXTHDR(&msg, cmsg))
+        {
+            if(cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS)
+            {
+                size_t count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+                const int *received = reinterpret_cast<const int*>(CMSG_DATA(cmsg));
+                fds.insert(fds.end(), received, received + count);
+            }
+        }
+        if(msg.msg_flags & MSG_CTRUNC)
+            LOG_ERROR("HotRestart::inherit control message truncated\n");
+        payload.append(buf, n);
+        if(payload.size() >= sizeof kEnd - 1
+            && payload.compare(payload.size() - (sizeof kEnd - 1), sizeof kEnd - 1, kEnd) == 0)
+            break;
+    }
+
+    // 每行"name count"，顺序与fd顺序一致，最后一行END
+    size_t used = 0;
+    bool ok = payload.size() >= sizeof kEnd - 1
+        && payload.compare(payload.size() - (sizeof kEnd - 1), sizeof kEnd - 1, kEnd) == 0;
+    size_t pos = 0;
+    while(ok)
+    {
+        size_t eol = payload.find('\n', pos);
+        std::string line = payload.substr(pos, eol - pos);
+        pos = eol + 1;
+        if(line == "END")
+            break;
+        size_t space = line.rfind(' ');
+        if(space == std::string::npos)
+        {
+            ok = false;
+            break;
+        }
+        std::string name = line.substr(0, space);
+        size_t count = strtoul(line.c_str() + space + 1, nullptr, 10);
+        if(used + count > fds.size())
+        {
+            ok = false;
+            break;
+        }
+        std::vector<int> &target = inheritedFds_[name];
+        target.insert(target.end(), fds.begin() + used, fds.begin() + used + count);
+        used += count;
+    }
+    if(!ok || used != fds.size())
+    {
+        LOG_ERROR("HotRestart::inherit bad reply from %s (%zu bytes, %zu fds)\n",
+            controlPath_.c_str(), payload.size(), fds.size());
+        for(int received : fds)
+            ::close(received);
+        inheritedFds_.clear();
+        ::close(fd);
+        return false;
+    }
+
+    LOG_INFO("HotRestart inherited %zu fds from %s\n", fds.size(), controlPath_.c_str());
+    controlFd_ = fd;
+    inheritedAny_ = true;
+    return true;
+}
+
+int HotRestart::takeFd(const std::string &name)
+{
+    auto it = inheritedFds_.find(name);
+    if(it == inheritedFds_.end() || it->second.empty())
+        return -1;
+    int fd = it->second.front();
+    it->second.erase(it->second.begin());
+    if(it->second.empty())
+        inheritedFds_.erase(it);
+    return fd;
+}
+
+std::vector<int> HotRestart::takeFds(const std::string &name)
+{
+    std::vector<int> fds;
+    auto it = inheritedFds_.find(name);
+    if(it != inheritedFds_.end())
+    {
+        fds.swap(it->second);
+        inheritedFds_.erase(it);
+    }
+    return fds;
+}
+
+void HotRestart::addFd(const std::string &name, int fd)
+{
+    entries_.push_back(Entry{name, [fd]() {return std::vector<int>(1, fd);}, nullptr});
+}
+
+void HotRestart::addServer(TcpServer *server)
+{
+    entries_.push_back(Entry{server->name(),
+        [server]() {return std::vector<int>(1, server->listenFd());},
+        [server]() {server->handOffListener();}});
+}
+
+void HotRestart::addUdpServer(UdpServer *server)
+{
+    entries_.push_back(Entry{server->name(), [server]() {return server->socketFds();}, nullptr});
+}
+
+void HotRestart::start()
+{
+    for(auto &item : inheritedFds_)
+    {
+        LOG_ERROR("HotRestart: %zu inherited fds named %s not taken, closing\n", item.second.size(), item.first.c_str());
+        for(int fd : item.second)
+            ::close(fd);
+    }
+    inheritedFds_.clear();
+
+    // 先绑定新的控制socket再发送READY，任何时刻控制路径上都有进程在监听
+    listenControl();
+    if(controlFd_ >= 0)
+    {
+        if(!writeAll(controlFd_, kReady, sizeof kReady - 1))
+            LOG_ERROR("HotRestart send READY error:%d\n", errno);
+        ::close(controlFd_);
+        controlFd_ = -1;
+    }
+}
+
+void HotRestart::listenControl()
+{
+    sockaddr_un addr;
+    if(!makeUnixAddr(controlPath_, &addr))
+        return;
+    listenFd_ = ::socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if(listenFd_ < 0)
+    {
+        LOG_ERROR("HotRestart control socket error:%d\n", errno);
+        return;
+    }
+    // 旧进程的控制socket文件在这里被替换，旧进程仍然持有已经accept的连接，不受影响
+    ::unlink(controlPath_.c_str());
+    if(::bind(listenFd_, reinterpret_cast<sockaddr*>(&addr), sizeof addr) < 0 || ::listen(listenFd_, 4) < 0)
+    {
+        LOG_ERROR("HotRestart bind control socket %s error:%d\n", controlPath_.c_str(), errno);
+        ::close(listenFd_);
+        listenFd_ = -1;
+        return;
+    }
+    listenChannel_.reset(new Channel(loop_, listenFd_));
+    listenChannel_->setReadCallback(std::bind(&HotRestart::handleAccept, this));
+    listenChannel_->enableReading();
+}
+
+void HotRestart::stopControl()
+{
+    if(listenChannel_)
+    {
+        listenChannel_->disableAll();
+        listenChannel_->remove();
+        // 和closePeer()一样：READY在handlePeerRead中处理，同一批就绪事件里可能还有监听socket，延后析构
+        std::shared_ptr<Channel> channel(listenChannel_.release());
+        loop_->queueLoop([channel]() {});
+    }
+    if(listenFd_ >= 0)
+    {
+        // 控制路径此时属于新进程，不删除
+        ::close(listenFd_);
+        listenFd_ = -1;
+    }
+}
+
+void HotRestart::handleAccept()
+{
+    int fd = ::accept4(listenFd_, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if(fd < 0)
+        return;
+    if(peerFd_ >= 0)
+    {
+        LOG_ERROR("HotRestart: another restart already in progress, rejecting\n");
+        ::close(fd);
+        return;
+    }
+    peerFd_ = fd;
+    peerBuffer_.clear();
+    peerChannel_.reset(new Channel(loop_, peerFd_));
+    peerChannel_->setReadCallback(std::bind(&HotRestart::handlePeerRead, this));
+    peerChannel_->enableReading();
+}
+
+void HotRestart::handlePeerRead()
+{
+    char buf[256];
+    ssize_t n = ::read(peerFd_, buf, sizeof buf);
+    if(n < 0 && (errno == EAGAIN || errno == EINTR))
+        return;
+    if(n <= 0)
+    {
+        // 新进程在READY之前退出，本进程继续服务
+        LOG_ERROR("HotRestart: new process went away before READY\n");
+        closePeer();
+        return;
+    }
+    peerBuffer_.append(buf, n);
+
+    size_t eol;
+    while((eol = peerBuffer_.find('\n')) != std::string::npos)
+    {
+        std::string line = peerBuffer_.substr(0, eol);
+        peerBuffer_.erase(0, eol + 1);
+        if(line == "HELLO")
+        {
+            if(!sendFds())
+            {
+                closePeer();
+                return;
+            }
+        }
+        else if(line == "READY")
+        {
+            LOG_INFO("HotRestart: new process took over %s\n", controlPath_.c_str());
+            closePeer();
+            stopControl();
+            for(Entry &entry : entries_)
+            {
+                if(entry.handOff)
+                    entry.handOff();
+            }
+            if(takeoverCallback_)
+                takeoverCallback_();
+            return;
+        }
+        else
+        {
+            LOG_ERROR("HotRestart: unexpected message %s\n", line.c_str());
+            closePeer();
+            return;
+        }
+    }
+    if(peerBuffer_.size() > kMaxPayload)
+        closePeer();
+}
+
+bool HotRestart::sendFds()
+{
+    std::string payload;
+    std::vector<int> fds;
+    char line[256];
+    for(Entry &entry : entries_)
+    {
+        std::vector<int> entryFds = entry.fds();
+        snprintf(line, sizeof line, "%s %zu\n", entry.name.c_str(), entryFds.size());
+        payload += line;
+        fds.insert(fds.end(), entryFds.begin(), entryFds.end());
+    }
+    payload += kEnd;
+    if(fds.size() > static_cast<size_t>(kMaxFds) || payload.size() > kMaxPayload)
+    {
+        LOG_ERROR("HotRestart: too many fds to hand off (%zu)\n", fds.size());
+        return false;
+    }
+
+    iovec iov;
+    iov.iov_base = const_cast<char*>(payload.data());
+    iov.iov_len = payload.size();
+    union
+    {
+        cmsghdr align;
+        char control[CMSG_SPACE(sizeof(int) * kMaxFds)];
+    } control;
+    msghdr msg;
+    memset(&msg, 0, sizeof msg);
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    if(!fds.empty())
+    {
+        msg.msg_control = control.control;
+        msg.msg_controllen = CMSG_SPACE(sizeof(int) * fds.size());
+        cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int) * fds.size());
+        memcpy(CMSG_DATA(cmsg), fds.data(), sizeof(int) * fds.size());
+    }
+    // 负载很小，一次sendmsg就能写进刚建立的连接的发送缓冲区
+    ssize_t n = ::sendmsg(peerFd_, &msg, MSG_NOSIGNAL);
+    if(n != static_cast<ssize_t>(payload.size()))
+    {
+        LOG_ERROR("HotRestart sendmsg error:%d\n", errno);
+        return false;
+    }
+    LOG_INFO("HotRestart: sent %zu fds to new process\n", fds.size());
+    return true;
+}
+
+void HotRestart::closePeer()
+{
+    if(peerChannel_)
+    {
+        peerChannel_->disableAll();
+        peerChannel_->remove();
+        // 可能正处在这个channel的handleEvent调用栈中，延后到本轮事件处理完再析构
+        std::shared_ptr<Channel> channel(peerChannel_.release());
+        loop_->queueLoop([channel]() {});
+    }
+    if(peerFd_ >= 0)
+    {
+        ::close(peerFd_);
+        peerFd_ = -1;
+    }
+    peerBuffer_.clear();
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include "noncopyable.h"
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+class EventLoop;
+class Channel;
+class TcpServer;
+class UdpServer;
+
+/**
+ * 热重启：新进程通过Unix域控制socket从旧进程拿到正在监听的fd，监听socket和SYN队列一直存在，重启期间不会拒绝连接
+ *
+ * 新进程                                         旧进程
+ *   inherit(): connect控制socket，发送HELLO  ->
+ *                                           <-   sendmsg(SCM_RIGHTS)发送所有登记的fd
+ *   takeFd()/takeFds()接管fd，start服务器
+ *   start(): 重新绑定控制socket，发送READY   ->
+ *                                                takeover回调(通常是TcpServer::drain)，关闭控制socket
+ *
+ * fd按名字登记，同一个名字可以有多个fd(比如UdpServer每个loop一个SO_REUSEPORT socket)
+ * 旧进程在READY之前一直正常accept，新进程中途退出时旧进程继续服务，不受影响
+ * 所有接口都在loop线程中调用；inherit()是阻塞的，在loop()之前调用
+ */
+class HotRestart : noncopyable
+{
+public:
+    using TakeoverCallback = std::function<void()>;
+
+    // 一次最多传递的fd数量，受SCM_MAX_FD限制
+    static const int kMaxFds = 253;
+
+    HotRestart(EventLoop *loop, const std::string &controlPath);
+    ~HotRestart();
+
+    // 新进程：从控制socket上的旧进程接收fd，没有旧进程或超时返回false，此时按正常方式创建socket
+    bool inherit(double timeoutSeconds = 5.0);
+    bool inherited() const {return inheritedAny_;}
+    // 取出继承来的fd，没有时返回-1/空，没有被取走的fd在start()时关闭
+    int takeFd(const std::string &name);
+    std::vector<int> takeFds(const std::string &name);
+
+    // 旧进程(也就是每一个进程)：登记可以交给下一个进程的fd，收到HELLO时才取fd，所以服务器可以在start()之后再登记
+    void addFd(const std::string &name, int fd);
+    // 按TcpServer::name()登记监听socket，交接完成后不再删除Unix域socket文件
+    void addServer(TcpServer *server);
+    // 按UdpServer::name()登记每个loop的socket，要在UdpServer::start()之后才有fd
+    void addUdpServer(UdpServer *server);
+    // 新进程发来READY之后调用，通常在这里drain然后退出
+    void setTakeoverCallback(const TakeoverCallback &cb) {takeoverCallback_ = cb;}
+
+    // 通知旧进程(如果有)已经开始服务，然后在控制socket上等待下一个进程
+    void start();
+
+private:
+    struct Entry
+    {
+        std::string name;
+        std::function<std::vector<int>()> fds;
+        std::function<void()> handOff;
+    };
+
+    void listenControl();
+    void stopControl();
+    void handleAccept();
+    void handlePeerRead();
+    void closePeer();
+    bool sendFds();
+
+    EventLoop *loop_;
+    const std::string controlPath_;
+    std::vector<Entry> entries_;
+    TakeoverCallback takeoverCallback_;
+
+    // 新进程一侧
+    int controlFd_;     // inherit()成功后保留到start()，用来发送READY
+    bool inheritedAny_;
+    std::map<std::string, std::vector<int>> inheritedFds_;
+
+    // 旧进程一侧，同一时间只服务一个新进程
+    int listenFd_;
+    std::unique_ptr<Channel> listenChannel_;
+    int peerFd_;
+    std::unique_ptr<Channel> peerChannel_;
+    std::string peerBuffer_;
+};
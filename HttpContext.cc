@@ -0,0 +1,289 @@
+#include "HttpContext.h"
+
+#include <algorithm>
+#include <ctype.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+HttpContext::HttpContext()
+    : maxBodySize_(kDefaultMaxBodySize)
+    , headerScratch_(256)
+{
+    reset();
+}
+
+void HttpContext::reset()
+{
+    state_ = kExpectRequestLine;
+    pos_ = 0;
+    method_ = HttpRequest::kInvalid;
+    version_ = HttpRequest::kUnknown;
+    path_.off = path_.len = 0;
+    query_.off = query_.len = 0;
+    headers_.clear();
+    chunked_ = false;
+    hasTransferEncoding_ = false;
+    hasContentLength_ = false;
+    contentLength_ = 0;
+    chunkRemain_ = 0;
+    bodyStart_ = 0;
+    bodyLen_ = 0;
+}
+
+static HttpRequest::Method parseMethod(const StringPiece &m)
+{
+    if(m == "GET") return HttpRequest::kGet;
+    if(m == "POST") return HttpRequest::kPost;
+    if(m == "HEAD") return HttpRequest::kHead;
+    if(m == "PUT") return HttpRequest::kPut;
+    if(m == "DELETE") return HttpRequest::kDelete;
+    if(m == "OPTIONS") return HttpRequest::kOptions;
+    if(m == "PATCH") return HttpRequest::kPatch;
+    return HttpRequest::kInvalid;
+}
+
+// GET /index.html?a=1 HTTP/1.1
+bool HttpContext::processRequestLine(const char *base, const char *begin, const char *end)
+{
+    const char *space = std::find(begin, end, ' ');
+    if(space == end)
+        return false;
+    method_ = parseMethod(StringPiece(begin, space - begin));
+    if(method_ == HttpRequest::kInvalid)
+        return false;
+
+    begin = space + 1;
+    space = std::find(begin, end, ' ');
+    if(space == end || space == begin)
+        return false;
+    const char *question = std::find(begin, space, '?');
+    path_.off = begin - base;
+    path_.len = question - begin;
+    if(question != space)
+    {
+        query_.off = question + 1 - base;
+        query_.len = space - question - 1;
+    }
+
+    StringPiece version(space + 1, end - space - 1);
+    if(version == "HTTP/1.1")
+        version_ = HttpRequest::kHttp11;
+    else if(version == "HTTP/1.0")
+        version_ = HttpRequest::kHttp10;
+    else
+        return false;
+    return true;
+}
+
+// Host: 127.0.0.1:8000
+bool HttpContext::processHeader(const char *base, const char *begin, const char *end)
+{
+    const char *colon = std::find(begin, end, ':');
+    if(colon == end || colon == begin)
+        return false;
+
+    const char *value = colon + 1;
+    while(value < end && (*value == ' ' || *value == '\t'))
+        ++value;
+    const char *valueEnd = end;
+    while(valueEnd > value && (valueEnd[-1] == ' ' || valueEnd[-1] == '\t'))
+        --valueEnd;
+
+    StringPiece field(begin, colon - begin);
+    StringPiece fieldValue(value, valueEnd - value);
+    if(field.equalsIgnoreCase("Content-Length"))
+    {
+        // 只接受1*DIGIT：strtoull会接受"+5"、"-1"这样的写法
+        if(fieldValue.empty())
+            return false;
+        size_t n = 0;
+        for(const char *p = fieldValue.data(); p < fieldValue.end(); ++p)
+        {
+            if(*p < '0' || *p > '9')
+                return false;
+            size_t digit = static_cast<size_t>(*p - '0');
+            if(n > (SIZE_MAX - digit) / 10)
+                return false;
+            n = n * 10 + digit;
+        }
+        // 重复的Content-Length取值不同时无法确定请求体长度，是请求走私的常见手法
+        if(hasContentLength_ && n != contentLength_)
+            return false;
+        contentLength_ = n;
+        hasContentLength_ = true;
+    }
+    else if(field.equalsIgnoreCase("Transfer-Encoding"))
+    {
+        // gzip, chunked：只看最后一个编码，chunked必须是最后一个
+        const char *last = fieldValue.data();
+        for(const char *p = fieldValue.data(); p < fieldValue.end(); ++p)
+        {
+            if(*p == ',')
+                last = p + 1;
+        }
+        while(last < fieldValue.end() && (*last == ' ' || *last == '\t'))
+            ++last;
+        chunked_ = StringPiece(last, fieldValue.end() - last).equalsIgnoreCase("chunked");
+        hasTransferEncoding_ = true;
+    }
+
+    Span f = {static_cast<size_t>(begin - base), field.size()};
+    Span v = {static_cast<size_t>(value - base), fieldValue.size()};
+    headers_.push_back(std::make_pair(f, v));
+    return true;
+}
+
+HttpContext::ParseResult HttpContext::parse(Buffer *buf, Timestamp receiveTime)
+{
+    const char *base = buf->peek();
+    const size_t readable = buf->readableBytes();
+
+    for(;;)
+    {
+        switch(state_)
+        {
+        case kExpectRequestLine:
+        case kExpectHeaders:
+        {
+            const char *crlf = buf->findCRLF(base + pos_);
+            if(crlf == nullptr)
+                return readable > kMaxHeaderSize ? kHeaderTooLarge : kNeedMore;
+            if(static_cast<size_t>(crlf - base) > kMaxHeaderSize)
+                return kHeaderTooLarge;
+
+            const char *begin = base + pos_;
+            pos_ = crlf + 2 - base;
+            if(state_ == kExpectRequestLine)
+            {
+                // 容忍请求之间多余的空行
+                if(crlf == begin)
+                    continue;
+                if(!processRequestLine(base, begin, crlf))
+                    return kBadRequest;
+                receiveTime_ = receiveTime;
+                state_ = kExpectHeaders;
+            }
+            else if(crlf == begin) // 空行，头部结束
+            {
+                bodyStart_ = pos_;
+                // 同时带Content-Length和Transfer-Encoding可能被用来做请求走私；
+                // 最后一个编码不是chunked时无法确定请求体长度，都直接拒绝
+                if(hasTransferEncoding_ && (hasContentLength_ || !chunked_))
+                    return kBadRequest;
+                if(chunked_)
+                    state_ = kExpectChunkSize;
+                else if(contentLength_ > 0)
+                {
+                    if(contentLength_ > maxBodySize_)
+                        return kBodyTooLarge;
+                    state_ = kExpectBody;
+                }
+                else
+                    state_ = kGotAll;
+            }
+            else if(!processHeader(base, begin, crlf))
+                return kBadRequest;
+            break;
+        }
+        case kExpectBody:
+        {
+            if(readable - pos_ < contentLength_)
+                return kNeedMore;
+            bodyLen_ = contentLength_;
+            pos_ += contentLength_;
+            state_ = kGotAll;
+            break;
+        }
+        case kExpectChunkSize:
+        {
+            // 1a;ext=val\r\n
+            const char *crlf = buf->findCRLF(base + pos_);
+            if(crlf == nullptr)
+                return readable - pos_ > 1024 ? kBadRequest : kNeedMore;
+            char *numEnd = nullptr;
+            std::string line(base + pos_, crlf);
+            unsigned long long size = strtoull(line.c_str(), &numEnd, 16);
+            if(!isxdigit(static_cast<unsigned char>(line[0])) || (*numEnd != '\0' && *numEnd != ';' && *numEnd != ' '))
+                return kBadRequest;
+            pos_ = crlf + 2 - base;
+            if(size == 0)
+                state_ = kExpectTrailers;
+            else
+            {
+                // 写成减法，chunk-size接近2^64时加法会回绕
+                if(size > maxBodySize_ - bodyLen_)
+                    return kBodyTooLarge;
+                chunkRemain_ = static_cast<size_t>(size);
+                state_ = kExpectChunkData;
+            }
+            break;
+        }
+        case kExpectChunkData:
+        {
+            size_t take = std::min(readable - pos_, chunkRemain_);
+            if(take == 0)
+                return kNeedMore;
+            // 把分块数据前移，覆盖掉分块头，和之前的分块拼在一起
+            char *data = buf->beginRead();
+            if(bodyStart_ + bodyLen_ != pos_)
+                memmove(data + bodyStart_ + bodyLen_, data + pos_, take);
+            bodyLen_ += take;
+            pos_ += take;
+            chunkRemain_ -= take;
+            if(chunkRemain_ == 0)
+                state_ = kExpectChunkDataEnd;
+            break;
+        }
+        case kExpectChunkDataEnd:
+        {
+            if(readable - pos_ < 2)
+                return kNeedMore;
+            if(base[pos_] != '\r' || base[pos_ + 1] != '\n')
+                return kBadRequest;
+            pos_ += 2;
+            state_ = kExpectChunkSize;
+            break;
+        }
+        case kExpectTrailers:
+        {
+            // trailer字段直接忽略，遇到空行结束
+            const char *crlf = buf->findCRLF(base + pos_);
+            if(crlf == nullptr)
+                return readable - pos_ > kMaxHeaderSize ? kHeaderTooLarge : kNeedMore;
+            if(crlf == base + pos_)
+                state_ = kGotAll;
+            pos_ = crlf + 2 - base;
+            break;
+        }
+        case kGotAll:
+            fillRequest(base);
+            return kGotRequest;
+        }
+    }
+}
+
+// 请求已经完整，Buffer在finishRequest()之前不会再变化，此时换算成指针是安全的
+void HttpContext::fillRequest(const char *base)
+{
+    request_.method_ = method_;
+    request_.version_ = version_;
+    request_.path_.set(base + path_.off, path_.len);
+    request_.query_.set(base + query_.off, query_.len);
+    request_.body_.set(base + bodyStart_, bodyLen_);
+    request_.chunked_ = chunked_;
+    request_.receiveTime_ = receiveTime_;
+    request_.headers_.clear();
+    for(const std::pair<Span, Span> &header : headers_)
+    {
+        request_.headers_.push_back(std::make_pair(
+            StringPiece(base + header.first.off, header.first.len),
+            StringPiece(base + header.second.off, header.second.len)));
+    }
+}
+
+void HttpContext::finishRequest(Buffer *buf)
+{
+    buf->retrieve(pos_);
+    reset();
+}
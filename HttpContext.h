@@ -0,0 +1,83 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "HttpRequest.h"
+#include "Buffer.h"
+#include "Timestamp.h"
+
+#include <vector>
+#include <utility>
+
+/**
+ * 每个连接一个HttpContext，在inputBuffer_上增量解析HTTP/1.1请求
+ * 1.不拷贝：解析过程中只记录相对buf->peek()的偏移量，请求完整以后再换算成StringPiece
+ *   (解析途中Buffer可能扩容搬移数据，所以不能提前保存指针)
+ * 2.增量：pos_记录已经解析到的位置，新数据到来时从pos_继续，不重复扫描
+ * 3.流水线：一个请求处理完调用finishRequest()，buf中剩余的数据就是下一个请求
+ * 4.chunked：分块数据在buf中原地前移，拼成一段连续的body
+ */
+class HttpContext : noncopyable
+{
+public:
+    enum ParseResult{kNeedMore, kGotRequest, kBadRequest, kHeaderTooLarge, kBodyTooLarge};
+
+    static const size_t kMaxHeaderSize = 8 * 1024;
+    static const size_t kDefaultMaxBodySize = 8 * 1024 * 1024;
+
+    HttpContext();
+
+    ParseResult parse(Buffer *buf, Timestamp receiveTime);
+    // kGotRequest以后有效，直到finishRequest()
+    const HttpRequest& request() const {return request_;}
+    // 从buf中取走当前请求占用的数据，准备解析下一个请求
+    void finishRequest(Buffer *buf);
+
+    void setMaxBodySize(size_t maxBodySize) {maxBodySize_ = maxBodySize;}
+    // 给HttpResponse复用的头部临时缓冲区
+    Buffer* headerScratch() {return &headerScratch_;}
+
+private:
+    enum ParseState
+    {
+        kExpectRequestLine,
+        kExpectHeaders,
+        kExpectBody,
+        kExpectChunkSize,
+        kExpectChunkData,
+        kExpectChunkDataEnd,
+        kExpectTrailers,
+        kGotAll,
+    };
+    // 相对于buf->peek()的偏移量
+    struct Span
+    {
+        size_t off;
+        size_t len;
+    };
+
+    bool processRequestLine(const char *base, const char *begin, const char *end);
+    bool processHeader(const char *base, const char *begin, const char *end);
+    void fillRequest(const char *base);
+    void reset();
+
+    ParseState state_;
+    size_t pos_;
+    size_t maxBodySize_;
+
+    HttpRequest::Method method_;
+    HttpRequest::Version version_;
+    Span path_;
+    Span query_;
+    std::vector<std::pair<Span, Span>> headers_;
+    bool chunked_;
+    bool hasTransferEncoding_;
+    bool hasContentLength_;
+    size_t contentLength_;
+    size_t chunkRemain_;
+    size_t bodyStart_;
+    size_t bodyLen_;
+    Timestamp receiveTime_;
+
+    HttpRequest request_;
+    Buffer headerScratch_;
+};
@@ -0,0 +1,82 @@
+#pragma once
+
+#include "StringPiece.h"
+#include "Timestamp.h"
+
+#include <vector>
+#include <utility>
+
+/**
+ * 解析完成的HTTP请求
+ * 所有StringPiece都直接指向连接的inputBuffer_，不拷贝请求行和头部
+ * 只在HttpServer的回调期间有效，需要保留的数据请自行as_string()
+ */
+class HttpRequest
+{
+public:
+    enum Method{kInvalid, kGet, kPost, kHead, kPut, kDelete, kOptions, kPatch};
+    enum Version{kUnknown, kHttp10, kHttp11};
+    using Header = std::pair<StringPiece, StringPiece>;
+
+    HttpRequest()
+        : method_(kInvalid)
+        , version_(kUnknown)
+        , chunked_(false)
+    {}
+
+    Method method() const {return method_;}
+    const char* methodString() const
+    {
+        switch(method_)
+        {
+        case kGet: return "GET";
+        case kPost: return "POST";
+        case kHead: return "HEAD";
+        case kPut: return "PUT";
+        case kDelete: return "DELETE";
+        case kOptions: return "OPTIONS";
+        case kPatch: return "PATCH";
+        default: return "UNKNOWN";
+        }
+    }
+    Version version() const {return version_;}
+    const StringPiece& path() const {return path_;}
+    const StringPiece& query() const {return query_;}
+    const StringPiece& body() const {return body_;}
+    // body是否以chunked编码传输，body()已经是去掉分块头以后的连续数据
+    bool chunked() const {return chunked_;}
+    Timestamp receiveTime() const {return receiveTime_;}
+    const std::vector<Header>& headers() const {return headers_;}
+
+    // 字段名大小写不敏感，没有该字段时返回空视图
+    StringPiece getHeader(const StringPiece &field) const
+    {
+        for(const Header &header : headers_)
+        {
+            if(header.first.equalsIgnoreCase(field))
+                return header.second;
+        }
+        return StringPiece();
+    }
+
+    // HTTP/1.1默认长连接，HTTP/1.0默认短连接，Connection头部可以改变默认行为
+    bool keepAlive() const
+    {
+        StringPiece connection = getHeader("Connection");
+        if(version_ == kHttp11)
+            return !connection.equalsIgnoreCase("close");
+        return connection.equalsIgnoreCase("keep-alive");
+    }
+
+private:
+    friend class HttpContext;
+
+    Method method_;
+    Version version_;
+    StringPiece path_;
+    StringPiece query_;
+    StringPiece body_;
+    bool chunked_;
+    Timestamp receiveTime_;
+    std::vector<Header> headers_; // clear()保留容量，长连接上解析后续请求不再分配内存
+};
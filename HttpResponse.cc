@@ -0,0 +1,59 @@
+#include "HttpResponse.h"
+#include "Buffer.h"
+
+#include <stdio.h>
+
+HttpResponse::HttpResponse(Buffer *output, Buffer *headerScratch, bool close)
+    : output_(output)
+    , headers_(headerScratch)
+    , statusCode_(k200Ok)
+    , closeConnection_(close)
+    , headOnly_(false)
+    , finished_(false)
+{
+    headers_->retrieveAll();
+}
+
+void HttpResponse::addHeader(const StringPiece &field, const StringPiece &value)
+{
+    headers_->append(field.data(), field.size());
+    headers_->append(": ", 2);
+    headers_->append(value.data(), value.size());
+    headers_->append("\r\n", 2);
+}
+
+const char* HttpResponse::statusMessage(HttpStatusCode code)
+{
+    switch(code)
+    {
+    case k200Ok: return "OK";
+    case k204NoContent: return "No Content";
+    case k301MovedPermanently: return "Moved Permanently";
+    case k400BadRequest: return "Bad Request";
+    case k404NotFound: return "Not Found";
+    case k413PayloadTooLarge: return "Payload Too Large";
+    case k431HeaderFieldsTooLarge: return "Request Header Fields Too Large";
+    case k500InternalServerError: return "Internal Server Error";
+    default: return "Unknown";
+    }
+}
+
+// 状态行 => Connection => Content-Length => 自定义头部 => 空行 => body
+void HttpResponse::finish()
+{
+    if(finished_)
+        return;
+    finished_ = true;
+
+    char buf[128];
+    int n = snprintf(buf, sizeof buf, "HTTP/1.1 %d %s\r\n%s\r\nContent-Length: %zu\r\n",
+        static_cast<int>(statusCode_), statusMessage(statusCode_),
+        closeConnection_ ? "Connection: close" : "Connection: Keep-Alive",
+        body_.size());
+    output_->append(buf, n);
+    output_->append(headers_->peek(), headers_->readableBytes());
+    headers_->retrieveAll();
+    output_->append("\r\n", 2);
+    if(!headOnly_)
+        output_->append(body_.data(), body_.size());
+}
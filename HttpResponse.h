@@ -0,0 +1,63 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "StringPiece.h"
+
+#include <string>
+
+class Buffer;
+
+/**
+ * HTTP响应，finish()时把状态行、头部和body直接写进连接的outputBuffer_
+ * 自定义头部先追加到HttpContext复用的临时Buffer中，不为每个头部分配string
+ */
+class HttpResponse : noncopyable
+{
+public:
+    enum HttpStatusCode
+    {
+        kUnknown,
+        k200Ok = 200,
+        k204NoContent = 204,
+        k301MovedPermanently = 301,
+        k400BadRequest = 400,
+        k404NotFound = 404,
+        k413PayloadTooLarge = 413,
+        k431HeaderFieldsTooLarge = 431,
+        k500InternalServerError = 500,
+    };
+
+    HttpResponse(Buffer *output, Buffer *headerScratch, bool close);
+
+    void setStatusCode(HttpStatusCode code) {statusCode_ = code;}
+    void setCloseConnection(bool on) {closeConnection_ = on;}
+    bool closeConnection() const {return closeConnection_;}
+
+    void setContentType(const StringPiece &contentType)
+    {addHeader("Content-Type", contentType);}
+    void addHeader(const StringPiece &field, const StringPiece &value);
+
+    // body不拷贝，调用者保证数据在回调返回之前有效
+    void setBody(const StringPiece &body) {body_ = body;}
+    // body拷贝一份由response持有
+    void setBody(std::string &&body) {ownedBody_.swap(body); body_ = ownedBody_;}
+
+    // HEAD请求只发头部
+    void setHeadOnly(bool on) {headOnly_ = on;}
+
+    // 写入outputBuffer_，只能调用一次
+    void finish();
+    bool finished() const {return finished_;}
+
+    static const char* statusMessage(HttpStatusCode code);
+
+private:
+    Buffer *output_;
+    Buffer *headers_;
+    HttpStatusCode statusCode_;
+    bool closeConnection_;
+    bool headOnly_;
+    bool finished_;
+    StringPiece body_;
+    std::string ownedBody_;
+};
@@ -0,0 +1,105 @@
+#include "HttpServer.h"
+#include "HttpContext.h"
+#include "Logger.h"
+
+static void defaultHttpCallback(const HttpRequest&, HttpResponse *resp)
+{
+    resp->setStatusCode(HttpResponse::k404NotFound);
+    resp->setCloseConnection(true);
+}
+
+HttpServer::HttpServer(EventLoop *loop,
+          const InetAddress &listenAddr,
+          const std::string &name,
+          TcpServer::Option option)
+    : loop_(loop)
+    , server_(loop, listenAddr, name, option)
+    , httpCallback_(defaultHttpCallback)
+    , maxBodySize_(HttpContext::kDefaultMaxBodySize)
+{
+    server_.setConnectionCallback(std::bind(&HttpServer::onConnection, this, std::placeholders::_1));
+    server_.setMessageCallback(std::bind(&HttpServer::onMessage, this,
+        std::placeholders::_1, std::placeholders::_2, std::placeholders::_3));
+}
+
+HttpServer::HttpServer(EventLoop *loop,
+          int listenFd,
+          const std::string &name)
+    : loop_(loop)
+    , server_(loop, listenFd, name)
+    , httpCallback_(defaultHttpCallback)
+    , maxBodySize_(HttpContext::kDefaultMaxBodySize)
+{
+    server_.setConnectionCallback(std::bind(&HttpServer::onConnection, this, std::placeholders::_1));
+    server_.setMessageCallback(std::bind(&HttpServer::onMessage, this,
+        std::placeholders::_1, std::placeholders::_2, std::placeholders::_3));
+}
+
+void HttpServer::start()
+{
+    LOG_INFO("HttpServer[%s] starts listening on %s\n",
+        server_.name().c_str(), server_.ipPort().c_str());
+    server_.start();
+}
+
+void HttpServer::onConnection(const TcpConnectionPtr &conn)
+{
+    if(conn->connected())
+    {
+        std::shared_ptr<HttpContext> context(new HttpContext);
+        context->setMaxBodySize(maxBodySize_);
+        conn->setContext(context);
+    }
+}
+
+void HttpServer::onMessage(const TcpConnectionPtr &conn, Buffer *buf, Timestamp receiveTime)
+{
+    // 已经决定关闭的连接，后续数据直接丢弃
+    if(!conn->connected())
+    {
+        buf->retrieveAll();
+        return;
+    }
+
+    HttpContext *context = static_cast<HttpContext*>(conn->getContext().get());
+    Buffer *output = conn->outputBuffer();
+    bool close = false;
+
+    // 流水线：buf中可能有多个完整请求，逐个处理直到数据不够
+    while(!close)
+    {
+        HttpContext::ParseResult result = context->parse(buf, receiveTime);
+        if(result == HttpContext::kNeedMore)
+            break;
+
+        if(result != HttpContext::kGotRequest)
+        {
+            HttpResponse response(output, context->headerScratch(), true);
+            if(result == HttpContext::kHeaderTooLarge)
+                response.setStatusCode(HttpResponse::k431HeaderFieldsTooLarge);
+            else if(result == HttpContext::kBodyTooLarge)
+                response.setStatusCode(HttpResponse::k413PayloadTooLarge);
+            else
+                response.setStatusCode(HttpResponse::k400BadRequest);
+            response.finish();
+            buf->retrieveAll();
+            close = true;
+            break;
+        }
+
+        const HttpRequest &request = context->request();
+        HttpResponse response(output, context->headerScratch(), !request.keepAlive());
+        response.setHeadOnly(request.method() == HttpRequest::kHead);
+        httpCallback_(request, &response);
+        response.finish();
+        close = response.closeConnection();
+        context->finishRequest(buf);
+    }
+
+    conn->flushOutput();
+    if(close)
+    {
+        buf->retrieveAll();
+        conn->shutdown(); // outputBuffer_发完以后再半关闭
+    }
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "TcpServer.h"
+#include "HttpRequest.h"
+#include "HttpResponse.h"
+
+#include <functional>
+#include <string>
+
+/**
+ * 基于TcpServer的HTTP/1.1服务器
+ * 支持长连接和流水线：一次读事件中解析出的所有请求依次回调，响应追加到同一个outputBuffer_，最后一次性发出
+ * 回调在连接所属的subLoop中执行，不能阻塞
+ */
+class HttpServer : noncopyable
+{
+public:
+    using HttpCallback = std::function<void(const HttpRequest&, HttpResponse*)>;
+
+    HttpServer(EventLoop *loop,
+        const InetAddress &listenAddr,
+        const std::string &name,
+        TcpServer::Option option = TcpServer::kNoReusePort);
+    // 接管已经在监听的socket，用于热重启
+    HttpServer(EventLoop *loop,
+        int listenFd,
+        const std::string &name);
+
+    EventLoop* getLoop() const {return loop_;}
+    const TcpServer& tcpServer() const {return server_;}
+    TcpServer& tcpServer() {return server_;}
+
+    // 默认回调对所有请求返回404
+    void setHttpCallback(const HttpCallback &cb) {httpCallback_ = cb;}
+    void setThreadNum(int numThreads) {server_.setThreadNum(numThreads);}
+    void setMaxBodySize(size_t maxBodySize) {maxBodySize_ = maxBodySize;}
+
+    void start();
+
+private:
+    void onConnection(const TcpConnectionPtr &conn);
+    void onMessage(const TcpConnectionPtr &conn, Buffer *buf, Timestamp receiveTime);
+
+    EventLoop *loop_;
+    TcpServer server_;
+    HttpCallback httpCallback_;
+    size_t maxBodySize_;
+};
@@ -1,5 +1,8 @@
 #include "InetAddress.h"
+#include "Logger.h"
+
 #include <string.h>
+#include <stddef.h>
 
 /*
 inet_pton 本地const char* --> 网络uint
@@ -11,32 +14,134 @@ ntohs 网络short --> 本地short
 InetAddress::InetAddress(uint16_t port, string ip)
 {
     bzero(&addr_, sizeof addr_);
-    addr_.sin_family = AF_INET;
-    addr_.sin_port = htons(port);
-    inet_pton(AF_INET, ip.c_str(), &addr_.sin_addr);
+    if(ip.find(':') != string::npos)
+    {
+        sockaddr_in6 *addr6 = reinterpret_cast<sockaddr_in6*>(&addr_);
+        addr6->sin6_family = AF_INET6;
+        addr6->sin6_port = htons(port);
+        inet_pton(AF_INET6, ip.c_str(), &addr6->sin6_addr);
+        len_ = sizeof(sockaddr_in6);
+    }
+    else
+    {
+        sockaddr_in *addr4 = reinterpret_cast<sockaddr_in*>(&addr_);
+        addr4->sin_family = AF_INET;
+        addr4->sin_port = htons(port);
+        inet_pton(AF_INET, ip.c_str(), &addr4->sin_addr);
+        len_ = sizeof(sockaddr_in);
+    }
+}
+
+InetAddress::InetAddress(const sockaddr_in &addr)
+{
+    setSockAddr(reinterpret_cast<const sockaddr*>(&addr), sizeof addr);
+}
+
+InetAddress::InetAddress(const sockaddr_in6 &addr)
+{
+    setSockAddr(reinterpret_cast<const sockaddr*>(&addr), sizeof addr);
+}
+
+InetAddress::InetAddress(const sockaddr *addr, socklen_t len)
+{
+    setSockAddr(addr, len);
+}
+
+void InetAddress::setSockAddr(const sockaddr *addr, socklen_t len)
+{
+    bzero(&addr_, sizeof addr_);
+    len_ = len < sizeof addr_ ? len : sizeof addr_;
+    memcpy(&addr_, addr, len_);
+}
+
+InetAddress InetAddress::fromUnixPath(const string &path)
+{
+    sockaddr_un addr;
+    bzero(&addr, sizeof addr);
+    addr.sun_family = AF_UNIX;
+    // 路径要留一个字节给结尾的'\0'，抽象命名空间不需要；截断会绑定到另一个路径上，直接返回AF_UNSPEC的地址
+    const bool abstract = !path.empty() && path[0] == '@';
+    const size_t maxLen = abstract ? sizeof addr.sun_path : sizeof addr.sun_path - 1;
+    if(path.size() > maxLen)
+    {
+        LOG_ERROR("InetAddress::fromUnixPath path too long (%zu > %zu): %s\n", path.size(), maxLen, path.c_str());
+        return InetAddress(reinterpret_cast<const sockaddr*>(&addr), 0);
+    }
+    size_t n = path.size();
+    memcpy(addr.sun_path, path.data(), n);
+    socklen_t len = offsetof(sockaddr_un, sun_path) + n;
+    // 抽象命名空间：sun_path[0]为'\0'，名字按长度计算，不以'\0'结尾
+    if(abstract)
+        addr.sun_path[0] = '\0';
+    else
+        len += 1;
+    return InetAddress(reinterpret_cast<const sockaddr*>(&addr), len);
+}
+
+InetAddress InetAddress::getLocalAddr(int sockfd)
+{
+    sockaddr_storage addr;
+    socklen_t len = sizeof addr;
+    bzero(&addr, sizeof addr);
+    if(::getsockname(sockfd, reinterpret_cast<sockaddr*>(&addr), &len) < 0)
+        len = 0;
+    return InetAddress(reinterpret_cast<const sockaddr*>(&addr), len);
+}
+
+InetAddress InetAddress::getPeerAddr(int sockfd)
+{
+    sockaddr_storage addr;
+    socklen_t len = sizeof addr;
+    bzero(&addr, sizeof addr);
+    if(::getpeername(sockfd, reinterpret_cast<sockaddr*>(&addr), &len) < 0)
+        len = 0;
+    return InetAddress(reinterpret_cast<const sockaddr*>(&addr), len);
 }
 
 string InetAddress::toIp() const
 {
     char buf[64] = {0};
-    inet_ntop(AF_INET, &addr_.sin_addr, buf, 64);
+    if(family() == AF_INET)
+        inet_ntop(AF_INET, &reinterpret_cast<const sockaddr_in*>(&addr_)->sin_addr, buf, sizeof buf);
+    else if(family() == AF_INET6)
+        inet_ntop(AF_INET6, &reinterpret_cast<const sockaddr_in6*>(&addr_)->sin6_addr, buf, sizeof buf);
+    else if(family() == AF_UNIX)
+    {
+        // 未绑定的Unix域socket(例如客户端)没有路径
+        const sockaddr_un *addr = reinterpret_cast<const sockaddr_un*>(&addr_);
+        size_t offset = offsetof(sockaddr_un, sun_path);
+        if(len_ <= offset)
+            return string();
+        string path(addr->sun_path, len_ - offset);
+        if(path[0] == '\0')
+            path[0] = '@';
+        else
+            path = path.c_str(); // 去掉结尾的'\0'
+        return path;
+    }
     return buf;
 }
 
 string InetAddress::toIpPort() const
 {
-    char buf[64] = {0};
-    inet_ntop(AF_INET, &addr_.sin_addr, buf, 64);
+    if(family() == AF_UNIX)
+        return "unix:" + toIp();
 
-    int end = strlen(buf);
-    uint16_t port = ntohs(addr_.sin_port);
-    sprintf(buf+end,":%u",port);
+    char buf[80] = {0};
+    if(family() == AF_INET6)
+        snprintf(buf, sizeof buf, "[%s]:%u", toIp().c_str(), toPort());
+    else
+        snprintf(buf, sizeof buf, "%s:%u", toIp().c_str(), toPort());
     return buf;
 }
 
 uint16_t InetAddress::toPort() const
 {
-    return ntohs(addr_.sin_port);
+    if(family() == AF_INET)
+        return ntohs(reinterpret_cast<const sockaddr_in*>(&addr_)->sin_port);
+    if(family() == AF_INET6)
+        return ntohs(reinterpret_cast<const sockaddr_in6*>(&addr_)->sin6_port);
+    return 0;
 }
 
 /*
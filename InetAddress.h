@@ -2,28 +2,47 @@
 
 #include <arpa/inet.h>
 #include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 #include <string>
 #include <iostream>
 
 using namespace std;
 
+/**
+ * socket地址，底层是sockaddr_storage，支持IPv4、IPv6和Unix域(包括抽象命名空间)
+ * ip中含有':'时按IPv6解析，Unix域地址通过fromUnixPath构造，路径以'@'开头表示抽象命名空间
+ */
 class InetAddress
 {
     public:
     explicit InetAddress(uint16_t port=0, string ip="127.0.0.1");
-    explicit InetAddress(const sockaddr_in &addr)
-    :addr_(addr){}
+    explicit InetAddress(const sockaddr_in &addr);
+    explicit InetAddress(const sockaddr_in6 &addr);
+    InetAddress(const sockaddr *addr, socklen_t len);
 
-    string toIp() const;
-    string toIpPort() const;
-    uint16_t toPort() const;
+    // 路径超过sun_path的长度时打印错误，返回的地址family为AF_UNSPEC
+    static InetAddress fromUnixPath(const string &path);
+    // 通过fd获取本端/对端地址，失败时返回的地址family为AF_UNSPEC
+    static InetAddress getLocalAddr(int sockfd);
+    static InetAddress getPeerAddr(int sockfd);
 
-    const sockaddr_in* getSockAddr() const
-    {return &addr_;}
-    void setSockAddr(const sockaddr_in &addr)
-     {addr_ = addr;}
+    sa_family_t family() const {return addr_.ss_family;}
+    bool isUnix() const {return family() == AF_UNIX;}
+    bool isIpv6() const {return family() == AF_INET6;}
+
+    string toIp() const;      // Unix域返回路径
+    string toIpPort() const;  // IPv6为[ip]:port，Unix域为unix:path
+    uint16_t toPort() const;  // Unix域返回0
+
+    const sockaddr* getSockAddr() const
+    {return reinterpret_cast<const sockaddr*>(&addr_);}
+    socklen_t length() const
+    {return len_;}
+    void setSockAddr(const sockaddr *addr, socklen_t len);
 
     private:
-    sockaddr_in addr_;
+    sockaddr_storage addr_;
+    socklen_t len_;
     
-};
\ No newline at end of file
+};
@@ -0,0 +1,74 @@
+#include "LengthHeaderCodec.h"
+#include "TcpConnection.h"
+#include "EventLoop.h"
+#include "Buffer.h"
+#include "Logger.h"
+
+static void defaultErrorCallback(const TcpConnectionPtr &conn, int32_t len)
+{
+    LOG_ERROR("LengthHeaderCodec [%s] invalid frame length %d\n", conn->name().c_str(), len);
+    conn->forceClose();
+}
+
+LengthHeaderCodec::LengthHeaderCodec(const FrameCallback &cb, size_t maxFrameSize)
+    : frameCallback_(cb)
+    , errorCallback_(defaultErrorCallback)
+    , maxFrameSize_(maxFrameSize)
+{
+}
+
+// 一次读事件可能带来多帧，全部取完再返回，不完整的尾部留在buf中等下一次
+void LengthHeaderCodec::onMessage(const TcpConnectionPtr &conn, Buffer *buf, Timestamp receiveTime)
+{
+    while(buf->readableBytes() >= kHeaderLen)
+    {
+        const int32_t len = buf->peekInt32();
+        if(len < 0 || static_cast<size_t>(len) > maxFrameSize_)
+        {
+            errorCallback_(conn, len);
+            buf->retrieveAll();
+            break;
+        }
+        if(buf->readableBytes() < kHeaderLen + len)
+        {
+            // 提前为这一帧留好空间，减少大帧在多次读事件中反复扩容；
+            // 预留量有上限，否则只发4字节帧头的连接就能让每个连接分配maxFrameSize_
+            size_t missing = kHeaderLen + len - buf->readableBytes();
+            buf->ensureWriteableBytes(missing < kMaxReserve ? missing : kMaxReserve);
+            break;
+        }
+
+        frameCallback_(conn, StringPiece(buf->peek() + kHeaderLen, len), receiveTime);
+        buf->retrieve(kHeaderLen + len);
+    }
+}
+
+void LengthHeaderCodec::encode(Buffer *buf)
+{
+    buf->prependInt32(static_cast<int32_t>(buf->readableBytes()));
+}
+
+void LengthHeaderCodec::append(Buffer *buf, const StringPiece &frame)
+{
+    buf->appendInt32(static_cast<int32_t>(frame.size()));
+    buf->append(frame.data(), frame.size());
+}
+
+void LengthHeaderCodec::send(const TcpConnectionPtr &conn, const StringPiece &frame) const
+{
+    if(!conn->connected())
+        return;
+
+    if(conn->getLoop()->isInLoopThread())
+    {
+        append(conn->outputBuffer(), frame);
+        conn->flushOutput();
+    }
+    else
+    {
+        Buffer buf(frame.size());
+        buf.append(frame.data(), frame.size());
+        encode(&buf);
+        conn->send(&buf);
+    }
+}
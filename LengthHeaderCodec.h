@@ -0,0 +1,59 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "Callbacks.h"
+#include "StringPiece.h"
+#include "Timestamp.h"
+
+#include <functional>
+#include <stdint.h>
+
+class Buffer;
+
+/**
+ * 长度头分帧编解码
+ * +----------------+------------------+
+ * | len(int32 大端) |   frame(len字节)  |
+ * +----------------+------------------+
+ * 编码：frame先写进Buffer，再把长度头prepend到Buffer的kCheapPrepend区域，不搬移、不扩容
+ * 解码：作为messageCallback，一次读事件中循环取出所有完整的帧
+ *       回调拿到的是指向inputBuffer_的StringPiece，不拷贝，回调返回后失效
+ */
+class LengthHeaderCodec : noncopyable
+{
+public:
+    using FrameCallback = std::function<void(const TcpConnectionPtr&, const StringPiece &frame, Timestamp)>;
+    // 帧长度非法(负数或超过上限)时回调，默认关闭连接
+    using ErrorCallback = std::function<void(const TcpConnectionPtr&, int32_t len)>;
+
+    static const size_t kHeaderLen = sizeof(int32_t);
+    static const size_t kDefaultMaxFrameSize = 64 * 1024 * 1024;
+    // 帧头里的长度来自对端，不可信：不完整的帧最多提前预留这么多，其余随实际收到的数据扩容
+    static const size_t kMaxReserve = 64 * 1024;
+
+    explicit LengthHeaderCodec(const FrameCallback &cb,
+        size_t maxFrameSize = kDefaultMaxFrameSize);
+
+    void setErrorCallback(const ErrorCallback &cb) {errorCallback_ = cb;}
+    size_t maxFrameSize() const {return maxFrameSize_;}
+
+    // 作为TcpConnection的MessageCallback
+    void onMessage(const TcpConnectionPtr &conn, Buffer *buf, Timestamp receiveTime);
+
+    // buf中的全部可读数据作为一帧，在前面填上长度头
+    static void encode(Buffer *buf);
+    // 把一帧追加到buf中
+    static void append(Buffer *buf, const StringPiece &frame);
+
+    /**
+     * 发送一帧
+     * 在loop线程中直接写入outputBuffer_，省掉中间Buffer
+     * 在其他线程中先编码到临时Buffer再转交给loop
+     */
+    void send(const TcpConnectionPtr &conn, const StringPiece &frame) const;
+
+private:
+    FrameCallback frameCallback_;
+    ErrorCallback errorCallback_;
+    const size_t maxFrameSize_;
+};
@@ -0,0 +1,56 @@
+#include "LoopMetrics.h"
+
+#include <algorithm>
+#include <stdio.h>
+
+LoopMetrics::Snapshot& LoopMetrics::Snapshot::operator+=(const Snapshot &rhs)
+{
+    iterations += rhs.iterations;
+    events += rhs.events;
+    pollNanos += rhs.pollNanos;
+    callbackNanos += rhs.callbackNanos;
+    functorNanos += rhs.functorNanos;
+    functorsRun += rhs.functorsRun;
+    lastPendingDepth = std::max(lastPendingDepth, rhs.lastPendingDepth);
+    maxPendingDepth = std::max(maxPendingDepth, rhs.maxPendingDepth);
+    accepts += rhs.accepts;
+    bytesRead += rhs.bytesRead;
+    bytesWritten += rhs.bytesWritten;
+    readEagain += rhs.readEagain;
+    writeEagain += rhs.writeEagain;
+    return *this;
+}
+
+std::string LoopMetrics::Snapshot::toString() const
+{
+    char buf[512] = {0};
+    snprintf(buf, sizeof buf,
+        "iterations=%lu events=%lu events_per_poll=%.2f poll_ms=%.3f callback_ms=%.3f functor_ms=%.3f "
+        "functors=%lu pending_depth=%lu max_pending_depth=%lu accepts=%lu "
+        "bytes_read=%lu bytes_written=%lu read_eagain=%lu write_eagain=%lu",
+        (unsigned long)iterations, (unsigned long)events, eventsPerPoll(),
+        pollNanos / 1e6, callbackNanos / 1e6, functorNanos / 1e6,
+        (unsigned long)functorsRun, (unsigned long)lastPendingDepth, (unsigned long)maxPendingDepth,
+        (unsigned long)accepts, (unsigned long)bytesRead, (unsigned long)bytesWritten,
+        (unsigned long)readEagain, (unsigned long)writeEagain);
+    return buf;
+}
+
+LoopMetrics::Snapshot LoopMetrics::snapshot() const
+{
+    Snapshot s;
+    s.iterations = iterations.get();
+    s.events = events.get();
+    s.pollNanos = pollNanos.get();
+    s.callbackNanos = callbackNanos.get();
+    s.functorNanos = functorNanos.get();
+    s.functorsRun = functorsRun.get();
+    s.lastPendingDepth = lastPendingDepth.get();
+    s.maxPendingDepth = maxPendingDepth.get();
+    s.accepts = accepts.get();
+    s.bytesRead = bytesRead.get();
+    s.bytesWritten = bytesWritten.get();
+    s.readEagain = readEagain.get();
+    s.writeEagain = writeEagain.get();
+    return s;
+}
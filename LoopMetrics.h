@@ -0,0 +1,71 @@
+#pragma once
+
+#include "noncopyable.h"
+
+#include <atomic>
+#include <string>
+#include <stdint.h>
+
+/**
+ * 单写者计数器：只由所属loop线程修改，任意线程都可以读
+ * add()是relaxed的load+store而不是fetch_add，编译出来就是普通的mov/add，没有lock前缀
+ */
+class LoopCounter
+{
+public:
+    LoopCounter() : value_(0) {}
+
+    void add(uint64_t n = 1) {value_.store(value_.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);}
+    void set(uint64_t v) {value_.store(v, std::memory_order_relaxed);}
+    void setMax(uint64_t v) {if(v > get()) set(v);}
+    uint64_t get() const {return value_.load(std::memory_order_relaxed);}
+
+private:
+    std::atomic<uint64_t> value_;
+};
+
+/**
+ * 每个EventLoop一份的运行统计，按cache line对齐，不同loop的计数器不会落在同一个cache line上
+ * 热路径上只有本loop线程写，读取方调用snapshot()拿到一份拷贝，跨loop的汇总在读取时完成
+ */
+struct alignas(64) LoopMetrics : noncopyable
+{
+    struct Snapshot
+    {
+        uint64_t iterations = 0;        // loop()循环次数
+        uint64_t events = 0;            // poll返回的活跃channel总数
+        uint64_t pollNanos = 0;         // 阻塞在epoll_wait中的时间
+        uint64_t callbackNanos = 0;     // 执行channel回调的时间
+        uint64_t functorNanos = 0;      // 执行doPendingFunctors的时间
+        uint64_t functorsRun = 0;       // 执行过的pendingFunctor个数
+        uint64_t lastPendingDepth = 0;  // 最近一次doPendingFunctors取出的队列长度
+        uint64_t maxPendingDepth = 0;   // 历史最大队列长度
+        uint64_t accepts = 0;
+        uint64_t bytesRead = 0;
+        uint64_t bytesWritten = 0;
+        uint64_t readEagain = 0;        // 读返回EAGAIN的次数(空唤醒)
+        uint64_t writeEagain = 0;       // 写返回EAGAIN的次数(发送缓冲区满)
+
+        // 合并另一个loop的统计，计数相加，队列长度取最大值
+        Snapshot& operator+=(const Snapshot &rhs);
+        double eventsPerPoll() const {return iterations ? static_cast<double>(events) / iterations : 0;}
+        // key=value形式的单行文本，方便日志和脚本解析
+        std::string toString() const;
+    };
+
+    Snapshot snapshot() const;
+
+    LoopCounter iterations;
+    LoopCounter events;
+    LoopCounter pollNanos;
+    LoopCounter callbackNanos;
+    LoopCounter functorNanos;
+    LoopCounter functorsRun;
+    LoopCounter lastPendingDepth;
+    LoopCounter maxPendingDepth;
+    LoopCounter accepts;
+    LoopCounter bytesRead;
+    LoopCounter bytesWritten;
+    LoopCounter readEagain;
+    LoopCounter writeEagain;
+};
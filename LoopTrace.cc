@@ -0,0 +1,244 @@
+#include "LoopTrace.h"
+#include "Logger.h"
+
+#include <algorithm>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+std::atomic_bool LoopTrace::s_enabled_(false);
+std::atomic<size_t> LoopTrace::s_capacity_(LoopTrace::kDefaultCapacity);
+
+namespace
+{
+// 存活的LoopTrace，导出时持锁，保证导出期间loop不会析构
+std::mutex& registryMutex()
+{
+    static std::mutex mutex;
+    return mutex;
+}
+
+std::set<LoopTrace*>& registry()
+{
+    static std::set<LoopTrace*> traces;
+    return traces;
+}
+
+const char* kindName(LoopTrace::Kind kind)
+{
+    switch(kind)
+    {
+    case LoopTrace::kPoll: return "epoll_wait";
+    case LoopTrace::kHandleEvent: return "handleEvent";
+    case LoopTrace::kFunctor: return "pendingFunctor";
+    case LoopTrace::kAccept: return "accept";
+    case LoopTrace::kRead: return "read";
+    case LoopTrace::kWrite: return "write";
+    }
+    return "unknown";
+}
+
+int s_dumpPipe[2] = {-1, -1};
+std::string s_dumpPath;
+
+void dumpSignalHandler(int)
+{
+    // 信号处理函数中只做异步信号安全的write，真正的导出交给后台线程
+    int savedErrno = errno;
+    char c = 0;
+    ssize_t n = ::write(s_dumpPipe[1], &c, 1);
+    (void)n;
+    errno = savedErrno;
+}
+}
+
+LoopTrace::LoopTrace(pid_t tid)
+    : tid_(tid)
+    , ring_(nullptr)
+{
+    std::lock_guard<std::mutex> lock(registryMutex());
+    registry().insert(this);
+}
+
+LoopTrace::~LoopTrace()
+{
+    {
+        std::lock_guard<std::mutex> lock(registryMutex());
+        registry().erase(this);
+    }
+    delete ring_.load(std::memory_order_acquire);
+}
+
+void LoopTrace::enable(size_t capacity)
+{
+    size_t cap = 1;
+    while(cap < capacity)
+        cap <<= 1;
+    s_capacity_.store(cap, std::memory_order_relaxed);
+    s_enabled_.store(true, std::memory_order_relaxed);
+}
+
+void LoopTrace::disable()
+{
+    s_enabled_.store(false, std::memory_order_relaxed);
+}
+
+void LoopTrace::append(Kind kind, int64_t startNanos, int64_t endNanos, int fd, uint64_t arg)
+{
+    // ring_只由loop线程写，这里relaxed读到的就是最新值
+    Ring *ring = ring_.load(std::memory_order_relaxed);
+    if(ring == nullptr)
+    {
+        ring = new Ring(s_capacity_.load(std::memory_order_relaxed));
+        ring_.store(ring, std::memory_order_release);
+    }
+
+    uint64_t head = ring->head.load(std::memory_order_relaxed);
+    Event &event = ring->events[head & (ring->capacity - 1)];
+    event.startNanos = startNanos;
+    event.durNanos = endNanos - startNanos;
+    event.fd = fd;
+    event.arg = static_cast<uint32_t>(std::min<uint64_t>(arg, UINT32_MAX));
+    event.kind = kind;
+    ring->head.store(head + 1, std::memory_order_release);
+}
+
+uint64_t LoopTrace::recorded() const
+{
+    Ring *ring = ring_.load(std::memory_order_acquire);
+    return ring ? ring->head.load(std::memory_order_acquire) : 0;
+}
+
+std::vector<LoopTrace::Event> LoopTrace::snapshot() const
+{
+    std::vector<Event> events;
+    Ring *ring = ring_.load(std::memory_order_acquire);
+    if(ring == nullptr)
+        return events;
+
+    const uint64_t cap = ring->capacity;
+    uint64_t head = ring->head.load(std::memory_order_acquire);
+    uint64_t begin = head > cap ? head - cap : 0;
+    events.reserve(head - begin);
+    for(uint64_t i = begin; i < head; ++i)
+        events.push_back(ring->events[i & (cap - 1)]);
+
+    // 拷贝期间写者可能又写了若干条(包括正在写、还没发布的下一条)，它们覆盖的旧记录不可信，丢掉
+    std::atomic_thread_fence(std::memory_order_acquire);
+    uint64_t after = ring->head.load(std::memory_order_relaxed);
+    uint64_t firstValid = after >= cap ? after - cap + 1 : 0;
+    if(firstValid > begin)
+        events.erase(events.begin(), events.begin() + std::min<uint64_t>(firstValid - begin, events.size()));
+    return events;
+}
+
+std::string LoopTrace::toChromeJson()
+{
+    std::string json;
+    json.reserve(1 << 20);
+    json.append("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+
+    const int pid = ::getpid();
+    char buf[256];
+    bool first = true;
+    std::lock_guard<std::mutex> lock(registryMutex());
+    for(LoopTrace *trace : registry())
+    {
+        int n = snprintf(buf, sizeof buf,
+            "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"EventLoop %d\"}}",
+            first ? "" : ",", pid, trace->tid(), trace->tid());
+        json.append(buf, n);
+        first = false;
+
+        for(const Event &event : trace->snapshot())
+        {
+            // trace_event的ts/dur单位是微秒，保留到纳秒
+            n = snprintf(buf, sizeof buf,
+                ",{\"name\":\"%s\",\"cat\":\"loop\",\"ph\":\"X\",\"pid\":%d,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f,\"args\":{",
+                kindName(event.kind), pid, trace->tid(), event.startNanos / 1000.0, event.durNanos / 1000.0);
+            json.append(buf, n);
+            switch(event.kind)
+            {
+            case kPoll:
+                n = snprintf(buf, sizeof buf, "\"events\":%u}}", event.arg);
+                break;
+            case kHandleEvent:
+                n = snprintf(buf, sizeof buf, "\"fd\":%d,\"revents\":\"0x%x\"}}", event.fd, event.arg);
+                break;
+            case kFunctor:
+                n = snprintf(buf, sizeof buf, "\"queue_delay_us\":%u}}", event.arg);
+                break;
+            case kAccept:
+                n = snprintf(buf, sizeof buf, "\"fd\":%d}}", event.fd);
+                break;
+            case kRead:
+            case kWrite:
+                n = snprintf(buf, sizeof buf, "\"fd\":%d,\"bytes\":%u}}", event.fd, event.arg);
+                break;
+            default:
+                n = snprintf(buf, sizeof buf, "}}");
+                break;
+            }
+            json.append(buf, n);
+        }
+    }
+    json.append("]}\n");
+    return json;
+}
+
+bool LoopTrace::dumpAll(const std::string &path)
+{
+    std::string json = toChromeJson();
+    FILE *fp = ::fopen(path.c_str(), "w");
+    if(fp == nullptr)
+    {
+        LOG_ERROR("LoopTrace::dumpAll open %s failed: %d\n", path.c_str(), errno);
+        return false;
+    }
+    size_t n = ::fwrite(json.data(), 1, json.size(), fp);
+    ::fclose(fp);
+    return n == json.size();
+}
+
+void LoopTrace::installDumpSignal(int signo, const std::string &path)
+{
+    if(s_dumpPipe[0] >= 0)
+    {
+        LOG_ERROR("LoopTrace::installDumpSignal already installed\n");
+        return;
+    }
+    if(::pipe2(s_dumpPipe, O_CLOEXEC) < 0)
+    {
+        LOG_ERROR("LoopTrace::installDumpSignal pipe error:%d\n", errno);
+        return;
+    }
+    s_dumpPath = path;
+
+    std::thread([]()
+    {
+        char c;
+        while(true)
+        {
+            ssize_t n = ::read(s_dumpPipe[0], &c, 1);
+            if(n < 0 && errno == EINTR)
+                continue;
+            if(n <= 0)
+                break;
+            if(dumpAll(s_dumpPath))
+                LOG_INFO("LoopTrace dumped to %s\n", s_dumpPath.c_str());
+        }
+    }).detach();
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof sa);
+    sa.sa_handler = dumpSignalHandler;
+    sa.sa_flags = SA_RESTART;
+    ::sigemptyset(&sa.sa_mask);
+    ::sigaction(signo, &sa, nullptr);
+}
@@ -0,0 +1,115 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "Timestamp.h"
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <sys/types.h>
+
+/**
+ * 每个EventLoop一份的追踪环形缓冲区，记录epoll_wait、handleEvent、pendingFunctor、accept、read、write的时间段
+ * 用来定位是哪个回调把subLoop卡住了，导出为Chrome trace_event格式的JSON，可以直接拖进Perfetto/chrome://tracing查看
+ *
+ * 全局开关默认关闭，关闭时每个埋点只多一次relaxed load和一次分支；缓冲区在打开后由loop线程第一次记录时才分配
+ * 单写者：只有所属loop线程record()，写满后覆盖最旧的记录；导出时拷贝一份，丢弃拷贝期间可能被覆盖的部分，整个过程没有锁
+ */
+class LoopTrace : noncopyable
+{
+public:
+    enum Kind : uint8_t
+    {
+        kPoll,          // arg: 活跃channel数
+        kHandleEvent,   // fd, arg: revents
+        kFunctor,       // arg: 排队时间(微秒)
+        kAccept,        // fd: 新连接的fd
+        kRead,          // fd, arg: 读到的字节数
+        kWrite,         // fd, arg: 写出的字节数
+    };
+
+    struct Event
+    {
+        int64_t startNanos;     // Timestamp::monotonicNanos()
+        int64_t durNanos;
+        int32_t fd;
+        uint32_t arg;
+        Kind kind;
+    };
+
+    static const size_t kDefaultCapacity = 1 << 16;   // 每个loop保留最近的65536条记录，约2MB
+
+    // 作用域内的一段时间，开关关闭时构造和析构都不取时间
+    class Span : noncopyable
+    {
+    public:
+        Span(LoopTrace &trace, Kind kind, int fd = -1)
+            : trace_(enabled() ? &trace : nullptr)
+            , kind_(kind)
+            , fd_(fd)
+            , arg_(0)
+            , startNanos_(trace_ ? Timestamp::monotonicNanos() : 0)
+        {}
+        ~Span()
+        {
+            if(trace_)
+                trace_->record(kind_, startNanos_, Timestamp::monotonicNanos(), fd_, arg_);
+        }
+
+        void setFd(int fd) {fd_ = fd;}
+        void setArg(uint64_t arg) {arg_ = static_cast<uint32_t>(arg);}
+
+    private:
+        LoopTrace *trace_;
+        Kind kind_;
+        int fd_;
+        uint32_t arg_;
+        int64_t startNanos_;
+    };
+
+    explicit LoopTrace(pid_t tid);
+    ~LoopTrace();
+
+    // 全局开关，对所有loop生效；capacity向上取整为2的幂，只影响之后才分配缓冲区的loop
+    static void enable(size_t capacity = kDefaultCapacity);
+    // 关闭后已有记录保留，可以在发现卡顿后先关闭再导出，避免现场被覆盖
+    static void disable();
+    static bool enabled() {return s_enabled_.load(std::memory_order_relaxed);}
+
+    void record(Kind kind, int64_t startNanos, int64_t endNanos, int fd = -1, uint64_t arg = 0)
+    {
+        if(enabled())
+            append(kind, startNanos, endNanos, fd, arg);
+    }
+
+    pid_t tid() const {return tid_;}
+    // 按时间顺序拷贝当前缓冲区中的记录，可以在任意线程调用
+    std::vector<Event> snapshot() const;
+    // 该loop累计记录(包括被覆盖的)的条数
+    uint64_t recorded() const;
+
+    // 所有存活loop的记录，Chrome trace_event JSON格式
+    static std::string toChromeJson();
+    static bool dumpAll(const std::string &path);
+    // 收到signo信号后由后台线程把toChromeJson()写入path，信号处理函数本身只写一个字节到管道
+    static void installDumpSignal(int signo, const std::string &path);
+
+private:
+    struct Ring
+    {
+        explicit Ring(size_t cap) : capacity(cap), events(new Event[cap]), head(0) {}
+        const size_t capacity;
+        std::unique_ptr<Event[]> events;
+        std::atomic<uint64_t> head;     // 下一条记录的序号，写完记录以后才release递增
+    };
+
+    void append(Kind kind, int64_t startNanos, int64_t endNanos, int fd, uint64_t arg);
+
+    const pid_t tid_;
+    std::atomic<Ring*> ring_;
+
+    static std::atomic_bool s_enabled_;
+    static std::atomic<size_t> s_capacity_;
+};
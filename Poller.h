@@ -5,7 +5,6 @@
 class Channel;
 class EventLoop;
 
-#include <unordered_map>
 #include <vector>
 
 using namespace std;
@@ -39,9 +38,18 @@ public:
     static Poller *newDefaultPoller(EventLoop *loop);
 
 protected:
-    // 记录 sockfd : Channel*
-    using ChannelMap = unordered_map<int, Channel *>;
-    ChannelMap channels_;
+    /**
+     * 记录 sockfd : Channel*
+     * fd是内核按最小空闲值分配的小整数，直接用fd做下标的数组代替哈希表：增删查都是一次下标访问，不分配节点
+     * 数组按2倍扩容，不缩容，空位为nullptr
+     */
+    using ChannelTable = std::vector<Channel *>;
+    void addToTable(Channel *channel);
+    void removeFromTable(Channel *channel);
+    size_t numChannels() const { return numChannels_; }
+
+    ChannelTable channels_;
+    size_t numChannels_;
 
 private:
     // 记录Poller所属的EventLoop
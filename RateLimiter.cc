@@ -0,0 +1,44 @@
+#include "RateLimiter.h"
+
+RateLimiter::RateLimiter(double ratePerSecond, double burst)
+    : rate_(0)
+    , burst_(0)
+    , nanosPerUnit_(0)
+    , burstNanos_(0)
+    , tat_(0)
+    , throttled_(0)
+{
+    setRate(ratePerSecond, burst);
+}
+
+void RateLimiter::setRate(double ratePerSecond, double burst)
+{
+    rate_.store(ratePerSecond, std::memory_order_relaxed);
+    burst_.store(burst, std::memory_order_relaxed);
+    double nanosPerUnit = ratePerSecond > 0 ? 1e9 / ratePerSecond : 0;
+    nanosPerUnit_.store(nanosPerUnit, std::memory_order_relaxed);
+    burstNanos_.store(static_cast<int64_t>(burst * nanosPerUnit), std::memory_order_relaxed);
+}
+
+int64_t RateLimiter::consume(uint64_t units, int64_t nowNanos)
+{
+    const double nanosPerUnit = nanosPerUnit_.load(std::memory_order_relaxed);
+    if(nanosPerUnit <= 0)
+        return 0;
+    const int64_t cost = static_cast<int64_t>(units * nanosPerUnit);
+    const int64_t burstNanos = burstNanos_.load(std::memory_order_relaxed);
+
+    // 空闲一段时间后tat_落后于当前时刻，从当前时刻重新开始累计，积攒的额度不超过burst
+    int64_t tat = tat_.load(std::memory_order_relaxed);
+    int64_t next;
+    do
+    {
+        next = (tat > nowNanos ? tat : nowNanos) + cost;
+    } while(!tat_.compare_exchange_weak(tat, next, std::memory_order_relaxed));
+
+    int64_t debt = next - nowNanos - burstNanos;
+    if(debt <= 0)
+        return 0;
+    throttled_.store(throttled() + 1, std::memory_order_relaxed);
+    return debt;
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include "noncopyable.h"
+
+#include <atomic>
+#include <memory>
+#include <stdint.h>
+
+/**
+ * 令牌桶限速器，按GCRA实现：只保存一个"理论到达时刻"tat_，每消耗units个令牌就把它往后推units/rate秒
+ * tat_超出当前时刻burst/rate秒的部分就是欠账，调用方暂停同样长的时间再继续；先读写、后记账，允许一次透支
+ *
+ * 单位由使用方决定(字节或者消息数)。一个限速器可以给单个连接用，也可以被一组连接(同一个租户)共享，
+ * 共享时多个loop同时消耗，tat_用CAS更新；setRate()可以在任意线程随时调用，下一次consume()就按新速率计算
+ */
+class RateLimiter : noncopyable
+{
+public:
+    // ratePerSecond <= 0表示不限速；burst是允许的突发量，单位同ratePerSecond
+    RateLimiter(double ratePerSecond, double burst);
+
+    void setRate(double ratePerSecond, double burst);
+    double rate() const {return rate_.load(std::memory_order_relaxed);}
+    double burst() const {return burst_.load(std::memory_order_relaxed);}
+
+    // 消耗units个令牌，返回需要暂停的纳秒数，0表示还在预算之内
+    int64_t consume(uint64_t units, int64_t nowNanos);
+    // 触发暂停的次数，近似值
+    uint64_t throttled() const {return throttled_.load(std::memory_order_relaxed);}
+
+private:
+    std::atomic<double> rate_;
+    std::atomic<double> burst_;
+    std::atomic<double> nanosPerUnit_;
+    std::atomic<int64_t> burstNanos_;
+    std::atomic<int64_t> tat_;
+    std::atomic<uint64_t> throttled_;
+};
+
+using RateLimiterPtr = std::shared_ptr<RateLimiter>;
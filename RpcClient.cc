@@ -0,0 +1,102 @@
+#include "RpcClient.h"
+#include "EventLoop.h"
+#include "Logger.h"
+
+RpcClient::RpcClient(EventLoop *loop,
+          const InetAddress &serverAddr,
+          const std::string &name)
+    : loop_(loop)
+    , client_(loop, serverAddr, name)
+    , codec_(std::bind(&RpcClient::onFrame, this,
+        std::placeholders::_1, std::placeholders::_2, std::placeholders::_3))
+    , nextId_(1)
+{
+    client_.setConnectionCallback(std::bind(&RpcClient::onConnection, this, std::placeholders::_1));
+    client_.setMessageCallback(std::bind(&RpcClient::onMessage, this,
+        std::placeholders::_1, std::placeholders::_2, std::placeholders::_3));
+    client_.setConnectFailedCallback([this](int)
+    {
+        if(connectionCallback_)
+            connectionCallback_(false);
+    });
+}
+
+void RpcClient::call(uint16_t method, const StringPiece &request, const ResponseCallback &cb)
+{
+    if(loop_->isInLoopThread())
+        callInLoop(method, request, cb);
+    else
+    {
+        // request可能在调用返回后失效，拷贝一份带到loop线程
+        std::string copy = request.as_string();
+        loop_->queueLoop([this, method, copy, cb]()
+        {
+            callInLoop(method, copy, cb);
+        });
+    }
+}
+
+void RpcClient::callInLoop(uint16_t method, const StringPiece &request, const ResponseCallback &cb)
+{
+    if(!conn_ || !conn_->connected())
+    {
+        cb(kRpcConnectionClosed, StringPiece());
+        return;
+    }
+    int64_t id = nextId_++;
+    pending_[id] = cb;
+    RpcCodec::sendRequest(conn_, id, method, request);
+}
+
+void RpcClient::onConnection(const TcpConnectionPtr &conn)
+{
+    if(conn->connected())
+    {
+        conn->setTcpNoDelay(true);
+        conn_ = conn;
+    }
+    else
+    {
+        conn_.reset();
+        failAll(kRpcConnectionClosed);
+    }
+    if(connectionCallback_)
+        connectionCallback_(conn->connected());
+}
+
+void RpcClient::onMessage(const TcpConnectionPtr &conn, Buffer *buf, Timestamp receiveTime)
+{
+    RpcCodec::BatchGuard batch(conn);
+    codec_.onMessage(conn, buf, receiveTime);
+}
+
+void RpcClient::onFrame(const TcpConnectionPtr &conn, const StringPiece &frame, Timestamp)
+{
+    RpcCodec::Message msg;
+    if(!RpcCodec::decode(frame, &msg) || msg.type != RpcCodec::kResponse)
+    {
+        LOG_ERROR("RpcClient [%s] bad response frame\n", conn->name().c_str());
+        conn->forceClose();
+        return;
+    }
+
+    auto it = pending_.find(msg.id);
+    if(it == pending_.end())
+    {
+        LOG_ERROR("RpcClient [%s] unknown response id %ld\n", conn->name().c_str(), static_cast<long>(msg.id));
+        return;
+    }
+    // 先从表中移出再回调，回调中可以继续发起新的调用
+    ResponseCallback cb;
+    cb.swap(it->second);
+    pending_.erase(it);
+    cb(msg.status, msg.payload);
+}
+
+void RpcClient::failAll(RpcStatus status)
+{
+    std::unordered_map<int64_t, ResponseCallback> pending;
+    pending.swap(pending_);
+    for(auto &item : pending)
+        item.second(status, StringPiece());
+}
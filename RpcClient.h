@@ -0,0 +1,60 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "TcpClient.h"
+#include "LengthHeaderCodec.h"
+#include "RpcCodec.h"
+
+#include <functional>
+#include <string>
+#include <unordered_map>
+
+/**
+ * RPC客户端，一条连接上可以同时发出任意多个调用
+ * 每个调用分配一个连接内唯一的id，应答按id匹配，不要求按发送顺序返回
+ * 回调在loop线程中执行，response指向inputBuffer_，回调返回后失效
+ */
+class RpcClient : noncopyable
+{
+public:
+    using ResponseCallback = std::function<void(RpcStatus status, const StringPiece &response)>;
+    using ConnectionCallback = std::function<void(bool connected)>;
+
+    RpcClient(EventLoop *loop,
+        const InetAddress &serverAddr,
+        const std::string &name);
+
+    void setConnectionCallback(const ConnectionCallback &cb) {connectionCallback_ = cb;}
+
+    void connect() {client_.connect();}
+    void disconnect() {client_.disconnect();}
+
+    EventLoop* getLoop() const {return loop_;}
+
+    /**
+     * 可以在任意线程调用
+     * 在loop线程中调用时请求直接编码进outputBuffer_；在应答回调中连续发起的调用会合并成一次write
+     * 连接不可用时回调立即以kRpcConnectionClosed完成
+     */
+    void call(uint16_t method, const StringPiece &request, const ResponseCallback &cb);
+
+    // 尚未收到应答的调用个数，只能在loop线程中调用
+    size_t inflight() const {return pending_.size();}
+
+private:
+    void callInLoop(uint16_t method, const StringPiece &request, const ResponseCallback &cb);
+    void onConnection(const TcpConnectionPtr &conn);
+    void onMessage(const TcpConnectionPtr &conn, Buffer *buf, Timestamp receiveTime);
+    void onFrame(const TcpConnectionPtr &conn, const StringPiece &frame, Timestamp receiveTime);
+    void failAll(RpcStatus status);
+
+    EventLoop *loop_;
+    TcpClient client_;
+    LengthHeaderCodec codec_;
+    ConnectionCallback connectionCallback_;
+
+    // 以下成员只在loop线程中访问
+    TcpConnectionPtr conn_;
+    int64_t nextId_;
+    std::unordered_map<int64_t, ResponseCallback> pending_;
+};
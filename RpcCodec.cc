@@ -0,0 +1,127 @@
+#include "RpcCodec.h"
+#include "TcpConnection.h"
+#include "EventLoop.h"
+#include "Buffer.h"
+
+#include <string.h>
+#include <endian.h>
+
+// 当前loop线程正在批量处理的连接，该连接上的消息只追加不发送
+static __thread TcpConnection *t_batchConn = nullptr;
+
+static int64_t readInt64(const char *p)
+{
+    int64_t be64;
+    ::memcpy(&be64, p, sizeof be64);
+    return be64toh(be64);
+}
+
+static uint16_t readUint16(const char *p)
+{
+    uint16_t be16;
+    ::memcpy(&be16, p, sizeof be16);
+    return be16toh(be16);
+}
+
+bool RpcCodec::decode(const StringPiece &frame, Message *msg)
+{
+    if(frame.size() < 1)
+        return false;
+    const char *p = frame.data();
+    if(p[0] == kRequest)
+    {
+        if(frame.size() < kRequestHeaderLen)
+            return false;
+        msg->type = kRequest;
+        msg->id = readInt64(p + 1);
+        msg->method = readUint16(p + 9);
+        msg->status = kRpcOk;
+        msg->payload.set(p + kRequestHeaderLen, frame.size() - kRequestHeaderLen);
+        return true;
+    }
+    if(p[0] == kResponse)
+    {
+        if(frame.size() < kResponseHeaderLen)
+            return false;
+        msg->type = kResponse;
+        msg->id = readInt64(p + 1);
+        msg->method = 0;
+        msg->status = static_cast<RpcStatus>(p[9]);
+        msg->payload.set(p + kResponseHeaderLen, frame.size() - kResponseHeaderLen);
+        return true;
+    }
+    return false;
+}
+
+void RpcCodec::appendRequest(Buffer *buf, int64_t id, uint16_t method, const StringPiece &payload)
+{
+    buf->appendInt32(static_cast<int32_t>(kRequestHeaderLen + payload.size()));
+    buf->appendInt8(kRequest);
+    buf->appendInt64(id);
+    buf->appendInt16(static_cast<int16_t>(method));
+    buf->append(payload.data(), payload.size());
+}
+
+void RpcCodec::appendResponse(Buffer *buf, int64_t id, RpcStatus status, const StringPiece &payload)
+{
+    buf->appendInt32(static_cast<int32_t>(kResponseHeaderLen + payload.size()));
+    buf->appendInt8(kResponse);
+    buf->appendInt64(id);
+    buf->appendInt8(static_cast<int8_t>(status));
+    buf->append(payload.data(), payload.size());
+}
+
+void RpcCodec::sendRequest(const TcpConnectionPtr &conn, int64_t id, uint16_t method, const StringPiece &payload)
+{
+    if(!conn->connected())
+        return;
+
+    if(conn->getLoop()->isInLoopThread())
+    {
+        appendRequest(conn->outputBuffer(), id, method, payload);
+        if(t_batchConn != conn.get())
+            conn->flushOutput();
+    }
+    else
+    {
+        Buffer buf(kRequestHeaderLen + payload.size() + 4);
+        appendRequest(&buf, id, method, payload);
+        conn->send(&buf);
+    }
+}
+
+void RpcCodec::sendResponse(const TcpConnectionPtr &conn, int64_t id, RpcStatus status, const StringPiece &payload)
+{
+    if(!conn->connected())
+        return;
+
+    if(conn->getLoop()->isInLoopThread())
+    {
+        appendResponse(conn->outputBuffer(), id, status, payload);
+        if(t_batchConn != conn.get())
+            conn->flushOutput();
+    }
+    else
+    {
+        Buffer buf(kResponseHeaderLen + payload.size() + 4);
+        appendResponse(&buf, id, status, payload);
+        conn->send(&buf);
+    }
+}
+
+RpcCodec::BatchGuard::BatchGuard(const TcpConnectionPtr &conn)
+    : conn_(conn)
+    , outer_(t_batchConn == nullptr)
+{
+    if(outer_)
+        t_batchConn = conn.get();
+}
+
+RpcCodec::BatchGuard::~BatchGuard()
+{
+    if(outer_)
+    {
+        t_batchConn = nullptr;
+        conn_->flushOutput();
+    }
+}
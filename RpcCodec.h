@@ -0,0 +1,72 @@
+#pragma once
+
+#include "Callbacks.h"
+#include "StringPiece.h"
+
+#include <stdint.h>
+
+class Buffer;
+
+enum RpcStatus
+{
+    kRpcOk = 0,
+    kRpcNoMethod = 1,       // 服务端没有注册该方法
+    kRpcBadRequest = 2,     // 无法解析的请求
+    kRpcHandlerError = 3,   // 业务处理失败
+    kRpcOverloaded = 4,     // 服务端拒绝执行
+    kRpcConnectionClosed = 5, // 客户端本地：应答到达之前连接断开
+};
+
+/**
+ * RPC消息在LengthHeaderCodec的帧内的格式(整数均为大端)
+ * 请求：| int8 type=1 | int64 id | uint16 method | payload |
+ * 应答：| int8 type=2 | int64 id | int8 status   | payload |
+ * id由客户端在每条连接上单调递增分配，应答可以乱序返回，客户端按id匹配
+ * method是整数编号，服务端按编号直接索引处理函数表，不做字符串查找
+ */
+class RpcCodec
+{
+public:
+    enum MessageType{kRequest = 1, kResponse = 2};
+
+    struct Message
+    {
+        MessageType type;
+        int64_t id;
+        uint16_t method;    // 只对请求有效
+        RpcStatus status;   // 只对应答有效
+        StringPiece payload;
+    };
+
+    static const size_t kRequestHeaderLen = 1 + 8 + 2;
+    static const size_t kResponseHeaderLen = 1 + 8 + 1;
+
+    // frame为LengthHeaderCodec交出的一帧，payload指向frame内部
+    static bool decode(const StringPiece &frame, Message *msg);
+
+    // 连同长度头一起追加到buf
+    static void appendRequest(Buffer *buf, int64_t id, uint16_t method, const StringPiece &payload);
+    static void appendResponse(Buffer *buf, int64_t id, RpcStatus status, const StringPiece &payload);
+
+    /**
+     * 发送请求/应答
+     * 不在loop线程：编码到临时Buffer，转交给loop
+     * 在loop线程：直接编码进outputBuffer_，处于BatchGuard范围内时不立即发送
+     */
+    static void sendRequest(const TcpConnectionPtr &conn, int64_t id, uint16_t method, const StringPiece &payload);
+    static void sendResponse(const TcpConnectionPtr &conn, int64_t id, RpcStatus status, const StringPiece &payload);
+
+    /**
+     * 处理一次读事件期间，产生的所有消息只追加到outputBuffer_，析构时统一flushOutput()
+     * 流水线上的多个调用因此只需要一次write
+     */
+    class BatchGuard
+    {
+    public:
+        explicit BatchGuard(const TcpConnectionPtr &conn);
+        ~BatchGuard();
+    private:
+        const TcpConnectionPtr &conn_;
+        bool outer_;
+    };
+};
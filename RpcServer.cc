@@ -0,0 +1,83 @@
+#include "RpcServer.h"
+#include "Logger.h"
+
+RpcServer::RpcServer(EventLoop *loop,
+          const InetAddress &listenAddr,
+          const std::string &name,
+          TcpServer::Option option)
+    : server_(loop, listenAddr, name, option)
+    , codec_(std::bind(&RpcServer::onFrame, this,
+        std::placeholders::_1, std::placeholders::_2, std::placeholders::_3))
+    , workers_(name + "-worker")
+    , workerThreads_(0)
+    , maxWorkerQueueSize_(0)
+{
+    server_.setMessageCallback(std::bind(&RpcServer::onMessage, this,
+        std::placeholders::_1, std::placeholders::_2, std::placeholders::_3));
+}
+
+RpcServer::~RpcServer()
+{
+}
+
+void RpcServer::registerMethod(uint16_t method, const RpcHandler &handler, ExecMode mode)
+{
+    if(method >= methods_.size())
+        methods_.resize(method + 1);
+    methods_[method].handler = handler;
+    methods_[method].mode = mode;
+}
+
+void RpcServer::start()
+{
+    if(workerThreads_ > 0)
+        workers_.start(workerThreads_);
+    server_.start();
+}
+
+// 一次读事件中的所有请求处理完以后，inline产生的应答一次性发出
+void RpcServer::onMessage(const TcpConnectionPtr &conn, Buffer *buf, Timestamp receiveTime)
+{
+    RpcCodec::BatchGuard batch(conn);
+    codec_.onMessage(conn, buf, receiveTime);
+}
+
+void RpcServer::onFrame(const TcpConnectionPtr &conn, const StringPiece &frame, Timestamp)
+{
+    RpcCodec::Message msg;
+    if(!RpcCodec::decode(frame, &msg) || msg.type != RpcCodec::kRequest)
+    {
+        LOG_ERROR("RpcServer [%s] bad request frame\n", conn->name().c_str());
+        conn->forceClose();
+        return;
+    }
+
+    RpcReply reply(conn, msg.id);
+    if(msg.method >= methods_.size() || !methods_[msg.method].handler)
+    {
+        reply.reply(StringPiece(), kRpcNoMethod);
+        return;
+    }
+
+    const Method &method = methods_[msg.method];
+    if(method.mode == kInLoop || workerThreads_ == 0)
+    {
+        method.handler(msg.payload, reply);
+    }
+    else
+    {
+        if(maxWorkerQueueSize_ > 0 && workers_.queueSize() >= maxWorkerQueueSize_)
+        {
+            reply.reply(StringPiece(), kRpcOverloaded);
+            return;
+        }
+        // payload指向inputBuffer_，交给其他线程之前必须拷贝
+        // methods_在start()以后不再改变，可以直接引用
+        std::string request = msg.payload.as_string();
+        const RpcHandler *handler = &method.handler;
+        workers_.run([handler, request, reply]()
+        {
+            (*handler)(request, reply);
+        });
+    }
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "TcpServer.h"
+#include "LengthHeaderCodec.h"
+#include "RpcCodec.h"
+#include "ThreadPool.h"
+
+#include <functional>
+#include <string>
+#include <vector>
+
+/**
+ * 一次调用的应答句柄
+ * 可以拷贝、可以带到其他线程，任意时刻调用一次reply()即可，应答不必按请求顺序返回
+ */
+class RpcReply
+{
+public:
+    RpcReply(const TcpConnectionPtr &conn, int64_t id)
+        : conn_(conn), id_(id) {}
+
+    void reply(const StringPiece &payload, RpcStatus status = kRpcOk) const
+    {RpcCodec::sendResponse(conn_, id_, status, payload);}
+
+    const TcpConnectionPtr& connection() const {return conn_;}
+    int64_t id() const {return id_;}
+
+private:
+    TcpConnectionPtr conn_;
+    int64_t id_;
+};
+
+/**
+ * 基于LengthHeaderCodec的RPC服务端
+ * 一条连接上可以同时有任意多个未完成的调用(流水线)，应答按完成顺序返回
+ * 方法用整数编号注册，分发时直接按编号索引处理函数表
+ * kInLoop：处理函数在连接所属的subLoop中执行，request指向inputBuffer_，适合轻量处理
+ * kInWorker：request拷贝一份交给工作线程池执行，适合耗时处理
+ */
+class RpcServer : noncopyable
+{
+public:
+    enum ExecMode{kInLoop, kInWorker};
+    using RpcHandler = std::function<void(const StringPiece &request, const RpcReply &reply)>;
+
+    RpcServer(EventLoop *loop,
+        const InetAddress &listenAddr,
+        const std::string &name,
+        TcpServer::Option option = TcpServer::kNoReusePort);
+    ~RpcServer();
+
+    void setThreadNum(int numThreads) {server_.setThreadNum(numThreads);}
+    void setWorkerThreadNum(int numThreads) {workerThreads_ = numThreads;}
+    // 工作线程队列上限，超过时直接回复kRpcOverloaded
+    void setMaxWorkerQueueSize(size_t maxSize) {maxWorkerQueueSize_ = maxSize;}
+
+    // 必须在start()之前注册
+    void registerMethod(uint16_t method, const RpcHandler &handler, ExecMode mode = kInLoop);
+
+    void start();
+
+private:
+    struct Method
+    {
+        RpcHandler handler;
+        ExecMode mode;
+    };
+
+    void onMessage(const TcpConnectionPtr &conn, Buffer *buf, Timestamp receiveTime);
+    void onFrame(const TcpConnectionPtr &conn, const StringPiece &frame, Timestamp receiveTime);
+
+    TcpServer server_;
+    LengthHeaderCodec codec_;
+    std::vector<Method> methods_;
+    ThreadPool workers_;
+    int workerThreads_;
+    size_t maxWorkerQueueSize_;
+};
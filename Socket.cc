@@ -7,6 +7,7 @@
 #include <sys/socket.h>
 #include <string.h>
 #include <netinet/tcp.h>
+#include <errno.h>
 
 /**
  * 假设客户端有connfd，服务端有listenfd和clientfd，
@@ -25,8 +26,8 @@ Socket::~Socket()
 
 void Socket::bindAddress(const InetAddress &localaddr)
 {
-    if(0 != ::bind(sockfd_, (sockaddr*)localaddr.getSockAddr(), sizeof(sockaddr_in)))
-        LOG_FATAL("bind sockfd:%d fail\n", sockfd_);
+    if(0 != ::bind(sockfd_, localaddr.getSockAddr(), localaddr.length()))
+        LOG_FATAL("bind sockfd:%d %s fail: %d\n", sockfd_, localaddr.toIpPort().c_str(), errno);
 }
 
 void Socket::listen()
@@ -37,12 +38,12 @@ void Socket::listen()
 
 int Socket::accept(InetAddress *peeraddr)
 {
-    sockaddr_in addr;
+    sockaddr_storage addr;
     socklen_t len = sizeof addr;
     bzero(&addr, sizeof addr);
     int connfd = ::accept4(sockfd_, (sockaddr*)&addr, &len, SOCK_NONBLOCK | SOCK_CLOEXEC);
     if(connfd >= 0)
-        peeraddr->setSockAddr(addr);
+        peeraddr->setSockAddr((sockaddr*)&addr, len);
     return connfd;
 }
 
@@ -0,0 +1,60 @@
+#include "SplicePipe.h"
+#include "Logger.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+
+SplicePipe::SplicePipe()
+    : readFd_(-1)
+    , writeFd_(-1)
+    , size_(0)
+    , capacity_(0)
+{
+    int fds[2];
+    if(::pipe2(fds, O_NONBLOCK | O_CLOEXEC) < 0)
+    {
+        LOG_ERROR("SplicePipe::pipe2 error:%d \n", errno);
+        return;
+    }
+    readFd_ = fds[0];
+    writeFd_ = fds[1];
+
+    // 管道容量决定了单次splice最多搬运多少数据，同时也是转发的背压窗口
+    int cap = ::fcntl(writeFd_, F_SETPIPE_SZ, kPipeSize);
+    if(cap < 0)
+        cap = ::fcntl(writeFd_, F_GETPIPE_SZ);
+    capacity_ = cap > 0 ? cap : kPipeSize;
+}
+
+SplicePipe::~SplicePipe()
+{
+    if(readFd_ >= 0)
+    {
+        ::close(readFd_);
+        ::close(writeFd_);
+    }
+}
+
+ssize_t SplicePipe::spliceFrom(int fd, int *saveErrno)
+{
+    // 只是单次搬运的上限，管道实际能接下多少由内核按剩余槽位决定
+    ssize_t n = ::splice(fd, nullptr, writeFd_, nullptr, capacity_,
+        SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+    if(n < 0)
+        *saveErrno = errno;
+    else
+        size_ += n;
+    return n;
+}
+
+ssize_t SplicePipe::spliceTo(int fd, int *saveErrno)
+{
+    ssize_t n = ::splice(readFd_, nullptr, fd, nullptr, size_,
+        SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+    if(n < 0)
+        *saveErrno = errno;
+    else
+        size_ -= n;
+    return n;
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include "noncopyable.h"
+
+#include <sys/types.h>
+#include <stddef.h>
+
+/**
+ * 用于splice零拷贝转发的管道
+ * socketA --splice--> pipe --splice--> socketB
+ * 数据只在内核的page之间移动，不经过用户态的Buffer
+ * size_记录管道中尚未发出的字节数。管道的容量按page槽位计算而不是字节：小段数据每段占一个槽位，
+ * 字节数远没到capacity_时管道就可能已经满了，所以是否满只能看spliceFrom()是否返回EAGAIN
+ */
+class SplicePipe : noncopyable
+{
+public:
+    static const int kPipeSize = 64 * 1024;
+
+    SplicePipe();
+    ~SplicePipe();
+
+    // pipe2可能因为fd耗尽而失败，此时调用者应退回到Buffer拷贝的方式
+    bool valid() const {return readFd_ >= 0;}
+
+    size_t size() const {return size_;}
+    bool empty() const {return size_ == 0;}
+
+    // 从socket读入管道，管道满了或者socket没有数据时返回-1，errno为EAGAIN
+    ssize_t spliceFrom(int fd, int *saveErrno);
+    // 把管道中的数据写入socket
+    ssize_t spliceTo(int fd, int *saveErrno);
+
+private:
+    int readFd_;
+    int writeFd_;
+    size_t size_;
+    size_t capacity_;
+};
@@ -0,0 +1,95 @@
+#include "Strand.h"
+#include "EventLoop.h"
+
+#include <sched.h>
+
+Strand::Strand(ComputePool *pool)
+    : pool_(pool)
+    , maxQueueSize_(0)
+    , count_(0)
+    , executed_(0)
+    , head_(nullptr)
+    , tail_(new Node)
+{
+    tail_->next.store(nullptr, std::memory_order_relaxed);
+    head_.store(tail_, std::memory_order_relaxed);
+}
+
+Strand::~Strand()
+{
+    // 有任务未执行完时线程池持有引用，能析构说明链表里只剩哨兵节点
+    while(tail_ != nullptr)
+    {
+        Node *next = tail_->next.load(std::memory_order_relaxed);
+        delete tail_;
+        tail_ = next;
+    }
+}
+
+bool Strand::post(Task task)
+{
+    if(!pool_->running_)
+        return false;
+    if(maxQueueSize_ > 0 && count_.load(std::memory_order_relaxed) >= maxQueueSize_)
+    {
+        pool_->rejected_.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    push(std::move(task));
+    if(count_.fetch_add(1, std::memory_order_acq_rel) == 0)
+    {
+        StrandPtr self = shared_from_this();
+        // 和stop()竞争失败时线程池已经不再接受任务，在当前线程执行完，count_从0到1的是我们，仍然是串行的
+        if(!pool_->push([self]() {self->run();}, ComputePool::kUnbounded))
+            run();
+    }
+    return true;
+}
+
+bool Strand::post(EventLoop *loop, Task work, Task done)
+{
+    ComputePool *pool = pool_;
+    ComputePool::CompletionsPtr completions = pool->completionsOf(loop);
+    return post([pool, loop, completions, work, done]()
+    {
+        work();
+        pool->complete(loop, completions, done);
+    });
+}
+
+void Strand::push(Task task)
+{
+    Node *node = new Node;
+    node->next.store(nullptr, std::memory_order_relaxed);
+    node->task = std::move(task);
+    Node *prev = head_.exchange(node, std::memory_order_acq_rel);
+    prev->next.store(node, std::memory_order_release);
+}
+
+// 只在count_ > 0时调用，一定有任务；生产者交换了head_但还没有链上next时短暂等待
+Strand::Task Strand::pop()
+{
+    Node *next;
+    while((next = tail_->next.load(std::memory_order_acquire)) == nullptr)
+        ::sched_yield();
+    Task task(std::move(next->task));
+    delete tail_;
+    tail_ = next;
+    return task;
+}
+
+void Strand::run()
+{
+    for(int i = 0; i < kBatchSize; ++i)
+    {
+        Task task = pop();
+        task();
+        executed_.store(executed_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        if(count_.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            return;
+    }
+    // 还有任务，排到本worker队列的头部让出；线程池已经stop()时接着执行完
+    StrandPtr self = shared_from_this();
+    if(!pool_->push([self]() {self->run();}, ComputePool::kYield))
+        run();
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "ComputePool.h"
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <type_traits>
+#include <stdint.h>
+
+class EventLoop;
+
+/**
+ * 串行执行器：提交到同一个Strand的任务按提交顺序在ComputePool的worker上执行，任意时刻最多一个在执行，
+ * 不同Strand之间互不影响、并行执行，没有专门的线程，也没有全局锁
+ *
+ * 典型用法是每个连接一个Strand(比如放在conn->setContext()里)，这个连接的请求交给Strand处理，
+ * 完成回调按处理顺序投递回loop，响应顺序和请求顺序一致，不同连接的请求仍然分散在所有worker上
+ *
+ * 任务放在无锁的多生产者单消费者链表里，count_记录未执行完的任务数：
+ * 提交时count_从0变为1的一方负责把Strand调度到线程池，执行方执行完一个任务后减1，减到0就退出，
+ * 所以调度和交接只有原子操作；连续执行kBatchSize个任务以后让出worker，避免一个忙的Strand饿死其他任务
+ *
+ * 必须由shared_ptr管理，有任务未执行完时线程池持有它的引用
+ */
+class Strand : noncopyable, public std::enable_shared_from_this<Strand>
+{
+public:
+    using Task = std::function<void()>;
+
+    explicit Strand(ComputePool *pool);
+    ~Strand();
+
+    // 排队的任务数上限，超出时post()返回false，0表示不限制；Strand的任务不计入线程池的maxQueueSize
+    void setMaxQueueSize(size_t maxSize) {maxQueueSize_ = maxSize;}
+
+    // 可以在任意线程调用，排队数超出上限或者线程池已经stop()时返回false
+    bool post(Task task);
+    // work在worker线程中串行执行，之后done在loop线程中执行；同一个Strand的done按post的顺序执行
+    bool post(EventLoop *loop, Task work, Task done);
+    // work的返回值交给done，done在loop线程中执行
+    template <typename Work, typename Done>
+    bool call(EventLoop *loop, Work work, Done done)
+    {
+        using Result = typename std::result_of<Work()>::type;
+        std::shared_ptr<Result> result = std::make_shared<Result>();
+        return post(loop, [work, result]() mutable {*result = work();},
+            [done, result]() mutable {done(std::move(*result));});
+    }
+
+    ComputePool* pool() const {return pool_;}
+    // 排队和正在执行的任务数
+    size_t pending() const {return count_.load(std::memory_order_relaxed);}
+    uint64_t executed() const {return executed_.load(std::memory_order_relaxed);}
+
+private:
+    static const int kBatchSize = 64;
+
+    struct Node
+    {
+        std::atomic<Node*> next;
+        Task task;
+    };
+
+    void push(Task task);
+    Task pop();
+    void run();
+
+    ComputePool *pool_;
+    size_t maxQueueSize_;
+    std::atomic<size_t> count_;
+    std::atomic<uint64_t> executed_;
+    // 生产者在head_一端追加，执行方从tail_一端取；tail_指向已经取走的哨兵节点
+    std::atomic<Node*> head_;
+    Node *tail_;
+};
+
+using StrandPtr = std::shared_ptr<Strand>;
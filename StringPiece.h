@@ -0,0 +1,54 @@
+#pragma once
+
+#include <string>
+#include <string.h>
+#include <strings.h>
+
+/**
+ * 指向一段外部内存的(指针, 长度)视图，不拥有数据，不做拷贝
+ * 典型用法是指向Buffer中的可读数据，Buffer被retrieve或者扩容以后视图失效
+ */
+class StringPiece
+{
+public:
+    StringPiece()
+        : ptr_(nullptr), length_(0) {}
+    StringPiece(const char *str)
+        : ptr_(str), length_(strlen(str)) {}
+    StringPiece(const char *str, size_t len)
+        : ptr_(str), length_(len) {}
+    StringPiece(const std::string &str)
+        : ptr_(str.data()), length_(str.size()) {}
+
+    const char* data() const {return ptr_;}
+    size_t size() const {return length_;}
+    bool empty() const {return length_ == 0;}
+    const char* begin() const {return ptr_;}
+    const char* end() const {return ptr_ + length_;}
+
+    char operator[](size_t i) const {return ptr_[i];}
+
+    void set(const char *str, size_t len) {ptr_ = str; length_ = len;}
+    void clear() {ptr_ = nullptr; length_ = 0;}
+    void remove_prefix(size_t n) {ptr_ += n; length_ -= n;}
+    void remove_suffix(size_t n) {length_ -= n;}
+
+    bool operator==(const StringPiece &x) const
+    {return length_ == x.length_ && memcmp(ptr_, x.ptr_, length_) == 0;}
+    bool operator!=(const StringPiece &x) const
+    {return !(*this == x);}
+
+    // HTTP头部字段名大小写不敏感
+    bool equalsIgnoreCase(const StringPiece &x) const
+    {return length_ == x.length_ && strncasecmp(ptr_, x.ptr_, length_) == 0;}
+
+    bool startsWith(const StringPiece &x) const
+    {return length_ >= x.length_ && memcmp(ptr_, x.ptr_, x.length_) == 0;}
+
+    std::string as_string() const
+    {return std::string(ptr_, length_);}
+
+private:
+    const char *ptr_;
+    size_t length_;
+};
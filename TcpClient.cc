@@ -0,0 +1,124 @@
+#include "TcpClient.h"
+#include "Connector.h"
+#include "EventLoop.h"
+#include "Logger.h"
+
+#include <strings.h>
+#include <sys/socket.h>
+
+static EventLoop* CheckLoopNotNull(EventLoop *loop)
+{
+    if(loop == nullptr)
+        LOG_FATAL("%s:%s:%d client loop is null!\n",__FILE__,__FUNCTION__,__LINE__);
+    return loop;
+}
+
+// TcpClient已经析构，连接关闭时只需要在loop中销毁连接
+static void removeDetachedConnection(EventLoop *loop, const TcpConnectionPtr &conn)
+{
+    loop->queueLoop(std::bind(&TcpConnection::connectDestroyed, conn));
+}
+
+TcpClient::TcpClient(EventLoop *loop,
+          const InetAddress &serverAddr,
+          const std::string &nameArg)
+    : loop_(CheckLoopNotNull(loop))
+    , connector_(new Connector(loop, serverAddr))
+    , name_(nameArg)
+    , connect_(false)
+    , nextConnId_(1)
+{
+    connector_->setNewConnectionCallback(std::bind(&TcpClient::newConnection, this, std::placeholders::_1));
+    connector_->setConnectFailedCallback([this](int err)
+    {
+        if(connectFailedCallback_)
+            connectFailedCallback_(err);
+    });
+}
+
+/**
+ * 连接仍然存在时，把关闭回调换成与TcpClient无关的函数
+ * 这样TcpClient析构以后，连接的关闭流程不会再访问this
+ */
+TcpClient::~TcpClient()
+{
+    TcpConnectionPtr conn;
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        conn = connection_;
+    }
+
+    if(conn)
+    {
+        CloseCallback cb = std::bind(&removeDetachedConnection, loop_, std::placeholders::_1);
+        loop_->runInLoop([conn, cb]()
+        {
+            conn->setCloseCallback(cb);
+        });
+        conn->forceClose();
+    }
+    else
+    {
+        connector_->stop();
+    }
+}
+
+void TcpClient::connect()
+{
+    LOG_INFO("TcpClient::connect [%s] - connecting to %s\n",
+        name_.c_str(), connector_->serverAddress().toIpPort().c_str());
+    connect_ = true;
+    connector_->start();
+}
+
+void TcpClient::disconnect()
+{
+    connect_ = false;
+    std::unique_lock<std::mutex> lock(mutex_);
+    if(connection_)
+        connection_->shutdown();
+}
+
+void TcpClient::stop()
+{
+    connect_ = false;
+    connector_->stop();
+}
+
+void TcpClient::newConnection(int sockfd)
+{
+    InetAddress peerAddr = InetAddress::getPeerAddr(sockfd);
+    InetAddress localAddr = InetAddress::getLocalAddr(sockfd);
+
+    char buf[160] = {0};
+    snprintf(buf, sizeof buf, ":%s#%d", peerAddr.toIpPort().c_str(), nextConnId_);
+    ++nextConnId_;
+    std::string connName = name_ + buf;
+
+    TcpConnectionPtr conn(new TcpConnection(
+        loop_,
+        connName,
+        sockfd,
+        localAddr,
+        peerAddr));
+    conn->setConnectionCallback(connectionCallback_);
+    conn->setMessageCallback(messageCallback_);
+    conn->setWriteCompleteCallback(writeCompleteCallback_);
+    conn->setCloseCallback(std::bind(&TcpClient::removeConnection, this, std::placeholders::_1));
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        connection_ = conn;
+    }
+    if(tlsContext_)
+        conn->startTls(tlsContext_);
+    conn->connectEstablished();
+}
+
+void TcpClient::removeConnection(const TcpConnectionPtr &conn)
+{
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        connection_.reset();
+    }
+    loop_->queueLoop(std::bind(&TcpConnection::connectDestroyed, conn));
+}
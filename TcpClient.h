@@ -0,0 +1,65 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "InetAddress.h"
+#include "Callbacks.h"
+#include "TcpConnection.h"
+
+#include <functional>
+#include <string>
+#include <memory>
+#include <mutex>
+
+class EventLoop;
+class Connector;
+
+// 对外的客户端编程使用的类，一个TcpClient管理一条到服务端的连接
+class TcpClient : noncopyable
+{
+public:
+    using ConnectFailedCallback = std::function<void(int err)>;
+
+    TcpClient(EventLoop *loop,
+        const InetAddress &serverAddr,
+        const std::string &nameArg);
+    ~TcpClient(); // 必须在loop所在的线程析构
+
+    void connect();
+    void disconnect();
+    void stop();
+
+    TcpConnectionPtr connection() const
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        return connection_;
+    }
+
+    EventLoop* getLoop() const {return loop_;}
+    const std::string& name() const {return name_;}
+
+    void setConnectionCallback(const ConnectionCallback &cb){connectionCallback_ = cb;}
+    void setMessageCallback(const MessageCallback &cb){messageCallback_ = cb;}
+    void setWriteCompleteCallback(const WriteCompleteCallback &cb){writeCompleteCallback_ = cb;}
+    void setConnectFailedCallback(const ConnectFailedCallback &cb){connectFailedCallback_ = cb;}
+    // 设置以后连接建立时先做TLS握手(客户端)，在connect()之前调用
+    void setTlsContext(const TlsContextPtr &context) {tlsContext_ = context;}
+
+private:
+    void newConnection(int sockfd);
+    void removeConnection(const TcpConnectionPtr &conn);
+
+    EventLoop *loop_;
+    std::shared_ptr<Connector> connector_;
+    const std::string name_;
+
+    ConnectionCallback connectionCallback_;
+    MessageCallback messageCallback_;
+    WriteCompleteCallback writeCompleteCallback_;
+    ConnectFailedCallback connectFailedCallback_;
+    TlsContextPtr tlsContext_;
+
+    bool connect_;
+    int nextConnId_;
+    mutable std::mutex mutex_;
+    TcpConnectionPtr connection_; // 被mutex_保护
+};
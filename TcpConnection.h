@@ -5,15 +5,24 @@
 #include "Callbacks.h"
 #include "Buffer.h"
 #include "Timestamp.h"
+#include "Socket.h"
+#include "Channel.h"
+#include "RateLimiter.h"
+#include "TlsContext.h"
 
+#include <deque>
 #include <memory>
 #include <atomic>
+#include <mutex>
 #include <string>
+#include <vector>
+#include <stdint.h>
+#include <sys/types.h>
 
 
 class EventLoop;
-class Channel;
-class Socket;
+class SplicePipe;
+class TlsSession;
 
 class TcpConnection : noncopyable, public std::enable_shared_from_this<TcpConnection>
 {
@@ -23,19 +32,99 @@ public:
         int sockfd,
         const InetAddress& localAddr,
         const InetAddress& peerAddr);
+    // TcpServer使用：id由ConnectionRegistry分配，名字在第一次调用name()时才拼成 namePrefix#id
+    TcpConnection(EventLoop *loop,
+        uint64_t id,
+        const std::shared_ptr<const std::string> &namePrefix,
+        int sockfd,
+        const InetAddress& localAddr,
+        const InetAddress& peerAddr);
     ~TcpConnection();
 
     EventLoop* getLoop() const {return loop_;}
-    const std::string& name() const {return name_;}
+    // TcpServer的连接有全局唯一的非0 id，可以用TcpServer::runOnConnection()从任意线程按id访问；TcpClient的连接id为0
+    uint64_t id() const {return id_;}
+    const std::string& name() const;
     const InetAddress& localAddress() const {return localAddr_;}
     const InetAddress& peerAddress() const {return peerAddr_;}
 
     bool connected() const {return state_ == kConnected;}
+    bool disconnected() const {return state_ == kDisconnected;}
+    // 收发缓冲区或转发管道中还有数据，只能在loop线程中调用
+    bool hasBufferedData() const
+    {return inputBuffer_.readableBytes() > 0 || hasPendingOutput() || relaying_;}
+    // 排队待发的字节数：outputBuffer_、共享数据和文件的剩余部分，只能在loop线程中调用
+    size_t pendingOutputBytes() const {return outputBuffer_.readableBytes() + queuedBytes_;}
+
+    void setTcpNoDelay(bool on);
 
     // 发送数据
     void send(const std::string &buf);
+    void send(const void *data, size_t len);
+    // 发送buf中的全部可读数据，buf会被清空
+    void send(Buffer *buf);
+    /**
+     * 发送文件fd中[offset, offset+count)的内容，和send()的数据按调用顺序发出；fd会被dup，调用后可以立即关闭
+     * 明文连接用sendfile，TLS连接装了kTLS时用SSL_sendfile，都不经过用户态；否则pread一块、加密、再发送
+     */
+    void sendFile(int fd, off_t offset, size_t count);
+    /**
+     * 发送共享的不可变数据：只保存引用不拷贝，和send()的数据按调用顺序发出，连续的几段由writev一次发出
+     * 同一份payload可以同时发给任意多个连接，比如广播
+     */
+    void sendShared(const SharedPayload &payload);
+    // 只排队不发送，只能在loop线程中调用，之后调用flushOutput()；给一批连接追加完再逐个flush
+    void appendShared(const SharedPayload &payload);
+
+    /**
+     * 在loop线程中(比如messageCallback_里)直接把数据写进outputBuffer()，省去一次中间拷贝
+     * 写完以后调用flushOutput()，把积攒的数据一次发出去
+     */
+    Buffer* outputBuffer() {return &outputBuffer_;}
+    void flushOutput();
+    // 接收缓冲区，只能在loop线程中访问，messageCallback_收到的就是它
+    Buffer* inputBuffer() {return &inputBuffer_;}
+
+    // 连接上挂载的用户数据，比如协议解析的上下文
+    void setContext(const std::shared_ptr<void> &context) {context_ = context;}
+    const std::shared_ptr<void>& getContext() const {return context_;}
     // 关闭连接
     void shutdown();
+    // 强制关闭连接，不等待outputBuffer_发送完
+    void forceClose();
+
+    /**
+     * 四层转发：把a收到的数据转发给b，b收到的数据转发给a
+     * zeroCopy为true时，数据经由每个方向各自的管道splice转发，不进入inputBuffer_/outputBuffer_
+     * zeroCopy为false或者splice不可用时，退回到Buffer拷贝的方式(需要加密或检查数据时使用)
+     * 两个连接必须属于同一个loop，转发开始后messageCallback_不再被调用
+     */
+    static void relay(const TcpConnectionPtr &a, const TcpConnectionPtr &b, bool zeroCopy = true);
+    bool relaying() const {return relaying_;}
+
+    /**
+     * 限速：超出预算时暂停EPOLLIN(写方向则暂停发送，数据留在outputBuffer_)，欠账还清后由loop定时器恢复
+     * 一个连接可以挂多个限速器，比如自己的一个加上所属租户共享的一个，任何一个超出都会暂停
+     * kBytes按读到/写出的字节数自动记账；kMessages由应用解析出消息后调用chargeMessages()记账
+     * 这几个接口只能在loop线程中调用(其他线程用TcpServer::runOnConnection)，速率用RateLimiter::setRate()随时调整
+     * 转发(relay)的splice路径不经过限速
+     */
+    enum RateUnit {kBytes, kMessages};
+    void addReadLimiter(const RateLimiterPtr &limiter, RateUnit unit = kBytes);
+    void addWriteLimiter(const RateLimiterPtr &limiter);
+    void clearRateLimiters();
+    void chargeMessages(uint64_t count);
+    bool readThrottled() const {return readThrottled_;}
+    bool writeThrottled() const {return writeThrottled_;}
+
+    /**
+     * 在connectEstablished()之前调用(TcpServer/TcpClient设置了TlsContext时自动调用)
+     * 握手在loop中非阻塞地进行，完成以后才调用connectionCallback_；握手前send()的数据在握手后发出
+     * 之后的读写在socket和inputBuffer_/outputBuffer_之间加解密，对messageCallback_透明
+     */
+    void startTls(const TlsContextPtr &context);
+    // 没有启用TLS时返回nullptr
+    const TlsSession* tlsSession() const {return tls_.get();}
 
     // 设置回调
     void setConnectionCallback(const ConnectionCallback& cb)
@@ -63,16 +152,48 @@ private:
     void handleError();
 
     void sendInLoop(const void* message, size_t len);
+    void sendStringInLoop(const std::string &message);
+    void sendFileInLoop(int fd, off_t offset, size_t count);
+    bool writeFileChunk(int *savedErrno);
+    // 输出流的下一个字节属于排队的文件
+    bool fileAtFront() const;
+    // 用writev发送outputBuffer_和共享数据，直到下一个文件；返回写出的字节数，-1表示出错
+    ssize_t writeOutput(int *savedErrno);
+    void retrieveOutput(size_t n);
+    bool hasPendingOutput() const {return outputBuffer_.readableBytes() > 0 || !pendingOutput_.empty();}
+
+    // socket读写，TLS连接在这里加解密
+    ssize_t readSocket(int *savedErrno);
+    ssize_t writeSocket(const void *data, size_t len, int *savedErrno);
+    bool handshaking() const;
+    void handleHandshake();
+    // 可以splice零拷贝：明文，或者两个方向都装了kTLS
+    bool spliceCapable() const;
     void shutdownInLoop();
+    void forceCloseInLoop();
+
+    void startRelayInLoop(const TcpConnectionPtr &peer, bool zeroCopy);
+    void handleRelayRead();
+    bool flushRelayInput();
+    void resumeRelaySource();
+
+    void chargeRead(RateUnit unit, uint64_t units);
+    void chargeWrite(uint64_t bytes);
+    void resumeReading();
+    void resumeWriting();
+    size_t writeQuota() const;
 
     EventLoop *loop_;   // baseLoop =》Acceptor，subloop =》TcpConnection
-    const std::string name_;
+    const uint64_t id_;
+    std::shared_ptr<const std::string> namePrefix_;
+    mutable std::string name_;
+    mutable std::once_flag nameOnce_;
     std::atomic_int state_;
     bool reading_;
 
-    // 这里和Acceptor类似
-    std::unique_ptr<Socket> socket_;
-    std::unique_ptr<Channel> channel_;
+    // 这里和Acceptor类似，直接内嵌而不是各自new一次，和连接对象在同一块内存里
+    Socket socket_;
+    Channel channel_;
 
     const InetAddress localAddr_;
     const InetAddress peerAddr_;
@@ -86,4 +207,42 @@ private:
 
     Buffer inputBuffer_; // 接收缓冲区
     Buffer outputBuffer_; // 发送缓冲区
+    std::shared_ptr<void> context_;
+
+    // 转发相关，只在loop_线程中访问
+    bool relaying_;
+    std::weak_ptr<TcpConnection> relayPeer_;    // 本端收到的数据发往relayPeer_
+    std::weak_ptr<TcpConnection> relaySource_;  // 本端发出的数据来自relaySource_
+    std::shared_ptr<SplicePipe> relayPipe_;     // 本端 => relayPeer_ 方向的管道
+    std::shared_ptr<SplicePipe> relayInput_;    // relaySource_ => 本端 方向的管道，即relaySource_的relayPipe_
+
+    // 限速相关，只在loop_线程中访问
+    struct ReadLimiter
+    {
+        RateLimiterPtr limiter;
+        RateUnit unit;
+    };
+    std::vector<ReadLimiter> readLimiters_;
+    std::vector<RateLimiterPtr> writeLimiters_;
+    bool readThrottled_;    // 读暂停中，恢复定时器已经设置
+    bool writeThrottled_;   // 写暂停中，恢复定时器已经设置
+
+    /**
+     * sendFile()排队的文件和sendShared()排队的共享数据，startAt是它在输出流中的位置：
+     * outputSent_到达startAt时outputBuffer_中排在它前面的数据已经发完，startAt相同的按排队顺序发
+     */
+    struct OutputItem
+    {
+        int fd;                 // 文件，-1表示共享数据
+        off_t offset;           // 文件或payload中下一个要发送的位置
+        size_t remaining;
+        uint64_t startAt;
+        SharedPayload payload;
+        bool isFile() const {return fd >= 0;}
+    };
+    std::deque<OutputItem> pendingOutput_;
+    uint64_t outputSent_;   // 从outputBuffer_发出的累计字节数
+    size_t queuedBytes_;    // pendingOutput_中剩余的字节数
+
+    std::unique_ptr<TlsSession> tls_;
 };
\ No newline at end of file
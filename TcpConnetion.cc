@@ -2,9 +2,25 @@
 #include "EventLoop.h"
 #include "Channel.h"
 #include "Socket.h"
+#include "SplicePipe.h"
+#include "TlsSession.h"
 #include "Logger.h"
 
+#include <algorithm>
 #include <functional>
+#include <fcntl.h>
+#include <sys/sendfile.h>
+#include <sys/uio.h>
+#include <limits.h>
+#include <unistd.h>
+
+// 拷贝转发时peer的outputBuffer_超过该值就暂停读，与splice管道的容量保持一致
+static const size_t kRelayHighWaterMark = SplicePipe::kPipeSize;
+// 限速暂停的最短时间，欠账很少时也不会每次读写都设置一个定时器
+static const int64_t kMinThrottleNanos = 1000 * 1000;
+static const size_t kMinWriteQuota = 4096;
+// writeOutput()一次writev最多的分段数，广播的小消息很多时一次系统调用能发出更多
+static const int kMaxOutputIov = IOV_MAX;
 
 static EventLoop *CheckLoopNotNull(EventLoop *loop)
 {
@@ -18,49 +34,121 @@ TcpConnection::TcpConnection(EventLoop *loop,
               int sockfd,
               const InetAddress &localAddr,
               const InetAddress &peerAddr)
-    : loop_(loop)
-    , name_(nameArg)
+    : TcpConnection(loop, 0, std::shared_ptr<const std::string>(), sockfd, localAddr, peerAddr)
+{
+    name_ = nameArg;
+}
+
+TcpConnection::TcpConnection(EventLoop *loop,
+              uint64_t id,
+              const std::shared_ptr<const std::string> &namePrefix,
+              int sockfd,
+              const InetAddress &localAddr,
+              const InetAddress &peerAddr)
+    : loop_(CheckLoopNotNull(loop))
+    , id_(id)
+    , namePrefix_(namePrefix)
     , state_(kConnecting)
     , reading_(true)
-    , socket_(new Socket(sockfd))
-    , channel_(new Channel(loop, sockfd))
+    , socket_(sockfd)
+    , channel_(loop, sockfd)
     , localAddr_(localAddr)
     , peerAddr_(peerAddr)
     , highWaterMark_(64*1024*1024) //64M
+    , relaying_(false)
+    , readThrottled_(false)
+    , writeThrottled_(false)
+    , outputSent_(0)
+    , queuedBytes_(0)
 {
-    channel_->setReadCallback(std::bind(&TcpConnection::handleRead, this, std::placeholders::_1));
-    channel_->setWriteCallback(std::bind(&TcpConnection::handleWrite, this));
-    channel_->setCloseCallback(std::bind(&TcpConnection::handleClose, this));
-    channel_->setErrorCallback(std::bind(&TcpConnection::handleError, this));
+    channel_.setReadCallback(std::bind(&TcpConnection::handleRead, this, std::placeholders::_1));
+    channel_.setWriteCallback(std::bind(&TcpConnection::handleWrite, this));
+    channel_.setCloseCallback(std::bind(&TcpConnection::handleClose, this));
+    channel_.setErrorCallback(std::bind(&TcpConnection::handleError, this));
 
-    LOG_INFO("TcpConnection::ctor[%s] at fd = %d\n", name_.c_str(), sockfd);
-    socket_->setKeepAlive(true);
+    LOG_DEBUG("TcpConnection::ctor[%lx] at fd = %d\n", static_cast<unsigned long>(id_), sockfd);
+    socket_.setKeepAlive(true);
+}
+
+// accept路径上不再格式化字符串，只有日志等真正用到名字时才拼接一次
+const std::string& TcpConnection::name() const
+{
+    std::call_once(nameOnce_, [this]()
+    {
+        if(namePrefix_)
+        {
+            char buf[32] = {0};
+            snprintf(buf, sizeof buf, "#%lx", static_cast<unsigned long>(id_));
+            name_ = *namePrefix_ + buf;
+        }
+    });
+    return name_;
 }
 
 TcpConnection::~TcpConnection()
 {
-    LOG_INFO("TcpConnection::dtor[%s] at fd = %d state = %d\n", name_.c_str(), channel_->fd(),(int)state_);
+    for(const OutputItem &item : pendingOutput_)
+    {
+        if(item.isFile())
+            ::close(item.fd);
+    }
+    LOG_DEBUG("TcpConnection::dtor[%lx] at fd = %d state = %d\n", static_cast<unsigned long>(id_), channel_.fd(),(int)state_);
+}
+
+void TcpConnection::setTcpNoDelay(bool on)
+{
+    socket_.setTcpNoDelay(on);
 }
 
 // 发送数据
 void TcpConnection::send(const std::string &buf)
+{
+    send(buf.data(), buf.size());
+}
+
+// 跨线程发送时数据必须拷贝一份放进回调里，调用者的内存在回调执行时可能已经失效
+void TcpConnection::send(const void *data, size_t len)
 {
     if(state_ == kConnected)
     {
         if(loop_->isInLoopThread())
-            sendInLoop(buf.c_str(), buf.size());
+            sendInLoop(data, len);
         else
         {
             loop_->runInLoop(std::bind(
-                &TcpConnection::sendInLoop,
-                this,
-                buf.c_str(),
-                buf.size()
+                &TcpConnection::sendStringInLoop,
+                shared_from_this(),
+                std::string(static_cast<const char*>(data), len)
             ));
         }
     }
 }
 
+void TcpConnection::send(Buffer *buf)
+{
+    if(state_ == kConnected)
+    {
+        if(loop_->isInLoopThread())
+        {
+            sendInLoop(buf->peek(), buf->readableBytes());
+            buf->retrieveAll();
+        }
+        else
+        {
+            loop_->runInLoop(std::bind(
+                &TcpConnection::sendStringInLoop,
+                shared_from_this(),
+                buf->retrieveAllAsString()
+            ));
+        }
+    }
+}
+
+void TcpConnection::sendStringInLoop(const std::string &message)
+{
+    sendInLoop(message.data(), message.size());
+}
+
 // 发送数据，应用发送数据快，但是内核发送数据慢
 // 如果发送数据成功，关闭EPOLLOUT事件
 // 如果发送数据失败，缓存起来，开启EPOLLOUT事件
@@ -81,11 +169,20 @@ void TcpConnection::sendInLoop(const void *data, size_t len)
 
     // channel_第一次开始写数据，而且缓冲区没有数据
     // channel_如果之前发送数据失败，那么会监听EPOLLOUT事件并且缓冲有数据
-    if(!channel_->isWriting() && outputBuffer_.readableBytes() == 0)
+    // 排队中的文件、限速暂停和TLS握手都要求数据先进outputBuffer_，保持发送顺序
+    if(!channel_.isWriting() && !writeThrottled_ && !handshaking() && !hasPendingOutput())
     {
-        nwrote = ::write(channel_->fd(), data, len);
+        int savedErrno = 0;
+        {
+            LoopTrace::Span span(loop_->trace(), LoopTrace::kWrite, channel_.fd());
+            nwrote = writeSocket(data, std::min(len, writeQuota()), &savedErrno);
+            span.setArg(nwrote > 0 ? nwrote : 0);
+        }
+        errno = savedErrno;
         if(nwrote >= 0)
         {
+            loop_->metrics().bytesWritten.add(nwrote);
+            chargeWrite(nwrote);
             remaining = len - nwrote;
             if(remaining == 0 && writeCompleteCallback_)
                 // 既然数据全部发送完成，不用给channel_设置epollout事件了
@@ -94,7 +191,9 @@ void TcpConnection::sendInLoop(const void *data, size_t len)
         else
         {
             nwrote = 0;
-            if(errno != EWOULDBLOCK)
+            if(errno == EWOULDBLOCK)
+                loop_->metrics().writeEagain.add();
+            else
             {
                 LOG_ERROR("TcpConnection::sendInLoop");
                 // SIGPIPE RESET
@@ -120,11 +219,250 @@ void TcpConnection::sendInLoop(const void *data, size_t len)
             && highWaterMarkCallback_)
                 loop_->queueLoop(std::bind(highWaterMarkCallback_, shared_from_this(), oldLen + remaining));
         outputBuffer_.append((char*)data + nwrote, remaining);
-        if(!channel_->isWriting())
-            channel_->enableWriting();
+        if(!channel_.isWriting() && !writeThrottled_ && !handshaking())
+            channel_.enableWriting();
     }
 }
 
+void TcpConnection::sendFile(int fd, off_t offset, size_t count)
+{
+    if(state_ != kConnected || count == 0)
+        return;
+    int dupFd = ::fcntl(fd, F_DUPFD_CLOEXEC, 0);
+    if(dupFd < 0)
+    {
+        LOG_ERROR("TcpConnection::sendFile dup error:%d \n", errno);
+        return;
+    }
+    if(loop_->isInLoopThread())
+        sendFileInLoop(dupFd, offset, count);
+    else
+        loop_->runInLoop(std::bind(&TcpConnection::sendFileInLoop, shared_from_this(), dupFd, offset, count));
+}
+
+// 文件排在outputBuffer_现有数据的后面，由handleWrite按顺序发出
+void TcpConnection::sendFileInLoop(int fd, off_t offset, size_t count)
+{
+    if(state_ == kDisconnected)
+    {
+        ::close(fd);
+        return;
+    }
+    pendingOutput_.push_back(OutputItem{fd, offset, count, outputSent_ + outputBuffer_.readableBytes(), SharedPayload()});
+    queuedBytes_ += count;
+    if(!channel_.isWriting() && !writeThrottled_ && !handshaking())
+        channel_.enableWriting();
+}
+
+void TcpConnection::sendShared(const SharedPayload &payload)
+{
+    if(state_ != kConnected || !payload || payload->empty())
+        return;
+    if(loop_->isInLoopThread())
+    {
+        appendShared(payload);
+        flushOutput();
+    }
+    else
+    {
+        TcpConnectionPtr self = shared_from_this();
+        loop_->runInLoop([self, payload]()
+        {
+            self->appendShared(payload);
+            self->flushOutput();
+        });
+    }
+}
+
+void TcpConnection::appendShared(const SharedPayload &payload)
+{
+    if(state_ == kDisconnected || !payload || payload->empty())
+        return;
+    pendingOutput_.push_back(OutputItem{-1, 0, payload->size(), outputSent_ + outputBuffer_.readableBytes(), payload});
+    queuedBytes_ += payload->size();
+}
+
+bool TcpConnection::fileAtFront() const
+{
+    return !pendingOutput_.empty() && pendingOutput_.front().isFile() && pendingOutput_.front().startAt == outputSent_;
+}
+
+/**
+ * 按输出流的顺序收集outputBuffer_的片段和共享数据，遇到文件为止，一次writev发出
+ * TLS连接只能逐段加密，只发第一段
+ */
+ssize_t TcpConnection::writeOutput(int *savedErrno)
+{
+    struct iovec iov[kMaxOutputIov];
+    int count = 0;
+    size_t total = 0;
+    const size_t quota = writeQuota();
+    const int maxIov = tls_ ? 1 : kMaxOutputIov;
+    const char *base = outputBuffer_.peek();
+    uint64_t pos = outputSent_;
+    bool beforeFile = false;
+    auto add = [&](const char *data, size_t len)
+    {
+        if(len == 0 || count == maxIov || total >= quota)
+            return;
+        iov[count].iov_base = const_cast<char*>(data);
+        iov[count].iov_len = len;
+        ++count;
+        total += len;
+    };
+    for(const OutputItem &item : pendingOutput_)
+    {
+        add(base + (pos - outputSent_), static_cast<size_t>(item.startAt - pos));
+        pos = item.startAt;
+        if(item.isFile())
+        {
+            beforeFile = true;
+            break;
+        }
+        add(item.payload->data() + item.offset, item.remaining);
+        if(count == maxIov || total >= quota)
+            break;
+    }
+    if(!beforeFile)
+        add(base + (pos - outputSent_), static_cast<size_t>(outputSent_ + outputBuffer_.readableBytes() - pos));
+    if(count == 0)
+        return 0;
+    // 超出写预算的部分截掉
+    if(total > quota)
+        iov[count - 1].iov_len -= total - quota;
+
+    ssize_t n;
+    {
+        LoopTrace::Span span(loop_->trace(), LoopTrace::kWrite, channel_.fd());
+        if(tls_)
+            n = writeSocket(iov[0].iov_base, iov[0].iov_len, savedErrno);
+        else
+        {
+            n = ::writev(channel_.fd(), iov, count);
+            if(n < 0)
+                *savedErrno = errno;
+        }
+        span.setArg(n > 0 ? n : 0);
+    }
+    if(n > 0)
+    {
+        loop_->metrics().bytesWritten.add(n);
+        retrieveOutput(static_cast<size_t>(n));
+        chargeWrite(n);
+    }
+    return n;
+}
+
+// 按输出流的顺序消费n个字节：排在队首的共享数据，或者outputBuffer_中到下一个排队项为止的数据
+void TcpConnection::retrieveOutput(size_t n)
+{
+    while(n > 0)
+    {
+        if(!pendingOutput_.empty() && pendingOutput_.front().startAt == outputSent_ && !pendingOutput_.front().isFile())
+        {
+            OutputItem &item = pendingOutput_.front();
+            size_t k = std::min(n, item.remaining);
+            item.offset += k;
+            item.remaining -= k;
+            queuedBytes_ -= k;
+            n -= k;
+            if(item.remaining == 0)
+                pendingOutput_.pop_front();
+            continue;
+        }
+        size_t limit = pendingOutput_.empty() ? outputBuffer_.readableBytes()
+            : static_cast<size_t>(pendingOutput_.front().startAt - outputSent_);
+        size_t k = std::min(n, limit);
+        if(k == 0)
+            break;
+        outputBuffer_.retrieve(k);
+        outputSent_ += k;
+        n -= k;
+    }
+}
+
+// 发送队首文件的一块，返回false表示需要等待(EAGAIN、限速或出错)
+bool TcpConnection::writeFileChunk(int *savedErrno)
+{
+    // sendfile一次最多发送的字节数，避免一个大文件长时间占住loop
+    static const size_t kMaxFileChunk = 1024 * 1024;
+    OutputItem &file = pendingOutput_.front();
+    size_t chunk = std::min(std::min(file.remaining, kMaxFileChunk), writeQuota());
+    ssize_t n = 0;
+    {
+        LoopTrace::Span span(loop_->trace(), LoopTrace::kWrite, channel_.fd());
+        if(tls_)
+            n = tls_->sendFile(file.fd, file.offset, chunk, savedErrno);
+        else
+        {
+            off_t offset = file.offset;
+            n = ::sendfile(channel_.fd(), file.fd, &offset, chunk);
+            if(n < 0)
+                *savedErrno = errno;
+        }
+        span.setArg(n > 0 ? n : 0);
+    }
+    if(n > 0)
+    {
+        loop_->metrics().bytesWritten.add(n);
+        file.offset += n;
+        file.remaining -= n;
+        queuedBytes_ -= n;
+        if(file.remaining == 0)
+        {
+            ::close(file.fd);
+            pendingOutput_.pop_front();
+        }
+        chargeWrite(n);
+        return !writeThrottled_;
+    }
+    if(n == 0)
+    {
+        // 文件比count短，剩下的部分不再发送
+        LOG_ERROR("TcpConnection::sendFile [%s] file ended early, %zu bytes not sent\n", name().c_str(), file.remaining);
+        ::close(file.fd);
+        queuedBytes_ -= file.remaining;
+        pendingOutput_.pop_front();
+        return true;
+    }
+    if(*savedErrno == EAGAIN)
+        loop_->metrics().writeEagain.add();
+    else
+        LOG_ERROR("TcpConnection::sendFile error:%d \n", *savedErrno);
+    return false;
+}
+
+// outputBuffer_已经由调用者填好，尽量直接发出，发不完的部分交给handleWrite
+void TcpConnection::flushOutput()
+{
+    if(state_ == kDisconnected || channel_.isWriting() || writeThrottled_ || handshaking()
+        || !hasPendingOutput())
+        return;
+
+    // 发到下一个文件为止，文件交给handleWrite按顺序发
+    int savedErrno = 0;
+    ssize_t n = writeOutput(&savedErrno);
+    if(n < 0)
+    {
+        if(savedErrno == EWOULDBLOCK)
+            loop_->metrics().writeEagain.add();
+        else
+        {
+            LOG_ERROR("TcpConnection::flushOutput error:%d \n", savedErrno);
+            if(savedErrno == EPIPE || savedErrno == ECONNRESET)
+                return;
+        }
+    }
+
+    if(hasPendingOutput())
+    {
+        if(!writeThrottled_)
+            channel_.enableWriting();
+    }
+    else if(writeCompleteCallback_)
+        loop_->queueLoop(std::bind(writeCompleteCallback_, shared_from_this()));
+}
+
 // 关闭连接 kDistconnecting的意义：还有数据没有发送到对端，尚且滞留在服务器中，需要标志此状态
 // 关闭连接：shutdown写端，相当于半关闭
 void TcpConnection::shutdown()
@@ -138,20 +476,236 @@ void TcpConnection::shutdown()
 
 void TcpConnection::shutdownInLoop()
 {
-    if(!channel_->isWriting())  // outputBuffer中的数据没有全部发送完成
+    // outputBuffer中的数据没有全部发送完成(正在写，或者被限速暂停)时，等发完再关闭
+    if(!channel_.isWriting() && !(writeThrottled_ && hasPendingOutput()))
     {
-        socket_->shutdownWrite(); // 关闭写端
+        if(tls_)
+            tls_->shutdown();   // 先发close_notify
+        socket_.shutdownWrite(); // 关闭写端
     }
 }
 
+void TcpConnection::forceClose()
+{
+    if(state_ == kConnected || state_ == kDisconnecting)
+    {
+        setState(kDisconnecting);
+        loop_->queueLoop(std::bind(&TcpConnection::forceCloseInLoop, shared_from_this()));
+    }
+}
+
+void TcpConnection::forceCloseInLoop()
+{
+    if(state_ == kConnected || state_ == kDisconnecting)
+        handleClose();
+}
+
+void TcpConnection::relay(const TcpConnectionPtr &a, const TcpConnectionPtr &b, bool zeroCopy)
+{
+    a->getLoop()->runInLoop([a, b, zeroCopy]()
+    {
+        a->startRelayInLoop(b, zeroCopy);
+        b->startRelayInLoop(a, zeroCopy);
+    });
+}
+
+// 建立 本端 => peer 方向的转发
+void TcpConnection::startRelayInLoop(const TcpConnectionPtr &peer, bool zeroCopy)
+{
+    if(peer->getLoop() != loop_)
+    {
+        LOG_ERROR("TcpConnection::relay [%s] and [%s] are not in the same loop\n",
+            name().c_str(), peer->name().c_str());
+        return;
+    }
+
+    relaying_ = true;
+    relayPeer_ = peer;
+    peer->relaySource_ = shared_from_this();
+    // 用户态TLS的socket里是密文，不能直接splice
+    if(zeroCopy && spliceCapable() && peer->spliceCapable())
+    {
+        std::shared_ptr<SplicePipe> pipe(new SplicePipe);
+        if(pipe->valid())
+        {
+            relayPipe_ = pipe;
+            peer->relayInput_ = pipe;
+        }
+    }
+
+    // 转发开始之前已经读到inputBuffer_的数据，经由peer的outputBuffer_发出
+    // peer的handleWrite保证先发完outputBuffer_，再发管道中的数据
+    if(inputBuffer_.readableBytes() > 0)
+    {
+        peer->sendInLoop(inputBuffer_.peek(), inputBuffer_.readableBytes());
+        inputBuffer_.retrieveAll();
+    }
+}
+
+// socket --splice--> relayPipe_ --splice--> peer socket
+void TcpConnection::handleRelayRead()
+{
+    TcpConnectionPtr peer = relayPeer_.lock();
+    if(!peer)
+    {
+        // 对端已经销毁，退回普通的读流程，由messageCallback_处理
+        relaying_ = false;
+        relayPipe_.reset();
+        handleRead(loop_->pollReturnTime());
+        return;
+    }
+
+    int savedErrno = 0;
+    ssize_t n = relayPipe_->spliceFrom(channel_.fd(), &savedErrno);
+    if(n > 0)
+    {
+        loop_->metrics().bytesRead.add(n);
+        // 对端发不动，管道中有积压，暂停读，等对端handleWrite清空管道后恢复
+        if(!peer->flushRelayInput())
+            channel_.disableReading();
+    }
+    else if(n == 0)
+        handleClose();
+    else if(savedErrno == EINVAL)
+    {
+        // 该fd不支持splice，退回拷贝转发
+        LOG_ERROR("TcpConnection::handleRelayRead [%s] splice unsupported, fall back to copy\n", name().c_str());
+        relayPipe_.reset();
+        peer->relayInput_.reset();
+        handleRead(loop_->pollReturnTime());
+    }
+    else if(savedErrno == EAGAIN)
+    {
+        // 管道的槽位用完了，继续关注EPOLLIN会在水平触发下空转，等对端清空管道后resumeRelaySource()恢复
+        if(!relayPipe_->empty())
+            channel_.disableReading();
+    }
+    else
+    {
+        errno = savedErrno;
+        LOG_ERROR("TcpConnection::handleRelayRead");
+        handleError();
+    }
+}
+
+// 把relaySource_经由管道转发过来的数据写到socket，全部写完返回true
+bool TcpConnection::flushRelayInput()
+{
+    if(!relayInput_ || relayInput_->empty())
+        return true;
+    if(state_ == kDisconnected)
+        return false;
+
+    // outputBuffer_中还有更早的数据(或文件)，必须等它们先发完
+    if(channel_.isWriting() || hasPendingOutput())
+    {
+        if(!channel_.isWriting())
+            channel_.enableWriting();
+        return false;
+    }
+
+    int savedErrno = 0;
+    ssize_t n = relayInput_->spliceTo(channel_.fd(), &savedErrno);
+    if(n > 0)
+        loop_->metrics().bytesWritten.add(n);
+    if(n < 0 && savedErrno != EAGAIN)
+    {
+        errno = savedErrno;
+        LOG_ERROR("TcpConnection::flushRelayInput");
+        return false;
+    }
+    if(!relayInput_->empty())
+    {
+        channel_.enableWriting();
+        return false;
+    }
+    return true;
+}
+
+// 本端的积压已经清空，恢复转发源的读事件
+void TcpConnection::resumeRelaySource()
+{
+    TcpConnectionPtr source = relaySource_.lock();
+    if(source && source->relaying_
+        && source->state_ != kDisconnected
+        && !source->readThrottled_
+        && !source->channel_.isReading())
+        source->channel_.enableReading();
+}
+
 // 连接建立
 // Poller => channel::readcallback => acceptor::handleread => TcpServer::newconnection => TcpConnection::connectEstablished
 void TcpConnection::connectEstablished()
 {
     setState(kConnected);
-    channel_->tie(shared_from_this());
-    channel_->enableReading();  // 向poller注册channel的epollin事件
-    connectionCallback_(shared_from_this()); // 新连接建立，执行回调，可以理解成shared_ptr<TcpConnection>
+    channel_.tie(shared_from_this());
+    channel_.enableReading();  // 向poller注册channel的epollin事件
+    // TLS连接握手完成以后才算建立，由handleHandshake()执行回调
+    if(tls_)
+        handleHandshake();
+    else if(connectionCallback_)
+        connectionCallback_(shared_from_this()); // 新连接建立，执行回调，可以理解成shared_ptr<TcpConnection>
+}
+
+void TcpConnection::startTls(const TlsContextPtr &context)
+{
+    tls_.reset(new TlsSession(context, channel_.fd()));
+}
+
+bool TcpConnection::handshaking() const
+{
+    return tls_ && !tls_->established();
+}
+
+// 握手期间读写事件都交给这里，按OpenSSL的要求切换关注的事件
+void TcpConnection::handleHandshake()
+{
+    switch(tls_->handshake())
+    {
+    case TlsSession::kDone:
+        // 握手期间send()的数据缓存在outputBuffer_中，现在开始发送
+        if(hasPendingOutput() && !writeThrottled_)
+            channel_.enableWriting();
+        else if(channel_.isWriting())
+            channel_.disableWriting();
+        if(connectionCallback_)
+            connectionCallback_(shared_from_this());
+        break;
+    case TlsSession::kWantRead:
+        if(channel_.isWriting())
+            channel_.disableWriting();
+        break;
+    case TlsSession::kWantWrite:
+        if(!channel_.isWriting())
+            channel_.enableWriting();
+        break;
+    case TlsSession::kFailed:
+        handleClose();
+        break;
+    }
+}
+
+ssize_t TcpConnection::readSocket(int *savedErrno)
+{
+    if(tls_)
+        return tls_->read(&inputBuffer_, savedErrno);
+    return inputBuffer_.readFd(channel_.fd(), savedErrno);
+}
+
+ssize_t TcpConnection::writeSocket(const void *data, size_t len, int *savedErrno)
+{
+    if(tls_)
+        return tls_->write(data, len, savedErrno);
+    ssize_t n = ::write(channel_.fd(), data, len);
+    if(n < 0)
+        *savedErrno = errno;
+    return n;
+}
+
+// splice直接搬运socket中的字节，只有明文连接，或者收发两个方向都由kTLS处理的连接才能用
+bool TcpConnection::spliceCapable() const
+{
+    return !tls_ || (tls_->ktlsSend() && tls_->ktlsRecv());
 }
 
 // 连接销毁
@@ -162,20 +716,65 @@ void TcpConnection::connectDestroyed()
     if(state_ == kConnected)
     {
         setState(kDisconnected);
-        channel_->disableAll();
-        connectionCallback_(shared_from_this());
+        channel_.disableAll();
+        if(connectionCallback_ && !handshaking())
+            connectionCallback_(shared_from_this());
     }
-    channel_->remove();
+    channel_.remove();
 }
 
 void TcpConnection::handleRead(Timestamp receiveTime)
 {
+    if(relaying_ && relayPipe_)
+    {
+        handleRelayRead();
+        return;
+    }
+    if(handshaking())
+    {
+        handleHandshake();
+        return;
+    }
+
     int savedErrno = 0;
-    ssize_t n = inputBuffer_.readFd(channel_->fd(), &savedErrno);
+    ssize_t n = 0;
+    {
+        LoopTrace::Span span(loop_->trace(), LoopTrace::kRead, channel_.fd());
+        n = readSocket(&savedErrno);
+        span.setArg(n > 0 ? n : 0);
+    }
     if(n > 0)
-        messageCallback_(shared_from_this(), &inputBuffer_, receiveTime);
+    {
+        loop_->metrics().bytesRead.add(n);
+        if(!readLimiters_.empty())
+            chargeRead(kBytes, n);
+        TcpConnectionPtr peer = relaying_ ? relayPeer_.lock() : TcpConnectionPtr();
+        if(peer)
+        {
+            // 拷贝转发：inputBuffer_ => peer的outputBuffer_，积压过多时暂停读
+            peer->sendInLoop(inputBuffer_.peek(), inputBuffer_.readableBytes());
+            inputBuffer_.retrieveAll();
+            if(peer->outputBuffer_.readableBytes() >= kRelayHighWaterMark)
+                channel_.disableReading();
+        }
+        else if(messageCallback_)
+        {
+            int64_t start = Timestamp::monotonicNanos();
+            messageCallback_(shared_from_this(), &inputBuffer_, receiveTime);
+            loop_->histograms().messageCallback.record(Timestamp::monotonicNanos() - start);
+        }
+        else
+            inputBuffer_.retrieveAll();
+    }
     else if(n == 0)
+    {
+        // 对端发了close_notify，回一个再关闭
+        if(tls_)
+            tls_->shutdown();
         handleClose();
+    }
+    else if(savedErrno == EAGAIN)
+        loop_->metrics().readEagain.add();
     else
     {
         errno = savedErrno;
@@ -191,40 +790,85 @@ void TcpConnection::handleRead(Timestamp receiveTime)
  */
 void TcpConnection::handleWrite()
 {
-    if(channel_->isWriting())
+    if(handshaking())
+    {
+        handleHandshake();
+        return;
+    }
+    if(channel_.isWriting())
     {
         int savedErrno = 0;
-        ssize_t n = outputBuffer_.writeFd(channel_->fd(), &savedErrno);
-        if(n > 0)
+        // 先发排在第一个文件之前的数据
+        if(hasPendingOutput() && !fileAtFront())
         {
-            outputBuffer_.retrieve(n);
-            if(outputBuffer_.readableBytes() == 0)
+            if(writeOutput(&savedErrno) < 0)
             {
-                // 关闭channel_写操作，因为只有发现对端write失败时，才需要开启EPOLLOUT等待事件
-                channel_->disableWriting();
-                if(writeCompleteCallback_)
-                    loop_->queueLoop(std::bind(writeCompleteCallback_, shared_from_this()));
-                if(state_ == kDisconnecting)
-                    shutdownInLoop();
+                if(savedErrno == EAGAIN)
+                    loop_->metrics().writeEagain.add();
+                else
+                    LOG_ERROR("TcpConnection::handleWrite");
+                return;
             }
         }
-        else
-        {LOG_ERROR("TcpConnection::handleWrite");}
+
+        // 轮到文件了就发一块，文件发完以后下一次handleWrite再发它后面的数据
+        if(!writeThrottled_ && fileAtFront())
+        {
+            if(!writeFileChunk(&savedErrno) && !writeThrottled_)
+                return;
+        }
+
+        // 超出写预算，剩下的数据等resumeWriting()再发
+        if(writeThrottled_ && hasPendingOutput())
+        {
+            channel_.disableWriting();
+            return;
+        }
+
+        // outputBuffer_发完以后，再发转发管道中的数据
+        if(!hasPendingOutput() && relayInput_ && !relayInput_->empty())
+        {
+            ssize_t n = relayInput_->spliceTo(channel_.fd(), &savedErrno);
+            if(n > 0)
+                loop_->metrics().bytesWritten.add(n);
+            if(n < 0 && savedErrno != EAGAIN)
+            {
+                // 管道里的数据再也发不出去，继续关注EPOLLOUT只会反复得到同一个错误，直接关闭连接
+                LOG_ERROR("TcpConnection::handleWrite splice error:%d \n", savedErrno);
+                channel_.disableWriting();
+                handleClose();
+                return;
+            }
+        }
+
+        if(!hasPendingOutput() && (!relayInput_ || relayInput_->empty()))
+        {
+            // 关闭channel_写操作，因为只有发现对端write失败时，才需要开启EPOLLOUT等待事件
+            channel_.disableWriting();
+            if(writeCompleteCallback_)
+                loop_->queueLoop(std::bind(writeCompleteCallback_, shared_from_this()));
+            resumeRelaySource();
+            if(state_ == kDisconnecting)
+                shutdownInLoop();
+        }
     }
     else
-    {LOG_ERROR("TcpConnection fd = %d is down, no more writing \n", channel_->fd());}
+    {LOG_ERROR("TcpConnection fd = %d is down, no more writing \n", channel_.fd());}
 }
 
 // poller => channel::closeCallback => TcpConnection::handleClose => TcpSerevr::removeConnection => TcpConnection::connectDestroyed
 void TcpConnection::handleClose()
 {
-    LOG_INFO("TcpConnection::handleClose fd = %d state = %d \n", channel_->fd(), (int)state_);
+    LOG_DEBUG("TcpConnection::handleClose fd = %d state = %d \n", channel_.fd(), (int)state_);
     setState(kDisconnected);
-    channel_->disableAll();
+    channel_.disableAll();
 
     TcpConnectionPtr connPtr(shared_from_this());
-    connectionCallback_(connPtr); // 连接关闭，执行回调
-    closeCallback_(connPtr);    //关闭连接的回调
+    // 握手没有完成的TLS连接对用户不可见，不执行连接回调
+    if(connectionCallback_ && !handshaking())
+        connectionCallback_(connPtr); // 连接关闭，执行回调
+    if(closeCallback_)
+        closeCallback_(connPtr);    //关闭连接的回调
 }
 
 void TcpConnection::handleError()
@@ -232,11 +876,116 @@ void TcpConnection::handleError()
     int optval;
     socklen_t optlen = sizeof optval;
     int err = 0;
-    if(::getsockopt(channel_->fd(), SOL_SOCKET, SO_ERROR, &optval, &optlen) < 0)
+    if(::getsockopt(channel_.fd(), SOL_SOCKET, SO_ERROR, &optval, &optlen) < 0)
         err = errno;
     else
         err = optval;
-    LOG_ERROR("TcpConnection::handleError name:%s - SO_ERROR:%d \n", name_.c_str(), err);
+    LOG_ERROR("TcpConnection::handleError name:%s - SO_ERROR:%d \n", name().c_str(), err);
+}
+
+
+
+void TcpConnection::addReadLimiter(const RateLimiterPtr &limiter, RateUnit unit)
+{
+    readLimiters_.push_back(ReadLimiter{limiter, unit});
 }
 
+void TcpConnection::addWriteLimiter(const RateLimiterPtr &limiter)
+{
+    writeLimiters_.push_back(limiter);
+}
+
+// 已经设置的恢复定时器照常触发，只是之后不再暂停
+void TcpConnection::clearRateLimiters()
+{
+    readLimiters_.clear();
+    writeLimiters_.clear();
+}
 
+void TcpConnection::chargeMessages(uint64_t count)
+{
+    if(!readLimiters_.empty())
+        chargeRead(kMessages, count);
+}
+
+// 所有同单位的限速器都要记账(共享的租户限速器要反映真实用量)，暂停时间取最长的欠账
+void TcpConnection::chargeRead(RateUnit unit, uint64_t units)
+{
+    int64_t now = Timestamp::monotonicNanos();
+    int64_t wait = 0;
+    for(const ReadLimiter &item : readLimiters_)
+    {
+        if(item.unit == unit)
+            wait = std::max(wait, item.limiter->consume(units, now));
+    }
+    if(wait == 0 || readThrottled_ || state_ == kDisconnected)
+        return;
+
+    readThrottled_ = true;
+    channel_.disableReading();
+    std::weak_ptr<TcpConnection> weak(shared_from_this());
+    loop_->runAfter(std::max(wait, kMinThrottleNanos) / 1e9, [weak]()
+    {
+        TcpConnectionPtr conn = weak.lock();
+        if(conn)
+            conn->resumeReading();
+    });
+}
+
+void TcpConnection::chargeWrite(uint64_t bytes)
+{
+    if(writeLimiters_.empty() || bytes == 0)
+        return;
+    int64_t now = Timestamp::monotonicNanos();
+    int64_t wait = 0;
+    for(const RateLimiterPtr &limiter : writeLimiters_)
+        wait = std::max(wait, limiter->consume(bytes, now));
+    if(wait == 0 || writeThrottled_)
+        return;
+
+    writeThrottled_ = true;
+    std::weak_ptr<TcpConnection> weak(shared_from_this());
+    loop_->runAfter(std::max(wait, kMinThrottleNanos) / 1e9, [weak]()
+    {
+        TcpConnectionPtr conn = weak.lock();
+        if(conn)
+            conn->resumeWriting();
+    });
+}
+
+// 先写后记账，单次写入不能太大，否则一次write就能把整个socket发送缓冲区(可能有几MB)写满，限速形同虚设
+size_t TcpConnection::writeQuota() const
+{
+    if(writeLimiters_.empty())
+        return static_cast<size_t>(-1);
+    double burst = writeLimiters_[0]->burst();
+    for(const RateLimiterPtr &limiter : writeLimiters_)
+        burst = std::min(burst, limiter->burst());
+    return std::max(static_cast<size_t>(burst), kMinWriteQuota);
+}
+
+void TcpConnection::resumeReading()
+{
+    readThrottled_ = false;
+    if(state_ == kDisconnected || channel_.isReading())
+        return;
+    // 拷贝转发因为对端积压暂停了读，交给对端的resumeRelaySource()恢复
+    TcpConnectionPtr peer = relaying_ ? relayPeer_.lock() : TcpConnectionPtr();
+    if(peer && peer->outputBuffer_.readableBytes() >= kRelayHighWaterMark)
+        return;
+    channel_.enableReading();
+}
+
+void TcpConnection::resumeWriting()
+{
+    writeThrottled_ = false;
+    if(state_ == kDisconnected)
+        return;
+    if(hasPendingOutput())
+    {
+        if(!channel_.isWriting() && !handshaking())
+            channel_.enableWriting();
+    }
+    else if(state_ == kDisconnecting)
+        shutdownInLoop();
+}
@@ -3,6 +3,9 @@
 #include "TcpConnection.h"
 
 #include <strings.h>
+#include <stdio.h>
+#include <sys/socket.h>
+#include <unistd.h>
 
 static EventLoop* CheckLoopNotNull(EventLoop *loop)
 {
@@ -22,27 +25,58 @@ TcpServer::TcpServer(EventLoop *loop,
     , threadPool_(new EventLoopThreadPool(loop, name_))
     , connectionCallback_()
     , messageCallback_()
-    , nextConnId_(1)
     , started_(0)
+    , connNamePrefix_(std::make_shared<const std::string>(name_ + "-" + ipPort_))
+    , nextShard_(0)
+    , acceptPaused_(false)
+    , draining_(false)
+    , drainForced_(false)
+    , drainStartNanos_(0)
+    , drainDeadlineNanos_(0)
 {
     acceptor_->setNewConnectionCallback(std::bind(&TcpServer::newConnection, this,
         std::placeholders::_1, std::placeholders::_2));
 }
 
-/**
- * 不仅需要释放TcpConnection指针，同时还要让EventLoop的poller放弃监听channel的事件
- * 这里的做法很巧妙：使用局部变量来绑定shared_ptr，释放类作用域的shared_ptr
- * 但我感觉先EPOLLEDL掉poller监听的事件，再释放类作用域的资源不是更好么.........
- */
+TcpServer::TcpServer(EventLoop *loop,
+          int listenFd,
+          const std::string &nameArg)
+    : loop_(CheckLoopNotNull(loop))
+    , ipPort_(InetAddress::getLocalAddr(listenFd).toIpPort())
+    , name_(nameArg)
+    , acceptor_(new Acceptor(loop, listenFd))
+    , threadPool_(new EventLoopThreadPool(loop, name_))
+    , connectionCallback_()
+    , messageCallback_()
+    , started_(0)
+    , connNamePrefix_(std::make_shared<const std::string>(name_ + "-" + ipPort_))
+    , nextShard_(0)
+    , acceptPaused_(false)
+    , draining_(false)
+    , drainForced_(false)
+    , drainStartNanos_(0)
+    , drainDeadlineNanos_(0)
+{
+    acceptor_->setNewConnectionCallback(std::bind(&TcpServer::newConnection, this,
+        std::placeholders::_1, std::placeholders::_2));
+}
+
+// 连接表按loop分片，每个分片投递到自己的loop中销毁连接，任务持有分片的shared_ptr，不依赖TcpServer的生命周期
 TcpServer::~TcpServer()
 {
-    for(auto &item : connections_)
+    if(admission_)
     {
-        TcpConnectionPtr conn(item.second);
-        item.second.reset();
-
-        // bind绑定，绑定智能指针shared_ptr也是可以的，不一定非要是纯指针
-        conn->getLoop()->runInLoop(std::bind(&TcpConnection::connectDestroyed, conn));
+        loop_->cancel(lagProbeTimer_);
+        loop_->cancel(resumeTimer_);
+    }
+    // drain的定时器绑定了this，drain中途析构时必须取消
+    if(draining_)
+        loop_->cancel(drainTimer_);
+    for(RegistryPtr &shard : shards_)
+    {
+        RegistryPtr registry(shard);
+        shard.reset();
+        registry->getLoop()->runInLoop(std::bind(&ConnectionRegistry::destroyAll, registry));
     }
 }
 
@@ -51,64 +85,358 @@ void TcpServer::setThreadNum(int numThreads)
     threadPool_->setThreadNum(numThreads);
 }
 
+void TcpServer::setAdmissionPolicy(const AdmissionControl::Policy &policy)
+{
+    if(started_ > 0)
+    {
+        LOG_ERROR("TcpServer [%s] setAdmissionPolicy after start() ignored\n", name_.c_str());
+        return;
+    }
+    admission_ = std::make_shared<AdmissionControl>(policy);
+}
+
+AdmissionControl::Stats TcpServer::admissionStats() const
+{
+    return admission_ ? admission_->stats() : AdmissionControl::Stats();
+}
+
 // 开启服务器监听 loop.loop()
 void TcpServer::start()
 {
    if(started_++ == 0) // 防止一个TcpServer对象被多次start
    {
        threadPool_->start(threadInitCallback_); // 启动底层loop线程池
+       // 没有subLoop时getAllLoops()只返回baseLoop
+       std::vector<EventLoop*> loops = threadPool_->getAllLoops();
+       if(loops.size() > ConnectionRegistry::kMaxShards)
+           LOG_FATAL("TcpServer [%s] supports at most %u loops\n", name_.c_str(), ConnectionRegistry::kMaxShards);
+       for(size_t i = 0; i < loops.size(); ++i)
+       {
+           shards_.push_back(std::make_shared<ConnectionRegistry>(loops[i], static_cast<uint32_t>(i)));
+           shards_.back()->setAdmission(admission_);
+       }
+       std::shared_ptr<ConnectionSetup> setup = std::make_shared<ConnectionSetup>();
+       setup->connectionCallback = connectionCallback_;
+       setup->messageCallback = messageCallback_;
+       setup->writeCompleteCallback = writeCompleteCallback_;
+       setup->tlsContext = tlsContext_;
+       setup->namePrefix = connNamePrefix_;
+       connectionSetup_ = setup;
+       if(admission_ && admission_->policy().maxLoopLagSeconds > 0)
+           lagProbeTimer_ = loop_->runEvery(admission_->policy().lagProbeSeconds, std::bind(&TcpServer::probeLoopLag, this));
        loop_->runInLoop(std::bind(&Acceptor::listen, acceptor_.get())); // baseLoop启动监听
    } 
 }
 
+std::vector<LoopMetrics::Snapshot> TcpServer::loopMetrics() const
+{
+    std::vector<LoopMetrics::Snapshot> result(1, loop_->metrics().snapshot());
+    for(EventLoop *ioLoop : threadPool_->getAllLoops())
+    {
+        if(ioLoop != loop_)
+            result.push_back(ioLoop->metrics().snapshot());
+    }
+    return result;
+}
+
+LoopMetrics::Snapshot TcpServer::totalMetrics() const
+{
+    LoopMetrics::Snapshot total;
+    for(const LoopMetrics::Snapshot &s : loopMetrics())
+        total += s;
+    return total;
+}
+
+std::vector<LoopHistograms> TcpServer::loopHistograms() const
+{
+    std::vector<LoopHistograms> result(1, loop_->histograms());
+    for(EventLoop *ioLoop : threadPool_->getAllLoops())
+    {
+        if(ioLoop != loop_)
+            result.push_back(ioLoop->histograms());
+    }
+    return result;
+}
+
+LoopHistograms TcpServer::totalHistograms() const
+{
+    LoopHistograms total;
+    for(const LoopHistograms &h : loopHistograms())
+        total += h;
+    return total;
+}
+
+size_t TcpServer::numConnections() const
+{
+    size_t total = 0;
+    for(const RegistryPtr &shard : shards_)
+        total += shard->size();
+    return total;
+}
+
+void TcpServer::runOnConnection(uint64_t connId, const ConnectionCallback &cb)
+{
+    uint32_t index = ConnectionRegistry::shardOf(connId);
+    if(index >= shards_.size())
+        return;
+    RegistryPtr shard = shards_[index];
+    shard->getLoop()->runInLoop([shard, connId, cb]()
+    {
+        TcpConnectionPtr conn = shard->find(connId);
+        if(conn)
+            cb(conn);
+    });
+}
+
+void TcpServer::send(uint64_t connId, const std::string &message)
+{
+    runOnConnection(connId, [message](const TcpConnectionPtr &conn)
+    {
+        conn->send(message);
+    });
+}
+
 // 有一个新的客户端连接，acceptor执行这个回调
+// baseLoop只负责轮询选出分片，连接对象的创建和登记都在分片所属的subLoop中完成
 void TcpServer::newConnection(int sockfd, const InetAddress &peerAddr)
 {
-    // 轮询算法，选择一个subLoop来管理channel
-    EventLoop *ioLoop = threadPool_->getNextLoop();
-    char buf[64] = {0};
-    snprintf(buf, sizeof buf, "-%s#%d", ipPort_.c_str(), nextConnId_);
-    ++nextConnId_;
-    std::string connName = name_ + buf;
+    ConnectionRegistry *shard;
+    if(admission_)
+    {
+        shard = admit(sockfd, peerAddr);
+        if(shard == nullptr)
+            return;
+    }
+    else
+    {
+        shard = shards_[nextShard_].get();
+        nextShard_ = (nextShard_ + 1) % shards_.size();
+    }
+    // 在subLoop建立连接之前也要计数，准入控制的每loop上限和drain都依赖它
+    shard->addInFlight();
+    shard->getLoop()->runInLoop(std::bind(&TcpServer::newConnectionInLoop, shards_[shard->shard()], connectionSetup_,
+        sockfd, peerAddr));
+}
 
-    LOG_INFO("TcpServer::newConnection [%s] -new connection [%s] from %s \n",
-        name_.c_str(), connName.c_str(), peerAddr.toIpPort().c_str());
+// 先查服务器和来源IP的上限，再从轮询位置开始找第一个没有满、也没有过载的分片
+// 返回nullptr时连接已经被拒绝
+ConnectionRegistry* TcpServer::admit(int sockfd, const InetAddress &peerAddr)
+{
+    const AdmissionControl::Policy &policy = admission_->policy();
+    AdmissionControl::Verdict verdict = admission_->acquire(peerAddr);
+    if(verdict != AdmissionControl::kAdmitted)
+    {
+        admission_->countRejected(verdict);
+        // 单个来源IP超限不影响其他客户端，不暂停accept
+        reject(sockfd, verdict == AdmissionControl::kServerLimit);
+        return nullptr;
+    }
+
+    const int64_t now = policy.detectsOverload() ? Timestamp::monotonicNanos() : 0;
+    bool belowLimit = false;
+    for(size_t i = 0; i < shards_.size(); ++i)
+    {
+        size_t index = (nextShard_ + i) % shards_.size();
+        ConnectionRegistry *shard = shards_[index].get();
+        if(policy.maxConnectionsPerLoop > 0 && shard->load() >= policy.maxConnectionsPerLoop)
+            continue;
+        belowLimit = true;
+        if(overloaded(shard, now))
+            continue;
+        nextShard_ = (index + 1) % shards_.size();
+        admission_->countAdmitted();
+        return shard;
+    }
+
+    admission_->release(peerAddr);
+    if(belowLimit)
+        admission_->countShed();
+    else
+        admission_->countLoopLimit();
+    reject(sockfd, true);
+    return nullptr;
+}
+
+bool TcpServer::overloaded(ConnectionRegistry *shard, int64_t nowNanos) const
+{
+    const AdmissionControl::Policy &policy = admission_->policy();
+    if(policy.maxPendingFunctors > 0 && shard->getLoop()->metrics().lastPendingDepth.get() > policy.maxPendingFunctors)
+        return true;
+    return policy.maxLoopLagSeconds > 0 && shard->lagNanos(nowNanos) > policy.maxLoopLagSeconds * 1e9;
+}
+
+void TcpServer::reject(int sockfd, bool pauseAccept)
+{
+    AdmissionControl::RejectAction action = admission_->policy().action;
+    if(action == AdmissionControl::kReset)
+    {
+        struct linger lg = {1, 0};
+        ::setsockopt(sockfd, SOL_SOCKET, SO_LINGER, &lg, sizeof lg);
+    }
+    ::close(sockfd);
+
+    // 暂停期间新连接留在内核backlog中，由内核限流；drain已经停止accept时不再恢复
+    if(action == AdmissionControl::kPauseAccept && pauseAccept && !acceptPaused_ && !draining_)
+    {
+        acceptPaused_ = true;
+        admission_->countPause();
+        acceptor_->stopListening();
+        resumeTimer_ = loop_->runAfter(admission_->policy().pauseSeconds, [this]()
+        {
+            acceptPaused_ = false;
+            if(!draining_)
+                acceptor_->resumeListening();
+        });
+    }
+}
+
+// baseLoop定时向每个分片投递一个探测任务，上一个还没执行完时不再投递，等待时间由lagNanos()累计
+void TcpServer::probeLoopLag()
+{
+    int64_t now = Timestamp::monotonicNanos();
+    for(const RegistryPtr &shard : shards_)
+    {
+        if(shard->lagProbePending())
+            continue;
+        shard->beginLagProbe(now);
+        RegistryPtr registry(shard);
+        registry->getLoop()->queueLoop([registry]()
+        {
+            registry->finishLagProbe(Timestamp::monotonicNanos());
+        });
+    }
+}
+
+void TcpServer::newConnectionInLoop(const RegistryPtr &shard, const ConnectionSetupPtr &setup,
+    int sockfd, const InetAddress &peerAddr)
+{
+    EventLoop *ioLoop = shard->getLoop();
+    uint64_t connId = shard->allocate();
+
+    LOG_DEBUG("TcpServer::newConnection [%s] -new connection [%lx] from %s \n",
+        setup->namePrefix->c_str(), static_cast<unsigned long>(connId), peerAddr.toIpPort().c_str());
 
     // 通过sockfd获取本地主机的ip地址和端口信息
-    sockaddr_in local;
-    ::bzero(&local, sizeof local);
-    socklen_t addrlen = sizeof local;
-    if(::getsockname(sockfd, (sockaddr*)&local, &addrlen) < 0)
-        LOG_ERROR("sockets::getLocalAddr");
-    InetAddress localAddr(local);
+    InetAddress localAddr = InetAddress::getLocalAddr(sockfd);
 
     // 根据连接成功的sockfd，创建TcpConnection连接对象
-    TcpConnectionPtr conn(new TcpConnection(
+    // 控制块、TcpConnection及其内嵌的Socket/Channel是本分片内存池中的一整块，连接释放后回到池子复用
+    TcpConnectionPtr conn = std::allocate_shared<TcpConnection>(
+        PoolAllocator<TcpConnection>(shard->pool()),
         ioLoop,
-        connName,
-        sockfd, 
+        connId,
+        setup->namePrefix,
+        sockfd,
         localAddr,
-        peerAddr));
-    connections_[connName] = conn;
+        peerAddr);
+    shard->insert(connId, conn);
+    shard->removeInFlight();
     // 用户设置回调函数TcpServer=>TcpConnection=>channel
-    conn->setConnectionCallback(connectionCallback_);
-    conn->setMessageCallback(messageCallback_);
-    conn->setWriteCompleteCallback(writeCompleteCallback_);
-    // 设置了如何销毁连接，而不是关闭连接
-    conn->setCloseCallback(std::bind(&TcpServer::removeConnection, this, std::placeholders::_1));
-    ioLoop->runInLoop(std::bind(&TcpConnection::connectEstablished, conn));
+    conn->setConnectionCallback(setup->connectionCallback);
+    conn->setMessageCallback(setup->messageCallback);
+    conn->setWriteCompleteCallback(setup->writeCompleteCallback);
+    // 连接关闭时直接在本loop中从分片移除并销毁，不再绕道baseLoop
+    conn->setCloseCallback(std::bind(&ConnectionRegistry::removeConnection, shard, std::placeholders::_1));
+    if(setup->tlsContext)
+        conn->startTls(setup->tlsContext);
+    conn->connectEstablished();
+}
+
+// tick间隔，也是强制关闭以后等待连接真正关闭的时间
+static const double kDrainTickSeconds = 0.1;
+
+std::string TcpServer::DrainProgress::toString() const
+{
+    char buf[160] = {0};
+    snprintf(buf, sizeof buf, "elapsed=%.3fs remaining=%zu half_closed=%zu force_closed=%zu finished=%d",
+        elapsedSeconds, remaining, halfClosed, forceClosed, finished ? 1 : 0);
+    return buf;
+}
+
+void TcpServer::drain(double timeoutSeconds, const DrainCallback &cb)
+{
+    loop_->runInLoop(std::bind(&TcpServer::drainInLoop, this, timeoutSeconds, cb));
 }
 
-void TcpServer::removeConnection(const TcpConnectionPtr &conn)
+void TcpServer::drainInLoop(double timeoutSeconds, const DrainCallback &cb)
 {
-    loop_->runInLoop(std::bind(&TcpServer::removeConnectionInLoop, this, conn));
+    if(draining_)
+        return;
+    draining_ = true;
+    acceptor_->stopListening();
+    // 准入控制暂停accept时留下的恢复定时器也要取消，否则drain结束以后它会重新开始监听
+    if(acceptPaused_)
+    {
+        loop_->cancel(resumeTimer_);
+        acceptPaused_ = false;
+    }
+
+    // 上一次drain可能强制关闭过连接，状态要重新开始，否则第一个tick就会直接报告结束
+    drainForced_ = false;
+    drainTimer_ = TimerId();
+    drainCallback_ = cb;
+    drainCounters_ = std::make_shared<DrainCounters>();
+    drainStartNanos_ = Timestamp::monotonicNanos();
+    drainDeadlineNanos_ = drainStartNanos_ + static_cast<int64_t>(timeoutSeconds * 1e9);
+    LOG_INFO("TcpServer [%s] draining %zu connections, timeout %.3fs\n", name_.c_str(), numConnections(), timeoutSeconds);
+
+    drainTick();
+    if(draining_)
+        drainTimer_ = loop_->runEvery(kDrainTickSeconds, std::bind(&TcpServer::drainTick, this));
 }
 
-void TcpServer::removeConnectionInLoop(const TcpConnectionPtr &conn)
+// baseLoop只负责计时和汇总，对连接的操作投递到各自的loop中完成
+void TcpServer::drainTick()
 {
-    LOG_INFO("TcpServer::removeConnectionInLoop [%s] - connection %s\n",
-        name_.c_str(), conn->name().c_str());
-    connections_.erase(conn->name()); // map_erase以后不会立即释放内存，而是有自己的回收机制，在合适时间进行回收
-    EventLoop *ioLoop = conn->getLoop();
-    ioLoop->queueLoop(std::bind(&TcpConnection::connectDestroyed, conn));
+    const int64_t now = Timestamp::monotonicNanos();
+    const bool force = !drainForced_ && now >= drainDeadlineNanos_;
+    const bool waitedAfterForce = drainForced_;
+    if(force)
+        drainForced_ = true;
+
+    std::shared_ptr<DrainCounters> counters = drainCounters_;
+    IdlePredicate idle = drainIdlePredicate_;
+    for(const RegistryPtr &shard : shards_)
+    {
+        RegistryPtr registry(shard);
+        registry->getLoop()->runInLoop([registry, counters, idle, force]()
+        {
+            registry->forEach([&](const TcpConnectionPtr &conn)
+            {
+                if(force)
+                {
+                    if(!conn->disconnected())
+                    {
+                        conn->forceClose();
+                        counters->forceClosed.fetch_add(1, std::memory_order_relaxed);
+                    }
+                }
+                // shutdown()在outputBuffer_还有数据时只标记状态，handleWrite发完以后再半关闭
+                else if(conn->connected() && (idle ? idle(conn) : !conn->hasBufferedData()))
+                {
+                    conn->shutdown();
+                    counters->halfClosed.fetch_add(1, std::memory_order_relaxed);
+                }
+            });
+        });
+    }
+
+    DrainProgress progress;
+    progress.elapsedSeconds = (now - drainStartNanos_) / 1e9;
+    // 已经accept、还在投递给subLoop途中的连接也算，否则drain可能在它们建立之前就报告结束
+    progress.remaining = 0;
+    for(const RegistryPtr &shard : shards_)
+        progress.remaining += shard->load();
+    progress.halfClosed = counters->halfClosed.load(std::memory_order_relaxed);
+    progress.forceClosed = counters->forceClosed.load(std::memory_order_relaxed);
+    // 强制关闭是投递出去的，至少再等一个tick才算结束
+    progress.finished = progress.remaining == 0 || waitedAfterForce;
+    if(progress.finished)
+    {
+        draining_ = false;
+        loop_->cancel(drainTimer_);
+        LOG_INFO("TcpServer [%s] drained: %s\n", name_.c_str(), progress.toString().c_str());
+    }
+    if(drainCallback_)
+        drainCallback_(progress);
 }
@@ -8,12 +8,14 @@
 #include "Callbacks.h"
 #include "TcpConnection.h"
 #include "Buffer.h"
+#include "ConnectionRegistry.h"
+#include "AdmissionControl.h"
 
 #include <functional>
 #include <string>
 #include <memory>
 #include <atomic>
-#include <unordered_map>
+#include <vector>
 
 // 对外的服务器编程使用的类
 class TcpServer : noncopyable
@@ -21,26 +23,105 @@ class TcpServer : noncopyable
     public:
     using ThreadInitCallback = std::function<void(EventLoop*)>;
     enum Option{kNoReusePort, kReusePort};
+
+    // drain()的进度，计数都是累计值
+    struct DrainProgress
+    {
+        double elapsedSeconds = 0;
+        size_t remaining = 0;       // 还没关闭的连接数
+        size_t halfClosed = 0;      // 空闲后被shutdown半关闭的连接数
+        size_t forceClosed = 0;     // 到期后被强制关闭的连接数
+        bool finished = false;      // 最后一次回调为true
+        std::string toString() const;
+    };
+    using DrainCallback = std::function<void(const DrainProgress&)>;
+    // drain时判断连接是否空闲(可以半关闭)，在连接所属loop中调用
+    using IdlePredicate = std::function<bool(const TcpConnectionPtr&)>;
+
     TcpServer(EventLoop *loop,
         const InetAddress &listenAddr,
         const std::string &nameArg,
         Option option = kNoReusePort);
+    // 接管一个已经在监听的socket，用于热重启(见HotRestart)
+    TcpServer(EventLoop *loop,
+        int listenFd,
+        const std::string &nameArg);
     ~TcpServer();
 
+    // 回调都在start()之前设置，start()时复制一份给新连接使用
     void setThreadInitCallback(const ThreadInitCallback &cb){threadInitCallback_ = cb;}
     void setConnectionCallback(const ConnectionCallback &cb){connectionCallback_ = cb;}
     void setMessageCallback(const MessageCallback &cb){messageCallback_ = cb;}
     void setWriteComplete(const WriteCompleteCallback &cb){writeCompleteCallback_ = cb;}
+    // 默认收发缓冲区都为空就算空闲；请求交给其他线程异步处理的服务需要自己判断是否还有未完成的请求
+    void setDrainIdlePredicate(const IdlePredicate &pred){drainIdlePredicate_ = pred;}
 
     void setThreadNum(int numThreads);
+    // 准入控制和过载保护(见AdmissionControl)，在start()之前设置
+    void setAdmissionPolicy(const AdmissionControl::Policy &policy);
+    // 设置以后所有新连接先做TLS握手，握手完成才执行connectionCallback，在start()之前调用
+    void setTlsContext(const TlsContextPtr &context) {tlsContext_ = context;}
+    // 没有设置准入策略时返回全0
+    AdmissionControl::Stats admissionStats() const;
+
+    const std::string& ipPort() const {return ipPort_;}
+    const std::string& name() const {return name_;}
+    EventLoop* getLoop() const {return loop_;}
+    int listenFd() const {return acceptor_->fd();}
+    // 监听socket已经交给新进程，本进程析构时不再删除Unix域socket文件
+    void handOffListener() {acceptor_->releaseUnixPath();}
+
+    // 各个loop的统计快照，第0个是负责accept的baseLoop，其余是subLoop，可以在任意线程调用
+    std::vector<LoopMetrics::Snapshot> loopMetrics() const;
+    // 所有loop汇总后的统计
+    LoopMetrics::Snapshot totalMetrics() const;
+    // 各个loop延迟直方图的快照，顺序同loopMetrics()
+    std::vector<LoopHistograms> loopHistograms() const;
+    LoopHistograms totalHistograms() const;
+
+    // 按连接id(TcpConnection::id())在连接所属loop中执行cb，连接已经关闭时cb不会被调用，可以在任意线程调用
+    void runOnConnection(uint64_t connId, const ConnectionCallback &cb);
+    // 按连接id发送数据，连接已经关闭时丢弃
+    void send(uint64_t connId, const std::string &message);
+    // 当前连接数，可以在任意线程调用
+    size_t numConnections() const;
 
     void start();
+
+    /**
+     * 优雅下线，可以在任意线程调用，不阻塞任何loop：
+     * 1. 停止accept新连接
+     * 2. 每个tick把已经空闲的连接shutdown半关闭，对端读到EOF后关闭连接；忙的连接继续处理，outputBuffer_发完后再半关闭
+     * 3. 超过timeoutSeconds仍未关闭的连接强制关闭
+     * cb在baseLoop中每个tick调用一次报告进度，所有连接关闭(或强制关闭后又等了一个tick)时最后调用一次，finished为true
+     */
+    void drain(double timeoutSeconds, const DrainCallback &cb = DrainCallback());
+    bool draining() const {return draining_;}
+
 private:
-    void newConnection(int sockfd, const InetAddress &peerAddr);
-    void removeConnection(const TcpConnectionPtr &conn);
-    void removeConnectionInLoop(const TcpConnectionPtr &conn);
+    using RegistryPtr = std::shared_ptr<ConnectionRegistry>;
+
+    // 建立新连接需要的全部配置，start()时做成不可变的快照；投递到subLoop的任务只持有它和分片，
+    // TcpServer在任务执行之前析构也不受影响
+    struct ConnectionSetup
+    {
+        ConnectionCallback connectionCallback;
+        MessageCallback messageCallback;
+        WriteCompleteCallback writeCompleteCallback;
+        TlsContextPtr tlsContext;
+        std::shared_ptr<const std::string> namePrefix;
+    };
+    using ConnectionSetupPtr = std::shared_ptr<const ConnectionSetup>;
 
-    using ConnectionMap = std::unordered_map<std::string, TcpConnectionPtr>;
+    void newConnection(int sockfd, const InetAddress &peerAddr);
+    static void newConnectionInLoop(const RegistryPtr &shard, const ConnectionSetupPtr &setup,
+        int sockfd, const InetAddress &peerAddr);
+    ConnectionRegistry* admit(int sockfd, const InetAddress &peerAddr);
+    bool overloaded(ConnectionRegistry *shard, int64_t nowNanos) const;
+    void reject(int sockfd, bool pauseAccept);
+    void probeLoopLag();
+    void drainInLoop(double timeoutSeconds, const DrainCallback &cb);
+    void drainTick();
 
     EventLoop *loop_; // baseLoop
     
@@ -54,9 +135,32 @@ private:
     MessageCallback messageCallback_;
     WriteCompleteCallback writeCompleteCallback_;
     ThreadInitCallback threadInitCallback_;
+    TlsContextPtr tlsContext_;
 
     std::atomic_int started_;
 
-    int nextConnId_;
-    ConnectionMap connections_; // 运行在subLoop，保存所有TcpConnection连接
+    std::shared_ptr<const std::string> connNamePrefix_; // 所有连接共享的名字前缀 name-ip:port
+    ConnectionSetupPtr connectionSetup_; // start()时创建
+    std::vector<RegistryPtr> shards_;   // 下标与loop一一对应，start()以后不再变化，每个分片只在自己的loop中修改
+    size_t nextShard_;                  // 只在baseLoop中访问
+
+    std::shared_ptr<AdmissionControl> admission_;   // 没有设置策略时为空，分发路径和原来一样
+    TimerId lagProbeTimer_;
+    TimerId resumeTimer_;
+    bool acceptPaused_;                 // 只在baseLoop中访问
+
+    // drain状态，除了计数以外只在baseLoop中访问；计数由各个subLoop累加
+    struct DrainCounters
+    {
+        std::atomic<size_t> halfClosed{0};
+        std::atomic<size_t> forceClosed{0};
+    };
+    IdlePredicate drainIdlePredicate_;
+    std::atomic_bool draining_;
+    bool drainForced_;
+    int64_t drainStartNanos_;
+    int64_t drainDeadlineNanos_;
+    TimerId drainTimer_;
+    DrainCallback drainCallback_;
+    std::shared_ptr<DrainCounters> drainCounters_;
 };
\ No newline at end of file
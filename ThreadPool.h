@@ -0,0 +1,48 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "Thread.h"
+
+#include <functional>
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+
+// 固定线程数的任务队列线程池，用来执行不能放在subLoop中的阻塞或耗时任务
+class ThreadPool : noncopyable
+{
+public:
+    using Task = std::function<void()>;
+
+    explicit ThreadPool(const std::string &name = std::string("ThreadPool"));
+    ~ThreadPool();
+
+    // 0表示不限制，队列满了以后run()阻塞，形成背压
+    void setMaxQueueSize(size_t maxSize) {maxQueueSize_ = maxSize;}
+
+    void start(int numThreads);
+    void stop();
+
+    // numThreads为0时直接在调用线程执行
+    void run(Task task);
+
+    const std::string& name() const {return name_;}
+    size_t queueSize() const;
+
+private:
+    bool isFull() const;
+    void runInThread();
+    Task take();
+
+    mutable std::mutex mutex_;
+    std::condition_variable notEmpty_;
+    std::condition_variable notFull_;
+    std::string name_;
+    std::vector<std::unique_ptr<Thread>> threads_;
+    std::deque<Task> queue_;
+    size_t maxQueueSize_;
+    bool running_;
+};
@@ -0,0 +1,43 @@
+#pragma once
+
+#include "noncopyable.h"
+
+#include <atomic>
+#include <functional>
+#include <stdint.h>
+
+// 一个定时任务，到期时间使用单调时钟(纳秒)，interval大于0表示周期任务
+class Timer : noncopyable
+{
+public:
+    using TimerCallback = std::function<void()>;
+
+    Timer(TimerCallback cb, int64_t expirationNanos, int64_t intervalNanos)
+        : callback_(std::move(cb))
+        , expiration_(expirationNanos)
+        , interval_(intervalNanos)
+        , sequence_(s_numCreated_++)
+    {}
+
+    void run() const { callback_(); }
+
+    int64_t expiration() const { return expiration_; }
+    bool repeat() const { return interval_ > 0; }
+    int64_t sequence() const { return sequence_; }
+
+    // 周期任务按上一次的到期时间推进，不受回调执行耗时影响；落后太多时从now重新开始
+    void restart(int64_t nowNanos)
+    {
+        expiration_ += interval_;
+        if(expiration_ <= nowNanos)
+            expiration_ = nowNanos + interval_;
+    }
+
+private:
+    const TimerCallback callback_;
+    int64_t expiration_;
+    const int64_t interval_;
+    const int64_t sequence_;
+
+    static std::atomic<int64_t> s_numCreated_;
+};
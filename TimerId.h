@@ -0,0 +1,25 @@
+#pragma once
+
+#include <stdint.h>
+
+class Timer;
+
+// 用于取消定时器，sequence区分地址被复用的不同Timer
+class TimerId
+{
+public:
+    TimerId()
+        : timer_(nullptr)
+        , sequence_(0)
+    {}
+    TimerId(Timer *timer, int64_t seq)
+        : timer_(timer)
+        , sequence_(seq)
+    {}
+
+    friend class TimerQueue;
+
+private:
+    Timer *timer_;
+    int64_t sequence_;
+};
@@ -0,0 +1,143 @@
+#include "TimerQueue.h"
+#include "EventLoop.h"
+#include "Logger.h"
+
+#include <sys/timerfd.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+
+std::atomic<int64_t> Timer::s_numCreated_(0);
+
+static int createTimerfd()
+{
+    int timerfd = ::timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if(timerfd < 0)
+        LOG_FATAL("%s:%s:%d timerfd_create err: %d \n", __FILE__, __FUNCTION__, __LINE__, errno);
+    return timerfd;
+}
+
+// 把timerfd设置为在单调时钟的whenNanos时刻触发
+static void resetTimerfd(int timerfd, int64_t whenNanos)
+{
+    itimerspec newValue;
+    memset(&newValue, 0, sizeof newValue);
+    // it_value全为0会解除timerfd，已经过期的定时器至少等1纳秒
+    if(whenNanos <= 0)
+        whenNanos = 1;
+    newValue.it_value.tv_sec = static_cast<time_t>(whenNanos / 1000000000);
+    newValue.it_value.tv_nsec = static_cast<long>(whenNanos % 1000000000);
+    if(::timerfd_settime(timerfd, TFD_TIMER_ABSTIME, &newValue, nullptr) < 0)
+        LOG_ERROR("timerfd_settime err: %d\n", errno);
+}
+
+TimerQueue::TimerQueue(EventLoop *loop)
+    : loop_(loop)
+    , timerfd_(createTimerfd())
+    , timerfdChannel_(loop, timerfd_)
+    , callingExpiredTimers_(false)
+{
+    timerfdChannel_.setReadCallback(std::bind(&TimerQueue::handleRead, this));
+    timerfdChannel_.enableReading();
+}
+
+TimerQueue::~TimerQueue()
+{
+    timerfdChannel_.disableAll();
+    timerfdChannel_.remove();
+    ::close(timerfd_);
+    for(const Entry &timer : timers_)
+        delete timer.second;
+}
+
+TimerId TimerQueue::addTimer(Timer::TimerCallback cb, int64_t whenNanos, int64_t intervalNanos)
+{
+    Timer *timer = new Timer(std::move(cb), whenNanos, intervalNanos);
+    loop_->runInLoop(std::bind(&TimerQueue::addTimerInLoop, this, timer));
+    return TimerId(timer, timer->sequence());
+}
+
+void TimerQueue::cancel(TimerId timerId)
+{
+    loop_->runInLoop(std::bind(&TimerQueue::cancelInLoop, this, timerId));
+}
+
+void TimerQueue::addTimerInLoop(Timer *timer)
+{
+    if(insert(timer))
+        resetTimerfd(timerfd_, timer->expiration());
+}
+
+void TimerQueue::cancelInLoop(TimerId timerId)
+{
+    ActiveTimer timer(timerId.timer_, timerId.sequence_);
+    ActiveTimerSet::iterator it = activeTimers_.find(timer);
+    if(it != activeTimers_.end())
+    {
+        timers_.erase(Entry(it->first->expiration(), it->first));
+        delete it->first;
+        activeTimers_.erase(it);
+    }
+    else if(callingExpiredTimers_)
+    {
+        // 正在执行的定时器已经从timers_中取出，只能标记，reset时不再重新加入
+        cancelingTimers_.insert(timer);
+    }
+}
+
+void TimerQueue::handleRead()
+{
+    uint64_t howmany;
+    ssize_t n = ::read(timerfd_, &howmany, sizeof howmany);
+    if(n != sizeof howmany)
+        LOG_ERROR("TimerQueue::handleRead() reads %ld bytes instead of 8\n", static_cast<long>(n));
+
+    int64_t now = Timestamp::monotonicNanos();
+    std::vector<Entry> expired = getExpired(now);
+
+    callingExpiredTimers_ = true;
+    cancelingTimers_.clear();
+    for(const Entry &it : expired)
+        it.second->run();
+    callingExpiredTimers_ = false;
+
+    reset(expired, now);
+}
+
+std::vector<TimerQueue::Entry> TimerQueue::getExpired(int64_t nowNanos)
+{
+    std::vector<Entry> expired;
+    Entry sentry(nowNanos, reinterpret_cast<Timer*>(UINTPTR_MAX));
+    TimerList::iterator end = timers_.lower_bound(sentry);
+    expired.assign(timers_.begin(), end);
+    timers_.erase(timers_.begin(), end);
+    for(const Entry &it : expired)
+        activeTimers_.erase(ActiveTimer(it.second, it.second->sequence()));
+    return expired;
+}
+
+void TimerQueue::reset(const std::vector<Entry> &expired, int64_t nowNanos)
+{
+    for(const Entry &it : expired)
+    {
+        ActiveTimer timer(it.second, it.second->sequence());
+        if(it.second->repeat() && cancelingTimers_.find(timer) == cancelingTimers_.end())
+        {
+            it.second->restart(nowNanos);
+            insert(it.second);
+        }
+        else
+            delete it.second;
+    }
+
+    if(!timers_.empty())
+        resetTimerfd(timerfd_, timers_.begin()->second->expiration());
+}
+
+bool TimerQueue::insert(Timer *timer)
+{
+    bool earliestChanged = timers_.empty() || timer->expiration() < timers_.begin()->first;
+    timers_.insert(Entry(timer->expiration(), timer));
+    activeTimers_.insert(ActiveTimer(timer, timer->sequence()));
+    return earliestChanged;
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "Channel.h"
+#include "Timer.h"
+#include "TimerId.h"
+
+#include <set>
+#include <vector>
+#include <utility>
+#include <stdint.h>
+
+class EventLoop;
+
+/**
+ * 基于timerfd的定时器队列，timerfd作为一个普通的Channel注册到所属loop的poller中
+ * 按到期时间排序的set中只有最早到期的那个决定timerfd的触发时间，所有定时任务在loop线程中执行
+ */
+class TimerQueue : noncopyable
+{
+public:
+    explicit TimerQueue(EventLoop *loop);
+    ~TimerQueue();
+
+    // 可以在任意线程调用，when为单调时钟的纳秒时间
+    TimerId addTimer(Timer::TimerCallback cb, int64_t whenNanos, int64_t intervalNanos);
+    void cancel(TimerId timerId);
+
+private:
+    using Entry = std::pair<int64_t, Timer*>;
+    using TimerList = std::set<Entry>;
+    using ActiveTimer = std::pair<Timer*, int64_t>;
+    using ActiveTimerSet = std::set<ActiveTimer>;
+
+    void addTimerInLoop(Timer *timer);
+    void cancelInLoop(TimerId timerId);
+    void handleRead();
+    // 取出所有到期的定时器
+    std::vector<Entry> getExpired(int64_t nowNanos);
+    void reset(const std::vector<Entry> &expired, int64_t nowNanos);
+    // 返回新定时器是否成为最早到期的那个
+    bool insert(Timer *timer);
+
+    EventLoop *loop_;
+    const int timerfd_;
+    Channel timerfdChannel_;
+    TimerList timers_;
+
+    ActiveTimerSet activeTimers_;
+    bool callingExpiredTimers_;
+    ActiveTimerSet cancelingTimers_; // 回调执行期间被取消的周期定时器，不再重新加入
+};
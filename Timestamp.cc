@@ -1,6 +1,7 @@
 #include "Timestamp.h"
 
 #include <time.h>
+#include <sys/time.h>
 
 Timestamp::Timestamp()
 {
@@ -12,19 +13,30 @@ Timestamp::Timestamp(int64_t microSecondSinceEpoch)
 }
 Timestamp Timestamp::now()
 {
-    return Timestamp(time(NULL));
+    timeval tv;
+    ::gettimeofday(&tv, NULL);
+    return Timestamp(tv.tv_sec * kMicroSecondsPerSecond + tv.tv_usec);
+}
+int64_t Timestamp::monotonicNanos()
+{
+    timespec ts;
+    ::clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
 }
 std::string Timestamp::toString() const
 {
     char buf[128] = {0};
-    tm *tm_time = localtime(&microSecondSinceEpoch_);
-    snprintf(buf, 128, "%4d/%02d/%02d %02d:%02d:%02d",
-    tm_time->tm_year + 1900,
-    tm_time->tm_mon + 1,
-    tm_time->tm_mday,
-    tm_time->tm_hour,
-    tm_time->tm_min,
-    tm_time->tm_sec);
+    time_t seconds = static_cast<time_t>(microSecondSinceEpoch_ / kMicroSecondsPerSecond);
+    tm tm_time;
+    localtime_r(&seconds, &tm_time);
+    snprintf(buf, 128, "%4d/%02d/%02d %02d:%02d:%02d.%06d",
+    tm_time.tm_year + 1900,
+    tm_time.tm_mon + 1,
+    tm_time.tm_mday,
+    tm_time.tm_hour,
+    tm_time.tm_min,
+    tm_time.tm_sec,
+    static_cast<int>(microSecondSinceEpoch_ % kMicroSecondsPerSecond));
     return buf;
 }
 
@@ -34,4 +46,4 @@ int main()
     cout << Timestamp::now().toString() << endl;
     return 0;
 }
-*/
\ No newline at end of file
+*/
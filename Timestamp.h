@@ -1,16 +1,24 @@
 #pragma once
 
 #include <iostream>
+#include <stdint.h>
 using namespace std;
 
 class Timestamp
 {
 public:
+    static const int64_t kMicroSecondsPerSecond = 1000 * 1000;
+
     Timestamp();
     explicit Timestamp(int64_t microSecondSinceEpoch);
     static Timestamp now();
+    // 单调时钟(CLOCK_MONOTONIC)，只用来计算时间间隔，不受系统时间调整影响
+    static int64_t monotonicNanos();
     string toString() const;
 
+    int64_t microSecondsSinceEpoch() const { return microSecondSinceEpoch_; }
+    bool valid() const { return microSecondSinceEpoch_ > 0; }
+
 private:
     int64_t microSecondSinceEpoch_;
-};
\ No newline at end of file
+};
@@ -0,0 +1,206 @@
+#include "TlsContext.h"
+#include "Logger.h"
+
+#include <stdio.h>
+
+#ifdef MYMUDUO_WITH_TLS
+#include <openssl/err.h>
+#include <openssl/ssl.h>
+
+namespace
+{
+// 客户端收到新会话(TLS 1.3在握手之后才通过NewSessionTicket发来)，返回1表示接管这个引用
+int onNewSession(SSL *ssl, SSL_SESSION *session)
+{
+    TlsContext *context = static_cast<TlsContext*>(SSL_CTX_get_app_data(SSL_get_SSL_CTX(ssl)));
+    context->saveSession(session);
+    return 1;
+}
+
+SSL_CTX* newContext(const SSL_METHOD *method)
+{
+    SSL_CTX *ctx = SSL_CTX_new(method);
+    if(ctx == nullptr)
+        return nullptr;
+    SSL_CTX_set_min_proto_version(ctx, TLS1_2_VERSION);
+    // 非阻塞socket上允许只写出一部分，重试时缓冲区地址可以变(outputBuffer_会挪动数据)
+    // 空闲连接释放读写缓冲，每个连接省下约34KB
+    SSL_CTX_set_mode(ctx, SSL_MODE_ENABLE_PARTIAL_WRITE | SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER | SSL_MODE_RELEASE_BUFFERS);
+#ifdef SSL_OP_ENABLE_KTLS
+    SSL_CTX_set_options(ctx, SSL_OP_ENABLE_KTLS);
+#endif
+    return ctx;
+}
+}
+
+std::shared_ptr<TlsContext> TlsContext::newServer(const std::string &certFile, const std::string &keyFile)
+{
+    SSL_CTX *ctx = newContext(TLS_server_method());
+    if(ctx == nullptr)
+    {
+        logErrors("TlsContext::newServer");
+        return nullptr;
+    }
+    if(SSL_CTX_use_certificate_chain_file(ctx, certFile.c_str()) != 1
+        || SSL_CTX_use_PrivateKey_file(ctx, keyFile.c_str(), SSL_FILETYPE_PEM) != 1
+        || SSL_CTX_check_private_key(ctx) != 1)
+    {
+        logErrors("TlsContext::newServer");
+        SSL_CTX_free(ctx);
+        return nullptr;
+    }
+    // TLS 1.2按session id在服务端缓存，TLS 1.3用无状态的ticket；每次握手只发一个ticket
+    static const unsigned char kSessionContext[] = "mymuduo";
+    SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_SERVER);
+    SSL_CTX_set_session_id_context(ctx, kSessionContext, sizeof kSessionContext - 1);
+    SSL_CTX_set_num_tickets(ctx, 1);
+    return std::shared_ptr<TlsContext>(new TlsContext(ctx, true));
+}
+
+std::shared_ptr<TlsContext> TlsContext::newClient(const std::string &caFile)
+{
+    SSL_CTX *ctx = newContext(TLS_client_method());
+    if(ctx == nullptr)
+    {
+        logErrors("TlsContext::newClient");
+        return nullptr;
+    }
+    int loaded = caFile.empty() ? SSL_CTX_set_default_verify_paths(ctx)
+        : SSL_CTX_load_verify_locations(ctx, caFile.c_str(), nullptr);
+    if(loaded != 1)
+    {
+        logErrors("TlsContext::newClient");
+        SSL_CTX_free(ctx);
+        return nullptr;
+    }
+    SSL_CTX_set_verify(ctx, SSL_VERIFY_PEER, nullptr);
+    // 会话由TlsContext自己保存，不用OpenSSL的内部缓存
+    SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+    SSL_CTX_sess_set_new_cb(ctx, onNewSession);
+    std::shared_ptr<TlsContext> context(new TlsContext(ctx, false));
+    SSL_CTX_set_app_data(ctx, context.get());
+    return context;
+}
+
+TlsContext::~TlsContext()
+{
+    if(session_ != nullptr)
+        SSL_SESSION_free(session_);
+    SSL_CTX_free(ctx_);
+}
+
+void TlsContext::logErrors(const char *what)
+{
+    unsigned long err;
+    while((err = ERR_get_error()) != 0)
+    {
+        // 不能叫buf，LOG_ERROR宏里面有一个同名的缓冲区
+        char errBuf[256];
+        ERR_error_string_n(err, errBuf, sizeof errBuf);
+        LOG_ERROR("%s: %s\n", what, errBuf);
+    }
+}
+
+void TlsContext::setVerifyPeer(bool on)
+{
+    verifyPeer_ = on;
+    SSL_CTX_set_verify(ctx_, on ? SSL_VERIFY_PEER : SSL_VERIFY_NONE, nullptr);
+}
+
+void TlsContext::setKtls(bool on)
+{
+    ktls_ = on;
+#ifdef SSL_OP_ENABLE_KTLS
+    if(on)
+        SSL_CTX_set_options(ctx_, SSL_OP_ENABLE_KTLS);
+    else
+        SSL_CTX_clear_options(ctx_, SSL_OP_ENABLE_KTLS);
+#endif
+}
+
+ssl_session_st* TlsContext::takeSessionRef() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    if(!resumption_ || session_ == nullptr)
+        return nullptr;
+    SSL_SESSION_up_ref(session_);
+    return session_;
+}
+
+void TlsContext::saveSession(ssl_session_st *session)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    if(session_ != nullptr)
+        SSL_SESSION_free(session_);
+    session_ = session;
+}
+
+#else // MYMUDUO_WITH_TLS
+
+std::shared_ptr<TlsContext> TlsContext::newServer(const std::string&, const std::string&)
+{
+    LOG_ERROR("TlsContext: built without OpenSSL\n");
+    return nullptr;
+}
+
+std::shared_ptr<TlsContext> TlsContext::newClient(const std::string&)
+{
+    LOG_ERROR("TlsContext: built without OpenSSL\n");
+    return nullptr;
+}
+
+TlsContext::~TlsContext() {}
+void TlsContext::logErrors(const char*) {}
+void TlsContext::setVerifyPeer(bool on) {verifyPeer_ = on;}
+void TlsContext::setKtls(bool on) {ktls_ = on;}
+ssl_session_st* TlsContext::takeSessionRef() const {return nullptr;}
+void TlsContext::saveSession(ssl_session_st*) {}
+
+#endif // MYMUDUO_WITH_TLS
+
+TlsContext::TlsContext(ssl_ctx_st *ctx, bool server)
+    : ctx_(ctx)
+    , server_(server)
+    , ktls_(true)
+    , resumption_(true)
+    , verifyPeer_(!server)
+    , session_(nullptr)
+    , handshakes_(0)
+    , resumed_(0)
+    , failures_(0)
+    , ktlsSend_(0)
+    , ktlsRecv_(0)
+{
+}
+
+void TlsContext::countHandshake(bool resumed, bool ktlsSend, bool ktlsRecv)
+{
+    handshakes_.fetch_add(1, std::memory_order_relaxed);
+    if(resumed)
+        resumed_.fetch_add(1, std::memory_order_relaxed);
+    if(ktlsSend)
+        ktlsSend_.fetch_add(1, std::memory_order_relaxed);
+    if(ktlsRecv)
+        ktlsRecv_.fetch_add(1, std::memory_order_relaxed);
+}
+
+TlsContext::Stats TlsContext::stats() const
+{
+    Stats s;
+    s.handshakes = handshakes_.load(std::memory_order_relaxed);
+    s.resumed = resumed_.load(std::memory_order_relaxed);
+    s.failures = failures_.load(std::memory_order_relaxed);
+    s.ktlsSend = ktlsSend_.load(std::memory_order_relaxed);
+    s.ktlsRecv = ktlsRecv_.load(std::memory_order_relaxed);
+    return s;
+}
+
+std::string TlsContext::Stats::toString() const
+{
+    char buf[160];
+    snprintf(buf, sizeof buf, "handshakes=%lu resumed=%lu failures=%lu ktls_send=%lu ktls_recv=%lu",
+        static_cast<unsigned long>(handshakes), static_cast<unsigned long>(resumed),
+        static_cast<unsigned long>(failures), static_cast<unsigned long>(ktlsSend),
+        static_cast<unsigned long>(ktlsRecv));
+    return buf;
+}
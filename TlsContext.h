@@ -0,0 +1,92 @@
+#pragma once
+
+#include "noncopyable.h"
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <stdint.h>
+
+// OpenSSL的类型只做前向声明，使用者不需要OpenSSL的头文件
+struct ssl_ctx_st;
+struct ssl_session_st;
+
+/**
+ * TLS配置，封装SSL_CTX，一个TcpServer或者一组TcpClient共享一个
+ *
+ * 握手完成后OpenSSL尝试安装内核TLS(kTLS，TLS_TX/TLS_RX)：成功以后加解密在内核里完成，SSL_write/SSL_read只是普通的
+ * write/recvmsg，TcpConnection::sendFile()走SSL_sendfile，relay的splice零拷贝也可以用；内核没有tls模块或者
+ * 加密套件不支持时自动退回用户态加解密，行为不变，只是慢一些
+ *
+ * 会话复用：服务端开启会话缓存和TLS 1.3 session ticket；客户端保存最近一次的会话，下一次连接时带上，
+ * 恢复的握手不需要证书签名和验证，CPU开销小得多。stats()里的resumed统计复用次数
+ *
+ * 没有OpenSSL(编译时没有定义MYMUDUO_WITH_TLS)时newServer/newClient返回nullptr
+ */
+class TlsContext : noncopyable
+{
+public:
+    struct Stats
+    {
+        uint64_t handshakes = 0;    // 完成的握手
+        uint64_t resumed = 0;       // 其中复用会话的
+        uint64_t failures = 0;      // 失败的握手
+        uint64_t ktlsSend = 0;      // 发送方向装上kTLS的连接
+        uint64_t ktlsRecv = 0;      // 接收方向装上kTLS的连接
+        std::string toString() const;
+    };
+
+    // certFile是PEM格式的证书链，keyFile是私钥；失败时打印OpenSSL的错误并返回nullptr
+    static std::shared_ptr<TlsContext> newServer(const std::string &certFile, const std::string &keyFile);
+    // 默认校验服务端证书：caFile为空时用系统默认的CA路径，否则只信任caFile里的CA
+    static std::shared_ptr<TlsContext> newClient(const std::string &caFile = std::string());
+    ~TlsContext();
+
+    bool isServer() const {return server_;}
+    // 默认开启kTLS，关掉以后总是在用户态加解密(用来对比)
+    void setKtls(bool on);
+    bool ktls() const {return ktls_;}
+    // 客户端：关掉对服务端证书的校验，只用于测试和自签名证书，必须显式调用
+    void setVerifyPeer(bool on);
+    bool verifyPeer() const {return verifyPeer_;}
+    // 客户端：SNI，校验证书时同时校验证书中的主机名
+    void setServerName(const std::string &name) {serverName_ = name;}
+    const std::string& serverName() const {return serverName_;}
+    // 客户端：是否带上保存的会话，默认开启
+    void setSessionResumption(bool on) {resumption_ = on;}
+
+    Stats stats() const;
+
+    // 以下供TlsSession使用
+    ssl_ctx_st* native() const {return ctx_;}
+    // 取出保存的会话(调用者负责SSL_SESSION_free)，没有时返回nullptr
+    ssl_session_st* takeSessionRef() const;
+    void saveSession(ssl_session_st *session);
+    void countHandshake(bool resumed, bool ktlsSend, bool ktlsRecv);
+    void countFailure() {failures_.fetch_add(1, std::memory_order_relaxed);}
+    // 取出并打印OpenSSL线程错误队列里的所有错误
+    static void logErrors(const char *what);
+
+private:
+    TlsContext(ssl_ctx_st *ctx, bool server);
+
+    ssl_ctx_st *ctx_;
+    const bool server_;
+    bool ktls_;
+    bool resumption_;
+    bool verifyPeer_;
+    std::string serverName_;
+
+    mutable std::mutex mutex_;
+    ssl_session_st *session_;   // 客户端最近一次的会话，被mutex_保护
+
+    // 多个loop同时更新
+    std::atomic<uint64_t> handshakes_;
+    std::atomic<uint64_t> resumed_;
+    std::atomic<uint64_t> failures_;
+    std::atomic<uint64_t> ktlsSend_;
+    std::atomic<uint64_t> ktlsRecv_;
+};
+
+using TlsContextPtr = std::shared_ptr<TlsContext>;
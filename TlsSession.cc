@@ -0,0 +1,203 @@
+#include "TlsSession.h"
+#include "Buffer.h"
+#include "Logger.h"
+
+#include <algorithm>
+#include <errno.h>
+#include <limits.h>
+#include <unistd.h>
+
+#ifdef MYMUDUO_WITH_TLS
+#include <openssl/err.h>
+#include <openssl/ssl.h>
+
+namespace
+{
+// SSL_read/SSL_write失败时换算成errno：需要等待的是EAGAIN，其余是真正的错误
+int toErrno(SSL *ssl, int ret)
+{
+    int err = SSL_get_error(ssl, ret);
+    if(err == SSL_ERROR_WANT_READ || err == SSL_ERROR_WANT_WRITE)
+        return EAGAIN;
+    if(err == SSL_ERROR_SYSCALL && errno != 0)
+        return errno;
+    TlsContext::logErrors("TlsSession");
+    return EPROTO;
+}
+}
+
+TlsSession::TlsSession(const TlsContextPtr &context, int sockfd)
+    : context_(context)
+    , ssl_(SSL_new(context->native()))
+    , established_(false)
+    , shutdownSent_(false)
+{
+    SSL_set_fd(ssl_, sockfd);
+    if(context_->isServer())
+        SSL_set_accept_state(ssl_);
+    else
+    {
+        SSL_set_connect_state(ssl_);
+        const std::string &name = context_->serverName();
+        if(!name.empty())
+        {
+            SSL_set_tlsext_host_name(ssl_, name.c_str());
+            SSL_set1_host(ssl_, name.c_str());
+        }
+        SSL_SESSION *session = context_->takeSessionRef();
+        if(session != nullptr)
+        {
+            SSL_set_session(ssl_, session);
+            SSL_SESSION_free(session);
+        }
+    }
+}
+
+TlsSession::~TlsSession()
+{
+    SSL_free(ssl_);
+}
+
+TlsSession::HandshakeResult TlsSession::handshake()
+{
+    ERR_clear_error();
+    int ret = SSL_do_handshake(ssl_);
+    if(ret == 1)
+    {
+        established_ = true;
+        context_->countHandshake(resumed(), ktlsSend(), ktlsRecv());
+        return kDone;
+    }
+    int err = SSL_get_error(ssl_, ret);
+    if(err == SSL_ERROR_WANT_READ)
+        return kWantRead;
+    if(err == SSL_ERROR_WANT_WRITE)
+        return kWantWrite;
+    TlsContext::logErrors("TlsSession::handshake");
+    context_->countFailure();
+    return kFailed;
+}
+
+// 一次SSL_read最多解出一条记录(16KB)，循环读到没有数据为止；留足一条记录的空间，
+// 保证OpenSSL内部不会留下已经解密、但是epoll感知不到的数据
+ssize_t TlsSession::read(Buffer *buf, int *savedErrno)
+{
+    static const size_t kRecordSize = 16 * 1024;
+    size_t total = 0;
+    while(total < kMaxReadBytes)
+    {
+        buf->ensureWriteableBytes(kRecordSize);
+        ERR_clear_error();
+        errno = 0;
+        int n = SSL_read(ssl_, buf->beginWrite(), static_cast<int>(buf->writableBytes()));
+        if(n > 0)
+        {
+            buf->hasWritten(n);
+            total += n;
+            continue;
+        }
+        int err = SSL_get_error(ssl_, n);
+        if(total > 0)
+            break;
+        // close_notify，或者对端直接关闭了TCP连接
+        if(err == SSL_ERROR_ZERO_RETURN || (err == SSL_ERROR_SYSCALL && errno == 0))
+            return 0;
+        *savedErrno = toErrno(ssl_, n);
+        return -1;
+    }
+    return static_cast<ssize_t>(total);
+}
+
+ssize_t TlsSession::write(const void *data, size_t len, int *savedErrno)
+{
+    if(len == 0)
+        return 0;
+    ERR_clear_error();
+    errno = 0;
+    int n = SSL_write(ssl_, data, static_cast<int>(std::min<size_t>(len, INT_MAX)));
+    if(n > 0)
+        return n;
+    *savedErrno = toErrno(ssl_, n);
+    return -1;
+}
+
+ssize_t TlsSession::sendFile(int fd, off_t offset, size_t count, int *savedErrno)
+{
+#ifndef OPENSSL_NO_KTLS
+    if(ktlsSend())
+    {
+        ERR_clear_error();
+        errno = 0;
+        ossl_ssize_t n = SSL_sendfile(ssl_, fd, offset, count, 0);
+        if(n >= 0)
+            return n;
+        *savedErrno = toErrno(ssl_, static_cast<int>(n));
+        return -1;
+    }
+#endif
+    char buf[16 * 1024];
+    ssize_t n = ::pread(fd, buf, std::min(count, sizeof buf), offset);
+    if(n <= 0)
+    {
+        if(n < 0)
+            *savedErrno = errno;
+        return n;
+    }
+    return write(buf, n, savedErrno);
+}
+
+void TlsSession::shutdown()
+{
+    if(established_ && !shutdownSent_)
+    {
+        shutdownSent_ = true;
+        ERR_clear_error();
+        SSL_shutdown(ssl_);
+    }
+}
+
+bool TlsSession::ktlsSend() const
+{
+#ifndef OPENSSL_NO_KTLS
+    return BIO_get_ktls_send(SSL_get_wbio(ssl_)) != 0;
+#else
+    return false;
+#endif
+}
+
+bool TlsSession::ktlsRecv() const
+{
+#ifndef OPENSSL_NO_KTLS
+    return BIO_get_ktls_recv(SSL_get_rbio(ssl_)) != 0;
+#else
+    return false;
+#endif
+}
+
+bool TlsSession::resumed() const
+{
+    return SSL_session_reused(ssl_) == 1;
+}
+
+std::string TlsSession::description() const
+{
+    return std::string(SSL_get_version(ssl_)) + " " + SSL_get_cipher_name(ssl_);
+}
+
+#else // MYMUDUO_WITH_TLS
+
+// 没有OpenSSL时TlsContext无法创建，这些函数不会被调用
+TlsSession::TlsSession(const TlsContextPtr &context, int)
+    : context_(context), ssl_(nullptr), established_(false), shutdownSent_(false) {}
+TlsSession::~TlsSession() {}
+TlsSession::HandshakeResult TlsSession::handshake() {return kFailed;}
+ssize_t TlsSession::read(Buffer*, int *savedErrno) {*savedErrno = ENOTSUP; return -1;}
+ssize_t TlsSession::write(const void*, size_t, int *savedErrno) {*savedErrno = ENOTSUP; return -1;}
+ssize_t TlsSession::sendFile(int, off_t, size_t, int *savedErrno) {*savedErrno = ENOTSUP; return -1;}
+void TlsSession::shutdown() {}
+bool TlsSession::ktlsSend() const {return false;}
+bool TlsSession::ktlsRecv() const {return false;}
+bool TlsSession::resumed() const {return false;}
+std::string TlsSession::description() const {return std::string();}
+
+#endif // MYMUDUO_WITH_TLS
@@ -0,0 +1,49 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "TlsContext.h"
+
+#include <string>
+#include <sys/types.h>
+
+struct ssl_st;
+class Buffer;
+
+/**
+ * 一条TLS连接的状态(SSL对象)，由TcpConnection持有，只在连接所属的loop线程中使用
+ * SSL直接绑定socket fd(而不是内存BIO)，这样OpenSSL才能在握手后安装kTLS
+ * read/write的返回值和errno约定与read(2)/write(2)一致：需要等待时返回-1，*savedErrno为EAGAIN
+ */
+class TlsSession : noncopyable
+{
+public:
+    enum HandshakeResult {kDone, kWantRead, kWantWrite, kFailed};
+
+    TlsSession(const TlsContextPtr &context, int sockfd);
+    ~TlsSession();
+
+    HandshakeResult handshake();
+    bool established() const {return established_;}
+
+    // 解密后追加到buf，一次最多读kMaxReadBytes；对端发了close_notify或者关闭连接时返回0
+    ssize_t read(Buffer *buf, int *savedErrno);
+    ssize_t write(const void *data, size_t len, int *savedErrno);
+    // 发送文件的一段：装了kTLS时用SSL_sendfile，否则pread一块再加密发送
+    ssize_t sendFile(int fd, off_t offset, size_t count, int *savedErrno);
+    // 发送close_notify
+    void shutdown();
+
+    bool ktlsSend() const;
+    bool ktlsRecv() const;
+    bool resumed() const;
+    // 比如 TLSv1.3 TLS_AES_128_GCM_SHA256
+    std::string description() const;
+
+    static const size_t kMaxReadBytes = 64 * 1024;
+
+private:
+    TlsContextPtr context_;
+    ssl_st *ssl_;
+    bool established_;
+    bool shutdownSent_;
+};
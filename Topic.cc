@@ -0,0 +1,201 @@
+#include "Topic.h"
+#include "EventLoop.h"
+#include "TcpConnection.h"
+#include "Logger.h"
+
+#include <stdio.h>
+
+std::string Topic::Stats::toString() const
+{
+    char buf[256];
+    snprintf(buf, sizeof buf, "published=%lu delivered=%lu dropped=%lu disconnected=%lu batches=%lu",
+        static_cast<unsigned long>(published), static_cast<unsigned long>(delivered),
+        static_cast<unsigned long>(dropped), static_cast<unsigned long>(disconnected),
+        static_cast<unsigned long>(batches));
+    return buf;
+}
+
+Topic::Topic(const std::string &name)
+    : name_(name)
+    , policy_(kDrop)
+    , maxQueuedBytes_(0)
+    , published_(0)
+    , groups_(std::make_shared<GroupMap>())
+{
+}
+
+// 已经投递的任务持有LoopGroup的引用，Topic可以先于它们析构
+Topic::~Topic() = default;
+
+Topic::LoopGroupPtr Topic::groupOf(EventLoop *loop)
+{
+    std::shared_ptr<const GroupMap> groups = std::atomic_load(&groups_);
+    GroupMap::const_iterator it = groups->find(loop);
+    if(it != groups->end())
+        return it->second;
+
+    std::lock_guard<std::mutex> lock(groupsMutex_);
+    groups = std::atomic_load(&groups_);
+    it = groups->find(loop);
+    if(it != groups->end())
+        return it->second;
+    std::shared_ptr<GroupMap> copy = std::make_shared<GroupMap>(*groups);
+    LoopGroupPtr group = std::make_shared<LoopGroup>();
+    group->loop = loop;
+    group->policy = policy_;
+    group->maxQueuedBytes = maxQueuedBytes_;
+    (*copy)[loop] = group;
+    std::atomic_store(&groups_, std::shared_ptr<const GroupMap>(copy));
+    return group;
+}
+
+void Topic::subscribe(const TcpConnectionPtr &conn)
+{
+    LoopGroupPtr group = groupOf(conn->getLoop());
+    std::weak_ptr<TcpConnection> weakConn(conn);
+    conn->getLoop()->runInLoop([group, weakConn]()
+    {
+        TcpConnectionPtr conn = weakConn.lock();
+        if(conn && conn->connected())
+        {
+            group->subscribers[conn.get()] = weakConn;
+            group->size.store(group->subscribers.size(), std::memory_order_relaxed);
+        }
+    });
+}
+
+void Topic::unsubscribe(const TcpConnectionPtr &conn)
+{
+    LoopGroupPtr group = groupOf(conn->getLoop());
+    TcpConnection *key = conn.get();
+    conn->getLoop()->runInLoop([group, key]()
+    {
+        group->subscribers.erase(key);
+        group->size.store(group->subscribers.size(), std::memory_order_relaxed);
+    });
+}
+
+void Topic::publish(const std::string &message)
+{
+    publish(std::make_shared<const std::string>(message));
+}
+
+void Topic::publish(const void *data, size_t len)
+{
+    publish(std::make_shared<const std::string>(static_cast<const char*>(data), len));
+}
+
+void Topic::publish(const SharedPayload &payload)
+{
+    if(!payload || payload->empty())
+        return;
+    published_.fetch_add(1, std::memory_order_relaxed);
+    std::shared_ptr<const GroupMap> groups = std::atomic_load(&groups_);
+    for(const GroupMap::value_type &entry : *groups)
+    {
+        const LoopGroupPtr &group = entry.second;
+        if(group->size.load(std::memory_order_relaxed) == 0)
+            continue;
+        bool schedule = false;
+        {
+            std::lock_guard<std::mutex> lock(group->mutex);
+            group->pending.push_back(payload);
+            if(!group->scheduled)
+            {
+                group->scheduled = true;
+                schedule = true;
+            }
+        }
+        if(schedule)
+            group->loop->queueLoop(std::bind(&Topic::deliver, group));
+    }
+}
+
+// 在group->loop线程中执行：把积攒的消息追加给每个订阅者，然后逐个flush
+void Topic::deliver(const LoopGroupPtr &group)
+{
+    std::vector<SharedPayload> payloads;
+    {
+        std::lock_guard<std::mutex> lock(group->mutex);
+        payloads.swap(group->pending);
+        group->scheduled = false;
+    }
+    group->batches.store(group->batches.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+
+    uint64_t delivered = 0;
+    uint64_t dropped = 0;
+    uint64_t disconnected = 0;
+    for(auto it = group->subscribers.begin(); it != group->subscribers.end(); )
+    {
+        TcpConnectionPtr conn = it->second.lock();
+        if(!conn || !conn->connected())
+        {
+            it = group->subscribers.erase(it);
+            continue;
+        }
+        bool slow = false;
+        bool canFlush = true;
+        for(const SharedPayload &payload : payloads)
+        {
+            // 超出上限时先把已经追加的发给内核，直到内核也接不下才算慢
+            if(canFlush && group->maxQueuedBytes > 0
+                && conn->pendingOutputBytes() + payload->size() > group->maxQueuedBytes)
+            {
+                size_t queued = conn->pendingOutputBytes();
+                conn->flushOutput();
+                canFlush = conn->pendingOutputBytes() < queued;
+            }
+            if(group->maxQueuedBytes > 0 && conn->pendingOutputBytes() + payload->size() > group->maxQueuedBytes)
+            {
+                slow = true;
+                if(group->policy == kDisconnect)
+                    break;
+                ++dropped;
+                continue;
+            }
+            conn->appendShared(payload);
+            ++delivered;
+        }
+        if(slow && group->policy == kDisconnect)
+        {
+            LOG_INFO("Topic slow subscriber [%s] disconnected, %zu bytes queued\n",
+                conn->name().c_str(), conn->pendingOutputBytes());
+            ++disconnected;
+            conn->forceClose();
+            it = group->subscribers.erase(it);
+            continue;
+        }
+        conn->flushOutput();
+        ++it;
+    }
+    group->size.store(group->subscribers.size(), std::memory_order_relaxed);
+    group->delivered.store(group->delivered.load(std::memory_order_relaxed) + delivered, std::memory_order_relaxed);
+    group->dropped.store(group->dropped.load(std::memory_order_relaxed) + dropped, std::memory_order_relaxed);
+    group->disconnected.store(group->disconnected.load(std::memory_order_relaxed) + disconnected,
+        std::memory_order_relaxed);
+}
+
+size_t Topic::subscribers() const
+{
+    size_t count = 0;
+    std::shared_ptr<const GroupMap> groups = std::atomic_load(&groups_);
+    for(const GroupMap::value_type &entry : *groups)
+        count += entry.second->size.load(std::memory_order_relaxed);
+    return count;
+}
+
+Topic::Stats Topic::stats() const
+{
+    Stats stats;
+    stats.published = published_.load(std::memory_order_relaxed);
+    std::shared_ptr<const GroupMap> groups = std::atomic_load(&groups_);
+    for(const GroupMap::value_type &entry : *groups)
+    {
+        const LoopGroup &group = *entry.second;
+        stats.delivered += group.delivered.load(std::memory_order_relaxed);
+        stats.dropped += group.dropped.load(std::memory_order_relaxed);
+        stats.disconnected += group.disconnected.load(std::memory_order_relaxed);
+        stats.batches += group.batches.load(std::memory_order_relaxed);
+    }
+    return stats;
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "Callbacks.h"
+
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <stdint.h>
+
+class EventLoop;
+
+/**
+ * 广播：把同一条消息发给分布在各个subLoop上的所有订阅连接
+ *
+ * publish()只把消息拷贝一次做成不可变的SharedPayload，每个有订阅者的loop投递一个任务(不是每个连接一个)，
+ * loop在自己的线程里给本loop的订阅者逐个appendShared()追加引用，再flushOutput()，排队的多条消息由writev一次发出
+ * 发布得比loop处理得快时，同一个loop积攒的消息在一次任务里批量处理
+ *
+ * 订阅者读得慢时排队的数据会越来越多，超过setMaxQueuedBytes()以后按策略处理：
+ *   kDrop       丢掉这条消息，连接保留，之后追上了还能继续收到
+ *   kDisconnect 断开连接
+ *
+ * 订阅者断开后在下一次投递时自动移除，也可以unsubscribe()；所有接口可以在任意线程调用
+ */
+class Topic : noncopyable
+{
+public:
+    enum SlowPolicy {kDrop, kDisconnect};
+
+    struct Stats
+    {
+        uint64_t published = 0;     // publish()的消息数
+        uint64_t delivered = 0;     // 追加到订阅者的消息数，一条消息发给n个订阅者算n次
+        uint64_t dropped = 0;       // kDrop丢掉的
+        uint64_t disconnected = 0;  // kDisconnect断开的连接数
+        uint64_t batches = 0;       // loop执行投递任务的次数
+        std::string toString() const;
+    };
+
+    explicit Topic(const std::string &name);
+    ~Topic();
+
+    // 在subscribe()之前设置；maxQueuedBytes为0表示不限制
+    void setSlowSubscriberPolicy(SlowPolicy policy, size_t maxQueuedBytes)
+    {policy_ = policy; maxQueuedBytes_ = maxQueuedBytes;}
+
+    void subscribe(const TcpConnectionPtr &conn);
+    void unsubscribe(const TcpConnectionPtr &conn);
+
+    void publish(const std::string &message);
+    void publish(const void *data, size_t len);
+    void publish(const SharedPayload &payload);
+
+    const std::string& name() const {return name_;}
+    // 订阅者数，订阅/退订是异步生效的，近似值
+    size_t subscribers() const;
+    Stats stats() const;
+
+private:
+    // 一个loop上的订阅者，subscribers和统计只在loop线程中访问
+    struct LoopGroup
+    {
+        EventLoop *loop;
+        SlowPolicy policy;
+        size_t maxQueuedBytes;
+        std::unordered_map<TcpConnection*, std::weak_ptr<TcpConnection>> subscribers;
+        std::atomic<size_t> size{0};
+
+        // 等待投递的消息，从空变为非空时才投递任务
+        std::mutex mutex;
+        std::vector<SharedPayload> pending;
+        bool scheduled = false;
+
+        std::atomic<uint64_t> delivered{0};
+        std::atomic<uint64_t> dropped{0};
+        std::atomic<uint64_t> disconnected{0};
+        std::atomic<uint64_t> batches{0};
+    };
+    using LoopGroupPtr = std::shared_ptr<LoopGroup>;
+    using GroupMap = std::map<EventLoop*, LoopGroupPtr>;
+
+    LoopGroupPtr groupOf(EventLoop *loop);
+    static void deliver(const LoopGroupPtr &group);
+
+    const std::string name_;
+    SlowPolicy policy_;
+    size_t maxQueuedBytes_;
+    std::atomic<uint64_t> published_;
+
+    // 和ComputePool的完成队列表一样，读多写少：发布时原子地取一份快照，第一次见到某个loop时复制替换
+    std::mutex groupsMutex_;
+    std::shared_ptr<const GroupMap> groups_;
+};
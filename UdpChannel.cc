@@ -0,0 +1,262 @@
+#include "UdpChannel.h"
+#include "EventLoop.h"
+#include "Logger.h"
+
+#include <netinet/in.h>
+#include <netinet/udp.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <algorithm>
+
+// 一次读事件最多连续recvmmsg的轮数，防止一个socket长期占住loop
+static const int kMaxReadRounds = 4;
+
+int UdpChannel::createSocket(const InetAddress &bindAddr, bool reusePort)
+{
+    int sockfd = ::socket(bindAddr.family(), SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, IPPROTO_UDP);
+    if(sockfd < 0)
+        LOG_FATAL("%s:%s:%d udp socket create err: %d \n", __FILE__, __FUNCTION__, __LINE__, errno);
+
+    int on = 1;
+    ::setsockopt(sockfd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof on);
+    if(reusePort)
+        ::setsockopt(sockfd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof on);
+    if(::bind(sockfd, bindAddr.getSockAddr(), bindAddr.length()) < 0)
+        LOG_FATAL("udp bind %s fail: %d\n", bindAddr.toIpPort().c_str(), errno);
+    return sockfd;
+}
+
+UdpChannel::UdpChannel(EventLoop *loop, int sockfd, int batchSize, size_t maxDatagramSize)
+    : loop_(loop)
+    , socket_(sockfd)
+    , channel_(loop, sockfd)
+    , batchSize_(batchSize)
+    , maxDatagramSize_(maxDatagramSize)
+    , recvBuf_(batchSize * maxDatagramSize)
+    , recvMsgs_(batchSize)
+    , recvIovecs_(batchSize)
+    , recvAddrs_(batchSize)
+    , batching_(false)
+    , gsoSupported_(true)
+    , packetsReceived_(0)
+    , packetsSent_(0)
+    , packetsDropped_(0)
+{
+    // 接收用的mmsghdr只需要初始化一次，每次recvmmsg前只重置msg_namelen
+    for(int i = 0; i < batchSize_; ++i)
+    {
+        recvIovecs_[i].iov_base = &recvBuf_[i * maxDatagramSize_];
+        recvIovecs_[i].iov_len = maxDatagramSize_;
+        memset(&recvMsgs_[i], 0, sizeof(mmsghdr));
+        recvMsgs_[i].msg_hdr.msg_iov = &recvIovecs_[i];
+        recvMsgs_[i].msg_hdr.msg_iovlen = 1;
+        recvMsgs_[i].msg_hdr.msg_name = &recvAddrs_[i];
+    }
+    channel_.setReadCallback(std::bind(&UdpChannel::handleRead, this, std::placeholders::_1));
+}
+
+UdpChannel::~UdpChannel()
+{
+}
+
+void UdpChannel::start()
+{
+    channel_.enableReading();
+}
+
+void UdpChannel::stop()
+{
+    flush();
+    channel_.disableAll();
+    channel_.remove();
+}
+
+InetAddress UdpChannel::localAddress() const
+{
+    return InetAddress::getLocalAddr(socket_.fd());
+}
+
+void UdpChannel::handleRead(Timestamp receiveTime)
+{
+    batching_ = true;
+    for(int round = 0; round < kMaxReadRounds; ++round)
+    {
+        for(int i = 0; i < batchSize_; ++i)
+            recvMsgs_[i].msg_hdr.msg_namelen = sizeof(sockaddr_in6);
+
+        int n = ::recvmmsg(socket_.fd(), recvMsgs_.data(), batchSize_, MSG_DONTWAIT, nullptr);
+        if(n < 0)
+        {
+            if(errno != EAGAIN && errno != EINTR)
+                LOG_ERROR("UdpChannel::handleRead recvmmsg error:%d\n", errno);
+            break;
+        }
+
+        packetsReceived_ += n;
+        for(int i = 0; i < n; ++i)
+        {
+            // 超过maxDatagramSize_的数据报被截断，直接丢弃
+            if(recvMsgs_[i].msg_hdr.msg_flags & MSG_TRUNC)
+            {
+                ++packetsDropped_;
+                continue;
+            }
+            if(messageCallback_)
+            {
+                StringPiece data(static_cast<const char*>(recvIovecs_[i].iov_base), recvMsgs_[i].msg_len);
+                messageCallback_(this, data, InetAddress(reinterpret_cast<const sockaddr*>(&recvAddrs_[i]), recvMsgs_[i].msg_hdr.msg_namelen), receiveTime);
+            }
+        }
+        if(n < batchSize_)
+            break;
+    }
+    batching_ = false;
+    flush();
+}
+
+void UdpChannel::send(const InetAddress &peer, const StringPiece &data)
+{
+    if(loop_->isInLoopThread())
+    {
+        queuePacket(peer, data.data(), data.size());
+        if(!batching_)
+            flush();
+    }
+    else
+    {
+        std::string copy = data.as_string();
+        loop_->runInLoop([this, peer, copy]()
+        {
+            send(peer, copy);
+        });
+    }
+}
+
+void UdpChannel::queuePacket(const InetAddress &peer, const char *data, size_t len)
+{
+    PendingPacket packet;
+    packet.offset = sendBuf_.size();
+    packet.len = len;
+    packet.addrlen = std::min(peer.length(), static_cast<socklen_t>(sizeof packet.addr));
+    memcpy(&packet.addr, peer.getSockAddr(), packet.addrlen);
+    sendBuf_.insert(sendBuf_.end(), data, data + len);
+    pending_.push_back(packet);
+}
+
+void UdpChannel::flush()
+{
+    if(pending_.empty())
+        return;
+
+    // sendBuf_在攒批期间可能扩容，发送前才把offset换算成指针
+    const size_t count = pending_.size();
+    sendMsgs_.resize(count);
+    sendIovecs_.resize(count);
+    for(size_t i = 0; i < count; ++i)
+    {
+        PendingPacket &packet = pending_[i];
+        sendIovecs_[i].iov_base = &sendBuf_[packet.offset];
+        sendIovecs_[i].iov_len = packet.len;
+        memset(&sendMsgs_[i], 0, sizeof(mmsghdr));
+        sendMsgs_[i].msg_hdr.msg_name = &packet.addr;
+        sendMsgs_[i].msg_hdr.msg_namelen = packet.addrlen;
+        sendMsgs_[i].msg_hdr.msg_iov = &sendIovecs_[i];
+        sendMsgs_[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    size_t sent = 0;
+    while(sent < count)
+    {
+        int n = ::sendmmsg(socket_.fd(), &sendMsgs_[sent], count - sent, MSG_DONTWAIT);
+        if(n < 0)
+        {
+            if(errno == EINTR)
+                continue;
+            // EAGAIN：发送缓冲区满，UDP不重传，剩下的直接丢弃
+            if(errno != EAGAIN)
+                LOG_ERROR("UdpChannel::flush sendmmsg error:%d\n", errno);
+            break;
+        }
+        sent += n;
+    }
+    packetsSent_ += sent;
+    packetsDropped_ += count - sent;
+
+    pending_.clear();
+    sendBuf_.clear(); // clear()保留容量，后续攒批不再分配
+}
+
+void UdpChannel::sendSegments(const InetAddress &peer, const StringPiece &data, uint16_t segmentSize)
+{
+    if(!loop_->isInLoopThread())
+    {
+        std::string copy = data.as_string();
+        loop_->runInLoop([this, peer, copy, segmentSize]()
+        {
+            sendSegments(peer, copy, segmentSize);
+        });
+        return;
+    }
+    if(segmentSize == 0 || data.empty())
+        return;
+
+    // 之前攒下的数据报必须先发，保证顺序
+    flush();
+    const size_t maxGsoBytes = static_cast<size_t>(segmentSize) * kMaxGsoSegments;
+    size_t offset = 0;
+    while(offset < data.size())
+    {
+        size_t len = std::min(data.size() - offset, std::min(maxGsoBytes, static_cast<size_t>(65000)));
+        StringPiece chunk(data.data() + offset, len);
+        if(!(gsoSupported_ && len > segmentSize && sendGso(peer, chunk, segmentSize)))
+        {
+            for(size_t pos = 0; pos < len; pos += segmentSize)
+                queuePacket(peer, chunk.data() + pos, std::min(static_cast<size_t>(segmentSize), len - pos));
+            flush();
+        }
+        offset += len;
+    }
+}
+
+// 一次sendmsg携带UDP_SEGMENT控制信息，内核(或网卡)负责把数据切成多个数据报
+bool UdpChannel::sendGso(const InetAddress &peer, const StringPiece &data, uint16_t segmentSize)
+{
+    char control[CMSG_SPACE(sizeof(uint16_t))];
+    memset(control, 0, sizeof control);
+    iovec iov;
+    iov.iov_base = const_cast<char*>(data.data());
+    iov.iov_len = data.size();
+
+    msghdr msg;
+    memset(&msg, 0, sizeof msg);
+    msg.msg_name = const_cast<sockaddr*>(peer.getSockAddr());
+    msg.msg_namelen = peer.length();
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof control;
+
+    cmsghdr *cm = CMSG_FIRSTHDR(&msg);
+    cm->cmsg_level = SOL_UDP;
+    cm->cmsg_type = UDP_SEGMENT;
+    cm->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+    memcpy(CMSG_DATA(cm), &segmentSize, sizeof segmentSize);
+
+    ssize_t n = ::sendmsg(socket_.fd(), &msg, MSG_DONTWAIT);
+    if(n < 0)
+    {
+        if(errno == EIO || errno == EINVAL || errno == ENOPROTOOPT)
+        {
+            LOG_ERROR("UdpChannel::sendGso UDP_SEGMENT unsupported(%d), fall back to sendmmsg\n", errno);
+            gsoSupported_ = false;
+            return false;
+        }
+        packetsDropped_ += (data.size() + segmentSize - 1) / segmentSize;
+        if(errno != EAGAIN)
+            LOG_ERROR("UdpChannel::sendGso error:%d\n", errno);
+        return true;
+    }
+    packetsSent_ += (data.size() + segmentSize - 1) / segmentSize;
+    return true;
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "Socket.h"
+#include "Channel.h"
+#include "InetAddress.h"
+#include "StringPiece.h"
+#include "Timestamp.h"
+
+#include <functional>
+#include <vector>
+#include <stdint.h>
+#include <sys/socket.h>
+
+class EventLoop;
+class UdpChannel;
+
+using UdpMessageCallback = std::function<void(UdpChannel*, const StringPiece &data,
+    const InetAddress &peer, Timestamp receiveTime)>;
+
+/**
+ * 一个UDP socket以及它在loop中的Channel
+ * 收：一次recvmmsg把最多batchSize个数据报读进预先分配好的缓冲区，逐个回调，回调拿到的data指向该缓冲区
+ * 发：回调期间send()的数据报先攒起来，本轮读处理完以后用一次sendmmsg发出
+ *     sendSegments()借助UDP_SEGMENT(GSO)一次系统调用发出多个等长数据报，内核不支持时退化为sendmmsg
+ * 除了send()以外的接口都只能在loop线程中调用
+ */
+class UdpChannel : noncopyable
+{
+public:
+    static const int kDefaultBatchSize = 32;
+    static const size_t kDefaultMaxDatagramSize = 2048;
+    static const int kMaxGsoSegments = 64;
+
+    // 创建非阻塞的UDP socket并绑定，reusePort为true时多个socket可以绑定同一端口，由内核分流
+    static int createSocket(const InetAddress &bindAddr, bool reusePort);
+
+    UdpChannel(EventLoop *loop, int sockfd,
+        int batchSize = kDefaultBatchSize,
+        size_t maxDatagramSize = kDefaultMaxDatagramSize);
+    ~UdpChannel();
+
+    void setMessageCallback(const UdpMessageCallback &cb) {messageCallback_ = cb;}
+
+    void start(); // 开始接收
+    void stop();  // 停止接收并从poller中移除
+
+    // 可以在任意线程调用，其他线程中调用时数据会被拷贝并转交给loop
+    void send(const InetAddress &peer, const StringPiece &data);
+    // data按segmentSize切成多个数据报发给peer，最后一段可以更短
+    void sendSegments(const InetAddress &peer, const StringPiece &data, uint16_t segmentSize);
+    // 立即发出攒下的数据报
+    void flush();
+
+    EventLoop* getLoop() const {return loop_;}
+    int fd() const {return socket_.fd();}
+    InetAddress localAddress() const;
+
+    // 统计信息，只在loop线程中修改
+    uint64_t packetsReceived() const {return packetsReceived_;}
+    uint64_t packetsSent() const {return packetsSent_;}
+    uint64_t packetsDropped() const {return packetsDropped_;}
+
+private:
+    struct PendingPacket
+    {
+        size_t offset;
+        size_t len;
+        sockaddr_in6 addr;  // 足够容纳IPv4和IPv6地址
+        socklen_t addrlen;
+    };
+
+    void handleRead(Timestamp receiveTime);
+    void queuePacket(const InetAddress &peer, const char *data, size_t len);
+    bool sendGso(const InetAddress &peer, const StringPiece &data, uint16_t segmentSize);
+
+    EventLoop *loop_;
+    Socket socket_;
+    Channel channel_;
+    UdpMessageCallback messageCallback_;
+
+    const int batchSize_;
+    const size_t maxDatagramSize_;
+    std::vector<char> recvBuf_;         // batchSize_ * maxDatagramSize_
+    std::vector<mmsghdr> recvMsgs_;
+    std::vector<iovec> recvIovecs_;
+    std::vector<sockaddr_in6> recvAddrs_;
+
+    std::vector<char> sendBuf_;         // 攒批的数据报内容，按offset引用
+    std::vector<PendingPacket> pending_;
+    std::vector<mmsghdr> sendMsgs_;
+    std::vector<iovec> sendIovecs_;
+    bool batching_;                     // 正在处理读事件，send()只攒不发
+    bool gsoSupported_;
+
+    uint64_t packetsReceived_;
+    uint64_t packetsSent_;
+    uint64_t packetsDropped_;
+};
@@ -0,0 +1,73 @@
+#include "UdpServer.h"
+#include "EventLoop.h"
+#include "Logger.h"
+
+static EventLoop* CheckLoopNotNull(EventLoop *loop)
+{
+    if(loop == nullptr)
+        LOG_FATAL("%s:%s:%d mainLoop is null!\n",__FILE__,__FUNCTION__,__LINE__);
+    return loop;
+}
+
+UdpServer::UdpServer(EventLoop *loop,
+          const InetAddress &listenAddr,
+          const std::string &nameArg)
+    : loop_(CheckLoopNotNull(loop))
+    , listenAddr_(listenAddr)
+    , name_(nameArg)
+    , threadPool_(new EventLoopThreadPool(loop, name_))
+    , batchSize_(UdpChannel::kDefaultBatchSize)
+    , maxDatagramSize_(UdpChannel::kDefaultMaxDatagramSize)
+    , started_(0)
+{
+}
+
+// channel必须在所属loop中移除，由投递过去的任务持有最后一个引用并在loop中析构
+UdpServer::~UdpServer()
+{
+    for(std::shared_ptr<UdpChannel> &channel : channels_)
+    {
+        std::shared_ptr<UdpChannel> ch;
+        ch.swap(channel);
+        ch->getLoop()->runInLoop([ch]()
+        {
+            ch->stop();
+        });
+    }
+}
+
+void UdpServer::start()
+{
+    if(started_++ != 0)
+        return;
+
+    threadPool_->start(threadInitCallback_);
+    std::vector<EventLoop*> loops = threadPool_->getAllLoops();
+    // 接管的socket和新建的socket在同一个SO_REUSEPORT组里，先加入接管的，实际端口以它们为准
+    for(size_t i = 0; i < adoptedFds_.size(); ++i)
+        addChannel(loops[i % loops.size()], adoptedFds_[i]);
+    for(size_t i = adoptedFds_.size(); i < loops.size(); ++i)
+        addChannel(loops[i], UdpChannel::createSocket(listenAddr_, true));
+    adoptedFds_.clear();
+    LOG_INFO("UdpServer[%s] listening on %s with %zu sockets\n",
+        name_.c_str(), listenAddr_.toIpPort().c_str(), channels_.size());
+}
+
+void UdpServer::addChannel(EventLoop *ioLoop, int sockfd)
+{
+    std::shared_ptr<UdpChannel> channel(new UdpChannel(ioLoop, sockfd, batchSize_, maxDatagramSize_));
+    // 端口为0时由第一个socket决定实际端口，其余socket绑定同一端口
+    if(channels_.empty())
+        listenAddr_ = channel->localAddress();
+    channel->setMessageCallback(messageCallback_);
+    channels_.push_back(channel);
+    ioLoop->runInLoop(std::bind(&UdpChannel::start, channel.get()));
+}
+
+std::vector<int> UdpServer::socketFds() const
+{
+    std::vector<int> fds;
+    for(const std::shared_ptr<UdpChannel> &channel : channels_)
+        fds.push_back(channel->fd());
+    return fds;
+}
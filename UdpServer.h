@@ -0,0 +1,61 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "InetAddress.h"
+#include "UdpChannel.h"
+#include "EventLoopThreadPool.h"
+
+#include <functional>
+#include <string>
+#include <vector>
+#include <memory>
+#include <atomic>
+
+class EventLoop;
+
+/**
+ * UDP服务器，每个loop(没有subLoop时就是baseLoop)各自持有一个绑定同一端口的SO_REUSEPORT socket
+ * 内核按四元组把数据报分流到不同socket，各个loop独立收发，互相之间没有锁
+ */
+class UdpServer : noncopyable
+{
+public:
+    using ThreadInitCallback = std::function<void(EventLoop*)>;
+
+    UdpServer(EventLoop *loop,
+        const InetAddress &listenAddr,
+        const std::string &nameArg);
+    ~UdpServer();
+
+    void setThreadNum(int numThreads) {threadPool_->setThreadNum(numThreads);}
+    void setThreadInitCallback(const ThreadInitCallback &cb) {threadInitCallback_ = cb;}
+    void setMessageCallback(const UdpMessageCallback &cb) {messageCallback_ = cb;}
+    void setBatchSize(int batchSize) {batchSize_ = batchSize;}
+    void setMaxDatagramSize(size_t size) {maxDatagramSize_ = size;}
+    // 接管已经绑定好的socket(热重启时从旧进程收到)，start()时按loop轮流分配，loop比socket多时再新建
+    void setAdoptedSockets(const std::vector<int> &fds) {adoptedFds_ = fds;}
+
+    void start();
+
+    const std::string& name() const {return name_;}
+    // start()以后有效，端口为0时返回内核分配的实际端口
+    InetAddress listenAddress() const {return listenAddr_;}
+    std::vector<std::shared_ptr<UdpChannel>> channels() const {return channels_;}
+    // 所有socket的fd，热重启时交给新进程
+    std::vector<int> socketFds() const;
+
+private:
+    EventLoop *loop_;
+    InetAddress listenAddr_;
+    const std::string name_;
+    std::shared_ptr<EventLoopThreadPool> threadPool_;
+    UdpMessageCallback messageCallback_;
+    ThreadInitCallback threadInitCallback_;
+    int batchSize_;
+    size_t maxDatagramSize_;
+    std::atomic_int started_;
+    std::vector<std::shared_ptr<UdpChannel>> channels_;
+    std::vector<int> adoptedFds_;
+
+    void addChannel(EventLoop *ioLoop, int sockfd);
+};
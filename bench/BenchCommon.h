@@ -0,0 +1,232 @@
+#pragma once
+
+/**
+ * bench目录下各个基准测试共用的工具
+ * 参数统一为--key=value，结果输出为一行key=value(加--json输出一行JSON)，方便脚本比较不同构建的结果
+ */
+
+#include "EventLoop.h"
+#include "TcpServer.h"
+#include "Histogram.h"
+#include "Logger.h"
+
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/resource.h>
+
+class BenchOptions
+{
+public:
+    BenchOptions(int argc, char *argv[])
+    {
+        for(int i = 1; i < argc; ++i)
+        {
+            std::string arg(argv[i]);
+            if(arg.compare(0, 2, "--") != 0)
+                continue;
+            size_t eq = arg.find('=');
+            if(eq == std::string::npos)
+                options_[arg.substr(2)] = "1";
+            else
+                options_[arg.substr(2, eq - 2)] = arg.substr(eq + 1);
+        }
+    }
+
+    bool has(const std::string &key) const {return options_.count(key) != 0;}
+    std::string get(const std::string &key, const std::string &def) const
+    {
+        std::map<std::string, std::string>::const_iterator it = options_.find(key);
+        return it == options_.end() ? def : it->second;
+    }
+    long getInt(const std::string &key, long def) const
+    {return has(key) ? atol(get(key, "").c_str()) : def;}
+    double getDouble(const std::string &key, double def) const
+    {return has(key) ? atof(get(key, "").c_str()) : def;}
+
+private:
+    std::map<std::string, std::string> options_;
+};
+
+class BenchReport
+{
+public:
+    explicit BenchReport(const std::string &name)
+    {add("bench", name);}
+
+    void add(const std::string &key, const std::string &value)
+    {items_.push_back(std::make_pair(key, "\"" + value + "\""));}
+    void add(const std::string &key, const char *value)
+    {add(key, std::string(value));}
+    void add(const std::string &key, long value)
+    {items_.push_back(std::make_pair(key, std::to_string(value)));}
+    void add(const std::string &key, int value)
+    {add(key, static_cast<long>(value));}
+    void add(const std::string &key, uint64_t value)
+    {items_.push_back(std::make_pair(key, std::to_string(value)));}
+    void add(const std::string &key, double value)
+    {
+        char buf[64];
+        snprintf(buf, sizeof buf, "%.3f", value);
+        items_.push_back(std::make_pair(key, buf));
+    }
+    // 以纳秒记录的直方图，输出微秒
+    void addHistogram(const std::string &prefix, const Histogram &h)
+    {
+        add(prefix + "count", h.count());
+        add(prefix + "p50_us", h.percentile(50) / 1e3);
+        add(prefix + "p90_us", h.percentile(90) / 1e3);
+        add(prefix + "p99_us", h.percentile(99) / 1e3);
+        add(prefix + "p999_us", h.percentile(99.9) / 1e3);
+        add(prefix + "max_us", h.max() / 1e3);
+    }
+
+    void print(bool json) const
+    {
+        std::string line;
+        for(size_t i = 0; i < items_.size(); ++i)
+        {
+            const std::string &value = items_[i].second;
+            if(json)
+                line += (i ? ", \"" : "{\"") + items_[i].first + "\": " + value;
+            else
+            {
+                bool quoted = value.size() >= 2 && value[0] == '"';
+                line += (i ? " " : "") + items_[i].first + "=" + (quoted ? value.substr(1, value.size() - 2) : value);
+            }
+        }
+        if(json)
+            line += "}";
+        printf("%s\n", line.c_str());
+        fflush(stdout);
+    }
+
+private:
+    std::vector<std::pair<std::string, std::string>> items_;
+};
+
+// 当前进程的常驻内存，单位KB
+inline long readRssKb()
+{
+    FILE *fp = fopen("/proc/self/status", "r");
+    if(fp == nullptr)
+        return 0;
+    char line[256];
+    long rss = 0;
+    while(fgets(line, sizeof line, fp))
+    {
+        if(strncmp(line, "VmRSS:", 6) == 0)
+        {
+            rss = atol(line + 6);
+            break;
+        }
+    }
+    fclose(fp);
+    return rss;
+}
+
+// 把fd上限提到硬上限，返回新的软上限
+inline long raiseFdLimit()
+{
+    rlimit rl;
+    if(::getrlimit(RLIMIT_NOFILE, &rl) == 0)
+    {
+        rl.rlim_cur = rl.rlim_max;
+        ::setrlimit(RLIMIT_NOFILE, &rl);
+        return static_cast<long>(rl.rlim_cur);
+    }
+    return 0;
+}
+
+/**
+ * 在独立线程中运行的回显服务器，用于客户端和服务端在同一进程中运行的模式
+ * echo为false时只接受连接不回显
+ */
+class BenchServerThread
+{
+public:
+    BenchServerThread(const InetAddress &addr, int threads, bool echo)
+        : server_(nullptr)
+        , loop_(nullptr)
+    {
+        thread_ = std::thread([this, addr, threads, echo]()
+        {
+            EventLoop loop;
+            TcpServer server(&loop, addr, "BenchServer");
+            server.setThreadNum(threads);
+            if(echo)
+            {
+                server.setMessageCallback([](const TcpConnectionPtr &conn, Buffer *buf, Timestamp)
+                {
+                    conn->send(buf);
+                });
+            }
+            server.start();
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                loop_ = &loop;
+                server_ = &server;
+                cond_.notify_one();
+            }
+            loop.loop();
+        });
+        std::unique_lock<std::mutex> lock(mutex_);
+        while(server_ == nullptr)
+            cond_.wait(lock);
+    }
+
+    ~BenchServerThread()
+    {
+        loop_->quit();
+        thread_.join();
+    }
+
+    TcpServer* server() const {return server_;}
+
+private:
+    TcpServer *server_;
+    EventLoop *loop_;
+    std::thread thread_;
+    std::mutex mutex_;
+    std::condition_variable cond_;
+};
+
+// --mode=server：只运行服务端直到进程被杀掉，客户端可以在另一台机器上用--mode=client连接
+inline int runBenchServer(const BenchOptions &options, bool echo)
+{
+    EventLoop loop;
+    InetAddress addr(static_cast<uint16_t>(options.getInt("port", 9100)), options.get("ip", "0.0.0.0"));
+    TcpServer server(&loop, addr, "BenchServer");
+    server.setThreadNum(static_cast<int>(options.getInt("server-threads", 1)));
+    if(echo)
+    {
+        server.setMessageCallback([](const TcpConnectionPtr &conn, Buffer *buf, Timestamp)
+        {
+            conn->send(buf);
+        });
+    }
+    server.start();
+    loop.loop();
+    return 0;
+}
+
+// 测量窗口：预热结束后开始统计，各客户端loop只读取，主线程在定时器中设置
+struct BenchWindow
+{
+    std::atomic<int64_t> startNanos{INT64_MAX};
+    std::atomic<int64_t> endNanos{INT64_MAX};
+
+    bool contains(int64_t nowNanos) const
+    {
+        return nowNanos >= startNanos.load(std::memory_order_relaxed)
+            && nowNanos < endNanos.load(std::memory_order_relaxed);
+    }
+};
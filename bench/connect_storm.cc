@@ -0,0 +1,174 @@
+#include "BenchCommon.h"
+#include "Connector.h"
+#include "EventLoopThreadPool.h"
+
+#include <memory>
+#include <unordered_map>
+#include <sys/socket.h>
+
+/**
+ * 建连风暴：每个客户端loop保持concurrency个非阻塞connect在途，连接建立后立即关闭并发起下一个，
+ * 直到发起total个连接，衡量服务端accept+创建/销毁TcpConnection的速度和connect延迟
+ * 默认正常close，跨机器测试大量连接时客户端端口可能被TIME_WAIT耗尽，--rst改为SO_LINGER(0)关闭(发RST)
+ *
+ * ./bench_connect_storm --total=20000 --concurrency=64 --server-threads=2 --client-threads=1
+ * ./bench_connect_storm --mode=server --port=9102 --server-threads=4
+ * ./bench_connect_storm --mode=client --ip=10.0.0.1 --port=9102
+ */
+class StormClient
+{
+public:
+    StormClient(EventLoop *loop, const InetAddress &addr, int total, int concurrency, bool rst)
+        : loop_(loop)
+        , addr_(addr)
+        , remaining_(total)
+        , concurrency_(concurrency)
+        , rst_(rst)
+        , inFlight_(0)
+        , done_(false)
+    {}
+
+    void start() {loop_->runInLoop(std::bind(&StormClient::fill, this));}
+
+    bool done() const {return done_;}
+    uint64_t succeeded() const {return succeeded_.get();}
+    uint64_t failed() const {return failed_.get();}
+    const Histogram& latency() const {return latency_;}
+    int64_t finishNanos() const {return finishNanos_.get();}
+
+private:
+    void fill()
+    {
+        while(inFlight_ < concurrency_ && remaining_ > 0)
+        {
+            --remaining_;
+            ++inFlight_;
+            std::shared_ptr<Connector> connector(new Connector(loop_, addr_));
+            Connector *raw = connector.get();
+            int64_t startNanos = Timestamp::monotonicNanos();
+            connector->setNewConnectionCallback([this, raw, startNanos](int sockfd)
+            {
+                latency_.record(Timestamp::monotonicNanos() - startNanos);
+                succeeded_.add();
+                if(rst_)
+                {
+                    linger lg = {1, 0};
+                    ::setsockopt(sockfd, SOL_SOCKET, SO_LINGER, &lg, sizeof lg);
+                }
+                ::close(sockfd);
+                finish(raw);
+            });
+            connector->setConnectFailedCallback([this, raw](int)
+            {
+                failed_.add();
+                finish(raw);
+            });
+            connectors_[raw] = connector;
+            connector->start();
+        }
+        if(inFlight_ == 0 && remaining_ == 0 && !done_)
+        {
+            finishNanos_.set(Timestamp::monotonicNanos());
+            done_ = true;
+        }
+    }
+
+    // 正处于Connector的回调中，Connector由它自己排队的任务保活，这里放到下一轮再释放
+    void finish(Connector *raw)
+    {
+        --inFlight_;
+        loop_->queueLoop([this, raw]()
+        {
+            connectors_.erase(raw);
+            fill();
+        });
+    }
+
+    EventLoop *loop_;
+    const InetAddress addr_;
+    int remaining_;
+    const int concurrency_;
+    const bool rst_;
+    int inFlight_;
+    std::atomic_bool done_;
+    std::unordered_map<Connector*, std::shared_ptr<Connector>> connectors_;
+    LoopCounter succeeded_;
+    LoopCounter failed_;
+    LoopCounter finishNanos_;
+    Histogram latency_;
+};
+
+int main(int argc, char *argv[])
+{
+    BenchOptions options(argc, argv);
+    std::string mode = options.get("mode", "self");
+    raiseFdLimit();
+    if(mode == "server")
+        return runBenchServer(options, false);
+
+    const int total = static_cast<int>(options.getInt("total", 20000));
+    const int concurrency = static_cast<int>(options.getInt("concurrency", 64));
+    const int serverThreads = static_cast<int>(options.getInt("server-threads", 1));
+    const int clientThreads = static_cast<int>(options.getInt("client-threads", 1));
+    const bool rst = options.has("rst");
+    InetAddress addr(static_cast<uint16_t>(options.getInt("port", 9102)), options.get("ip", "127.0.0.1"));
+
+    std::unique_ptr<BenchServerThread> server;
+    if(mode == "self")
+        server.reset(new BenchServerThread(addr, serverThreads, false));
+
+    EventLoop loop;
+    EventLoopThreadPool pool(&loop, "storm-client");
+    pool.setThreadNum(clientThreads);
+    pool.start();
+
+    std::vector<EventLoop*> loops = pool.getAllLoops();
+    std::vector<std::unique_ptr<StormClient>> clients;
+    int64_t startNanos = Timestamp::monotonicNanos();
+    for(size_t i = 0; i < loops.size(); ++i)
+    {
+        int share = total / static_cast<int>(loops.size()) + (static_cast<int>(i) < total % static_cast<int>(loops.size()) ? 1 : 0);
+        clients.emplace_back(new StormClient(loops[i], addr, share, concurrency, rst));
+        clients.back()->start();
+    }
+
+    loop.runEvery(0.01, [&]()
+    {
+        for(const std::unique_ptr<StormClient> &client : clients)
+        {
+            if(!client->done())
+                return;
+        }
+
+        uint64_t succeeded = 0, failed = 0;
+        int64_t finishNanos = startNanos;
+        Histogram latency;
+        for(const std::unique_ptr<StormClient> &client : clients)
+        {
+            succeeded += client->succeeded();
+            failed += client->failed();
+            latency += client->latency();
+            finishNanos = std::max(finishNanos, client->finishNanos());
+        }
+        double seconds = (finishNanos - startNanos) / 1e9;
+
+        BenchReport report("connect_storm");
+        report.add("mode", mode);
+        report.add("total", total);
+        report.add("concurrency", concurrency);
+        report.add("server_threads", serverThreads);
+        report.add("client_threads", clientThreads);
+        report.add("rst", rst ? 1 : 0);
+        report.add("seconds", seconds);
+        report.add("connected", succeeded);
+        report.add("failed", failed);
+        report.add("conns_per_sec", succeeded / seconds);
+        report.addHistogram("connect_", latency);
+        if(server)
+            report.add("server_accepts", server->server()->totalMetrics().accepts);
+        report.print(options.has("json"));
+        _exit(0);
+    });
+    loop.loop();
+    return 0;
+}
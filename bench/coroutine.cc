@@ -0,0 +1,173 @@
+#include "BenchCommon.h"
+#include "Coroutine.h"
+
+#include <memory>
+
+/**
+ * 协程接口的开销：一问一答的行协议(每行size字节，以\n结尾)，客户端用协程写，服务端分别用回调和协程实现
+ * 两个阶段依次测同样的时长，比较每秒往返次数；服务端协程每处理一行调用一次子协程，帧从loop的FramePool分配
+ *
+ * ./bench_coroutine --conns=16 --size=64 --seconds=3
+ * 需要cmake -DMYMUDUO_WITH_COROUTINES=ON
+ */
+namespace
+{
+struct Phase
+{
+    BenchWindow window;
+    Histogram latency;
+    bool stop = false;
+};
+
+// 服务端处理一行：读到\n，原样写回
+Task<bool> echoLine(CoConnection *c)
+{
+    size_t n = co_await c->readUntil("\n");
+    if(n == 0)
+        co_return false;
+    bool ok = co_await c->write(c->input()->peek(), n);
+    c->input()->retrieve(n);
+    co_return ok;
+}
+
+Task<> serverSession(CoConnectionPtr c)
+{
+    for(;;)
+    {
+        bool ok = co_await echoLine(c.get());
+        if(!ok)
+            break;
+    }
+}
+
+Task<> clientSession(EventLoop *loop, InetAddress addr, size_t size, Phase *phase)
+{
+    CoConnectionPtr c = co_await asyncConnect(loop, addr);
+    if(!c)
+        co_return;
+    c->connection()->setTcpNoDelay(true);
+    std::string message(size > 1 ? size - 1 : 0, 'p');
+    message += '\n';
+    while(!phase->stop)
+    {
+        int64_t start = Timestamp::monotonicNanos();
+        if(!co_await c->write(message))
+            break;
+        size_t n = co_await c->readUntil("\n");
+        if(n == 0)
+            break;
+        c->input()->retrieve(n);
+        int64_t now = Timestamp::monotonicNanos();
+        if(phase->window.contains(now))
+            phase->latency.record(now - start);
+    }
+}
+
+// 两个服务端跑在同一个线程的同一个loop里：回调版和协程版
+class Servers
+{
+public:
+    Servers(const InetAddress &callbackAddr, const InetAddress &coroutineAddr)
+        : loop_(nullptr)
+    {
+        thread_ = std::thread([this, callbackAddr, coroutineAddr]()
+        {
+            EventLoop loop;
+            TcpServer callbackServer(&loop, callbackAddr, "callback");
+            callbackServer.setMessageCallback([](const TcpConnectionPtr &conn, Buffer *buf, Timestamp)
+            {
+                const char *eol;
+                while((eol = std::find(buf->peek(), buf->peek() + buf->readableBytes(), '\n'))
+                    != buf->peek() + buf->readableBytes())
+                {
+                    conn->send(buf->peek(), eol + 1 - buf->peek());
+                    buf->retrieve(eol + 1 - buf->peek());
+                }
+            });
+            TcpServer coroutineServer(&loop, coroutineAddr, "coroutine");
+            coroutineServer.setConnectionCallback([](const TcpConnectionPtr &conn)
+            {
+                if(conn->connected())
+                    spawn(serverSession(CoConnection::attach(conn)));
+            });
+            callbackServer.start();
+            coroutineServer.start();
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                loop_ = &loop;
+                cond_.notify_one();
+            }
+            loop.loop();
+        });
+        std::unique_lock<std::mutex> lock(mutex_);
+        while(loop_ == nullptr)
+            cond_.wait(lock);
+    }
+
+    ~Servers()
+    {
+        loop_->quit();
+        thread_.join();
+    }
+
+    EventLoop* loop() const {return loop_;}
+
+private:
+    EventLoop *loop_;
+    std::thread thread_;
+    std::mutex mutex_;
+    std::condition_variable cond_;
+};
+}
+
+int main(int argc, char *argv[])
+{
+    BenchOptions options(argc, argv);
+    const int conns = static_cast<int>(options.getInt("conns", 16));
+    const size_t size = static_cast<size_t>(options.getInt("size", 64));
+    const double seconds = options.getDouble("seconds", 3);
+    const double warmup = options.getDouble("warmup", 0.5);
+    const uint16_t port = static_cast<uint16_t>(options.getInt("port", 9400));
+    const InetAddress callbackAddr(port, "127.0.0.1");
+    const InetAddress coroutineAddr(static_cast<uint16_t>(port + 1), "127.0.0.1");
+
+    Servers servers(callbackAddr, coroutineAddr);
+    EventLoop loop;
+    Phase phases[2];
+    const InetAddress *addrs[2] = {&callbackAddr, &coroutineAddr};
+    BenchReport report("coroutine");
+    report.add("conns", conns);
+    report.add("size", static_cast<long>(size));
+    report.add("seconds", seconds);
+
+    // 第i个阶段：建立连接，预热后统计seconds秒，然后让客户端协程退出
+    std::function<void(int)> runPhase = [&](int i)
+    {
+        if(i == 2)
+        {
+            report.add("client_frames_in_use", static_cast<long>(loop.framePool().blocksInUse()));
+            report.print(options.has("json"));
+            _exit(0);
+        }
+        Phase *phase = &phases[i];
+        for(int c = 0; c < conns; ++c)
+            spawn(clientSession(&loop, *addrs[i], size, phase));
+        loop.runAfter(warmup, [phase, seconds]()
+        {
+            int64_t now = Timestamp::monotonicNanos();
+            phase->window.startNanos = now;
+            phase->window.endNanos = now + static_cast<int64_t>(seconds * 1e9);
+        });
+        loop.runAfter(warmup + seconds, [&, phase, i]()
+        {
+            const char *name = i == 0 ? "callback_server_" : "coroutine_server_";
+            report.add(std::string(name) + "round_trips_per_sec", phase->latency.count() / seconds);
+            report.add(std::string(name) + "rtt_p99_us", phase->latency.percentile(99) / 1e3);
+            phase->stop = true;
+            loop.runAfter(0.2, [&, i]() {runPhase(i + 1);});
+        });
+    };
+    runPhase(0);
+    loop.loop();
+    return 0;
+}
@@ -0,0 +1,130 @@
+#include "BenchCommon.h"
+#include "TcpClient.h"
+#include "EventLoopThreadPool.h"
+
+#include <memory>
+
+/**
+ * 回显吞吐：每个连接先发出window字节(按size切块)，之后把收到的数据原样发回，
+ * 服务端也原样回显，数据在连接上持续往返，统计双方向的总字节数
+ *
+ * ./bench_echo --conns=16 --size=16384 --window=65536 --server-threads=2 --client-threads=2 --seconds=5
+ * ./bench_echo --mode=server --port=9101 --server-threads=4
+ * ./bench_echo --mode=client --ip=10.0.0.1 --port=9101
+ */
+class Session
+{
+public:
+    Session(EventLoop *loop, const InetAddress &addr, const std::string &name,
+        size_t size, size_t window, const BenchWindow *benchWindow)
+        : client_(loop, addr, name)
+        , chunk_(size, 'e')
+        , window_(window)
+        , benchWindow_(benchWindow)
+    {
+        client_.setConnectionCallback(std::bind(&Session::onConnection, this, std::placeholders::_1));
+        client_.setMessageCallback(std::bind(&Session::onMessage, this,
+            std::placeholders::_1, std::placeholders::_2, std::placeholders::_3));
+    }
+
+    void connect() {client_.connect();}
+    uint64_t bytesRead() const {return bytesRead_.get();}
+    uint64_t messagesRead() const {return messagesRead_.get();}
+
+private:
+    void onConnection(const TcpConnectionPtr &conn)
+    {
+        if(conn->connected())
+        {
+            conn->setTcpNoDelay(true);
+            for(size_t sent = 0; sent < window_; sent += chunk_.size())
+                conn->send(chunk_.data(), std::min(chunk_.size(), window_ - sent));
+        }
+    }
+
+    void onMessage(const TcpConnectionPtr &conn, Buffer *buf, Timestamp)
+    {
+        if(benchWindow_->contains(Timestamp::monotonicNanos()))
+        {
+            bytesRead_.add(buf->readableBytes());
+            messagesRead_.add();
+        }
+        conn->send(buf);
+    }
+
+    TcpClient client_;
+    const std::string chunk_;
+    const size_t window_;
+    const BenchWindow *benchWindow_;
+    LoopCounter bytesRead_;
+    LoopCounter messagesRead_;
+};
+
+int main(int argc, char *argv[])
+{
+    BenchOptions options(argc, argv);
+    std::string mode = options.get("mode", "self");
+    if(mode == "server")
+        return runBenchServer(options, true);
+
+    const int conns = static_cast<int>(options.getInt("conns", 16));
+    const size_t size = static_cast<size_t>(options.getInt("size", 16 * 1024));
+    const size_t window = static_cast<size_t>(options.getInt("window", 64 * 1024));
+    const int serverThreads = static_cast<int>(options.getInt("server-threads", 1));
+    const int clientThreads = static_cast<int>(options.getInt("client-threads", 1));
+    const double seconds = options.getDouble("seconds", 5);
+    const double warmup = options.getDouble("warmup", 1);
+    InetAddress addr(static_cast<uint16_t>(options.getInt("port", 9101)), options.get("ip", "127.0.0.1"));
+
+    std::unique_ptr<BenchServerThread> server;
+    if(mode == "self")
+        server.reset(new BenchServerThread(addr, serverThreads, true));
+
+    EventLoop loop;
+    EventLoopThreadPool pool(&loop, "echo-client");
+    pool.setThreadNum(clientThreads);
+    pool.start();
+
+    BenchWindow benchWindow;
+    std::vector<std::unique_ptr<Session>> sessions;
+    for(int i = 0; i < conns; ++i)
+    {
+        sessions.emplace_back(new Session(pool.getNextLoop(), addr, "echo-" + std::to_string(i),
+            size, window, &benchWindow));
+        sessions.back()->connect();
+    }
+
+    loop.runAfter(warmup, [&benchWindow, seconds]()
+    {
+        int64_t now = Timestamp::monotonicNanos();
+        benchWindow.startNanos = now;
+        benchWindow.endNanos = now + static_cast<int64_t>(seconds * 1e9);
+    });
+    loop.runAfter(warmup + seconds + 0.1, [&]()
+    {
+        uint64_t bytes = 0, reads = 0;
+        for(const std::unique_ptr<Session> &session : sessions)
+        {
+            bytes += session->bytesRead();
+            reads += session->messagesRead();
+        }
+
+        BenchReport report("echo");
+        report.add("mode", mode);
+        report.add("conns", conns);
+        report.add("size", static_cast<long>(size));
+        report.add("window", static_cast<long>(window));
+        report.add("server_threads", serverThreads);
+        report.add("client_threads", clientThreads);
+        report.add("seconds", seconds);
+        report.add("bytes", bytes);
+        report.add("mib_per_sec", bytes / seconds / (1024.0 * 1024.0));
+        report.add("avg_read_bytes", reads ? static_cast<double>(bytes) / reads : 0.0);
+        if(server)
+            report.add("server_events_per_poll", server->server()->totalMetrics().eventsPerPoll());
+        report.print(options.has("json"));
+        _exit(0);
+    });
+    loop.loop();
+    return 0;
+}
@@ -0,0 +1,275 @@
+#include "BenchCommon.h"
+#include "TcpClient.h"
+#include "Topic.h"
+
+#include <memory>
+#include <set>
+#include <sys/socket.h>
+
+/**
+ * 广播的开销：--subs个订阅连接分布在--server-threads个subLoop上，发布线程连续发布--messages条--size字节的消息，
+ * 统计从开始发布到所有订阅者收齐的时间
+ *   copy阶段：每条消息对每个连接调用一次send(std::string)，每次都是跨线程runInLoop加一份拷贝
+ *   topic阶段：Topic::publish()，每条消息一份SharedPayload，每个loop一个任务，writev发出
+ * --rate=N 每秒发布N条，默认0表示不限速一次发完
+ * --slow=N 另外加N个从不读的订阅者，topic阶段按--policy=drop|disconnect和--max-queued-kb处理，
+ * copy阶段它们的数据一直堆在outputBuffer_里，看rss_kb；突发超过内核缓冲区加上限时正常订阅者也会被当成慢的，需要配合--rate
+ *
+ * ./bench_fanout --subs=1000 --messages=2000 --size=128 --server-threads=2
+ * ./bench_fanout --subs=1000 --messages=5000 --rate=1000 --slow=50 --policy=drop --max-queued-kb=256
+ */
+namespace
+{
+// 广播服务端，copy为true时用逐个send()的方式
+class FanoutServer
+{
+public:
+    FanoutServer(const InetAddress &addr, int threads, bool copy, Topic *topic)
+        : copy_(copy)
+        , topic_(topic)
+        , loop_(nullptr)
+    {
+        thread_ = std::thread([this, addr, threads]()
+        {
+            EventLoop loop;
+            TcpServer server(&loop, addr, copy_ ? "fanout-copy" : "fanout-topic");
+            server.setThreadNum(threads);
+            server.setConnectionCallback([this](const TcpConnectionPtr &conn)
+            {
+                if(copy_)
+                {
+                    std::lock_guard<std::mutex> lock(mutex_);
+                    if(conn->connected())
+                        conns_.insert(conn);
+                    else
+                        conns_.erase(conn);
+                }
+                else if(conn->connected())
+                    topic_->subscribe(conn);
+            });
+            server.start();
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                loop_ = &loop;
+                cond_.notify_one();
+            }
+            loop.loop();
+        });
+        std::unique_lock<std::mutex> lock(mutex_);
+        while(loop_ == nullptr)
+            cond_.wait(lock);
+    }
+
+    ~FanoutServer()
+    {
+        loop_->quit();
+        thread_.join();
+    }
+
+    size_t subscribers()
+    {
+        if(!copy_)
+            return topic_->subscribers();
+        std::lock_guard<std::mutex> lock(mutex_);
+        return conns_.size();
+    }
+
+    void publish(const std::string &message)
+    {
+        if(!copy_)
+        {
+            topic_->publish(message);
+            return;
+        }
+        std::lock_guard<std::mutex> lock(mutex_);
+        for(const TcpConnectionPtr &conn : conns_)
+            conn->send(message);
+    }
+
+private:
+    const bool copy_;
+    Topic *topic_;
+    std::set<TcpConnectionPtr> conns_;
+    EventLoop *loop_;
+    std::thread thread_;
+    std::mutex mutex_;
+    std::condition_variable cond_;
+};
+
+// 一个阶段：连接订阅者，全部订阅以后在另一个线程中发布，收齐或者超时后调用done
+class Phase
+{
+public:
+    using Done = std::function<void()>;
+
+    Phase(EventLoop *loop, FanoutServer *server, const InetAddress &addr, const BenchOptions &options)
+        : loop_(loop)
+        , server_(server)
+        , addr_(addr)
+        , subs_(static_cast<int>(options.getInt("subs", 1000)))
+        , slow_(static_cast<int>(options.getInt("slow", 0)))
+        , messages_(static_cast<int>(options.getInt("messages", 2000)))
+        , size_(static_cast<size_t>(options.getInt("size", 128)))
+        , rate_(options.getDouble("rate", 0))
+        , timeout_(options.getDouble("timeout", 30))
+        , received_(0)
+        , started_(0)
+        , publishNanos_(0)
+        , elapsedNanos_(0)
+        , finished_(false)
+    {}
+
+    ~Phase()
+    {
+        if(publisher_.joinable())
+            publisher_.join();
+        for(int fd : slowFds_)
+            ::close(fd);
+    }
+
+    void start(const Done &done)
+    {
+        done_ = done;
+        for(int i = 0; i < subs_; ++i)
+        {
+            clients_.emplace_back(new TcpClient(loop_, addr_, "fanout-sub"));
+            clients_.back()->setMessageCallback([this](const TcpConnectionPtr&, Buffer *buf, Timestamp)
+            {
+                received_ += buf->readableBytes();
+                buf->retrieveAll();
+                if(received_ == static_cast<uint64_t>(subs_) * messages_ * size_)
+                    finish();
+            });
+            clients_.back()->connect();
+        }
+        // 慢订阅者：接收缓冲区尽量小，从不读
+        for(int i = 0; i < slow_; ++i)
+        {
+            int fd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+            int rcvbuf = 4096;
+            ::setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof rcvbuf);
+            if(::connect(fd, addr_.getSockAddr(), sizeof(sockaddr_in)) == 0)
+                slowFds_.push_back(fd);
+            else
+                ::close(fd);
+        }
+        waitTimer_ = loop_->runEvery(0.01, [this]()
+        {
+            if(server_->subscribers() < static_cast<size_t>(subs_ + slow_))
+                return;
+            loop_->cancel(waitTimer_);
+            startPublisher();
+        });
+    }
+
+    double publishSeconds() const {return publishNanos_ / 1e9;}
+    double elapsedSeconds() const {return elapsedNanos_ / 1e9;}
+    bool complete() const {return received_ == static_cast<uint64_t>(subs_) * messages_ * size_;}
+
+private:
+    void startPublisher()
+    {
+        started_ = Timestamp::monotonicNanos();
+        loop_->runAfter(timeout_, [this]() {finish();});
+        publisher_ = std::thread([this]()
+        {
+            std::string message(size_ - 1, 'm');
+            message += '\n';
+            for(int i = 0; i < messages_; ++i)
+            {
+                if(rate_ > 0)
+                {
+                    int64_t wait = started_ + static_cast<int64_t>(i * 1e9 / rate_) - Timestamp::monotonicNanos();
+                    if(wait > 0)
+                        std::this_thread::sleep_for(std::chrono::nanoseconds(wait));
+                }
+                server_->publish(message);
+            }
+            publishNanos_ = Timestamp::monotonicNanos() - started_;
+        });
+    }
+
+    void finish()
+    {
+        if(finished_)
+            return;
+        finished_ = true;
+        elapsedNanos_ = Timestamp::monotonicNanos() - started_;
+        publisher_.join();
+        loop_->queueLoop(done_);
+    }
+
+    EventLoop *loop_;
+    FanoutServer *server_;
+    const InetAddress addr_;
+    const int subs_;
+    const int slow_;
+    const int messages_;
+    const size_t size_;
+    const double rate_;
+    const double timeout_;
+    uint64_t received_;
+    int64_t started_;
+    std::atomic<int64_t> publishNanos_;
+    int64_t elapsedNanos_;
+    bool finished_;
+    TimerId waitTimer_;
+    Done done_;
+    std::thread publisher_;
+    std::vector<std::unique_ptr<TcpClient>> clients_;
+    std::vector<int> slowFds_;
+};
+}
+
+int main(int argc, char *argv[])
+{
+    BenchOptions options(argc, argv);
+    const int threads = static_cast<int>(options.getInt("server-threads", 2));
+    const uint16_t port = static_cast<uint16_t>(options.getInt("port", 9600));
+    const std::string policy = options.get("policy", "drop");
+    const size_t maxQueued = static_cast<size_t>(options.getInt("max-queued-kb", 256)) * 1024;
+    raiseFdLimit();
+
+    Topic topic("bench");
+    topic.setSlowSubscriberPolicy(policy == "disconnect" ? Topic::kDisconnect : Topic::kDrop, maxQueued);
+    const InetAddress copyAddr(port, "127.0.0.1");
+    const InetAddress topicAddr(static_cast<uint16_t>(port + 1), "127.0.0.1");
+    FanoutServer copyServer(copyAddr, threads, true, nullptr);
+    FanoutServer topicServer(topicAddr, threads, false, &topic);
+
+    EventLoop loop;
+    BenchReport report("fanout");
+    report.add("subs", options.getInt("subs", 1000));
+    report.add("slow", options.getInt("slow", 0));
+    report.add("messages", options.getInt("messages", 2000));
+    report.add("size", options.getInt("size", 128));
+    report.add("rate", options.getDouble("rate", 0));
+    report.add("server_threads", threads);
+    const double deliveries = static_cast<double>(options.getInt("subs", 1000)) * options.getInt("messages", 2000);
+
+    Phase copyPhase(&loop, &copyServer, copyAddr, options);
+    Phase topicPhase(&loop, &topicServer, topicAddr, options);
+    copyPhase.start([&]()
+    {
+        report.add("copy_complete", copyPhase.complete() ? "yes" : "no");
+        report.add("copy_publish_sec", copyPhase.publishSeconds());
+        report.add("copy_deliveries_per_sec", deliveries / copyPhase.elapsedSeconds());
+        report.add("copy_rss_kb", readRssKb());
+        topicPhase.start([&]()
+        {
+            report.add("topic_complete", topicPhase.complete() ? "yes" : "no");
+            report.add("topic_publish_sec", topicPhase.publishSeconds());
+            report.add("topic_deliveries_per_sec", deliveries / topicPhase.elapsedSeconds());
+            report.add("topic_rss_kb", readRssKb());
+            Topic::Stats stats = topic.stats();
+            report.add("topic_batches", stats.batches);
+            report.add("topic_dropped", stats.dropped);
+            report.add("topic_disconnected", stats.disconnected);
+            report.print(options.has("json"));
+            // 连接由进程退出统一回收
+            _exit(0);
+        });
+    });
+    loop.loop();
+    return 0;
+}
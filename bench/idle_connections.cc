@@ -0,0 +1,82 @@
+#include "BenchCommon.h"
+
+#include <memory>
+#include <sys/socket.h>
+#include <sys/time.h>
+
+/**
+ * 空闲连接：同一进程中的服务端接受conns个连接后保持空闲，
+ * 客户端只用裸socket(不占用户态内存)，进程RSS的增量近似为服务端每个连接的内存开销；
+ * 随后空闲seconds秒，统计这段时间里服务端loop的迭代次数和进程CPU时间，空闲连接不应该消耗CPU
+ *
+ * ./bench_idle_connections --conns=5000 --server-threads=2 --seconds=3
+ */
+static double cpuSeconds()
+{
+    rusage usage;
+    ::getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec
+        + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+int main(int argc, char *argv[])
+{
+    BenchOptions options(argc, argv);
+    const long fdLimit = raiseFdLimit();
+    const int serverThreads = static_cast<int>(options.getInt("server-threads", 1));
+    const double seconds = options.getDouble("seconds", 3);
+    // 客户端和服务端在同一进程，每个连接占两个fd
+    int conns = static_cast<int>(options.getInt("conns", 5000));
+    if(conns * 2 + 64 > fdLimit)
+        conns = static_cast<int>((fdLimit - 64) / 2);
+    InetAddress addr(static_cast<uint16_t>(options.getInt("port", 9103)), options.get("ip", "127.0.0.1"));
+
+    BenchServerThread server(addr, serverThreads, false);
+    ::usleep(100 * 1000);
+    const long rssBefore = readRssKb();
+
+    std::vector<int> sockets;
+    sockets.reserve(conns);
+    int failed = 0;
+    for(int i = 0; i < conns; ++i)
+    {
+        int sockfd = ::socket(addr.family(), SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if(sockfd < 0 || ::connect(sockfd, addr.getSockAddr(), addr.length()) < 0)
+        {
+            if(sockfd >= 0)
+                ::close(sockfd);
+            ++failed;
+            continue;
+        }
+        sockets.push_back(sockfd);
+    }
+
+    // 等待服务端把所有连接都建立起来
+    const uint64_t expected = sockets.size();
+    for(int i = 0; i < 1000 && server.server()->totalMetrics().accepts < expected; ++i)
+        ::usleep(10 * 1000);
+    ::usleep(200 * 1000);
+    const long rssAfter = readRssKb();
+
+    const uint64_t iterationsBefore = server.server()->totalMetrics().iterations;
+    const double cpuBefore = cpuSeconds();
+    ::usleep(static_cast<useconds_t>(seconds * 1e6));
+    const uint64_t idleIterations = server.server()->totalMetrics().iterations - iterationsBefore;
+    const double idleCpu = cpuSeconds() - cpuBefore;
+
+    BenchReport report("idle_connections");
+    report.add("conns", static_cast<long>(sockets.size()));
+    report.add("failed", failed);
+    report.add("server_threads", serverThreads);
+    report.add("rss_before_kb", rssBefore);
+    report.add("rss_after_kb", rssAfter);
+    report.add("bytes_per_conn", sockets.empty() ? 0.0 : (rssAfter - rssBefore) * 1024.0 / sockets.size());
+    report.add("idle_seconds", seconds);
+    report.add("idle_loop_iterations", idleIterations);
+    report.add("idle_cpu_ms", idleCpu * 1e3);
+    report.print(options.has("json"));
+
+    for(int sockfd : sockets)
+        ::close(sockfd);
+    _exit(0);
+}
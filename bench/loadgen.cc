@@ -0,0 +1,477 @@
+#include "BenchCommon.h"
+#include "TcpClient.h"
+#include "EventLoopThreadPool.h"
+#include "StringPiece.h"
+
+#include <deque>
+#include <memory>
+#include <unordered_map>
+#include <strings.h>
+
+/**
+ * 开环压测：按固定速率的时间表发请求，不等待响应，延迟从"计划发送时刻"开始计算
+ * 闭环客户端在服务端变慢时会跟着少发，排队时间被漏掉(coordinated omission)，这里计划时刻照常推进，
+ * 发送线程落后或响应迟到都会计入延迟；结束时仍未返回的请求按(结束时刻 - 计划时刻)计入
+ *
+ * 协议(--protocol)：
+ *   echo   size字节原样返回，--mode=self时在进程内启动回显服务器
+ *   frame  4字节长度头 + size字节，对应example/framedecho
+ *   http   GET --path，按Content-Length切分响应，对应example/httpserver
+ * 请求组合(--mix)：
+ *   fixed      每个时隙一个请求
+ *   pipelined  每个时隙在同一连接上一次发出--depth个请求
+ *   fanin      每个时隙向--fanout个连接各发一个子请求，全部返回才算完成，体现尾延迟放大
+ *
+ * ./bench_loadgen --rate=20000 --conns=32 --seconds=10
+ * ./bench_loadgen --mode=client --protocol=http --port=8000 --rate=5000 --mix=pipelined --depth=4
+ */
+
+enum Protocol {kEcho, kFrame, kHttp};
+enum Mix {kFixed, kPipelined, kFanin};
+
+class Worker;
+
+// 一个连接上按发送顺序排队等待响应的请求
+struct Outstanding
+{
+    int64_t intendedNanos;
+    int64_t sentNanos;
+    int64_t group;     // fanin的逻辑请求编号，其他组合为-1
+};
+
+class LoadConnection
+{
+public:
+    LoadConnection(EventLoop *loop, const InetAddress &addr, const std::string &name, Worker *worker)
+        : client_(loop, addr, name)
+        , worker_(worker)
+    {
+        client_.setConnectionCallback(std::bind(&LoadConnection::onConnection, this, std::placeholders::_1));
+        client_.setMessageCallback(std::bind(&LoadConnection::onMessage, this,
+            std::placeholders::_1, std::placeholders::_2, std::placeholders::_3));
+    }
+
+    void connect() {client_.connect();}
+    bool connected() const {return conn_ && conn_->connected();}
+    void send(const std::string &request, const Outstanding &item)
+    {
+        outstanding_.push_back(item);
+        conn_->send(request.data(), request.size());
+    }
+    std::deque<Outstanding>& outstanding() {return outstanding_;}
+
+private:
+    void onConnection(const TcpConnectionPtr &conn);
+    void onMessage(const TcpConnectionPtr &conn, Buffer *buf, Timestamp);
+    // 返回buf中第一个完整响应的长度，不完整返回0
+    size_t responseLength(const Buffer *buf) const;
+
+    TcpClient client_;
+    Worker *worker_;
+    TcpConnectionPtr conn_;
+    std::deque<Outstanding> outstanding_;
+};
+
+// 一个客户端loop上的一组连接和它们的发送时间表，所有状态只在该loop线程中访问
+class Worker
+{
+public:
+    Worker(EventLoop *loop, const BenchOptions &options, const InetAddress &addr,
+        int conns, double rate, const BenchWindow *window)
+        : loop_(loop)
+        , window_(window)
+        , protocol_(parseProtocol(options.get("protocol", "echo")))
+        , mix_(parseMix(options.get("mix", "fixed")))
+        , size_(static_cast<size_t>(options.getInt("size", 64)))
+        , depth_(static_cast<int>(options.getInt("depth", 4)))
+        , fanout_(static_cast<int>(options.getInt("fanout", 4)))
+        , periodNanos_(rate > 0 ? static_cast<int64_t>(1e9 / rate) : 0)
+        , nextIntended_(0)
+        , nextConn_(0)
+        , nextGroup_(0)
+        , stopped_(false)
+        , connected_(0)
+    {
+        buildRequest(options);
+        for(int i = 0; i < conns; ++i)
+            connections_.emplace_back(new LoadConnection(loop, addr, "loadgen-" + std::to_string(i), this));
+    }
+
+    void connect()
+    {
+        for(std::unique_ptr<LoadConnection> &conn : connections_)
+            conn->connect();
+    }
+
+    EventLoop* getLoop() const {return loop_;}
+    // 可以在任意线程读取
+    int connectedCount() const {return connected_.load();}
+    void onConnected(bool up) {connected_ += up ? 1 : -1;}
+
+    // 在loop线程中调用：从startNanos开始按时间表发送
+    void start(int64_t startNanos)
+    {
+        nextIntended_ = startNanos;
+        if(periodNanos_ > 0)
+            onTick();
+    }
+
+    // 在loop线程中调用：停止发送，把仍未返回的请求按结束时刻计入
+    void finish(int64_t endNanos)
+    {
+        stopped_ = true;
+        for(std::unique_ptr<LoadConnection> &conn : connections_)
+        {
+            for(const Outstanding &item : conn->outstanding())
+            {
+                if(item.group >= 0 && groups_.count(item.group) == 0)
+                    continue;
+                if(window_->contains(item.intendedNanos))
+                {
+                    latency_.record(endNanos - item.intendedNanos);
+                    unfinished_.add();
+                }
+                if(item.group >= 0)
+                    groups_.erase(item.group);
+            }
+            conn->outstanding().clear();
+        }
+    }
+
+    void onResponse(const Outstanding &item)
+    {
+        int64_t now = Timestamp::monotonicNanos();
+        if(item.group >= 0)
+        {
+            // fanin：最后一个子请求返回时整个逻辑请求才完成
+            std::unordered_map<int64_t, int>::iterator it = groups_.find(item.group);
+            if(it == groups_.end() || --it->second > 0)
+                return;
+            groups_.erase(it);
+        }
+        if(window_->contains(item.intendedNanos))
+        {
+            latency_.record(now - item.intendedNanos);
+            service_.record(now - item.sentNanos);
+            completed_.add();
+        }
+    }
+
+    Protocol protocol() const {return protocol_;}
+    size_t size() const {return size_;}
+    const Histogram& latency() const {return latency_;}
+    const Histogram& service() const {return service_;}
+    const Histogram& sendLag() const {return sendLag_;}
+    uint64_t sent() const {return sent_.get();}
+    uint64_t completed() const {return completed_.get();}
+    uint64_t unfinished() const {return unfinished_.get();}
+    uint64_t skipped() const {return skipped_.get();}
+
+private:
+    static Protocol parseProtocol(const std::string &name)
+    {
+        if(name == "frame")
+            return kFrame;
+        if(name == "http")
+            return kHttp;
+        return kEcho;
+    }
+    static Mix parseMix(const std::string &name)
+    {
+        if(name == "pipelined")
+            return kPipelined;
+        if(name == "fanin")
+            return kFanin;
+        return kFixed;
+    }
+
+    void buildRequest(const BenchOptions &options)
+    {
+        if(protocol_ == kHttp)
+        {
+            request_ = "GET " + options.get("path", "/") + " HTTP/1.1\r\nHost: "
+                + options.get("ip", "127.0.0.1") + "\r\n\r\n";
+        }
+        else
+        {
+            Buffer buf;
+            std::string payload(size_, 'l');
+            buf.append(payload);
+            if(protocol_ == kFrame)
+                buf.prependInt32(static_cast<int32_t>(size_));
+            request_ = buf.retrieveAllAsString();
+        }
+    }
+
+    // 发出所有计划时刻已到的请求，再把定时器设到下一个计划时刻，
+    // 速率低时每个请求都准时发出，速率高时一次唤醒发出一批
+    void onTick()
+    {
+        if(stopped_)
+            return;
+        int64_t now = Timestamp::monotonicNanos();
+        while(nextIntended_ <= now)
+        {
+            sendSlot(nextIntended_, now);
+            nextIntended_ += periodNanos_;
+        }
+        loop_->runAfter((nextIntended_ - Timestamp::monotonicNanos()) / 1e9, std::bind(&Worker::onTick, this));
+    }
+
+    void sendSlot(int64_t intended, int64_t now)
+    {
+        if(window_->contains(intended))
+            sendLag_.record(now - intended);
+
+        int count = mix_ == kFanin ? fanout_ : 1;
+        int64_t group = -1;
+        if(mix_ == kFanin)
+        {
+            group = nextGroup_++;
+            groups_[group] = count;
+        }
+        for(int i = 0; i < count; ++i)
+        {
+            LoadConnection *conn = pickConnection();
+            if(conn == nullptr)
+            {
+                // 没有可用连接，这个时隙作废，fanin的逻辑请求整体作废
+                skipped_.add();
+                if(group >= 0)
+                    groups_.erase(group);
+                return;
+            }
+            Outstanding item = {intended, now, group};
+            int requests = mix_ == kPipelined ? depth_ : 1;
+            for(int r = 0; r < requests; ++r)
+            {
+                conn->send(request_, item);
+                sent_.add();
+            }
+        }
+    }
+
+    LoadConnection* pickConnection()
+    {
+        for(size_t tries = 0; tries < connections_.size(); ++tries)
+        {
+            LoadConnection *conn = connections_[nextConn_].get();
+            nextConn_ = (nextConn_ + 1) % connections_.size();
+            if(conn->connected())
+                return conn;
+        }
+        return nullptr;
+    }
+
+    EventLoop *loop_;
+    const BenchWindow *window_;
+    const Protocol protocol_;
+    const Mix mix_;
+    const size_t size_;
+    const int depth_;
+    const int fanout_;
+    const int64_t periodNanos_;
+    std::string request_;
+
+    std::vector<std::unique_ptr<LoadConnection>> connections_;
+    int64_t nextIntended_;
+    size_t nextConn_;
+    int64_t nextGroup_;
+    std::unordered_map<int64_t, int> groups_;   // fanin逻辑请求 => 还差几个子请求
+    bool stopped_;
+    std::atomic_int connected_;
+
+    Histogram latency_;    // 计划发送时刻 => 收到响应
+    Histogram service_;    // 实际发送时刻 => 收到响应(闭环客户端看到的数字)
+    Histogram sendLag_;    // 实际发送比计划晚了多少，过大说明压测端本身跟不上
+    LoopCounter sent_;
+    LoopCounter completed_;
+    LoopCounter unfinished_;
+    LoopCounter skipped_;
+};
+
+void LoadConnection::onConnection(const TcpConnectionPtr &conn)
+{
+    if(conn->connected())
+    {
+        conn->setTcpNoDelay(true);
+        conn_ = conn;
+        worker_->onConnected(true);
+    }
+    else
+    {
+        conn_.reset();
+        worker_->onConnected(false);
+    }
+}
+
+void LoadConnection::onMessage(const TcpConnectionPtr &, Buffer *buf, Timestamp)
+{
+    size_t len;
+    while(!outstanding_.empty() && (len = responseLength(buf)) > 0)
+    {
+        buf->retrieve(len);
+        Outstanding item = outstanding_.front();
+        outstanding_.pop_front();
+        worker_->onResponse(item);
+    }
+}
+
+size_t LoadConnection::responseLength(const Buffer *buf) const
+{
+    size_t readable = buf->readableBytes();
+    switch(worker_->protocol())
+    {
+    case kEcho:
+        return readable >= worker_->size() ? worker_->size() : 0;
+    case kFrame:
+    {
+        if(readable < sizeof(int32_t))
+            return 0;
+        size_t len = sizeof(int32_t) + static_cast<size_t>(buf->peekInt32());
+        return readable >= len ? len : 0;
+    }
+    case kHttp:
+    {
+        StringPiece data(buf->peek(), readable);
+        const char *end = static_cast<const char*>(memmem(data.data(), data.size(), "\r\n\r\n", 4));
+        if(end == nullptr)
+            return 0;
+        size_t headerLen = end - data.data() + 4;
+        size_t bodyLen = 0;
+        // 逐行查找Content-Length，不区分大小写
+        const char *line = data.data();
+        while(line < end)
+        {
+            const char *crlf = static_cast<const char*>(memmem(line, end + 2 - line, "\r\n", 2));
+            if(crlf == nullptr)
+                break;
+            static const char kContentLength[] = "content-length:";
+            if(static_cast<size_t>(crlf - line) > sizeof kContentLength - 1
+                && strncasecmp(line, kContentLength, sizeof kContentLength - 1) == 0)
+                bodyLen = static_cast<size_t>(atol(line + sizeof kContentLength - 1));
+            line = crlf + 2;
+        }
+        return readable >= headerLen + bodyLen ? headerLen + bodyLen : 0;
+    }
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    BenchOptions options(argc, argv);
+    const std::string protocol = options.get("protocol", "echo");
+    const std::string mode = options.get("mode", protocol == "echo" ? "self" : "client");
+    if(mode == "server")
+        return runBenchServer(options, true);
+
+    const double rate = options.getDouble("rate", 10000);
+    const int conns = static_cast<int>(options.getInt("conns", 16));
+    const int serverThreads = static_cast<int>(options.getInt("server-threads", 1));
+    const int clientThreads = static_cast<int>(options.getInt("client-threads", 1));
+    const double seconds = options.getDouble("seconds", 5);
+    const double warmup = options.getDouble("warmup", 1);
+    const double drain = options.getDouble("drain", 1);
+    InetAddress addr(static_cast<uint16_t>(options.getInt("port", 9104)), options.get("ip", "127.0.0.1"));
+
+    std::unique_ptr<BenchServerThread> server;
+    if(mode == "self")
+        server.reset(new BenchServerThread(addr, serverThreads, true));
+
+    EventLoop loop;
+    EventLoopThreadPool pool(&loop, "loadgen");
+    pool.setThreadNum(clientThreads);
+    pool.start();
+
+    // 连接和速率平均分给各个客户端loop
+    BenchWindow window;
+    std::vector<EventLoop*> loops = pool.getAllLoops();
+    std::vector<std::unique_ptr<Worker>> workers;
+    const int nloops = static_cast<int>(loops.size());
+    for(int i = 0; i < nloops; ++i)
+    {
+        int share = conns / nloops + (i < conns % nloops ? 1 : 0);
+        if(share == 0)
+            continue;
+        workers.emplace_back(new Worker(loops[i], options, addr, share, rate * share / conns, &window));
+        workers.back()->connect();
+    }
+
+    // 等所有连接建立后再开始，时间表从同一时刻起算
+    TimerId waitConnected;
+    const int64_t waitStart = Timestamp::monotonicNanos();
+    std::atomic_int finished(0);
+    waitConnected = loop.runEvery(0.01, [&]()
+    {
+        int connected = 0;
+        for(const std::unique_ptr<Worker> &worker : workers)
+            connected += worker->connectedCount();
+        if(connected < conns && Timestamp::monotonicNanos() - waitStart < 5000000000LL)
+            return;
+        loop.cancel(waitConnected);
+
+        const int64_t start = Timestamp::monotonicNanos();
+        window.startNanos = start + static_cast<int64_t>(warmup * 1e9);
+        window.endNanos = start + static_cast<int64_t>((warmup + seconds) * 1e9);
+        for(std::unique_ptr<Worker> &worker : workers)
+        {
+            Worker *w = worker.get();
+            w->getLoop()->runInLoop([w, start]() {w->start(start);});
+        }
+
+        // 测量窗口结束后继续按时间表发送drain秒，保持负载不变，等窗口内的请求返回
+        loop.runAfter(warmup + seconds + drain, [&]()
+        {
+            for(std::unique_ptr<Worker> &worker : workers)
+            {
+                Worker *w = worker.get();
+                w->getLoop()->runInLoop([w, &finished]()
+                {
+                    w->finish(Timestamp::monotonicNanos());
+                    ++finished;
+                });
+            }
+        });
+    });
+
+    loop.runEvery(0.01, [&]()
+    {
+        if(finished.load() < static_cast<int>(workers.size()))
+            return;
+
+        Histogram latency, service, sendLag;
+        uint64_t sent = 0, completed = 0, unfinished = 0, skipped = 0;
+        for(const std::unique_ptr<Worker> &worker : workers)
+        {
+            latency += worker->latency();
+            service += worker->service();
+            sendLag += worker->sendLag();
+            sent += worker->sent();
+            completed += worker->completed();
+            unfinished += worker->unfinished();
+            skipped += worker->skipped();
+        }
+
+        BenchReport report("loadgen");
+        report.add("mode", mode);
+        report.add("protocol", protocol);
+        report.add("mix", options.get("mix", "fixed"));
+        report.add("conns", conns);
+        report.add("client_threads", clientThreads);
+        report.add("target_rate", rate);
+        report.add("seconds", seconds);
+        report.add("completed_rate", completed / seconds);
+        report.add("sent", sent);
+        report.add("completed", completed);
+        report.add("unfinished", unfinished);
+        report.add("skipped", skipped);
+        report.addHistogram("latency_", latency);
+        report.addHistogram("service_", service);
+        report.add("send_lag_p99_us", sendLag.percentile(99) / 1e3);
+        report.print(options.has("json"));
+        _exit(0);
+    });
+    loop.loop();
+    return 0;
+}
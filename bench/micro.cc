@@ -0,0 +1,243 @@
+#include "BlockPool.h"
+#include "Buffer.h"
+#include "Channel.h"
+#include "EventLoop.h"
+#include "EventLoopThread.h"
+#include "RateLimiter.h"
+#include "Socket.h"
+#include "TcpConnection.h"
+
+#include <benchmark/benchmark.h>
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+/**
+ * 热点原语的微基准(Google Benchmark)：
+ * Buffer的append/retrieve/扩容/整理、readFd，跨线程runInLoop/queueLoop，
+ * Poller的add/mod/del，Channel::handleEvent的分发开销，连接对象的分配
+ *
+ * ./bench_micro --benchmark_filter=Buffer --benchmark_repetitions=5
+ */
+
+// 一个线程只能有一个EventLoop，不运行loop()的基准共用这一个
+static EventLoop* benchLoop()
+{
+    static EventLoop loop;
+    return &loop;
+}
+
+static void BM_BufferAppendRetrieve(benchmark::State &state)
+{
+    const std::string data(static_cast<size_t>(state.range(0)), 'x');
+    Buffer buf;
+    for(auto _ : state)
+    {
+        buf.append(data.data(), data.size());
+        benchmark::DoNotOptimize(buf.peek());
+        buf.retrieve(data.size());
+    }
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_BufferAppendRetrieve)->RangeMultiplier(4)->Range(16, 64 << 10);
+
+// 每次从新的Buffer开始追加到1MB，主要是makeSpace的扩容(resize)开销
+static void BM_BufferGrow(benchmark::State &state)
+{
+    const std::string data(static_cast<size_t>(state.range(0)), 'x');
+    const size_t total = 1 << 20;
+    for(auto _ : state)
+    {
+        Buffer buf;
+        for(size_t n = 0; n < total; n += data.size())
+            buf.append(data.data(), data.size());
+        benchmark::DoNotOptimize(buf.peek());
+    }
+    state.SetBytesProcessed(state.iterations() * total);
+}
+BENCHMARK(BM_BufferGrow)->RangeMultiplier(8)->Range(64, 64 << 10);
+
+// 可读区始终留有一小段未取走的数据，写满后makeSpace把它挪回头部而不是扩容
+static void BM_BufferCompact(benchmark::State &state)
+{
+    const std::string data(static_cast<size_t>(state.range(0)), 'x');
+    Buffer buf;
+    buf.append(data.data(), 100);
+    for(auto _ : state)
+    {
+        buf.append(data.data(), data.size());
+        buf.retrieve(data.size());
+    }
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_BufferCompact)->Arg(128)->Arg(700)->Arg(4096);
+
+static void BM_BufferReadFd(benchmark::State &state)
+{
+    int fds[2];
+    if(::socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, fds) < 0)
+    {
+        state.SkipWithError("socketpair failed");
+        return;
+    }
+    const size_t size = static_cast<size_t>(state.range(0));
+    const std::string data(size, 'x');
+    Buffer buf;
+    int savedErrno = 0;
+    for(auto _ : state)
+    {
+        state.PauseTiming();
+        ssize_t n = ::write(fds[0], data.data(), size);
+        state.ResumeTiming();
+        benchmark::DoNotOptimize(n);
+        buf.readFd(fds[1], &savedErrno);
+        buf.retrieveAll();
+    }
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+    ::close(fds[0]);
+    ::close(fds[1]);
+}
+BENCHMARK(BM_BufferReadFd)->RangeMultiplier(8)->Range(64, 64 << 10);
+
+// 跨线程投递的吞吐：连续投递，最后等全部执行完
+static void BM_RunInLoopThroughput(benchmark::State &state)
+{
+    EventLoopThread thread;
+    EventLoop *loop = thread.startLoop();
+    std::atomic<int64_t> executed(0);
+    int64_t posted = 0;
+    for(auto _ : state)
+    {
+        loop->runInLoop([&executed]() {executed.fetch_add(1, std::memory_order_relaxed);});
+        ++posted;
+    }
+    while(executed.load(std::memory_order_acquire) < posted)
+        ;
+    state.SetItemsProcessed(posted);
+}
+BENCHMARK(BM_RunInLoopThroughput)->UseRealTime();
+
+// 跨线程投递的往返延迟：投递一个任务并等待它执行完
+static void BM_QueueLoopRoundTrip(benchmark::State &state)
+{
+    EventLoopThread thread;
+    EventLoop *loop = thread.startLoop();
+    std::atomic<bool> done(false);
+    for(auto _ : state)
+    {
+        done.store(false, std::memory_order_relaxed);
+        loop->queueLoop([&done]() {done.store(true, std::memory_order_release);});
+        while(!done.load(std::memory_order_acquire))
+            ;
+    }
+}
+BENCHMARK(BM_QueueLoopRoundTrip)->UseRealTime();
+
+// 一个channel完整的EPOLL_CTL_ADD => MOD => DEL
+static void BM_PollerAddModDel(benchmark::State &state)
+{
+    EventLoop *loop = benchLoop();
+    int fd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    Channel channel(loop, fd);
+    for(auto _ : state)
+    {
+        channel.enableReading();  // ADD
+        channel.enableWriting();  // MOD
+        channel.disableAll();     // DEL
+    }
+    channel.remove();
+    ::close(fd);
+    state.SetItemsProcessed(state.iterations() * 3);
+}
+BENCHMARK(BM_PollerAddModDel);
+
+// 已注册channel上的读写切换，对应TcpConnection发送缓冲区反复积压/清空
+static void BM_PollerModChurn(benchmark::State &state)
+{
+    EventLoop *loop = benchLoop();
+    int fd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    Channel channel(loop, fd);
+    channel.enableReading();
+    for(auto _ : state)
+    {
+        channel.enableWriting();
+        channel.disableWriting();
+    }
+    channel.disableAll();
+    channel.remove();
+    ::close(fd);
+    state.SetItemsProcessed(state.iterations() * 2);
+}
+BENCHMARK(BM_PollerModChurn);
+
+// Channel::handleEvent分发一个EPOLLIN到读回调，range(0)为1时channel通过tie绑定了owner
+static void BM_ChannelHandleEvent(benchmark::State &state)
+{
+    EventLoop *loop = benchLoop();
+    int fd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    Channel channel(loop, fd);
+    int64_t calls = 0;
+    channel.setReadCallback([&calls](Timestamp) {++calls;});
+    std::shared_ptr<int> owner(new int(0));
+    if(state.range(0))
+        channel.tie(owner);
+    Timestamp now(Timestamp::now());
+    for(auto _ : state)
+    {
+        channel.set_revents(EPOLLIN);
+        channel.handleEvent(now);
+    }
+    benchmark::DoNotOptimize(calls);
+    ::close(fd);
+}
+BENCHMARK(BM_ChannelHandleEvent)->Arg(0)->Arg(1);
+
+// 连接对象的分配/释放：保持1024个存活对象，每次替换其中一个，模拟短连接不断建立和关闭
+// range(0)为0时按改动前的布局：new连接对象 + 单独的shared_ptr控制块 + new Socket + new Channel
+// range(0)为1时是TcpServer现在的做法：Socket/Channel内嵌，allocate_shared从BlockPool取一整块
+struct FakeConnection
+{
+    char bytes[sizeof(TcpConnection)];
+    std::unique_ptr<char[]> socket;     // 只占位，不构造真正的Socket，避免析构时close
+    std::unique_ptr<char[]> channel;
+};
+
+static void BM_ConnectionAlloc(benchmark::State &state)
+{
+    const size_t kLive = 1024;
+    std::vector<std::shared_ptr<FakeConnection>> live(kLive);
+    std::shared_ptr<BlockPool> pool = std::make_shared<BlockPool>();
+    size_t next = 0;
+    for(auto _ : state)
+    {
+        std::shared_ptr<FakeConnection> conn;
+        if(state.range(0))
+            conn = std::allocate_shared<FakeConnection>(PoolAllocator<FakeConnection>(pool));
+        else
+        {
+            conn.reset(new FakeConnection);
+            conn->socket.reset(new char[sizeof(Socket)]);
+            conn->channel.reset(new char[sizeof(Channel)]);
+        }
+        live[next].swap(conn);
+        next = (next + 1) % kLive;
+    }
+    live.clear();
+}
+BENCHMARK(BM_ConnectionAlloc)->Arg(0)->Arg(1);
+
+// handleRead每次读到数据时的限速记账：取一次时间 + 一次CAS，多线程时模拟多个loop共享一个租户限速器
+static void BM_RateLimiterConsume(benchmark::State &state)
+{
+    static RateLimiter limiter(1e12, 1e9);  // 速率足够高，测的是记账本身而不是暂停
+    for(auto _ : state)
+        benchmark::DoNotOptimize(limiter.consume(4096, Timestamp::monotonicNanos()));
+}
+BENCHMARK(BM_RateLimiterConsume)->Threads(1)->Threads(2);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,262 @@
+#include "BenchCommon.h"
+#include "ComputePool.h"
+#include "Strand.h"
+#include "TcpClient.h"
+
+#include <memory>
+
+/**
+ * 把CPU密集的处理移出subLoop的效果：服务端只有一个subLoop，上面同时有两类连接
+ *   重连接：每个请求"h\n"要忙算--work-us微秒，每个连接保持--depth个请求在途
+ *   轻连接：一问一答的"l\n"，直接回复，统计往返延迟
+ * inline阶段在subLoop里直接计算，offload阶段交给ComputePool，结果由完成回调在subLoop里发回，
+ * strand阶段每个连接一个Strand，同一连接的请求串行执行、按顺序响应
+ * 比较各阶段轻连接的p99和重请求的吞吐；completions_per_wakeup是每次唤醒loop平均带回的结果数
+ *
+ * ./bench_offload --heavy=4 --light=4 --work-us=200 --depth=4 --pool-threads=2 --seconds=3
+ * --max-queue=N 限制线程池排队数，超出的重请求立即回复"E\n"(Strand的任务不受这个限制)
+ */
+namespace
+{
+// 模拟的CPU密集处理，返回一个校验和免得被优化掉
+uint64_t busyWork(int64_t nanos)
+{
+    uint64_t sum = 0;
+    int64_t deadline = Timestamp::monotonicNanos() + nanos;
+    while(Timestamp::monotonicNanos() < deadline)
+    {
+        for(int i = 0; i < 64; ++i)
+            sum = sum * 1099511628211ULL + i;
+    }
+    return sum;
+}
+
+class OffloadServer
+{
+public:
+    // pool为nullptr时在subLoop里直接计算；strand为true时每个连接的请求经过自己的Strand
+    OffloadServer(const InetAddress &addr, ComputePool *pool, bool strand, int64_t workNanos)
+        : loop_(nullptr)
+    {
+        thread_ = std::thread([this, addr, pool, strand, workNanos]()
+        {
+            EventLoop loop;
+            TcpServer server(&loop, addr, "offload");
+            if(strand)
+            {
+                server.setConnectionCallback([pool](const TcpConnectionPtr &conn)
+                {
+                    if(conn->connected())
+                        conn->setContext(std::make_shared<Strand>(pool));
+                });
+            }
+            server.setMessageCallback([pool, strand, workNanos](const TcpConnectionPtr &conn, Buffer *buf, Timestamp)
+            {
+                while(buf->readableBytes() >= 2)
+                {
+                    char type = *buf->peek();
+                    buf->retrieve(2);
+                    if(type == 'l')
+                        conn->send("l\n", 2);
+                    else if(pool == nullptr)
+                    {
+                        busyWork(workNanos);
+                        conn->send("h\n", 2);
+                    }
+                    else
+                    {
+                        std::function<uint64_t()> work = [workNanos]() {return busyWork(workNanos);};
+                        std::function<void(uint64_t)> done = [conn](uint64_t)
+                        {
+                            if(conn->connected())
+                                conn->send("h\n", 2);
+                        };
+                        bool accepted = strand
+                            ? std::static_pointer_cast<Strand>(conn->getContext())->call(conn->getLoop(), work, done)
+                            : pool->call(conn->getLoop(), work, done);
+                        if(!accepted)
+                            conn->send("E\n", 2);
+                    }
+                }
+            });
+            server.start();
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                loop_ = &loop;
+                cond_.notify_one();
+            }
+            loop.loop();
+        });
+        std::unique_lock<std::mutex> lock(mutex_);
+        while(loop_ == nullptr)
+            cond_.wait(lock);
+    }
+
+    ~OffloadServer()
+    {
+        loop_->quit();
+        thread_.join();
+    }
+
+private:
+    EventLoop *loop_;
+    std::thread thread_;
+    std::mutex mutex_;
+    std::condition_variable cond_;
+};
+
+struct Phase
+{
+    BenchWindow window;
+    Histogram light;
+    long heavyDone = 0;
+    long heavyRejected = 0;
+    bool stop = false;
+};
+
+// 客户端连接，记录发出每个轻请求的时刻；客户端对象保留到进程退出
+class Clients
+{
+public:
+    explicit Clients(EventLoop *loop) : loop_(loop) {}
+
+    void startHeavy(const InetAddress &addr, int depth, Phase *phase)
+    {
+        TcpClient *client = newClient(addr);
+        client->setConnectionCallback([depth, phase](const TcpConnectionPtr &conn)
+        {
+            if(conn->connected())
+            {
+                conn->setTcpNoDelay(true);
+                for(int i = 0; i < depth; ++i)
+                    conn->send("h\n", 2);
+            }
+        });
+        client->setMessageCallback([phase](const TcpConnectionPtr &conn, Buffer *buf, Timestamp)
+        {
+            while(buf->readableBytes() >= 2)
+            {
+                char type = *buf->peek();
+                buf->retrieve(2);
+                if(phase->window.contains(Timestamp::monotonicNanos()))
+                    ++(type == 'E' ? phase->heavyRejected : phase->heavyDone);
+                if(!phase->stop)
+                    conn->send("h\n", 2);
+            }
+        });
+        client->connect();
+    }
+
+    void startLight(const InetAddress &addr, Phase *phase)
+    {
+        TcpClient *client = newClient(addr);
+        std::shared_ptr<int64_t> sent(new int64_t(0));
+        client->setConnectionCallback([sent](const TcpConnectionPtr &conn)
+        {
+            if(conn->connected())
+            {
+                conn->setTcpNoDelay(true);
+                *sent = Timestamp::monotonicNanos();
+                conn->send("l\n", 2);
+            }
+        });
+        client->setMessageCallback([sent, phase](const TcpConnectionPtr &conn, Buffer *buf, Timestamp)
+        {
+            buf->retrieveAll();
+            int64_t now = Timestamp::monotonicNanos();
+            if(phase->window.contains(now))
+                phase->light.record(now - *sent);
+            if(!phase->stop)
+            {
+                *sent = now;
+                conn->send("l\n", 2);
+            }
+        });
+        client->connect();
+    }
+
+private:
+    TcpClient* newClient(const InetAddress &addr)
+    {
+        clients_.emplace_back(new TcpClient(loop_, addr, "offload-client"));
+        return clients_.back().get();
+    }
+
+    EventLoop *loop_;
+    std::vector<std::unique_ptr<TcpClient>> clients_;
+};
+}
+
+int main(int argc, char *argv[])
+{
+    BenchOptions options(argc, argv);
+    const int heavy = static_cast<int>(options.getInt("heavy", 4));
+    const int light = static_cast<int>(options.getInt("light", 4));
+    const int depth = static_cast<int>(options.getInt("depth", 4));
+    const int64_t workNanos = options.getInt("work-us", 200) * 1000;
+    const int poolThreads = static_cast<int>(options.getInt("pool-threads", 2));
+    const double seconds = options.getDouble("seconds", 3);
+    const double warmup = options.getDouble("warmup", 0.5);
+    const uint16_t port = static_cast<uint16_t>(options.getInt("port", 9500));
+    const InetAddress inlineAddr(port, "127.0.0.1");
+    const InetAddress offloadAddr(static_cast<uint16_t>(port + 1), "127.0.0.1");
+    const InetAddress strandAddr(static_cast<uint16_t>(port + 2), "127.0.0.1");
+
+    ComputePool pool("offload");
+    pool.setMaxQueueSize(static_cast<size_t>(options.getInt("max-queue", 0)));
+    pool.start(poolThreads);
+    OffloadServer inlineServer(inlineAddr, nullptr, false, workNanos);
+    OffloadServer offloadServer(offloadAddr, &pool, false, workNanos);
+    OffloadServer strandServer(strandAddr, &pool, true, workNanos);
+
+    EventLoop loop;
+    Clients clients(&loop);
+    Phase phases[3];
+    const InetAddress *addrs[3] = {&inlineAddr, &offloadAddr, &strandAddr};
+    const char *names[3] = {"inline_", "offload_", "strand_"};
+    BenchReport report("offload");
+    report.add("heavy", heavy);
+    report.add("light", light);
+    report.add("work_us", static_cast<long>(workNanos / 1000));
+    report.add("pool_threads", poolThreads);
+
+    std::function<void(int)> runPhase = [&](int i)
+    {
+        if(i == 3)
+        {
+            ComputePool::Stats stats = pool.stats();
+            report.add("stolen", stats.stolen);
+            report.add("rejected", stats.rejected);
+            report.add("completions_per_wakeup",
+                stats.wakeups == 0 ? 0.0 : static_cast<double>(stats.completions) / stats.wakeups);
+            report.print(options.has("json"));
+            _exit(0);
+        }
+        Phase *phase = &phases[i];
+        for(int c = 0; c < heavy; ++c)
+            clients.startHeavy(*addrs[i], depth, phase);
+        for(int c = 0; c < light; ++c)
+            clients.startLight(*addrs[i], phase);
+        loop.runAfter(warmup, [phase, seconds]()
+        {
+            int64_t now = Timestamp::monotonicNanos();
+            phase->window.startNanos = now;
+            phase->window.endNanos = now + static_cast<int64_t>(seconds * 1e9);
+        });
+        loop.runAfter(warmup + seconds, [&, phase, i]()
+        {
+            const std::string name = names[i];
+            report.add(name + "heavy_per_sec", phase->heavyDone / seconds);
+            report.add(name + "light_rtt_p50_us", phase->light.percentile(50) / 1e3);
+            report.add(name + "light_rtt_p99_us", phase->light.percentile(99) / 1e3);
+            if(i != 0)
+                report.add(name + "heavy_rejected", phase->heavyRejected);
+            phase->stop = true;
+            // 等在途的请求都回来再进入下一阶段
+            loop.runAfter(0.5, [&, i]() {runPhase(i + 1);});
+        });
+    };
+    runPhase(0);
+    loop.loop();
+    return 0;
+}
@@ -0,0 +1,277 @@
+#include "BenchCommon.h"
+#include "Channel.h"
+
+#include <memory>
+#include <sstream>
+#include <unordered_map>
+#include <sys/socket.h>
+
+/**
+ * 过载下的有效吞吐：客户端按固定速率新建连接(开环)，每个连接发一个请求、收到响应后关闭，
+ * 服务端每个请求在subLoop上忙等--work-us微秒，模拟CPU密集的处理
+ * 延迟从计划发起时刻算起，不超过--slo-ms的响应才计入goodput；被服务端拒绝(EOF/RST)的请求很快失败，不占用服务端CPU
+ * 依次跑--rates中的每一档速率，超过服务端容量以后：
+ *   不开准入控制时排队越来越长，延迟超过SLO，goodput掉下来
+ *   --max-lag-ms/--max-pending按loop延迟或队列长度拒绝多出来的连接，goodput保持在容量附近
+ *
+ * ./bench_overload --rates=1000,2000,4000,8000 --work-us=400 --server-threads=1
+ * ./bench_overload --rates=1000,2000,4000,8000 --work-us=400 --max-lag-ms=20 --action=reset
+ * --max-conns/--max-conns-per-loop/--max-conns-per-ip/--max-pending/--action=close|reset|pause
+ */
+struct Request
+{
+    int64_t intendedNanos;
+    std::unique_ptr<Channel> channel;
+};
+using RequestPtr = std::shared_ptr<Request>;
+
+class OverloadClient
+{
+public:
+    OverloadClient(EventLoop *loop, const InetAddress &addr, int64_t sloNanos)
+        : loop_(loop)
+        , addr_(addr)
+        , sloNanos_(sloNanos)
+        , rate_(0)
+        , levelStartNanos_(0)
+        , issued_(0)
+        , sending_(false)
+    {}
+
+    // 以下在loop线程中调用
+    void startLevel(double rate)
+    {
+        rate_ = rate;
+        levelStartNanos_ = Timestamp::monotonicNanos();
+        issued_ = 0;
+        sending_ = true;
+        good_ = slow_ = rejected_ = timedOut_ = 0;
+        latency_ = Histogram();
+        tick_ = loop_->runEvery(0.001, std::bind(&OverloadClient::issue, this));
+    }
+    void stopSending()
+    {
+        sending_ = false;
+        loop_->cancel(tick_);
+    }
+    // 还没有完成的请求全部算作超时
+    void finishLevel()
+    {
+        std::vector<RequestPtr> open;
+        for(auto &item : requests_)
+            open.push_back(item.second);
+        for(const RequestPtr &req : open)
+        {
+            ++timedOut_;
+            close(req);
+        }
+    }
+
+    uint64_t good_, slow_, rejected_, timedOut_;
+    Histogram latency_;
+    uint64_t issued() const {return issued_;}
+
+private:
+    void issue()
+    {
+        if(!sending_)
+            return;
+        int64_t now = Timestamp::monotonicNanos();
+        // 按时间表补齐到期的请求，计划时刻均匀分布，落后时照样按计划时刻计算延迟
+        uint64_t due = static_cast<uint64_t>((now - levelStartNanos_) / 1e9 * rate_);
+        while(issued_ < due)
+        {
+            int64_t intended = levelStartNanos_ + static_cast<int64_t>(issued_ / rate_ * 1e9);
+            ++issued_;
+            connect(intended);
+        }
+    }
+
+    void connect(int64_t intendedNanos)
+    {
+        int fd = ::socket(addr_.family(), SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if(fd < 0)
+        {
+            ++rejected_;
+            return;
+        }
+        int ret = ::connect(fd, addr_.getSockAddr(), addr_.length());
+        if(ret < 0 && errno != EINPROGRESS)
+        {
+            ::close(fd);
+            ++rejected_;
+            return;
+        }
+        RequestPtr req = std::make_shared<Request>();
+        req->intendedNanos = intendedNanos;
+        req->channel.reset(new Channel(loop_, fd));
+        Request *raw = req.get();
+        req->channel->setWriteCallback([this, raw]() {onConnected(raw);});
+        req->channel->setReadCallback([this, raw](Timestamp) {onReply(raw);});
+        req->channel->setErrorCallback([this, raw]() {fail(raw);});
+        req->channel->setCloseCallback([this, raw]() {fail(raw);});
+        req->channel->enableWriting();
+        requests_[raw] = req;
+    }
+
+    void onConnected(Request *raw)
+    {
+        int fd = raw->channel->fd();
+        int err = 0;
+        socklen_t len = sizeof err;
+        ::getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &len);
+        if(err != 0 || ::write(fd, "q", 1) != 1)
+        {
+            fail(raw);
+            return;
+        }
+        raw->channel->disableWriting();
+        raw->channel->enableReading();
+    }
+
+    void onReply(Request *raw)
+    {
+        char c;
+        ssize_t n = ::read(raw->channel->fd(), &c, 1);
+        if(n <= 0)
+        {
+            if(n < 0 && errno == EAGAIN)
+                return;
+            fail(raw);
+            return;
+        }
+        int64_t latency = Timestamp::monotonicNanos() - raw->intendedNanos;
+        latency_.record(latency);
+        if(latency <= sloNanos_)
+            ++good_;
+        else
+            ++slow_;
+        close(requests_[raw]);
+    }
+
+    void fail(Request *raw)
+    {
+        auto it = requests_.find(raw);
+        if(it == requests_.end())
+            return;
+        ++rejected_;
+        close(it->second);
+    }
+
+    // 可能在这个channel的回调中，channel延后到本轮事件处理完再析构
+    void close(RequestPtr req)
+    {
+        requests_.erase(req.get());
+        int fd = req->channel->fd();
+        req->channel->disableAll();
+        req->channel->remove();
+        ::close(fd);
+        loop_->queueLoop([req]() {});
+    }
+
+    EventLoop *loop_;
+    const InetAddress addr_;
+    const int64_t sloNanos_;
+    double rate_;
+    int64_t levelStartNanos_;
+    uint64_t issued_;
+    bool sending_;
+    TimerId tick_;
+    std::unordered_map<Request*, RequestPtr> requests_;
+};
+
+static AdmissionControl::Policy policyFrom(const BenchOptions &options, bool *enabled)
+{
+    AdmissionControl::Policy policy;
+    policy.maxConnections = options.getInt("max-conns", 0);
+    policy.maxConnectionsPerLoop = options.getInt("max-conns-per-loop", 0);
+    policy.maxConnectionsPerIp = options.getInt("max-conns-per-ip", 0);
+    policy.maxLoopLagSeconds = options.getDouble("max-lag-ms", 0) / 1000;
+    policy.maxPendingFunctors = options.getInt("max-pending", 0);
+    std::string action = options.get("action", "close");
+    policy.action = action == "reset" ? AdmissionControl::kReset
+        : action == "pause" ? AdmissionControl::kPauseAccept : AdmissionControl::kClose;
+    *enabled = policy.maxConnections || policy.maxConnectionsPerLoop || policy.maxConnectionsPerIp
+        || policy.detectsOverload();
+    return policy;
+}
+
+int main(int argc, char *argv[])
+{
+    BenchOptions options(argc, argv);
+    raiseFdLimit();
+    const int serverThreads = static_cast<int>(options.getInt("server-threads", 1));
+    const int64_t workNanos = options.getInt("work-us", 400) * 1000;
+    const int64_t sloNanos = static_cast<int64_t>(options.getDouble("slo-ms", 100) * 1e6);
+    const double seconds = options.getDouble("seconds", 3);
+    InetAddress addr(static_cast<uint16_t>(options.getInt("port", 9104)), "127.0.0.1");
+    std::vector<double> rates;
+    std::stringstream ss(options.get("rates", "1000,2000,4000,8000"));
+    for(std::string item; std::getline(ss, item, ',');)
+        rates.push_back(atof(item.c_str()));
+    bool admission = false;
+    AdmissionControl::Policy policy = policyFrom(options, &admission);
+
+    // 服务端：收到请求后忙等workNanos再回一个字节
+    std::atomic<TcpServer*> serverPtr(nullptr);
+    std::thread serverThread([&]()
+    {
+        EventLoop loop;
+        TcpServer server(&loop, addr, "OverloadServer");
+        server.setThreadNum(serverThreads);
+        if(admission)
+            server.setAdmissionPolicy(policy);
+        server.setMessageCallback([workNanos](const TcpConnectionPtr &conn, Buffer *buf, Timestamp)
+        {
+            buf->retrieveAll();
+            int64_t until = Timestamp::monotonicNanos() + workNanos;
+            while(Timestamp::monotonicNanos() < until)
+                ;
+            conn->send("r");
+        });
+        server.start();
+        serverPtr = &server;
+        loop.loop();
+    });
+    while(serverPtr.load() == nullptr)
+        ::usleep(1000);
+
+    EventLoop loop;
+    OverloadClient client(&loop, addr, sloNanos);
+    size_t level = 0;
+    // 每档速率：发送seconds秒，再等1秒让在途请求返回，剩下的算超时
+    std::function<void()> runLevel = [&]()
+    {
+        if(level == rates.size())
+        {
+            fflush(stdout);
+            _exit(0);
+        }
+        client.startLevel(rates[level]);
+        loop.runAfter(seconds, [&]()
+        {
+            client.stopSending();
+            loop.runAfter(1.0, [&]()
+            {
+                client.finishLevel();
+                BenchReport report("overload");
+                report.add("admission", admission ? 1 : 0);
+                report.add("offered_rate", rates[level]);
+                report.add("issued", client.issued());
+                report.add("goodput", client.good_ / seconds);
+                report.add("slow", client.slow_);
+                report.add("rejected", client.rejected_);
+                report.add("timed_out", client.timedOut_);
+                report.addHistogram("latency_", client.latency_);
+                if(admission)
+                    report.add("server", serverPtr.load()->admissionStats().toString());
+                report.print(options.has("json"));
+                ++level;
+                runLevel();
+            });
+        });
+    };
+    runLevel();
+    loop.loop();
+    return 0;
+}
@@ -0,0 +1,129 @@
+#include "BenchCommon.h"
+#include "TcpClient.h"
+#include "EventLoopThreadPool.h"
+
+#include <memory>
+
+/**
+ * ping-pong：每个连接同时只有一条size字节的消息在途，收齐回显后立即发下一条
+ * 输出每秒往返次数和往返延迟的分位数
+ *
+ * ./bench_pingpong --conns=64 --size=64 --server-threads=2 --client-threads=2 --seconds=5
+ * ./bench_pingpong --mode=server --port=9100 --server-threads=4
+ * ./bench_pingpong --mode=client --ip=10.0.0.1 --port=9100 --conns=64
+ */
+class Session
+{
+public:
+    Session(EventLoop *loop, const InetAddress &addr, const std::string &name,
+        size_t size, const BenchWindow *window)
+        : client_(loop, addr, name)
+        , message_(size, 'p')
+        , window_(window)
+        , sendNanos_(0)
+    {
+        client_.setConnectionCallback(std::bind(&Session::onConnection, this, std::placeholders::_1));
+        client_.setMessageCallback(std::bind(&Session::onMessage, this,
+            std::placeholders::_1, std::placeholders::_2, std::placeholders::_3));
+    }
+
+    void connect() {client_.connect();}
+    const Histogram& latency() const {return latency_;}
+
+private:
+    void onConnection(const TcpConnectionPtr &conn)
+    {
+        if(conn->connected())
+        {
+            conn->setTcpNoDelay(true);
+            ping(conn);
+        }
+    }
+
+    void onMessage(const TcpConnectionPtr &conn, Buffer *buf, Timestamp)
+    {
+        while(buf->readableBytes() >= message_.size())
+        {
+            buf->retrieve(message_.size());
+            int64_t now = Timestamp::monotonicNanos();
+            if(window_->contains(now))
+                latency_.record(now - sendNanos_);
+            ping(conn);
+        }
+    }
+
+    void ping(const TcpConnectionPtr &conn)
+    {
+        sendNanos_ = Timestamp::monotonicNanos();
+        conn->send(message_.data(), message_.size());
+    }
+
+    TcpClient client_;
+    const std::string message_;
+    const BenchWindow *window_;
+    int64_t sendNanos_;
+    Histogram latency_;
+};
+
+int main(int argc, char *argv[])
+{
+    BenchOptions options(argc, argv);
+    std::string mode = options.get("mode", "self");
+    if(mode == "server")
+        return runBenchServer(options, true);
+
+    const int conns = static_cast<int>(options.getInt("conns", 16));
+    const size_t size = static_cast<size_t>(options.getInt("size", 64));
+    const int serverThreads = static_cast<int>(options.getInt("server-threads", 1));
+    const int clientThreads = static_cast<int>(options.getInt("client-threads", 1));
+    const double seconds = options.getDouble("seconds", 5);
+    const double warmup = options.getDouble("warmup", 1);
+    InetAddress addr(static_cast<uint16_t>(options.getInt("port", 9100)), options.get("ip", "127.0.0.1"));
+
+    std::unique_ptr<BenchServerThread> server;
+    if(mode == "self")
+        server.reset(new BenchServerThread(addr, serverThreads, true));
+
+    EventLoop loop;
+    EventLoopThreadPool pool(&loop, "pingpong-client");
+    pool.setThreadNum(clientThreads);
+    pool.start();
+
+    BenchWindow window;
+    std::vector<std::unique_ptr<Session>> sessions;
+    for(int i = 0; i < conns; ++i)
+    {
+        sessions.emplace_back(new Session(pool.getNextLoop(), addr, "pingpong-" + std::to_string(i), size, &window));
+        sessions.back()->connect();
+    }
+
+    loop.runAfter(warmup, [&window, seconds]()
+    {
+        int64_t now = Timestamp::monotonicNanos();
+        window.startNanos = now;
+        window.endNanos = now + static_cast<int64_t>(seconds * 1e9);
+    });
+    loop.runAfter(warmup + seconds + 0.1, [&]()
+    {
+        Histogram latency;
+        for(const std::unique_ptr<Session> &session : sessions)
+            latency += session->latency();
+
+        BenchReport report("pingpong");
+        report.add("mode", mode);
+        report.add("conns", conns);
+        report.add("size", static_cast<long>(size));
+        report.add("server_threads", serverThreads);
+        report.add("client_threads", clientThreads);
+        report.add("seconds", seconds);
+        report.add("round_trips", latency.count());
+        report.add("round_trips_per_sec", latency.count() / seconds);
+        report.add("mib_per_sec", latency.count() * size / seconds / (1024.0 * 1024.0));
+        report.addHistogram("rtt_", latency);
+        report.print(options.has("json"));
+        // 连接和loop线程由进程退出统一回收
+        _exit(0);
+    });
+    loop.loop();
+    return 0;
+}
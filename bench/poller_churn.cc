@@ -0,0 +1,92 @@
+#include "BenchCommon.h"
+#include "Channel.h"
+
+#include <memory>
+#include <random>
+#include <sys/eventfd.h>
+
+/**
+ * Poller的channel表在大量fd下的增删开销：先注册fds个fd，然后反复随机关掉一个、再打开一个新的
+ * 内核总是分配最小的空闲fd，新fd正好落在刚释放的位置，和短连接服务器上accept/close交替的模式一致
+ * 用eventfd代替socket，只测Poller本身(channel表 + epoll_ctl)，不受TCP握手影响
+ *
+ * ./bench_poller_churn --fds=100000 --ops=1000000
+ * fd数量受RLIMIT_NOFILE限制，超过硬上限时按上限截断，实际数量见输出的fds
+ */
+static int openFd()
+{
+    int fd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if(fd < 0)
+        LOG_FATAL("eventfd error:%d\n", errno);
+    return fd;
+}
+
+int main(int argc, char *argv[])
+{
+    BenchOptions options(argc, argv);
+    const long fdLimit = raiseFdLimit();
+    long fds = options.getInt("fds", 100000);
+    if(fds + 64 > fdLimit)
+        fds = fdLimit - 64;
+    const long ops = options.getInt("ops", 1000000);
+
+    EventLoop loop;
+    std::vector<std::unique_ptr<Channel>> channels;
+    channels.reserve(fds);
+
+    const long rssBefore = readRssKb();
+    int64_t start = Timestamp::monotonicNanos();
+    for(long i = 0; i < fds; ++i)
+    {
+        channels.emplace_back(new Channel(&loop, openFd()));
+        channels.back()->enableReading();
+    }
+    const double fillSeconds = (Timestamp::monotonicNanos() - start) / 1e9;
+    const long rssAfter = readRssKb();
+
+    // 随机关闭一个再打开一个，记录每一对操作的耗时
+    std::mt19937 rng(12345);
+    std::uniform_int_distribution<long> pick(0, fds - 1);
+    Histogram churn;
+    start = Timestamp::monotonicNanos();
+    for(long i = 0; i < ops; ++i)
+    {
+        std::unique_ptr<Channel> &channel = channels[pick(rng)];
+        int64_t opStart = Timestamp::monotonicNanos();
+        int fd = channel->fd();
+        channel->disableAll();
+        channel->remove();
+        ::close(fd);
+        channel.reset(new Channel(&loop, openFd()));
+        channel->enableReading();
+        churn.record(Timestamp::monotonicNanos() - opStart);
+    }
+    const double churnSeconds = (Timestamp::monotonicNanos() - start) / 1e9;
+
+    // hasChannel在assert和关闭路径上使用，单独测一下查找
+    uint64_t found = 0;
+    start = Timestamp::monotonicNanos();
+    for(long i = 0; i < ops; ++i)
+        found += loop.hasChannel(channels[pick(rng)].get());
+    const double lookupSeconds = (Timestamp::monotonicNanos() - start) / 1e9;
+
+    BenchReport report("poller_churn");
+    report.add("fds", fds);
+    report.add("ops", ops);
+    report.add("fill_seconds", fillSeconds);
+    report.add("table_rss_kb", rssAfter - rssBefore);
+    report.add("churn_ops_per_sec", ops / churnSeconds);
+    report.addHistogram("churn_", churn);
+    report.add("lookups_per_sec", ops / lookupSeconds);
+    report.add("lookups_found", found);
+    report.print(options.has("json"));
+
+    for(std::unique_ptr<Channel> &channel : channels)
+    {
+        int fd = channel->fd();
+        channel->disableAll();
+        channel->remove();
+        ::close(fd);
+    }
+    return 0;
+}
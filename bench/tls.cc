@@ -0,0 +1,274 @@
+#include "BenchCommon.h"
+#include "TcpClient.h"
+#include "TlsContext.h"
+
+#include <memory>
+#include <fcntl.h>
+#include <openssl/evp.h>
+#include <openssl/pem.h>
+#include <openssl/x509.h>
+
+/**
+ * TLS的开销：完整握手和会话复用握手每秒各能完成多少次，以及明文/TLS下普通send和sendFile的下载吞吐
+ * 证书是启动时现场生成的自签名证书(默认ECDSA P-256，--rsa改用RSA 2048)，不需要准备任何文件
+ * 客户端和服务端跑在同一个loop里，依次执行各个阶段，数字是两端开销之和
+ *
+ * ./bench_tls --handshakes=1000 --mb=256
+ * ./bench_tls --no-ktls    关掉kTLS对比；内核没有tls模块时输出的ktls_send/ktls_recv为0，本来就是用户态加解密
+ */
+namespace
+{
+// 生成自签名证书和私钥，写到临时文件
+bool makeSelfSigned(bool rsa, const std::string &certFile, const std::string &keyFile)
+{
+    EVP_PKEY *key = rsa ? EVP_RSA_gen(2048) : EVP_EC_gen("P-256");
+    X509 *cert = X509_new();
+    bool ok = key != nullptr && cert != nullptr;
+    if(ok)
+    {
+        X509_set_version(cert, 2);
+        ASN1_INTEGER_set(X509_get_serialNumber(cert), 1);
+        X509_gmtime_adj(X509_getm_notBefore(cert), 0);
+        X509_gmtime_adj(X509_getm_notAfter(cert), 24 * 3600);
+        X509_set_pubkey(cert, key);
+        X509_NAME *name = X509_get_subject_name(cert);
+        X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC, (const unsigned char*)"localhost", -1, -1, 0);
+        X509_set_issuer_name(cert, name);
+        ok = X509_sign(cert, key, EVP_sha256()) > 0;
+    }
+    FILE *fp = ok ? fopen(certFile.c_str(), "w") : nullptr;
+    ok = fp != nullptr && PEM_write_X509(fp, cert) == 1;
+    if(fp)
+        fclose(fp);
+    fp = ok ? fopen(keyFile.c_str(), "w") : nullptr;
+    ok = fp != nullptr && PEM_write_PrivateKey(fp, key, nullptr, nullptr, 0, nullptr, nullptr) == 1;
+    if(fp)
+        fclose(fp);
+    X509_free(cert);
+    EVP_PKEY_free(key);
+    return ok;
+}
+
+// 下载服务：收到"b <bytes>\n"用send分块发送，收到"f <bytes>\n"用sendFile发送文件，发完后半关闭
+void serveDownload(TcpServer *server, int fileFd)
+{
+    static const size_t kChunk = 256 * 1024;
+    std::shared_ptr<std::string> chunk(new std::string(kChunk, 'x'));
+    server->setMessageCallback([fileFd, chunk](const TcpConnectionPtr &conn, Buffer *buf, Timestamp)
+    {
+        const char *eol = static_cast<const char*>(memchr(buf->peek(), '\n', buf->readableBytes()));
+        if(eol == nullptr)
+            return;
+        std::string line(buf->peek(), eol);
+        buf->retrieve(eol + 1 - buf->peek());
+        size_t bytes = static_cast<size_t>(atoll(line.c_str() + 2));
+        if(line[0] == 'f')
+        {
+            conn->sendFile(fileFd, 0, bytes);
+            conn->shutdown();
+            return;
+        }
+        // 剩余字节数放在context里，每次发完一块由writeComplete续上
+        std::shared_ptr<size_t> remaining(new size_t(bytes));
+        conn->setContext(remaining);
+        size_t n = std::min(*remaining, kChunk);
+        *remaining -= n;
+        conn->send(chunk->data(), n);
+    });
+    server->setWriteComplete([chunk](const TcpConnectionPtr &conn)
+    {
+        std::shared_ptr<size_t> remaining = std::static_pointer_cast<size_t>(conn->getContext());
+        if(!remaining)
+            return;
+        if(*remaining == 0)
+        {
+            conn->setContext(std::shared_ptr<void>());
+            conn->shutdown();
+            return;
+        }
+        size_t n = std::min(*remaining, kChunk);
+        *remaining -= n;
+        conn->send(chunk->data(), n);
+    });
+}
+
+/**
+ * 依次执行的阶段，每个阶段结束时调用done_开始下一个
+ * 客户端对象保留到进程退出，避免在它自己的回调里析构
+ */
+class Driver
+{
+public:
+    using Done = std::function<void(double seconds)>;
+
+    explicit Driver(EventLoop *loop) : loop_(loop), started_(0), remaining_(0) {}
+
+    // 串行建立count个连接，握手完成后立即关闭，前一个连接关闭以后再建下一个
+    void handshakes(const InetAddress &addr, const TlsContextPtr &context, int count, const Done &done)
+    {
+        done_ = done;
+        remaining_ = count;
+        started_ = Timestamp::monotonicNanos();
+        nextHandshake(addr, context);
+    }
+
+    // 下载bytes字节，file为true时服务端用sendFile
+    void download(const InetAddress &addr, const TlsContextPtr &context, bool file, size_t bytes, const Done &done)
+    {
+        done_ = done;
+        remaining_ = static_cast<long>(bytes);
+        TcpClient *client = newClient(addr, context);
+        client->setConnectionCallback([this, file, bytes](const TcpConnectionPtr &conn)
+        {
+            if(!conn->connected())
+                return;
+            started_ = Timestamp::monotonicNanos();
+            conn->send(std::string(file ? "f " : "b ") + std::to_string(bytes) + "\n");
+        });
+        client->setMessageCallback([this](const TcpConnectionPtr &conn, Buffer *buf, Timestamp)
+        {
+            remaining_ -= static_cast<long>(buf->readableBytes());
+            buf->retrieveAll();
+            if(remaining_ == 0)
+            {
+                conn->shutdown();
+                finish();
+            }
+        });
+        client->connect();
+    }
+
+private:
+    TcpClient* newClient(const InetAddress &addr, const TlsContextPtr &context)
+    {
+        clients_.emplace_back(new TcpClient(loop_, addr, "tls-bench"));
+        if(context)
+            clients_.back()->setTlsContext(context);
+        return clients_.back().get();
+    }
+
+    void nextHandshake(const InetAddress &addr, const TlsContextPtr &context)
+    {
+        if(remaining_ == 0)
+        {
+            finish();
+            return;
+        }
+        --remaining_;
+        TcpClient *client = newClient(addr, context);
+        client->setConnectionCallback([this, addr, context](const TcpConnectionPtr &conn)
+        {
+            if(conn->connected())
+                conn->shutdown();
+            else
+                loop_->queueLoop([this, addr, context]() {nextHandshake(addr, context);});
+        });
+        client->connect();
+    }
+
+    void finish()
+    {
+        double seconds = (Timestamp::monotonicNanos() - started_) / 1e9;
+        Done done;
+        done.swap(done_);
+        loop_->queueLoop([done, seconds]() {done(seconds);});
+    }
+
+    EventLoop *loop_;
+    int64_t started_;
+    long remaining_;
+    Done done_;
+    std::vector<std::unique_ptr<TcpClient>> clients_;
+};
+}
+
+int main(int argc, char *argv[])
+{
+    BenchOptions options(argc, argv);
+    const int handshakes = static_cast<int>(options.getInt("handshakes", 1000));
+    const size_t bytes = static_cast<size_t>(options.getInt("mb", 256)) * 1024 * 1024;
+    const bool ktls = !options.has("no-ktls");
+    const bool rsa = options.has("rsa");
+    const uint16_t port = static_cast<uint16_t>(options.getInt("port", 9300));
+
+    char dir[] = "/tmp/mymuduo-tls-XXXXXX";
+    if(::mkdtemp(dir) == nullptr)
+        LOG_FATAL("mkdtemp error:%d\n", errno);
+    const std::string certFile = std::string(dir) + "/cert.pem";
+    const std::string keyFile = std::string(dir) + "/key.pem";
+    const std::string dataFile = std::string(dir) + "/data";
+    if(!makeSelfSigned(rsa, certFile, keyFile))
+        LOG_FATAL("generate self-signed certificate failed\n");
+
+    TlsContextPtr serverContext = TlsContext::newServer(certFile, keyFile);
+    // 自签名证书本身就是CA，客户端只信任它
+    TlsContextPtr fullContext = TlsContext::newClient(certFile);
+    TlsContextPtr resumeContext = TlsContext::newClient(certFile);
+    if(!serverContext || !fullContext || !resumeContext)
+        LOG_FATAL("create TlsContext failed\n");
+    serverContext->setKtls(ktls);
+    fullContext->setKtls(ktls);
+    fullContext->setSessionResumption(false);
+    resumeContext->setKtls(ktls);
+
+    // sendFile用的文件，稀疏文件读出来是全0，不占磁盘
+    int fileFd = ::open(dataFile.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if(fileFd < 0 || ::ftruncate(fileFd, static_cast<off_t>(bytes)) < 0)
+        LOG_FATAL("create data file error:%d\n", errno);
+    ::unlink(certFile.c_str());
+    ::unlink(keyFile.c_str());
+    ::unlink(dataFile.c_str());
+    ::rmdir(dir);
+
+    EventLoop loop;
+    InetAddress plainAddr(port, "127.0.0.1");
+    InetAddress tlsAddr(static_cast<uint16_t>(port + 1), "127.0.0.1");
+    TcpServer plainServer(&loop, plainAddr, "plain");
+    TcpServer tlsServer(&loop, tlsAddr, "tls");
+    tlsServer.setTlsContext(serverContext);
+    serveDownload(&plainServer, fileFd);
+    serveDownload(&tlsServer, fileFd);
+    plainServer.start();
+    tlsServer.start();
+
+    BenchReport report("tls");
+    report.add("cert", rsa ? "rsa2048" : "p256");
+    report.add("ktls", ktls ? "on" : "off");
+    const double mib = bytes / (1024.0 * 1024.0);
+    Driver driver(&loop);
+    // 各阶段依次执行
+    driver.handshakes(tlsAddr, fullContext, handshakes, [&](double seconds)
+    {
+        report.add("full_handshakes_per_sec", handshakes / seconds);
+        driver.handshakes(tlsAddr, resumeContext, handshakes, [&](double seconds)
+        {
+            report.add("resumed_handshakes_per_sec", handshakes / seconds);
+            report.add("resumed", resumeContext->stats().resumed);
+            driver.download(plainAddr, TlsContextPtr(), false, bytes, [&](double seconds)
+            {
+                report.add("plain_send_mib_per_sec", mib / seconds);
+                driver.download(plainAddr, TlsContextPtr(), true, bytes, [&](double seconds)
+                {
+                    report.add("plain_sendfile_mib_per_sec", mib / seconds);
+                    driver.download(tlsAddr, resumeContext, false, bytes, [&](double seconds)
+                    {
+                        report.add("tls_send_mib_per_sec", mib / seconds);
+                        driver.download(tlsAddr, resumeContext, true, bytes, [&](double seconds)
+                        {
+                            report.add("tls_sendfile_mib_per_sec", mib / seconds);
+                            TlsContext::Stats stats = serverContext->stats();
+                            report.add("ktls_send", stats.ktlsSend);
+                            report.add("ktls_recv", stats.ktlsRecv);
+                            report.add("handshake_failures", stats.failures);
+                            report.print(options.has("json"));
+                            // 连接由进程退出统一回收
+                            _exit(0);
+                        });
+                    });
+                });
+            });
+        });
+    });
+    loop.loop();
+    return 0;
+}
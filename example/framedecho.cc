@@ -0,0 +1,52 @@
+#include <mymuduo/TcpServer.h>
+#include <mymuduo/LengthHeaderCodec.h>
+#include <mymuduo/Logger.h>
+
+#include <functional>
+#include <stdlib.h>
+
+/**
+ * 分帧回显服务器：收到的每一帧原样发回
+ * 帧格式为4字节大端长度 + 数据，超过1M的帧直接断开连接
+ * ./framedecho 8001
+ * ./framedecho /tmp/framedecho.sock   (Unix域socket，'@name'为抽象命名空间)
+ */
+class FramedEchoServer
+{
+public:
+    FramedEchoServer(EventLoop *loop, const InetAddress &addr)
+        : server_(loop, addr, "FramedEchoServer")
+        , codec_(std::bind(&FramedEchoServer::onFrame, this,
+            std::placeholders::_1, std::placeholders::_2, std::placeholders::_3), 1024 * 1024)
+    {
+        server_.setMessageCallback(std::bind(&LengthHeaderCodec::onMessage, &codec_,
+            std::placeholders::_1, std::placeholders::_2, std::placeholders::_3));
+        server_.setThreadNum(2);
+    }
+
+    void start()
+    {server_.start();}
+
+private:
+    // frame指向inputBuffer_，在loop线程中发送会直接编码进outputBuffer_，全程只有这一次拷贝
+    void onFrame(const TcpConnectionPtr &conn, const StringPiece &frame, Timestamp)
+    {
+        codec_.send(conn, frame);
+    }
+
+    TcpServer server_;
+    LengthHeaderCodec codec_;
+};
+
+int main(int argc, char *argv[])
+{
+    const char *arg = argc > 1 ? argv[1] : "8001";
+    InetAddress addr = (arg[0] == '/' || arg[0] == '@')
+        ? InetAddress::fromUnixPath(arg)
+        : InetAddress(static_cast<uint16_t>(atoi(arg)), "0.0.0.0");
+    EventLoop loop;
+    FramedEchoServer server(&loop, addr);
+    server.start();
+    loop.loop();
+    return 0;
+}
@@ -0,0 +1,113 @@
+#include <mymuduo/HttpServer.h>
+#include <mymuduo/HotRestart.h>
+#include <mymuduo/Logger.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <signal.h>
+#include <stdlib.h>
+
+/**
+ * HTTP/1.1服务器示例
+ * GET  /       返回hello
+ * POST /echo   原样返回请求body(支持chunked)
+ * GET  /metrics 各个loop的运行统计和延迟分位数
+ * 收到SIGTERM/SIGINT后drain：不再接受新连接，处理完手上的请求，最多等待5秒后退出
+ * 指定控制socket时支持热重启：用同样的参数再启动一个进程，它从旧进程接过监听socket，旧进程随后drain退出
+ * ./httpserver 8000 4 /tmp/httpserver.ctl
+ * curl -v http://127.0.0.1:8000/
+ * curl -v -H "Transfer-Encoding: chunked" -d hello http://127.0.0.1:8000/echo
+ */
+static HttpServer *g_server = nullptr;
+static volatile sig_atomic_t g_stop = 0;
+
+static void onSignal(int)
+{
+    g_stop = 1;
+}
+
+static void onRequest(const HttpRequest &req, HttpResponse *resp)
+{
+    static const char kHello[] = "hello, world!\n";
+    if(req.path() == "/")
+    {
+        resp->setContentType("text/plain");
+        resp->setBody(StringPiece(kHello, sizeof kHello - 1));
+    }
+    else if(req.path() == "/echo")
+    {
+        resp->setContentType("application/octet-stream");
+        resp->setBody(req.body()); // body指向inputBuffer_，finish()之前一直有效
+    }
+    else if(req.path() == "/metrics")
+    {
+        std::string body;
+        std::vector<LoopMetrics::Snapshot> loops = g_server->tcpServer().loopMetrics();
+        for(size_t i = 0; i < loops.size(); ++i)
+            body += "loop=" + std::to_string(i) + " " + loops[i].toString() + "\n";
+        body += "loop=total " + g_server->tcpServer().totalMetrics().toString() + "\n";
+        body += "latency " + g_server->tcpServer().totalHistograms().toString() + "\n";
+        resp->setContentType("text/plain");
+        resp->setBody(std::move(body));
+    }
+    else
+    {
+        resp->setStatusCode(HttpResponse::k404NotFound);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    uint16_t port = argc > 1 ? static_cast<uint16_t>(atoi(argv[1])) : 8000;
+    int threads = argc > 2 ? atoi(argv[2]) : 0;
+    std::string controlPath = argc > 3 ? argv[3] : "";
+
+    EventLoop loop;
+    std::unique_ptr<HotRestart> restart;
+    int listenFd = -1;
+    if(!controlPath.empty())
+    {
+        restart.reset(new HotRestart(&loop, controlPath));
+        if(restart->inherit())
+            listenFd = restart->takeFd("HttpServer");
+    }
+    std::unique_ptr<HttpServer> server(listenFd >= 0
+        ? new HttpServer(&loop, listenFd, "HttpServer")
+        : new HttpServer(&loop, InetAddress(port, "0.0.0.0"), "HttpServer", TcpServer::kNoReusePort));
+    g_server = server.get();
+    server->setHttpCallback(onRequest);
+    server->setThreadNum(threads);
+    server->start();
+
+    bool draining = false;
+    auto startDrain = [&]()
+    {
+        if(draining)
+            return;
+        draining = true;
+        server->tcpServer().drain(5.0, [&loop](const TcpServer::DrainProgress &progress)
+        {
+            if(progress.finished)
+                loop.quit();
+        });
+    };
+    if(restart)
+    {
+        restart->addServer(&server->tcpServer());
+        restart->setTakeoverCallback(startDrain);
+        restart->start();
+    }
+
+    ::signal(SIGTERM, onSignal);
+    ::signal(SIGINT, onSignal);
+    // 信号处理函数里只置标志，由loop定时检查
+    loop.runEvery(0.1, [&]()
+    {
+        if(g_stop)
+            startDrain();
+    });
+    loop.loop();
+
+    return 0;
+}
@@ -0,0 +1,238 @@
+#include <mymuduo/TcpClient.h>
+#include <mymuduo/EventLoop.h>
+#include <mymuduo/EventLoopThreadPool.h>
+#include <mymuduo/Histogram.h>
+#include <mymuduo/Logger.h>
+
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/**
+ * memcached文本协议压测客户端，可以压kvserver，也可以压真正的memcached
+ * 每条连接保持depth个请求在途，按getRatio%的比例发get(一次multiget个随机key)，其余发set
+ * 前1秒预热不计入统计，之后统计seconds秒，输出一行key=value
+ * ./kvbench ip port threads conns depth seconds keys value getRatio multiget
+ * ./kvbench 127.0.0.1 11211 2 32 8 5 100000 100 90 4
+ */
+namespace
+{
+std::atomic_bool g_measuring(false);
+std::atomic_bool g_stopping(false);
+
+class KvClient
+{
+public:
+    KvClient(EventLoop *loop, const InetAddress &addr, int index, int depth, int keys, size_t valueSize,
+        int getRatio, int multiget)
+        : client_(loop, addr, "KvBench" + std::to_string(index))
+        , depth_(depth)
+        , keys_(keys)
+        , getRatio_(getRatio)
+        , multiget_(multiget)
+        , value_(valueSize, 'v')
+        , random_(index)
+        , ops_(0)
+        , hits_(0)
+        , misses_(0)
+        , errors_(0)
+    {
+        client_.setConnectionCallback([this](const TcpConnectionPtr &conn)
+        {
+            if(!conn->connected())
+                return;
+            conn->setTcpNoDelay(true);
+            for(int i = 0; i < depth_; ++i)
+                sendOne(conn);
+            conn->flushOutput();
+        });
+        client_.setMessageCallback([this](const TcpConnectionPtr &conn, Buffer *buf, Timestamp)
+        {
+            onMessage(conn, buf);
+        });
+    }
+
+    void connect() {client_.connect();}
+    const Histogram& latency() const {return latency_;}
+    uint64_t ops() const {return ops_.load(std::memory_order_relaxed);}
+    uint64_t hits() const {return hits_.load(std::memory_order_relaxed);}
+    uint64_t misses() const {return misses_.load(std::memory_order_relaxed);}
+    uint64_t errors() const {return errors_.load(std::memory_order_relaxed);}
+
+private:
+    struct Pending
+    {
+        bool get;
+        int64_t start;
+    };
+
+    // 请求直接写进outputBuffer()，一批应答处理完以后一起flush
+    void sendOne(const TcpConnectionPtr &conn)
+    {
+        Buffer *out = conn->outputBuffer();
+        char line[64];
+        bool get = static_cast<int>(random_() % 100) < getRatio_;
+        if(get)
+        {
+            out->append("get", 3);
+            for(int i = 0; i < multiget_; ++i)
+            {
+                int n = snprintf(line, sizeof line, " key:%d", static_cast<int>(random_() % keys_));
+                out->append(line, n);
+            }
+            out->append("\r\n", 2);
+        }
+        else
+        {
+            int n = snprintf(line, sizeof line, "set key:%d 0 0 %zu\r\n",
+                static_cast<int>(random_() % keys_), value_.size());
+            out->append(line, n);
+            out->append(value_);
+            out->append("\r\n", 2);
+        }
+        pending_.push_back(Pending{get, Timestamp::monotonicNanos()});
+    }
+
+    // 解析一个完整的应答，返回消耗的字节数，不完整时返回0
+    size_t parseResponse(const Pending &pending, const char *begin, const char *end, int *hits)
+    {
+        const char *p = begin;
+        if(!pending.get)
+        {
+            const char *crlf = static_cast<const char*>(memmem(p, end - p, "\r\n", 2));
+            if(crlf == nullptr)
+                return 0;
+            if(crlf - p != 6 || memcmp(p, "STORED", 6) != 0)
+                errors_.store(errors_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            return crlf + 2 - begin;
+        }
+        // VALUE <key> <flags> <bytes>\r\n<data>\r\n ... END\r\n
+        for(;;)
+        {
+            const char *crlf = static_cast<const char*>(memmem(p, end - p, "\r\n", 2));
+            if(crlf == nullptr)
+                return 0;
+            if(crlf - p == 3 && memcmp(p, "END", 3) == 0)
+                return crlf + 2 - begin;
+            if(crlf - p < 6 || memcmp(p, "VALUE ", 6) != 0)
+            {
+                errors_.store(errors_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+                return crlf + 2 - begin;
+            }
+            const char *space = static_cast<const char*>(memrchr(p, ' ', crlf - p));
+            size_t bytes = static_cast<size_t>(strtoul(space + 1, nullptr, 10));
+            if(static_cast<size_t>(end - (crlf + 2)) < bytes + 2)
+                return 0;
+            p = crlf + 2 + bytes + 2;
+            ++*hits;
+        }
+    }
+
+    void onMessage(const TcpConnectionPtr &conn, Buffer *buf)
+    {
+        int64_t now = Timestamp::monotonicNanos();
+        bool measuring = g_measuring.load(std::memory_order_relaxed);
+        while(!pending_.empty())
+        {
+            int hits = 0;
+            size_t n = parseResponse(pending_.front(), buf->peek(), buf->peek() + buf->readableBytes(), &hits);
+            if(n == 0)
+                break;
+            buf->retrieve(n);
+            if(measuring)
+            {
+                latency_.record(now - pending_.front().start);
+                ops_.store(ops_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+                if(pending_.front().get)
+                {
+                    hits_.store(hits_.load(std::memory_order_relaxed) + hits, std::memory_order_relaxed);
+                    misses_.store(misses_.load(std::memory_order_relaxed) + multiget_ - hits,
+                        std::memory_order_relaxed);
+                }
+            }
+            pending_.pop_front();
+            if(!g_stopping.load(std::memory_order_relaxed))
+                sendOne(conn);
+        }
+        conn->flushOutput();
+    }
+
+    TcpClient client_;
+    const int depth_;
+    const int keys_;
+    const int getRatio_;
+    const int multiget_;
+    const std::string value_;
+    std::minstd_rand random_;
+    std::deque<Pending> pending_;
+    Histogram latency_;
+    std::atomic<uint64_t> ops_;
+    std::atomic<uint64_t> hits_;
+    std::atomic<uint64_t> misses_;
+    std::atomic<uint64_t> errors_;
+};
+}
+
+int main(int argc, char *argv[])
+{
+    if(argc < 3)
+    {
+        printf("Usage: %s ip port [threads conns depth seconds keys value getRatio multiget]\n", argv[0]);
+        return 0;
+    }
+    InetAddress addr(static_cast<uint16_t>(atoi(argv[2])), argv[1]);
+    int threads = argc > 3 ? atoi(argv[3]) : 1;
+    int conns = argc > 4 ? atoi(argv[4]) : 16;
+    int depth = argc > 5 ? atoi(argv[5]) : 8;
+    double seconds = argc > 6 ? atof(argv[6]) : 5;
+    int keys = argc > 7 ? atoi(argv[7]) : 100000;
+    size_t valueSize = argc > 8 ? static_cast<size_t>(atoi(argv[8])) : 100;
+    int getRatio = argc > 9 ? atoi(argv[9]) : 90;
+    int multiget = argc > 10 ? atoi(argv[10]) : 1;
+
+    EventLoop loop;
+    EventLoopThreadPool pool(&loop, "kvbench");
+    pool.setThreadNum(threads);
+    pool.start();
+
+    std::vector<std::unique_ptr<KvClient>> clients;
+    for(int i = 0; i < conns; ++i)
+    {
+        clients.emplace_back(new KvClient(pool.getNextLoop(), addr, i, depth, keys, valueSize, getRatio, multiget));
+        clients.back()->connect();
+    }
+
+    loop.runAfter(1.0, []() {g_measuring = true;});
+    loop.runAfter(1.0 + seconds, [&]()
+    {
+        g_measuring = false;
+        g_stopping = true;
+        Histogram latency;
+        uint64_t ops = 0, hits = 0, misses = 0, errors = 0;
+        for(auto &client : clients)
+        {
+            latency += client->latency();
+            ops += client->ops();
+            hits += client->hits();
+            misses += client->misses();
+            errors += client->errors();
+        }
+        printf("bench=kv conns=%d depth=%d keys=%d value=%zu get_ratio=%d multiget=%d ops=%llu errors=%llu "
+            "ops_per_sec=%.0f hit_ratio=%.3f p50_us=%.1f p99_us=%.1f p999_us=%.1f\n",
+            conns, depth, keys, valueSize, getRatio, multiget, static_cast<unsigned long long>(ops),
+            static_cast<unsigned long long>(errors), ops / seconds,
+            hits + misses ? static_cast<double>(hits) / (hits + misses) : 0.0,
+            latency.percentile(50) / 1e3, latency.percentile(99) / 1e3, latency.percentile(99.9) / 1e3);
+        fflush(stdout);
+        _exit(0); // 客户端仍挂在各自的loop上，直接退出
+    });
+    loop.loop();
+    return 0;
+}
@@ -0,0 +1,882 @@
+#include <mymuduo/TcpServer.h>
+#include <mymuduo/EventLoop.h>
+#include <mymuduo/StringPiece.h>
+#include <mymuduo/Logger.h>
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/**
+ * 兼容memcached文本协议的内存缓存
+ *   get/gets/set/add/replace/append/prepend/cas/delete/incr/decr/touch/flush_all/stats/version/quit
+ *
+ * 存储：key按哈希分到若干个分片，每个分片一把锁(任何subLoop都可以访问任何key)，分片内是开链哈希表
+ * 内存：按大小分级的slab，每级从全局预算中按1MB整页申请再切成等长的块，item头、key、value放在同一个块里
+ * 淘汰：每个分片的每一级一条LRU链，没有空闲块也申请不到新页时淘汰同一级链尾的item；
+ *       这一级一个item都没有时，从本分片其他级收回一整页(淘汰页上的item)，避免内存都被别的级占住
+ * 响应：一次读到的所有命令(包括多key的get)的响应直接写进outputBuffer()，命中的value在分片锁内拷贝过去，
+ *       最后flushOutput()一次发出
+ *
+ * ./kvserver port ioThreads memoryMB shards
+ * ./kvserver 11211 4 64 16
+ */
+namespace
+{
+const size_t kPageSize = 1024 * 1024;
+const size_t kMaxKeyLength = 250;
+const size_t kMaxLineLength = 2048;
+const time_t kRelativeExpireLimit = 60 * 60 * 24 * 30;  // 超过30天的exptime是绝对时间
+
+// 块的开头是item头，后面依次是key和带\r\n的value
+struct Item
+{
+    Item *prev;     // LRU链，prev指向更近访问的
+    Item *next;
+    Item *hnext;    // 哈希链
+    uint64_t cas;
+    time_t exptime; // 0表示不过期
+    uint32_t flags;
+    uint32_t nbytes;    // value长度，含结尾的\r\n
+    uint8_t nkey;
+    uint8_t slabClass;
+    bool linked;        // 在哈希表中，否则在空闲链表中
+
+    char* key() {return reinterpret_cast<char*>(this + 1);}
+    char* value() {return key() + nkey;}
+    StringPiece keyPiece() {return StringPiece(key(), nkey);}
+};
+
+uint64_t hashKey(const StringPiece &key)
+{
+    uint64_t h = 14695981039346656037ULL;
+    for(size_t i = 0; i < key.size(); ++i)
+    {
+        h ^= static_cast<unsigned char>(key[i]);
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+time_t realExptime(long exptime, time_t now)
+{
+    if(exptime < 0)
+        return 1;   // 负数表示立即过期
+    if(exptime == 0)
+        return 0;
+    if(exptime <= kRelativeExpireLimit)
+        return now + exptime;
+    return exptime;
+}
+
+class Cache
+{
+public:
+    enum StoreMode {kSet, kAdd, kReplace, kAppend, kPrepend, kCas};
+    enum Result {kStored, kNotStored, kExists, kNotFound, kTooLarge, kOutOfMemory, kNonNumeric, kDeleted, kTouched};
+
+    struct Stats
+    {
+        uint64_t getHits = 0;
+        uint64_t getMisses = 0;
+        uint64_t sets = 0;
+        uint64_t evictions = 0;
+        uint64_t items = 0;
+        uint64_t bytes = 0;
+    };
+
+    Cache(size_t maxBytes, int shards)
+        : shards_(static_cast<size_t>(std::max(shards, 1)))
+        // 每个分片至少要能拿到一页，否则它的任何item都存不下
+        , pagesLeft_(std::max(maxBytes / kPageSize, shards_.size()))
+        , maxBytes_(maxBytes)
+    {
+        // 块大小从64字节开始每级乘1.25，8字节对齐，最后一级是整页
+        for(size_t size = 64; size < kPageSize / 2; size = (size * 5 / 4 + 7) & ~static_cast<size_t>(7))
+            classSizes_.push_back(size);
+        classSizes_.push_back(kPageSize);
+        for(Shard &shard : shards_)
+        {
+            shard.buckets.assign(1024, nullptr);
+            shard.classes.resize(classSizes_.size());
+        }
+    }
+
+    ~Cache()
+    {
+        for(Shard &shard : shards_)
+        {
+            for(const Page &page : shard.pages)
+                free(page.base);
+        }
+    }
+
+    size_t maxBytes() const {return maxBytes_;}
+    size_t maxItemSize() const {return classSizes_.back();}
+    // key对应的value最多能有多少字节，写成减法避免客户端给的长度加法回绕
+    size_t maxValueSize(const StringPiece &key) const {return maxItemSize() - sizeof(Item) - key.size() - 2;}
+
+    // data不含结尾的\r\n
+    Result store(StoreMode mode, const StringPiece &key, uint32_t flags, time_t exptime, const StringPiece &data,
+        uint64_t cas, time_t now)
+    {
+        if(data.size() > maxValueSize(key))
+            return kTooLarge;
+        uint64_t hash = hashKey(key);
+        Shard &shard = shardOf(hash);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        ++shard.stats.sets;
+        Item *old = find(shard, key, hash, now);
+        if((mode == kAdd && old) || ((mode == kReplace || mode == kAppend || mode == kPrepend) && !old))
+        {
+            if(old)
+                bump(shard, old);
+            return kNotStored;
+        }
+        if(mode == kCas)
+        {
+            if(!old)
+                return kNotFound;
+            if(old->cas != cas)
+                return kExists;
+        }
+
+        // 申请新块可能淘汰掉old，需要的旧数据先拷出来，申请完再重新查找
+        std::string combined;
+        StringPiece value = data;
+        if(mode == kAppend || mode == kPrepend)
+        {
+            StringPiece oldValue(old->value(), old->nbytes - 2);
+            combined = mode == kAppend ? oldValue.as_string() + data.as_string() : data.as_string() + oldValue.as_string();
+            value = combined;
+            flags = old->flags;
+            exptime = old->exptime;
+            if(value.size() > maxValueSize(key))
+                return kTooLarge;
+        }
+        Item *item = allocItem(shard, key, flags, exptime, value, now);
+        if(item == nullptr)
+            return kOutOfMemory;
+        old = find(shard, key, hash, now);
+        if(old)
+            unlink(shard, old);
+        link(shard, item, hash);
+        return kStored;
+    }
+
+    // 命中时把VALUE行和value直接写进out
+    bool get(const StringPiece &key, bool withCas, Buffer *out, time_t now)
+    {
+        uint64_t hash = hashKey(key);
+        Shard &shard = shardOf(hash);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        Item *item = find(shard, key, hash, now);
+        if(item == nullptr)
+        {
+            ++shard.stats.getMisses;
+            return false;
+        }
+        ++shard.stats.getHits;
+        bump(shard, item);
+        char header[64];
+        int n = withCas
+            ? snprintf(header, sizeof header, " %u %u %llu\r\n", item->flags, item->nbytes - 2,
+                static_cast<unsigned long long>(item->cas))
+            : snprintf(header, sizeof header, " %u %u\r\n", item->flags, item->nbytes - 2);
+        out->ensureWriteableBytes(6 + key.size() + n + item->nbytes);
+        out->append("VALUE ", 6);
+        out->append(key.data(), key.size());
+        out->append(header, n);
+        out->append(item->value(), item->nbytes);
+        return true;
+    }
+
+    Result remove(const StringPiece &key, time_t now)
+    {
+        uint64_t hash = hashKey(key);
+        Shard &shard = shardOf(hash);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        Item *item = find(shard, key, hash, now);
+        if(item == nullptr)
+            return kNotFound;
+        unlink(shard, item);
+        return kDeleted;
+    }
+
+    Result touch(const StringPiece &key, time_t exptime, time_t now)
+    {
+        uint64_t hash = hashKey(key);
+        Shard &shard = shardOf(hash);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        Item *item = find(shard, key, hash, now);
+        if(item == nullptr)
+            return kNotFound;
+        item->exptime = exptime;
+        bump(shard, item);
+        return kTouched;
+    }
+
+    // 和memcached一样，decr不会减到0以下，incr按64位回绕
+    Result delta(const StringPiece &key, bool incr, uint64_t delta, uint64_t *result, time_t now)
+    {
+        uint64_t hash = hashKey(key);
+        Shard &shard = shardOf(hash);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        Item *item = find(shard, key, hash, now);
+        if(item == nullptr)
+            return kNotFound;
+        uint64_t value = 0;
+        size_t len = item->nbytes - 2;
+        if(len == 0 || len > 20)
+            return kNonNumeric;
+        for(size_t i = 0; i < len; ++i)
+        {
+            char c = item->value()[i];
+            if(c < '0' || c > '9')
+                return kNonNumeric;
+            value = value * 10 + (c - '0');
+        }
+        value = incr ? value + delta : (delta > value ? 0 : value - delta);
+        *result = value;
+        char digits[24];
+        int n = snprintf(digits, sizeof digits, "%llu", static_cast<unsigned long long>(value));
+        uint32_t flags = item->flags;
+        time_t exptime = item->exptime;
+        Item *updated = allocItem(shard, key, flags, exptime, StringPiece(digits, n), now);
+        if(updated == nullptr)
+            return kOutOfMemory;
+        item = find(shard, key, hash, now);
+        if(item)
+            unlink(shard, item);
+        link(shard, updated, hash);
+        return kStored;
+    }
+
+    void flushAll()
+    {
+        for(Shard &shard : shards_)
+        {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            for(Item *&head : shard.buckets)
+            {
+                while(head)
+                    unlink(shard, head);
+            }
+        }
+    }
+
+    Stats stats()
+    {
+        Stats stats;
+        for(Shard &shard : shards_)
+        {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            stats.getHits += shard.stats.getHits;
+            stats.getMisses += shard.stats.getMisses;
+            stats.sets += shard.stats.sets;
+            stats.evictions += shard.stats.evictions;
+            stats.items += shard.count;
+            stats.bytes += shard.stats.bytes;
+        }
+        return stats;
+    }
+
+private:
+    struct SlabClass
+    {
+        Item *freeList = nullptr;
+        Item *lruHead = nullptr;    // 最近访问的
+        Item *lruTail = nullptr;    // 最久没有访问的，先被淘汰
+    };
+
+    struct Page
+    {
+        char *base;
+        size_t slabClass;
+    };
+
+    struct Shard
+    {
+        std::mutex mutex;
+        std::vector<Item*> buckets;
+        size_t count = 0;
+        std::vector<SlabClass> classes;
+        std::vector<Page> pages;
+        size_t nextVictim = 0;
+        uint64_t casCounter = 0;
+        Stats stats;
+    };
+
+    Shard& shardOf(uint64_t hash) {return shards_[(hash >> 40) % shards_.size()];}
+
+    // 查找时顺便删除过期的item
+    Item* find(Shard &shard, const StringPiece &key, uint64_t hash, time_t now)
+    {
+        Item *item = shard.buckets[hash & (shard.buckets.size() - 1)];
+        while(item && item->keyPiece() != key)
+            item = item->hnext;
+        if(item && item->exptime != 0 && item->exptime <= now)
+        {
+            unlink(shard, item);
+            return nullptr;
+        }
+        return item;
+    }
+
+    Item* allocItem(Shard &shard, const StringPiece &key, uint32_t flags, time_t exptime, const StringPiece &value,
+        time_t now)
+    {
+        size_t total = sizeof(Item) + key.size() + value.size() + 2;
+        size_t cls = std::lower_bound(classSizes_.begin(), classSizes_.end(), total) - classSizes_.begin();
+        Item *item = allocChunk(shard, cls, now);
+        if(item == nullptr)
+            return nullptr;
+        item->prev = item->next = item->hnext = nullptr;
+        item->cas = ++shard.casCounter;
+        item->exptime = exptime;
+        item->flags = flags;
+        item->nbytes = static_cast<uint32_t>(value.size() + 2);
+        item->nkey = static_cast<uint8_t>(key.size());
+        item->slabClass = static_cast<uint8_t>(cls);
+        memcpy(item->key(), key.data(), key.size());
+        memcpy(item->value(), value.data(), value.size());
+        memcpy(item->value() + value.size(), "\r\n", 2);
+        return item;
+    }
+
+    // 空闲块 => 从全局预算申请一页切开 => 淘汰同一级LRU链尾 => 从其他级收回一页
+    Item* allocChunk(Shard &shard, size_t cls, time_t now)
+    {
+        SlabClass &slab = shard.classes[cls];
+        if(slab.freeList == nullptr && takePage())
+        {
+            char *page = static_cast<char*>(malloc(kPageSize));
+            shard.pages.push_back(Page{page, cls});
+            carve(slab, page, classSizes_[cls]);
+        }
+        if(slab.freeList == nullptr && slab.lruTail != nullptr)
+            evict(shard, slab.lruTail, now);
+        if(slab.freeList == nullptr)
+            reassignPage(shard, cls, now);
+        Item *item = slab.freeList;
+        if(item)
+            slab.freeList = item->next;
+        return item;
+    }
+
+    bool takePage()
+    {
+        size_t left = pagesLeft_.load(std::memory_order_relaxed);
+        while(left > 0)
+        {
+            if(pagesLeft_.compare_exchange_weak(left, left - 1, std::memory_order_relaxed))
+                return true;
+        }
+        return false;
+    }
+
+    static void freeChunk(SlabClass &slab, Item *item)
+    {
+        item->linked = false;
+        item->next = slab.freeList;
+        slab.freeList = item;
+    }
+
+    static void carve(SlabClass &slab, char *page, size_t chunk)
+    {
+        for(size_t offset = 0; offset + chunk <= kPageSize; offset += chunk)
+            freeChunk(slab, reinterpret_cast<Item*>(page + offset));
+    }
+
+    void evict(Shard &shard, Item *victim, time_t now)
+    {
+        if(victim->exptime == 0 || victim->exptime > now)
+            ++shard.stats.evictions;
+        unlink(shard, victim);
+    }
+
+    // 轮流选本分片中属于其他级的一页，淘汰上面的item，从原来那一级的空闲链表中摘掉，重新切给cls
+    void reassignPage(Shard &shard, size_t cls, time_t now)
+    {
+        for(size_t tried = 0; tried < shard.pages.size(); ++tried)
+        {
+            Page &page = shard.pages[shard.nextVictim++ % shard.pages.size()];
+            if(page.slabClass == cls)
+                continue;
+            SlabClass &from = shard.classes[page.slabClass];
+            size_t chunk = classSizes_[page.slabClass];
+            for(size_t offset = 0; offset + chunk <= kPageSize; offset += chunk)
+            {
+                Item *item = reinterpret_cast<Item*>(page.base + offset);
+                if(item->linked)
+                    evict(shard, item, now);
+            }
+            Item **pos = &from.freeList;
+            while(*pos)
+            {
+                char *p = reinterpret_cast<char*>(*pos);
+                if(p >= page.base && p < page.base + kPageSize)
+                    *pos = (*pos)->next;
+                else
+                    pos = &(*pos)->next;
+            }
+            page.slabClass = cls;
+            carve(shard.classes[cls], page.base, classSizes_[cls]);
+            return;
+        }
+    }
+
+    void link(Shard &shard, Item *item, uint64_t hash)
+    {
+        Item *&head = shard.buckets[hash & (shard.buckets.size() - 1)];
+        item->hnext = head;
+        head = item;
+        item->linked = true;
+        SlabClass &slab = shard.classes[item->slabClass];
+        item->prev = nullptr;
+        item->next = slab.lruHead;
+        if(slab.lruHead)
+            slab.lruHead->prev = item;
+        slab.lruHead = item;
+        if(slab.lruTail == nullptr)
+            slab.lruTail = item;
+        ++shard.count;
+        shard.stats.bytes += item->nkey + item->nbytes;
+        if(shard.count > shard.buckets.size() * 3 / 2)
+            rehash(shard);
+    }
+
+    void unlink(Shard &shard, Item *item)
+    {
+        Item **pos = &shard.buckets[hashKey(item->keyPiece()) & (shard.buckets.size() - 1)];
+        while(*pos != item)
+            pos = &(*pos)->hnext;
+        *pos = item->hnext;
+        SlabClass &slab = shard.classes[item->slabClass];
+        removeFromLru(slab, item);
+        --shard.count;
+        shard.stats.bytes -= item->nkey + item->nbytes;
+        freeChunk(slab, item);
+    }
+
+    static void removeFromLru(SlabClass &slab, Item *item)
+    {
+        if(item->prev)
+            item->prev->next = item->next;
+        else
+            slab.lruHead = item->next;
+        if(item->next)
+            item->next->prev = item->prev;
+        else
+            slab.lruTail = item->prev;
+    }
+
+    static void bump(Shard &shard, Item *item)
+    {
+        SlabClass &slab = shard.classes[item->slabClass];
+        if(slab.lruHead == item)
+            return;
+        removeFromLru(slab, item);
+        item->prev = nullptr;
+        item->next = slab.lruHead;
+        slab.lruHead->prev = item;
+        slab.lruHead = item;
+    }
+
+    void rehash(Shard &shard)
+    {
+        std::vector<Item*> buckets(shard.buckets.size() * 2, nullptr);
+        for(Item *item : shard.buckets)
+        {
+            while(item)
+            {
+                Item *next = item->hnext;
+                Item *&head = buckets[hashKey(item->keyPiece()) & (buckets.size() - 1)];
+                item->hnext = head;
+                head = item;
+                item = next;
+            }
+        }
+        shard.buckets.swap(buckets);
+    }
+
+    std::vector<Shard> shards_;
+    std::vector<size_t> classSizes_;
+    std::atomic<size_t> pagesLeft_;
+    const size_t maxBytes_;
+};
+
+// 每个连接的解析状态：value太大被拒绝时，还要跳过客户端接着发来的数据块
+struct Session
+{
+    size_t swallow = 0;
+};
+
+class KvServer
+{
+public:
+    KvServer(EventLoop *loop, const InetAddress &addr, size_t maxBytes, int shards)
+        : server_(loop, addr, "KvServer")
+        , loop_(loop)
+        , cache_(maxBytes, shards)
+        , startTime_(::time(nullptr))
+        , currConnections_(0)
+        , totalConnections_(0)
+        , commands_(0)
+    {
+        server_.setConnectionCallback([this](const TcpConnectionPtr &conn)
+        {
+            if(conn->connected())
+            {
+                conn->setTcpNoDelay(true);
+                conn->setContext(std::make_shared<Session>());
+                ++currConnections_;
+                ++totalConnections_;
+            }
+            else
+                --currConnections_;
+        });
+        server_.setMessageCallback([this](const TcpConnectionPtr &conn, Buffer *buf, Timestamp)
+        {
+            onMessage(conn, buf);
+        });
+    }
+
+    void setThreadNum(int n) {server_.setThreadNum(n);}
+    void start() {server_.start();}
+
+private:
+    void onMessage(const TcpConnectionPtr &conn, Buffer *buf)
+    {
+        Session *session = static_cast<Session*>(conn->getContext().get());
+        Buffer *out = conn->outputBuffer();
+        const time_t now = ::time(nullptr);
+        bool quit = false;
+        while(!quit)
+        {
+            if(session->swallow > 0)
+            {
+                size_t n = std::min(session->swallow, buf->readableBytes());
+                buf->retrieve(n);
+                session->swallow -= n;
+                if(session->swallow > 0)
+                    break;
+                continue;
+            }
+            const char *crlf = buf->findCRLF();
+            if(crlf == nullptr)
+            {
+                if(buf->readableBytes() > kMaxLineLength)
+                {
+                    out->append("CLIENT_ERROR line too long\r\n");
+                    quit = true;
+                }
+                break;
+            }
+            size_t consumed = 0;
+            if(!processCommand(session, StringPiece(buf->peek(), crlf - buf->peek()), buf, out, now, &consumed, &quit))
+                break;  // 数据块还没有收全
+            ++commands_;
+            buf->retrieve(consumed);
+        }
+        conn->flushOutput();
+        if(quit)
+            conn->shutdown();
+    }
+
+    // 返回false表示存储命令的数据块还没收全，什么都不消费；否则consumed是这条命令(含数据块)占用的字节数
+    bool processCommand(Session *session, const StringPiece &line, Buffer *buf, Buffer *out, time_t now,
+        size_t *consumed, bool *quit)
+    {
+        std::vector<StringPiece> &tokens = tokens_;
+        tokenize(line, &tokens);
+        *consumed = line.size() + 2;
+        if(tokens.empty())
+        {
+            out->append("ERROR\r\n");
+            return true;
+        }
+        const StringPiece &cmd = tokens[0];
+        if(cmd == "get" || cmd == "gets")
+        {
+            if(tokens.size() < 2)
+            {
+                out->append("ERROR\r\n");
+                return true;
+            }
+            for(size_t i = 1; i < tokens.size(); ++i)
+            {
+                if(tokens[i].size() > kMaxKeyLength)
+                {
+                    out->append("CLIENT_ERROR bad command line format\r\n");
+                    return true;
+                }
+                cache_.get(tokens[i], cmd.size() == 4, out, now);
+            }
+            out->append("END\r\n");
+        }
+        else if(cmd == "set" || cmd == "add" || cmd == "replace" || cmd == "append" || cmd == "prepend"
+            || cmd == "cas")
+            return processStore(session, tokens, line.size() + 2, buf, out, now, consumed);
+        else if(cmd == "delete")
+        {
+            if(tokens.size() < 2 || tokens.size() > 3 || tokens[1].size() > kMaxKeyLength)
+            {
+                out->append("CLIENT_ERROR bad command line format\r\n");
+                return true;
+            }
+            Cache::Result result = cache_.remove(tokens[1], now);
+            if(!noreply(tokens))
+                out->append(result == Cache::kDeleted ? "DELETED\r\n" : "NOT_FOUND\r\n");
+        }
+        else if(cmd == "incr" || cmd == "decr")
+        {
+            uint64_t delta = 0;
+            if(tokens.size() < 3 || tokens[1].size() > kMaxKeyLength || !parseUint64(tokens[2], &delta))
+            {
+                out->append("CLIENT_ERROR invalid numeric delta argument\r\n");
+                return true;
+            }
+            uint64_t value = 0;
+            Cache::Result result = cache_.delta(tokens[1], cmd == "incr", delta, &value, now);
+            if(noreply(tokens))
+                return true;
+            if(result == Cache::kStored)
+            {
+                char digits[24];
+                int n = snprintf(digits, sizeof digits, "%llu\r\n", static_cast<unsigned long long>(value));
+                out->append(digits, n);
+            }
+            else if(result == Cache::kNotFound)
+                out->append("NOT_FOUND\r\n");
+            else if(result == Cache::kNonNumeric)
+                out->append("CLIENT_ERROR cannot increment or decrement non-numeric value\r\n");
+            else
+                out->append("SERVER_ERROR out of memory\r\n");
+        }
+        else if(cmd == "touch")
+        {
+            uint64_t exptime = 0;
+            if(tokens.size() < 3 || tokens[1].size() > kMaxKeyLength || !parseUint64(tokens[2], &exptime))
+            {
+                out->append("CLIENT_ERROR bad command line format\r\n");
+                return true;
+            }
+            Cache::Result result = cache_.touch(tokens[1], realExptime(static_cast<long>(exptime), now), now);
+            if(!noreply(tokens))
+                out->append(result == Cache::kTouched ? "TOUCHED\r\n" : "NOT_FOUND\r\n");
+        }
+        else if(cmd == "flush_all")
+        {
+            uint64_t delay = 0;
+            if(tokens.size() > 1 && tokens[1] != "noreply")
+                parseUint64(tokens[1], &delay);
+            if(delay == 0)
+                cache_.flushAll();
+            else
+                loop_->runAfter(static_cast<double>(delay), [this]() {cache_.flushAll();});
+            if(!noreply(tokens))
+                out->append("OK\r\n");
+        }
+        else if(cmd == "stats")
+            appendStats(out, now);
+        else if(cmd == "version")
+            out->append("VERSION 1.6.0-mymuduo\r\n");
+        else if(cmd == "verbosity")
+        {
+            if(!noreply(tokens))
+                out->append("OK\r\n");
+        }
+        else if(cmd == "quit")
+            *quit = true;
+        else
+            out->append("ERROR\r\n");
+        return true;
+    }
+
+    // <cmd> <key> <flags> <exptime> <bytes> [cas unique] [noreply]\r\n<data>\r\n
+    bool processStore(Session *session, const std::vector<StringPiece> &tokens, size_t lineLength, Buffer *buf,
+        Buffer *out, time_t now, size_t *consumed)
+    {
+        const bool isCas = tokens[0] == "cas";
+        uint64_t flags = 0, bytes = 0, cas = 0;
+        long signedExptime = 0;
+        if(tokens.size() < (isCas ? 6u : 5u) || tokens[1].size() > kMaxKeyLength
+            || !parseUint64(tokens[2], &flags) || flags > UINT32_MAX
+            || !parseInt64(tokens[3], &signedExptime)
+            || !parseUint64(tokens[4], &bytes)
+            || (isCas && !parseUint64(tokens[5], &cas)))
+        {
+            out->append("CLIENT_ERROR bad command line format\r\n");
+            return true;
+        }
+        const bool quiet = noreply(tokens);
+        if(bytes > cache_.maxItemSize() - 2)
+        {
+            // 跳过后面的数据块
+            out->append("SERVER_ERROR object too large for cache\r\n");
+            session->swallow = bytes < SIZE_MAX - 2 ? static_cast<size_t>(bytes) + 2 : SIZE_MAX;
+            return true;
+        }
+        if(buf->readableBytes() < lineLength + bytes + 2)
+            return false;
+        const char *data = buf->peek() + lineLength;
+        *consumed = lineLength + bytes + 2;
+        if(memcmp(data + bytes, "\r\n", 2) != 0)
+        {
+            out->append("CLIENT_ERROR bad data chunk\r\n");
+            return true;
+        }
+
+        Cache::StoreMode mode = Cache::kSet;
+        if(tokens[0] == "add")
+            mode = Cache::kAdd;
+        else if(tokens[0] == "replace")
+            mode = Cache::kReplace;
+        else if(tokens[0] == "append")
+            mode = Cache::kAppend;
+        else if(tokens[0] == "prepend")
+            mode = Cache::kPrepend;
+        else if(isCas)
+            mode = Cache::kCas;
+        Cache::Result result = cache_.store(mode, tokens[1], static_cast<uint32_t>(flags),
+            realExptime(signedExptime, now), StringPiece(data, bytes), cas, now);
+        if(quiet)
+            return true;
+        switch(result)
+        {
+        case Cache::kStored: out->append("STORED\r\n"); break;
+        case Cache::kNotStored: out->append("NOT_STORED\r\n"); break;
+        case Cache::kExists: out->append("EXISTS\r\n"); break;
+        case Cache::kNotFound: out->append("NOT_FOUND\r\n"); break;
+        case Cache::kTooLarge: out->append("SERVER_ERROR object too large for cache\r\n"); break;
+        default: out->append("SERVER_ERROR out of memory storing object\r\n"); break;
+        }
+        return true;
+    }
+
+    void appendStats(Buffer *out, time_t now)
+    {
+        Cache::Stats stats = cache_.stats();
+        char buf[1024];
+        int n = snprintf(buf, sizeof buf,
+            "STAT uptime %ld\r\n"
+            "STAT time %ld\r\n"
+            "STAT curr_connections %d\r\n"
+            "STAT total_connections %llu\r\n"
+            "STAT cmd_total %llu\r\n"
+            "STAT cmd_set %llu\r\n"
+            "STAT get_hits %llu\r\n"
+            "STAT get_misses %llu\r\n"
+            "STAT curr_items %llu\r\n"
+            "STAT bytes %llu\r\n"
+            "STAT evictions %llu\r\n"
+            "STAT limit_maxbytes %zu\r\n"
+            "END\r\n",
+            static_cast<long>(now - startTime_), static_cast<long>(now), currConnections_.load(),
+            static_cast<unsigned long long>(totalConnections_.load()),
+            static_cast<unsigned long long>(commands_.load()),
+            static_cast<unsigned long long>(stats.sets), static_cast<unsigned long long>(stats.getHits),
+            static_cast<unsigned long long>(stats.getMisses), static_cast<unsigned long long>(stats.items),
+            static_cast<unsigned long long>(stats.bytes), static_cast<unsigned long long>(stats.evictions),
+            cache_.maxBytes());
+        out->append(buf, n);
+    }
+
+    static void tokenize(const StringPiece &line, std::vector<StringPiece> *tokens)
+    {
+        tokens->clear();
+        const char *p = line.begin();
+        const char *end = line.end();
+        while(p < end)
+        {
+            while(p < end && *p == ' ')
+                ++p;
+            const char *start = p;
+            while(p < end && *p != ' ')
+                ++p;
+            if(p > start)
+                tokens->push_back(StringPiece(start, p - start));
+        }
+    }
+
+    static bool noreply(const std::vector<StringPiece> &tokens)
+    {
+        return tokens.size() > 1 && tokens.back() == "noreply";
+    }
+
+    static bool parseUint64(const StringPiece &s, uint64_t *value)
+    {
+        if(s.empty() || s.size() > 20)
+            return false;
+        uint64_t v = 0;
+        for(size_t i = 0; i < s.size(); ++i)
+        {
+            if(s[i] < '0' || s[i] > '9')
+                return false;
+            unsigned digit = static_cast<unsigned>(s[i] - '0');
+            if(v > (UINT64_MAX - digit) / 10)
+                return false;
+            v = v * 10 + digit;
+        }
+        *value = v;
+        return true;
+    }
+
+    static bool parseInt64(const StringPiece &s, long *value)
+    {
+        if(!s.empty() && s[0] == '-')
+        {
+            uint64_t v = 0;
+            StringPiece digits = s;
+            digits.remove_prefix(1);
+            if(!parseUint64(digits, &v) || v > static_cast<uint64_t>(LONG_MAX))
+                return false;
+            *value = -static_cast<long>(v);
+            return true;
+        }
+        uint64_t v = 0;
+        if(!parseUint64(s, &v) || v > static_cast<uint64_t>(LONG_MAX))
+            return false;
+        *value = static_cast<long>(v);
+        return true;
+    }
+
+    TcpServer server_;
+    EventLoop *loop_;
+    Cache cache_;
+    const time_t startTime_;
+    std::atomic_int currConnections_;
+    std::atomic<uint64_t> totalConnections_;
+    std::atomic<uint64_t> commands_;
+    // 解析命令行用的临时数组，每个subLoop线程一份，避免每条命令分配
+    static thread_local std::vector<StringPiece> tokens_;
+};
+
+thread_local std::vector<StringPiece> KvServer::tokens_;
+}
+
+int main(int argc, char *argv[])
+{
+    uint16_t port = argc > 1 ? static_cast<uint16_t>(atoi(argv[1])) : 11211;
+    int ioThreads = argc > 2 ? atoi(argv[2]) : 0;
+    size_t memoryMb = argc > 3 ? static_cast<size_t>(atoi(argv[3])) : 64;
+    int shards = argc > 4 ? atoi(argv[4]) : 16;
+
+    EventLoop loop;
+    KvServer server(&loop, InetAddress(port, "0.0.0.0"), memoryMb * 1024 * 1024, shards);
+    server.setThreadNum(ioThreads);
+    server.start();
+    loop.loop();
+
+    return 0;
+}
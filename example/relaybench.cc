@@ -0,0 +1,117 @@
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+/**
+ * 转发吞吐量测试
+ * 本程序在sink_port上监听，充当relayserver的后端，只收不发
+ * 同时向relay_port建立conns条连接，持续写入seconds秒，统计后端实际收到的字节数
+ * ./relayserver 9000 127.0.0.1 9001 [copy] > /dev/null
+ * ./relaybench 127.0.0.1 9000 9001 10 4
+ */
+static std::atomic<int64_t> g_received(0);
+static std::atomic_bool g_stop(false);
+
+static void sinkThread(int connfd)
+{
+    std::vector<char> buf(256 * 1024);
+    ssize_t n;
+    while((n = ::read(connfd, buf.data(), buf.size())) > 0)
+        g_received += n;
+    ::close(connfd);
+}
+
+static void sendThread(const char *ip, uint16_t port)
+{
+    int sockfd = ::socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof addr);
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    ::inet_pton(AF_INET, ip, &addr.sin_addr);
+    if(::connect(sockfd, (sockaddr*)&addr, sizeof addr) < 0)
+    {
+        perror("connect");
+        exit(1);
+    }
+
+    std::vector<char> buf(64 * 1024, 'x');
+    while(!g_stop)
+    {
+        if(::write(sockfd, buf.data(), buf.size()) < 0)
+            break;
+    }
+    ::shutdown(sockfd, SHUT_WR);
+    ::close(sockfd);
+}
+
+int main(int argc, char *argv[])
+{
+    if(argc < 6)
+    {
+        printf("Usage: %s relay_ip relay_port sink_port seconds conns\n", argv[0]);
+        return 0;
+    }
+    const char *ip = argv[1];
+    uint16_t relayPort = static_cast<uint16_t>(atoi(argv[2]));
+    uint16_t sinkPort = static_cast<uint16_t>(atoi(argv[3]));
+    int seconds = atoi(argv[4]);
+    int conns = atoi(argv[5]);
+
+    int listenfd = ::socket(AF_INET, SOCK_STREAM, 0);
+    int on = 1;
+    ::setsockopt(listenfd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof on);
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof addr);
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(sinkPort);
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    if(::bind(listenfd, (sockaddr*)&addr, sizeof addr) < 0 || ::listen(listenfd, 128) < 0)
+    {
+        perror("sink listen");
+        return 1;
+    }
+
+    std::thread acceptor([listenfd, conns]()
+    {
+        for(int i = 0; i < conns; ++i)
+        {
+            int connfd = ::accept(listenfd, nullptr, nullptr);
+            if(connfd < 0)
+                break;
+            std::thread(sinkThread, connfd).detach();
+        }
+    });
+
+    std::vector<std::thread> senders;
+    for(int i = 0; i < conns; ++i)
+        senders.emplace_back(sendThread, ip, relayPort);
+
+    // 跳过建立连接的时间，只统计稳定阶段
+    std::this_thread::sleep_for(std::chrono::seconds(1));
+    int64_t start = g_received;
+    auto t0 = std::chrono::steady_clock::now();
+    std::this_thread::sleep_for(std::chrono::seconds(seconds));
+    int64_t bytes = g_received - start;
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+
+    g_stop = true;
+    for(std::thread &t : senders)
+        t.join();
+    acceptor.join();
+    ::close(listenfd);
+
+    printf("conns=%d seconds=%.2f bytes=%ld throughput_MiBps=%.1f\n",
+        conns, elapsed, static_cast<long>(bytes), bytes / elapsed / 1024 / 1024);
+    return 0;
+}
@@ -0,0 +1,148 @@
+#include <mymuduo/TcpServer.h>
+#include <mymuduo/TcpClient.h>
+#include <mymuduo/Logger.h>
+
+#include <string>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * 四层转发服务器
+ * 每个客户端连接在自己所属的subLoop上连接后端，连接成功以后两个连接之间开始转发
+ * ./relayserver 9000 127.0.0.1 9001        splice零拷贝转发
+ * ./relayserver 9000 127.0.0.1 9001 copy   Buffer拷贝转发，用于对比
+ */
+class RelayServer
+{
+public:
+    RelayServer(EventLoop *loop,
+        const InetAddress &listenAddr,
+        const InetAddress &backendAddr,
+        bool zeroCopy)
+        : server_(loop, listenAddr, "RelayServer")
+        , backendAddr_(backendAddr)
+        , zeroCopy_(zeroCopy)
+    {
+        server_.setConnectionCallback(std::bind(&RelayServer::onClientConnection, this, std::placeholders::_1));
+        // 后端连上之前客户端发来的数据先留在inputBuffer_中，转发开始时一起发给后端
+        server_.setMessageCallback([](const TcpConnectionPtr&, Buffer*, Timestamp){});
+        server_.setThreadNum(4);
+    }
+
+    void start()
+    {server_.start();}
+
+private:
+    using ClientPtr = std::shared_ptr<TcpClient>;
+
+    void onClientConnection(const TcpConnectionPtr &conn)
+    {
+        if(conn->connected())
+        {
+            conn->setTcpNoDelay(true);
+            // 后端连接与客户端连接必须在同一个loop上，splice才能在一个线程里完成
+            ClientPtr client(new TcpClient(conn->getLoop(), backendAddr_, conn->name()));
+            std::weak_ptr<TcpConnection> weakConn(conn);
+            client->setConnectionCallback([this, weakConn](const TcpConnectionPtr &backend)
+            {
+                onBackendConnection(weakConn, backend);
+            });
+            client->setConnectFailedCallback([this, weakConn](int)
+            {
+                TcpConnectionPtr conn = weakConn.lock();
+                if(conn)
+                {
+                    std::string name = conn->name();
+                    conn->getLoop()->queueLoop([this, name]() { eraseClient(name); });
+                    conn->forceClose();
+                }
+            });
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                clients_[conn->name()] = client;
+            }
+            client->connect();
+        }
+        else
+        {
+            ClientPtr client = findClient(conn->name());
+            TcpConnectionPtr backend = client ? client->connection() : TcpConnectionPtr();
+            if(backend)
+                backend->shutdown(); // 管道中剩余的数据发完以后再半关闭
+        }
+    }
+
+    void onBackendConnection(const std::weak_ptr<TcpConnection> &weakConn, const TcpConnectionPtr &backend)
+    {
+        TcpConnectionPtr conn = weakConn.lock();
+        if(backend->connected())
+        {
+            backend->setTcpNoDelay(true);
+            if(conn && conn->connected())
+                TcpConnection::relay(conn, backend, zeroCopy_);
+            else
+                backend->shutdown();
+        }
+        else
+        {
+            if(conn)
+            {
+                conn->shutdown();
+                // TcpClient不能在它自己的回调中析构，放到loop的下一轮释放
+                std::string name = conn->name();
+                backend->getLoop()->queueLoop([this, name]() { eraseClient(name); });
+            }
+        }
+    }
+
+    ClientPtr findClient(const std::string &name)
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        auto it = clients_.find(name);
+        return it == clients_.end() ? ClientPtr() : it->second;
+    }
+
+    void eraseClient(const std::string &name)
+    {
+        ClientPtr client;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            auto it = clients_.find(name);
+            if(it == clients_.end())
+                return;
+            client.swap(it->second);
+            clients_.erase(it);
+        }
+    }
+
+    TcpServer server_;
+    InetAddress backendAddr_;
+    bool zeroCopy_;
+    std::mutex mutex_;
+    std::map<std::string, ClientPtr> clients_; // 客户端连接名 => 后端TcpClient
+};
+
+int main(int argc, char *argv[])
+{
+    if(argc < 4)
+    {
+        printf("Usage: %s listen_port backend_ip backend_port [copy]\n", argv[0]);
+        return 0;
+    }
+
+    EventLoop loop;
+    InetAddress listenAddr(static_cast<uint16_t>(atoi(argv[1])), "0.0.0.0");
+    InetAddress backendAddr(static_cast<uint16_t>(atoi(argv[3])), argv[2]);
+    bool zeroCopy = !(argc > 4 && strcmp(argv[4], "copy") == 0);
+
+    RelayServer server(&loop, listenAddr, backendAddr, zeroCopy);
+    LOG_INFO("relay %s => %s mode:%s\n", listenAddr.toIpPort().c_str(),
+        backendAddr.toIpPort().c_str(), zeroCopy ? "splice" : "copy");
+    server.start();
+    loop.loop();
+
+    return 0;
+}
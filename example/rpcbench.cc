@@ -0,0 +1,157 @@
+#include <mymuduo/RpcClient.h>
+#include <mymuduo/EventLoop.h>
+#include <mymuduo/EventLoopThreadPool.h>
+#include <mymuduo/Logger.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+
+/**
+ * RPC压测客户端
+ * 每条连接保持depth个未完成的调用，每收到一个应答就立刻补发一个，直到发满calls个
+ * 输出一行key=value，便于脚本对比不同版本
+ * ./rpcbench 127.0.0.1 8002 method threads conns depth calls payload
+ * ./rpcbench 127.0.0.1 8002 1 2 8 16 100000 64
+ */
+using Clock = std::chrono::steady_clock;
+
+static int64_t nowUs()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        Clock::now().time_since_epoch()).count();
+}
+
+class BenchClient
+{
+public:
+    BenchClient(EventLoop *loop, const InetAddress &addr, int index,
+        uint16_t method, int depth, int calls, const std::string &payload,
+        std::function<void(BenchClient*)> done)
+        : client_(loop, addr, "RpcBench" + std::to_string(index))
+        , method_(method)
+        , depth_(depth)
+        , calls_(calls)
+        , sent_(0)
+        , received_(0)
+        , errors_(0)
+        , payload_(payload)
+        , done_(done)
+    {
+        latencies_.reserve(calls);
+        client_.setConnectionCallback([this](bool connected)
+        {
+            if(connected)
+            {
+                for(int i = 0; i < depth_ && sent_ < calls_; ++i)
+                    sendOne();
+            }
+            else if(received_ < calls_)
+            {
+                errors_ += calls_ - received_;
+                received_ = calls_;
+                done_(this);
+            }
+        });
+    }
+
+    void connect() {client_.connect();}
+    const std::vector<int32_t>& latencies() const {return latencies_;}
+    int errors() const {return errors_;}
+
+private:
+    void sendOne()
+    {
+        ++sent_;
+        int64_t start = nowUs();
+        client_.call(method_, payload_, [this, start](RpcStatus status, const StringPiece &)
+        {
+            latencies_.push_back(static_cast<int32_t>(nowUs() - start));
+            if(status != kRpcOk)
+                ++errors_;
+            ++received_;
+            if(sent_ < calls_)
+                sendOne(); // 在应答回调中发起，和同一批应答的其他请求合并成一次write
+            else if(received_ == calls_)
+                done_(this);
+        });
+    }
+
+    RpcClient client_;
+    uint16_t method_;
+    int depth_;
+    int calls_;
+    int sent_;
+    int received_;
+    int errors_;
+    std::string payload_;
+    std::function<void(BenchClient*)> done_;
+    std::vector<int32_t> latencies_;
+};
+
+int main(int argc, char *argv[])
+{
+    if(argc < 9)
+    {
+        printf("Usage: %s ip port method threads conns depth calls payload\n", argv[0]);
+        return 0;
+    }
+    InetAddress addr(static_cast<uint16_t>(atoi(argv[2])), argv[1]);
+    uint16_t method = static_cast<uint16_t>(atoi(argv[3]));
+    int threads = atoi(argv[4]);
+    int conns = atoi(argv[5]);
+    int depth = atoi(argv[6]);
+    int calls = atoi(argv[7]);
+    std::string payload(atoi(argv[8]), 'x');
+
+    EventLoop loop;
+    EventLoopThreadPool pool(&loop, "rpcbench");
+    pool.setThreadNum(threads);
+    pool.start();
+
+    std::atomic_int finished(0);
+    std::vector<std::unique_ptr<BenchClient>> clients;
+    auto done = [&](BenchClient*)
+    {
+        if(++finished == conns)
+            loop.quit();
+    };
+    for(int i = 0; i < conns; ++i)
+        clients.emplace_back(new BenchClient(pool.getNextLoop(), addr, i, method, depth, calls, payload, done));
+
+    int64_t start = nowUs();
+    for(auto &client : clients)
+        client->connect();
+    loop.loop();
+    double seconds = (nowUs() - start) / 1e6;
+
+    std::vector<int32_t> all;
+    int errors = 0;
+    for(auto &client : clients)
+    {
+        all.insert(all.end(), client->latencies().begin(), client->latencies().end());
+        errors += client->errors();
+    }
+    std::sort(all.begin(), all.end());
+    auto pct = [&all](double p) -> int32_t
+    {
+        return all.empty() ? 0 : all[std::min(all.size() - 1, static_cast<size_t>(p * all.size()))];
+    };
+    double avg = 0;
+    for(int32_t v : all)
+        avg += v;
+    avg = all.empty() ? 0 : avg / all.size();
+
+    printf("bench=rpc method=%u conns=%d depth=%d payload=%zu calls=%zu errors=%d seconds=%.3f qps=%.0f "
+        "avg_us=%.1f p50_us=%d p99_us=%d p999_us=%d max_us=%d\n",
+        method, conns, depth, payload.size(), all.size(), errors, seconds, all.size() / seconds,
+        avg, pct(0.50), pct(0.99), pct(0.999), all.empty() ? 0 : all.back());
+    fflush(stdout);
+    _exit(0); // 客户端仍挂在各自的loop上，直接退出
+}
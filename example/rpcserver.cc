@@ -0,0 +1,40 @@
+#include <mymuduo/RpcServer.h>
+#include <mymuduo/Logger.h>
+
+#include <stdlib.h>
+
+/**
+ * RPC服务端示例
+ * 方法1 echo：在subLoop中直接应答
+ * 方法2 echo：交给工作线程池处理后应答，用来对比两种执行方式
+ * ./rpcserver 8002 4 4
+ */
+enum EchoMethod
+{
+    kEchoInLoop = 1,
+    kEchoInWorker = 2,
+};
+
+int main(int argc, char *argv[])
+{
+    uint16_t port = argc > 1 ? static_cast<uint16_t>(atoi(argv[1])) : 8002;
+    int ioThreads = argc > 2 ? atoi(argv[2]) : 0;
+    int workerThreads = argc > 3 ? atoi(argv[3]) : 0;
+
+    EventLoop loop;
+    RpcServer server(&loop, InetAddress(port, "0.0.0.0"), "RpcServer");
+    server.setThreadNum(ioThreads);
+    server.setWorkerThreadNum(workerThreads);
+    server.registerMethod(kEchoInLoop, [](const StringPiece &request, const RpcReply &reply)
+    {
+        reply.reply(request);
+    });
+    server.registerMethod(kEchoInWorker, [](const StringPiece &request, const RpcReply &reply)
+    {
+        reply.reply(request);
+    }, RpcServer::kInWorker);
+    server.start();
+    loop.loop();
+
+    return 0;
+}
@@ -0,0 +1,100 @@
+#include <mymuduo/UdpServer.h>
+#include <mymuduo/EventLoop.h>
+#include <mymuduo/Logger.h>
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * UDP回显
+ * 服务端：每个loop一个SO_REUSEPORT socket，收到的数据报原样发回，同一批回显合并成一次sendmmsg
+ *   ./udpecho server 8003 4
+ * 客户端：发出count个size字节的数据报，gso时用UDP_SEGMENT一次发出一批，发完1秒后统计收到的回显
+ *   ./udpecho client 127.0.0.1 8003 100000 64 [gso]
+ */
+static int runServer(uint16_t port, int threads)
+{
+    EventLoop loop;
+    UdpServer server(&loop, InetAddress(port, "0.0.0.0"), "UdpEcho");
+    server.setThreadNum(threads);
+    server.setMessageCallback([](UdpChannel *channel, const StringPiece &data,
+        const InetAddress &peer, Timestamp)
+    {
+        channel->send(peer, data);
+    });
+    server.start();
+    loop.loop();
+    return 0;
+}
+
+static int runClient(const char *ip, uint16_t port, int count, int size, bool gso)
+{
+    EventLoop loop;
+    InetAddress server(port, ip);
+    UdpChannel channel(&loop, UdpChannel::createSocket(InetAddress(0, "0.0.0.0"), false));
+    long received = 0;
+    channel.setMessageCallback([&received](UdpChannel*, const StringPiece&, const InetAddress&, Timestamp)
+    {
+        ++received;
+    });
+    channel.start();
+
+    std::string payload(size, 'u');
+    const int kBurst = 32;
+    auto start = std::chrono::steady_clock::now();
+    // 发送线程把每一批交给loop线程执行，loop在两批之间处理回显
+    std::thread sender([&]()
+    {
+        for(int sent = 0; sent < count; sent += kBurst)
+        {
+            int n = std::min(kBurst, count - sent);
+            loop.runInLoop([&channel, &server, &payload, n, size, gso]()
+            {
+                if(gso)
+                {
+                    std::string burst;
+                    for(int i = 0; i < n; ++i)
+                        burst += payload;
+                    channel.sendSegments(server, burst, static_cast<uint16_t>(size));
+                }
+                else
+                {
+                    for(int i = 0; i < n; ++i)
+                        channel.send(server, payload);
+                }
+            });
+            // 控制发送速率，避免把两端的socket接收缓冲区灌满
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+        }
+        std::this_thread::sleep_for(std::chrono::seconds(1));
+        loop.quit();
+    });
+    loop.loop();
+    sender.join();
+    channel.stop();
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() - 1;
+    printf("bench=udpecho mode=%s size=%d sent=%lu dropped=%lu received=%ld send_seconds=%.3f\n",
+        gso ? "gso" : "sendmmsg", size,
+        (unsigned long)channel.packetsSent(), (unsigned long)channel.packetsDropped(),
+        received, seconds);
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    if(argc >= 3 && strcmp(argv[1], "server") == 0)
+        return runServer(static_cast<uint16_t>(atoi(argv[2])), argc > 3 ? atoi(argv[3]) : 0);
+    if(argc >= 6 && strcmp(argv[1], "client") == 0)
+        return runClient(argv[2], static_cast<uint16_t>(atoi(argv[3])), atoi(argv[4]), atoi(argv[5]),
+            argc > 6 && strcmp(argv[6], "gso") == 0);
+
+    printf("Usage: %s server port threads\n"
+           "       %s client ip port count size [gso]\n", argv[0], argv[0]);
+    return 0;
+}